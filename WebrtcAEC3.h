@@ -3,10 +3,19 @@
 
 #include <vector>
 #include <memory>
+#include <atomic>
+#ifdef WEBRTC_AEC3_STAGE_TIMING
+#include <chrono>
+#endif
+#include <condition_variable>
 #include <cstdint>
+#include <mutex>
+#include <thread>
+#include <utility>
 
 // Constants
-#define WEBRTC_AEC3_NUM_CHANNELS 1
+#define WEBRTC_AEC3_NUM_CHANNELS 1   // default capture and render channel count
+#define WEBRTC_AEC3_MAX_CHANNELS 8
 
 // Union-based variant replacement for C++11 compatibility
 struct ConfigValue {
@@ -30,6 +39,8 @@ namespace webrtc {
     struct StreamConfig;
 }
 
+class AecRecorder;
+
 class WebrtcAEC3 {
 public:
     // Configuration IDs
@@ -47,6 +58,9 @@ public:
         AEC_EXTENDED_FILTER = 10,
         ENABLE_VOICE_DETECTION = 11,
         AGC_MODE = 12,
+        CAPTURE_CHANNELS = 13,
+        RENDER_CHANNELS = 14,
+        NUM_CONFIG_IDS          // not a setting: one past the last id
     };
 
     enum AgcMode {
@@ -71,18 +85,143 @@ public:
     WebrtcAEC3();
     ~WebrtcAEC3();
 
+    // Before start() any setting may change. Afterwards everything except
+    // SAMPLE_RATE and the channel counts can still change: the value is
+    // validated here (throwing as before) and queued, and the next process()
+    // call applies it at a frame boundary. Settings AudioProcessing has
+    // setters for take effect on that frame. Transient suppression, delay
+    // agnostic mode and the extended filter need a new AudioProcessing; it is
+    // built and warmed up with the last 500 ms of audio on a background
+    // thread, and swapped in when ready, so processing never stalls.
+    // Callable from any thread.
     void setConfig(int configId, ConfigValue value);
+    // Current value of a setting, as the audio path uses it. Read from a
+    // copy published as each setting is applied, so it is callable from any
+    // thread without locking. Before start() and from the thread that calls
+    // process() this is exact; from other threads a queued change may not be
+    // reflected yet.
+    ConfigValue getConfig(int configId) const;
     void start();
+    // Clears all adaptive state (echo path, noise estimate, AGC gain) while
+    // keeping the current configuration, so an instance can be reused for a
+    // new, unrelated stream without paying for configureProcessing() again.
+    // A later rebuild is not warmed up with audio from before the reset, and
+    // one already in progress is discarded and redone from audio after it.
+    // Call it from the thread that calls process().
+    void reset();
+    bool isStarted() const { return is_started_; }
+    // True when no setting change is queued or being rebuilt, so getConfig()
+    // reports what the audio path uses from any thread
+    bool configSettled();
+    // Changes the delay reported through set_stream_delay_ms(). Unlike
+    // setConfig(SYSTEM_DELAY_MS) this is allowed after start(); call it from
+    // the thread that calls process().
+    void setStreamDelayMs(int delay_ms);
+    // Audio is interleaved: |near_in| and |out| hold captureChannels()
+    // samples per frame, |far_in| renderChannels(). Each channel is cancelled
+    // against the whole (e.g. stereo) render signal; no downmixing happens.
     void process(const std::vector<int16_t>& near_in,
                 const std::vector<int16_t>& far_in,
                 std::vector<int16_t>& out);
+    // Allocation-free variant for the real-time path. |num_frames| must equal
+    // chunkSamples(); buffers are sized as above. |out| may alias |near_in|.
+    void process(const int16_t* near_in,
+                 const int16_t* far_in,
+                 int16_t* out,
+                 size_t num_frames);
+
+    // Float variant for pipelines that already hold float audio: one plane
+    // per channel, |num_frames| == chunkSamples() samples each, full scale
+    // at [-1, 1] as in webrtc::S16ToFloat(). No int16 conversion or
+    // quantisation happens; AudioProcessing reads |near_in| and |far_in| and
+    // writes |out| directly. |out| may be |near_in| (the same plane
+    // pointers) for in-place processing. Planes need no particular
+    // alignment; ChannelBuffer<float> or 32-byte aligned caller buffers are
+    // the natural choice for SIMD code around it. Output is not clamped.
+    void processFloat(const float* const* near_in,
+                      const float* const* far_in,
+                      float* const* out,
+                      size_t num_frames);
+
+    // Streaming variant for callers whose buffers are not 10 ms, e.g. 20, 40
+    // or 60 ms packets, device callbacks of any size or whole files. Takes
+    // |num_frames| samples per channel of near and far audio (interleaved as
+    // above), runs every complete chunk through process() and writes the
+    // output of those chunks to |out|. Returns the frames written, a
+    // multiple of chunkSamples(); the rest stays buffered for the next call,
+    // so output lags input by less than one chunk. |out| needs room for
+    // num_frames + chunkSamples() - 1 frames and must not alias |near_in|.
+    size_t processStream(const int16_t* near_in,
+                         const int16_t* far_in,
+                         size_t num_frames,
+                         int16_t* out);
+    // Same, resizing |out| to the output produced
+    void processStream(const std::vector<int16_t>& near_in,
+                       const std::vector<int16_t>& far_in,
+                       std::vector<int16_t>& out);
+    // End of stream: pads the buffered remainder with silence, processes it
+    // and writes its streamPendingFrames() frames to |out|, which needs room
+    // for a whole chunk. Returns the frames written.
+    size_t flushStream(int16_t* out);
+    // Frames per channel buffered by processStream() and not yet processed
+    size_t streamPendingFrames() const { return stream_fill_; }
+
+#ifdef WEBRTC_AEC3_STAGE_TIMING
+    // Sections of process() timed separately for benchmarking. The input
+    // stage includes copying the frame into the warm-up history; for
+    // processFloat() that copy is all it does, and the output stage is empty.
+    enum Stage {
+        STAGE_S16_TO_FLOAT = 0,
+        STAGE_SET_DELAY,
+        STAGE_REVERSE_STREAM,
+        STAGE_FORWARD_STREAM,
+        STAGE_FLOAT_TO_S16,
+        NUM_STAGES
+    };
+
+    // Nanoseconds spent in each Stage by the most recent process() call
+    const int64_t* lastStageTimesNs() const { return stage_ns_; }
+#endif
+
+    // Samples per channel per 10 ms frame; valid after start()
+    size_t chunkSamples() const { return num_chunk_samples_; }
+    size_t captureChannels() const { return capture_channels_; }
+    size_t renderChannels() const { return render_channels_; }
+
+    // Records every processed frame, the configuration and each applied
+    // change into |recorder| (see aecrecorder.h), nullptr to stop. Callable
+    // from any thread; |recorder| must stay open until it is detached. The
+    // recording is bit-exact to replay when it starts before the first frame
+    // after start() or reset().
+    void setRecorder(AecRecorder* recorder) { recorder_.store(recorder, std::memory_order_release); }
+
+    // Rebuilt AudioProcessing instances swapped in since start()
+    uint64_t reconfigurations() const { return reconfigurations_.load(std::memory_order_relaxed); }
 
     // Optional: Get processing statistics
     bool hasVoice() const;
     bool hasEcho() const;
     float getSpeechProbability() const;
 
-    // Configuration parameters
+    // Long-term statistics of the echo canceller; dB values are averages
+    // since start(), delays are over the delay-logging window
+    struct EchoMetrics {
+        float erl_db;
+        float erle_db;
+        float a_nlp_db;
+        float divergent_filter_fraction;
+        int delay_median_ms;
+        int delay_std_ms;
+        float fraction_poor_delays;
+    };
+
+    // Returns false while AEC is disabled or has not produced statistics
+    // yet. Reads the processor's state unlocked, so call it from the thread
+    // that calls process().
+    bool getEchoMetrics(EchoMetrics* metrics) const;
+
+    // Configuration parameters. Written directly rather than through
+    // setConfig(), they reach getConfig() at start().
     int sample_rate_;
     int system_delay_ms_;
     int noise_suppression_level_;
@@ -97,29 +236,105 @@ public:
     bool aec_extended_filter_;
     bool enable_voice_detection_;
     int agc_mode_ ;
+    size_t capture_channels_;
+    size_t render_channels_;
 
 private:
+    enum RebuildState {
+        kRebuildIdle,
+        kRebuildRequested,  // builder owns the settings and warm-up audio
+        kRebuildReady       // rebuilt_processor_ waits for a frame boundary
+    };
+    static const size_t kWarmupFrames = 50;
+
+    void applyConfigValue(int configId, const ConfigValue& value, bool apply);
+    void publishConfig();
+    static bool needsRebuild(int configId);
     void configureProcessing();
+    std::shared_ptr<webrtc::AudioProcessing> createProcessing() const;
+    void applyComponentSettings(webrtc::AudioProcessing* processor) const;
+    void applyPendingConfig();
+    void builderLoop();
     void validateInputSizes(const std::vector<int16_t>& near_in,
                            const std::vector<int16_t>& far_in) const;
+    void validateFrameCount(size_t num_frames) const;
+    void recordSession(AecRecorder* recorder);
+    void runProcessing(const float* const* near_in, const float* const* far_in, float* const* out);
+    void pushHistory(const float* const* near_in, const float* const* far_in);
+    size_t newestHistorySlot() const;
+    const float* const* historyPlanes(const std::vector<float>& ring, size_t channels, size_t slot);
 
 
     // WebRTC objects
     std::shared_ptr<webrtc::AudioProcessing> audio_processor_;
-    std::unique_ptr<webrtc::StreamConfig> stream_config_in_;
-    std::unique_ptr<webrtc::StreamConfig> stream_config_out_;
+    // Capture is processed in place (same layout in and out); render has its
+    // own channel count
+    std::unique_ptr<webrtc::StreamConfig> capture_config_;
+    std::unique_ptr<webrtc::StreamConfig> render_config_;
 
-    // Processing buffers
-    std::vector<float> near_float_data_;
-    std::vector<float> far_float_data_;
-    std::vector<float> out_float_data_;
+    // Processing buffers; int16 audio is converted straight into these
     std::unique_ptr<webrtc::ChannelBuffer<float>> near_chan_buf_;
     std::unique_ptr<webrtc::ChannelBuffer<float>> far_chan_buf_;
     std::unique_ptr<webrtc::ChannelBuffer<float>> out_chan_buf_;
 
+    // The settings above as getConfig() reports them: int value, or 0/1 for
+    // bools. Written where the members are, read from any thread.
+    std::atomic<int> published_config_[NUM_CONFIG_IDS];
+
     // Processing parameters
     size_t num_chunk_samples_;
-    bool is_started_;
+    // Read by setConfig() on the control thread
+    std::atomic<bool> is_started_;
+
+    // Runtime reconfiguration. The control thread queues changes under
+    // config_mutex_; process() only ever try-locks it.
+    std::mutex config_mutex_;
+    std::vector<std::pair<int, ConfigValue> > pending_changes_;
+    std::atomic<bool> config_dirty_;
+    RebuildState rebuild_state_;
+    // Bumped by reset(); a rebuild requested under an older generation was
+    // warmed with audio from before the reset and is never swapped in
+    uint64_t reset_generation_;
+    uint64_t rebuild_generation_;
+    std::condition_variable rebuild_cv_;
+    std::thread builder_thread_;
+    bool builder_stop_;
+    std::shared_ptr<webrtc::AudioProcessing> rebuilt_processor_;
+    std::shared_ptr<webrtc::AudioProcessing> retired_processor_;
+
+    // Last kWarmupFrames frames of input (audio thread), and the copy handed
+    // to the builder. Kept as float planes, slot by slot, so both process()
+    // variants fill them with plain copies.
+    std::vector<float> history_near_;
+    std::vector<float> history_far_;
+    size_t history_pos_;
+    size_t history_frames_;
+    std::vector<float> warmup_near_;
+    std::vector<float> warmup_far_;
+    size_t warmup_frames_;
+    int warmup_delay_ms_;
+    std::atomic<uint64_t> reconfigurations_;
+
+    // processStream(): the partial chunk carried over to the next call
+    std::vector<int16_t> stream_near_;
+    std::vector<int16_t> stream_far_;
+    size_t stream_fill_;
+
+    // int16 copies of the frame for the recorder, and plane pointers into a
+    // history slot
+    std::vector<int16_t> record_near_;
+    std::vector<int16_t> record_far_;
+    std::vector<int16_t> record_out_;
+    const float* history_planes_[WEBRTC_AEC3_MAX_CHANNELS];
+
+    // Audio thread: frames since start() or reset(), stamped on recordings
+    std::atomic<AecRecorder*> recorder_;
+    uint64_t frame_index_;
+
+#ifdef WEBRTC_AEC3_STAGE_TIMING
+    int64_t stage_ns_[NUM_STAGES];
+    std::chrono::steady_clock::time_point stage_mark_;
+#endif
 };
 
 #endif // WEBRTC_AEC3_H
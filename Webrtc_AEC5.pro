@@ -24,6 +24,14 @@ HEADERS += \
 
 RESOURCES += qml.qrc
 
+# Headless service build (qmake CONFIG+=headless): QCoreApplication only,
+# no QML or Quick, configured with gflags. See aecdaemon.h.
+headless {
+    QT -= quick
+    RESOURCES -= qml.qrc
+    DEFINES += AEC_HEADLESS
+}
+
 LIBS += $$PWD/libwebrtc_aec.a
 LIBS += $$PWD/libgflags_nothreads.a
 LIBS += $$PWD/libgflags.a
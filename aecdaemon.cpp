@@ -0,0 +1,274 @@
+#include "aecdaemon.h"
+#include <QCoreApplication>
+#include <QDebug>
+#include <QSocketNotifier>
+#include <gflags/gflags.h>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Call
+DEFINE_string(mode, "server", "server or client");
+DEFINE_string(server_address, "127.0.0.1", "Host to connect to in client mode");
+DEFINE_int32(port, 8080, "WebSocket port to listen on (server) or connect to (client)");
+DEFINE_bool(conference, false, "Server mode: host an N-party conference instead of a two-party call");
+DEFINE_int32(prewarmed_processors, 4, "Conference: participant processors kept built ahead of joins");
+DEFINE_int32(reconnect_s, 5, "Client mode: retry a lost or failed connection after this long, 0 to give up");
+DEFINE_string(codec, "adpcm", "Preferred codec: adpcm, pcmu, pcma or pcm");
+DEFINE_int32(frames_per_packet, 1, "10 ms frames per WebSocket message, 1..10");
+DEFINE_bool(dtx, true, "Discontinuous transmission with comfort noise (turns voice detection on)");
+
+// Audio pipeline
+DEFINE_int32(far_queue_depth, 16, "Far-end reference ring capacity in 10 ms frames");
+DEFINE_bool(auto_delay, true, "Track the echo-path delay automatically");
+DEFINE_int32(realtime_priority, 0, "SCHED_FIFO priority for the audio thread, 0 for the default policy");
+DEFINE_bool(drift_compensation, true, "Resample received and played audio to the capture clock");
+
+// Observability
+DEFINE_int32(metrics_port, 0, "Loopback port serving /metrics and /metrics.json, 0 to disable");
+DEFINE_string(record, "", "Record the AEC session to this file for tools/aec_replay");
+DEFINE_int32(stats_interval_s, 60, "Log call statistics this often, 0 to disable");
+
+// WebrtcAEC3::ConfigId; applied only when given on the command line
+DEFINE_int32(sample_rate, 48000, "AEC sample rate (SAMPLE_RATE)");
+DEFINE_int32(system_delay_ms, 8, "Initial echo-path delay guess (SYSTEM_DELAY_MS)");
+DEFINE_int32(ns_level, 1, "Noise suppression level, 0 (low) .. 3 (very high) (NOISE_SUPPRESSION_LEVEL)");
+DEFINE_int32(aec_level, 2, "Echo suppression level, 0 (low) .. 2 (high) (AEC_LEVEL)");
+DEFINE_bool(aec, true, "Echo cancellation (ENABLE_AEC)");
+DEFINE_bool(agc, true, "Automatic gain control (ENABLE_AGC)");
+DEFINE_bool(hp_filter, true, "High-pass filter (ENABLE_HP_FILTER)");
+DEFINE_bool(ns, true, "Noise suppression (ENABLE_NOISE_SUPPRESSION)");
+DEFINE_bool(transient_suppression, false, "Transient suppression (ENABLE_TRANSIENT_SUPPRESSION)");
+DEFINE_bool(delay_agnostic, false, "Delay-agnostic echo cancellation (AEC_DELAY_AGNOSTIC)");
+DEFINE_bool(extended_filter, false, "Extended echo filter (AEC_EXTENDED_FILTER)");
+DEFINE_bool(voice_detection, true, "Voice detection (ENABLE_VOICE_DETECTION); without it DTX sends every frame");
+DEFINE_int32(agc_mode, 1, "0 adaptive analog, 1 adaptive digital, 2 fixed digital (AGC_MODE)");
+DEFINE_int32(capture_channels, 1, "Capture channels (CAPTURE_CHANNELS); the audio engine is mono");
+DEFINE_int32(render_channels, 1, "Render channels (RENDER_CHANNELS); the audio engine is mono");
+
+namespace {
+
+struct ProcessorFlag {
+    const char *name;
+    int configId;
+};
+
+// One flag per WebrtcAEC3::ConfigId, in id order
+const ProcessorFlag kProcessorFlags[] = {
+    { "sample_rate", WebrtcAEC3::SAMPLE_RATE },
+    { "system_delay_ms", WebrtcAEC3::SYSTEM_DELAY_MS },
+    { "ns_level", WebrtcAEC3::NOISE_SUPPRESSION_LEVEL },
+    { "aec_level", WebrtcAEC3::AEC_LEVEL },
+    { "aec", WebrtcAEC3::ENABLE_AEC },
+    { "agc", WebrtcAEC3::ENABLE_AGC },
+    { "hp_filter", WebrtcAEC3::ENABLE_HP_FILTER },
+    { "ns", WebrtcAEC3::ENABLE_NOISE_SUPPRESSION },
+    { "transient_suppression", WebrtcAEC3::ENABLE_TRANSIENT_SUPPRESSION },
+    { "delay_agnostic", WebrtcAEC3::AEC_DELAY_AGNOSTIC },
+    { "extended_filter", WebrtcAEC3::AEC_EXTENDED_FILTER },
+    { "voice_detection", WebrtcAEC3::ENABLE_VOICE_DETECTION },
+    { "agc_mode", WebrtcAEC3::AGC_MODE },
+    { "capture_channels", WebrtcAEC3::CAPTURE_CHANNELS },
+    { "render_channels", WebrtcAEC3::RENDER_CHANNELS },
+};
+static_assert(sizeof(kProcessorFlags) / sizeof(kProcessorFlags[0]) == WebrtcAEC3::NUM_CONFIG_IDS,
+              "every ConfigId needs a flag");
+
+// Flags that can be checked before anything is created
+bool validateFlags() {
+    if (FLAGS_mode != "server" && FLAGS_mode != "client") {
+        qWarning() << "--mode must be server or client, not" << FLAGS_mode.c_str();
+        return false;
+    }
+    if (FLAGS_conference && FLAGS_mode != "server") {
+        qWarning() << "--conference needs --mode=server";
+        return false;
+    }
+    if (FLAGS_port <= 0 || FLAGS_port > 65535) {
+        qWarning() << "--port out of range:" << FLAGS_port;
+        return false;
+    }
+    uint8_t payload;
+    if (!audioCodecFromName(FLAGS_codec, &payload)) {
+        qWarning() << "Unknown --codec" << FLAGS_codec.c_str();
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int AecDaemon::signalFds_[2] = { -1, -1 };
+
+AecDaemon::AecDaemon(QObject *parent)
+    : QObject(parent)
+    , signalNotifier_(nullptr)
+    , stopping_(false)
+{
+    connect(&controller_, &AudioController::statusMessageChanged, this, &AecDaemon::logStatus);
+    connect(&statsTimer_, &QTimer::timeout, this, &AecDaemon::logStats);
+    connect(&reconnectTimer_, &QTimer::timeout, this, &AecDaemon::reconnect);
+}
+
+AecDaemon::~AecDaemon() {
+    if (signalNotifier_) {
+        signal(SIGTERM, SIG_DFL);
+        signal(SIGINT, SIG_DFL);
+        delete signalNotifier_;
+        ::close(signalFds_[0]);
+        ::close(signalFds_[1]);
+        signalFds_[0] = signalFds_[1] = -1;
+    }
+}
+
+int AecDaemon::start() {
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, signalFds_) != 0) {
+        qWarning() << "socketpair failed:" << strerror(errno);
+        return 1;
+    }
+    signalNotifier_ = new QSocketNotifier(signalFds_[1], QSocketNotifier::Read, this);
+    // String-based: activated() is overloaded from Qt 5.15 on
+    connect(signalNotifier_, SIGNAL(activated(int)), this, SLOT(handleSignal()));
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = onTerminationSignal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    if (sigaction(SIGTERM, &action, nullptr) != 0 || sigaction(SIGINT, &action, nullptr) != 0) {
+        qWarning() << "sigaction failed:" << strerror(errno);
+        return 1;
+    }
+
+    const bool server = FLAGS_mode == "server";
+    controller_.setMode(server ? AudioController::ServerMode : AudioController::ClientMode);
+    controller_.setServerPort(FLAGS_port);
+    controller_.setConferenceMode(FLAGS_conference);
+    controller_.setPrewarmedProcessors(FLAGS_prewarmed_processors);
+    controller_.setPreferredCodec(QString::fromStdString(FLAGS_codec));
+    controller_.setFramesPerPacket(FLAGS_frames_per_packet);
+    controller_.setDtx(FLAGS_dtx);
+    controller_.setFarQueueDepth(FLAGS_far_queue_depth);
+    controller_.setAutoDelay(FLAGS_auto_delay);
+    controller_.setRealtimePriority(FLAGS_realtime_priority);
+    controller_.setDriftCompensation(FLAGS_drift_compensation);
+    // After setDtx(), so an explicit --voice_detection wins
+    if (!applyProcessorFlags()) {
+        return 2;
+    }
+    controller_.setMetricsPort(FLAGS_metrics_port);
+    if (!FLAGS_record.empty()) {
+        controller_.startRecording(QString::fromStdString(FLAGS_record));
+        if (!controller_.recording()) {
+            return 1;
+        }
+    }
+
+    if (FLAGS_stats_interval_s > 0) {
+        statsTimer_.start(FLAGS_stats_interval_s * 1000);
+    }
+
+    if (server) {
+        controller_.startServer();
+        return controller_.isListening() ? 0 : 1;
+    }
+
+    // A service outlives its peer: keep dialling until one answers
+    serverAddress_ = QString::fromStdString(FLAGS_server_address);
+    controller_.connectToServer(serverAddress_);
+    if (FLAGS_reconnect_s > 0) {
+        reconnectTimer_.start(FLAGS_reconnect_s * 1000);
+    }
+    return 0;
+}
+
+bool AecDaemon::applyProcessorFlags() {
+    // Only flags given on the command line, over the controller's defaults
+    for (const ProcessorFlag &flag : kProcessorFlags) {
+        gflags::CommandLineFlagInfo info;
+        if (!gflags::GetCommandLineFlagInfo(flag.name, &info) || info.is_default) {
+            continue;
+        }
+        const ConfigValue value = info.type == "bool"
+                                  ? ConfigValue(info.current_value == "true")
+                                  : ConfigValue(std::atoi(info.current_value.c_str()));
+        if (!controller_.setProcessorConfig(flag.configId, value)) {
+            qWarning().nospace() << "Invalid value for --" << flag.name << ": " << info.current_value.c_str();
+            return false;
+        }
+    }
+    return true;
+}
+
+void AecDaemon::onTerminationSignal(int) {
+    const char byte = 1;
+    const ssize_t ignored = ::write(signalFds_[0], &byte, 1);
+    (void)ignored;
+}
+
+void AecDaemon::handleSignal() {
+    char byte;
+    const ssize_t ignored = ::read(signalFds_[1], &byte, 1);
+    (void)ignored;
+    if (stopping_) {
+        return;
+    }
+    stopping_ = true;
+    qDebug() << "Shutting down";
+    statsTimer_.stop();
+    reconnectTimer_.stop();
+    controller_.disconnect();
+    controller_.stopRecording();
+    QCoreApplication::quit();
+}
+
+void AecDaemon::logStatus() {
+    qDebug() << "Status:" << controller_.statusMessage();
+}
+
+void AecDaemon::logStats() {
+    qDebug() << "Connected:" << controller_.isConnected()
+             << "participants:" << controller_.participantCount()
+             << "jitter:" << controller_.networkJitterMs() << "ms"
+             << "lost:" << controller_.packetsLost()
+             << "late:" << controller_.packetsLate()
+             << "deadline misses:" << controller_.deadlineMisses()
+             << "first frame:" << controller_.timeToFirstFrameMs() << "ms"
+             << "drift remote:" << controller_.remoteClockDriftPpm() << "ppm"
+             << "playout:" << controller_.playoutClockDriftPpm() << "ppm"
+             << "ERLE:" << controller_.erleDb() << "dB";
+}
+
+void AecDaemon::reconnect() {
+    if (!stopping_ && !controller_.isConnected()) {
+        controller_.connectToServer(serverAddress_);
+    }
+}
+
+int runAecDaemon(int argc, char *argv[]) {
+    gflags::SetUsageMessage("Headless echo-cancelling audio link.\n"
+                            "  --mode=server [--conference] [--port=N]\n"
+                            "  --mode=client --server_address=HOST [--port=N]");
+    gflags::ParseCommandLineFlags(&argc, &argv, true);
+    if (!validateFlags()) {
+        return 2;
+    }
+
+    QCoreApplication app(argc, argv);
+    int status;
+    {
+        // Gone before the application object
+        AecDaemon daemon;
+        status = daemon.start();
+        if (status == 0) {
+            status = app.exec();
+            daemon.logStats();
+        }
+    }
+    gflags::ShutDownCommandLineFlags();
+    return status;
+}
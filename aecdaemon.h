@@ -0,0 +1,63 @@
+#ifndef AECDAEMON_H
+#define AECDAEMON_H
+
+#include <QObject>
+#include <QString>
+#include <QTimer>
+#include "audiocontroller.h"
+
+class QSocketNotifier;
+
+// Headless service mode.
+//
+// Runs an AudioController under a QCoreApplication: no QML, no Quick and no
+// display. Everything the GUI exposes is set with command-line flags
+// (gflags; --helpon=aecdaemon lists them): server or client mode, ports,
+// codec, DTX, queue depths, and every WebrtcAEC3::ConfigId. Processor flags
+// left at their defaults keep AudioController's own settings.
+//
+// The service starts listening (or connecting) at once and runs until
+// SIGTERM or SIGINT, which disconnect cleanly, close any recording and exit
+// with status 0. A client keeps redialling a server that is not there yet
+// or went away. Bad flags exit with status 2 before anything starts.
+//
+// Built as the whole application with qmake CONFIG+=headless (AEC_HEADLESS),
+// which drops the Quick module; the GUI build runs it when the first
+// argument is --headless.
+class AecDaemon : public QObject {
+    Q_OBJECT
+
+public:
+    explicit AecDaemon(QObject *parent = nullptr);
+    ~AecDaemon();
+
+    // Applies the parsed flags and starts listening or connecting. Returns
+    // 0, or the status to exit with after logging why it could not start.
+    int start();
+    // One line of call statistics
+    void logStats();
+
+private slots:
+    void handleSignal();
+    void logStatus();
+    void reconnect();
+
+private:
+    bool applyProcessorFlags();
+    static void onTerminationSignal(int);
+
+    // Self-pipe: the handler only writes a byte, the event loop does the rest
+    static int signalFds_[2];
+
+    AudioController controller_;
+    QSocketNotifier *signalNotifier_;
+    QTimer statsTimer_;
+    QTimer reconnectTimer_;
+    QString serverAddress_;
+    bool stopping_;
+};
+
+// Parses the flags and runs the service until it is told to stop
+int runAecDaemon(int argc, char *argv[]);
+
+#endif // AECDAEMON_H
@@ -0,0 +1,239 @@
+#include "aecmetrics.h"
+
+#include <cstdio>
+#include <sstream>
+
+const int64_t AecMetrics::kBucketBoundsUs[AecMetrics::kNumBuckets - 1] = {
+    50, 100, 200, 500, 1000, 2000, 5000, 10000, 20000
+};
+
+namespace {
+
+const std::memory_order kRelaxed = std::memory_order_relaxed;
+
+// Prometheus floats; %g keeps small values readable without trailing zeros
+std::string number(double v) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.6g", v);
+    return buf;
+}
+
+void writeHistogram(std::ostringstream& out, const char* name, const char* help,
+                    const AecMetrics::Histogram& h) {
+    out << "# HELP " << name << " " << help << "\n";
+    out << "# TYPE " << name << " histogram\n";
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < AecMetrics::kNumBuckets; ++i) {
+        cumulative += h.buckets[i];
+        out << name << "_bucket{le=\"";
+        if (i + 1 < AecMetrics::kNumBuckets) {
+            out << number(AecMetrics::kBucketBoundsUs[i] / 1e6);
+        } else {
+            out << "+Inf";
+        }
+        out << "\"} " << cumulative << "\n";
+    }
+    out << name << "_sum " << number(h.sum_ns / 1e9) << "\n";
+    out << name << "_count " << h.count << "\n";
+}
+
+void writeGauge(std::ostringstream& out, const char* name, const char* help, double value) {
+    out << "# HELP " << name << " " << help << "\n";
+    out << "# TYPE " << name << " gauge\n";
+    out << name << " " << number(value) << "\n";
+}
+
+void writeCounter(std::ostringstream& out, const char* name, const char* help, uint64_t value) {
+    out << "# HELP " << name << " " << help << "\n";
+    out << "# TYPE " << name << " counter\n";
+    out << name << " " << value << "\n";
+}
+
+void writeJsonHistogram(std::ostringstream& out, const char* name, const AecMetrics::Histogram& h,
+                        bool last) {
+    out << "  \"" << name << "\": {\"count\": " << h.count
+        << ", \"mean_us\": " << number(h.count ? h.sum_ns / 1e3 / h.count : 0.0)
+        << ", \"p50_us\": " << number(h.quantileUs(0.5))
+        << ", \"p99_us\": " << number(h.quantileUs(0.99))
+        << ", \"buckets\": [";
+    for (size_t i = 0; i < AecMetrics::kNumBuckets; ++i) {
+        out << (i ? ", " : "") << h.buckets[i];
+    }
+    out << "]}" << (last ? "\n" : ",\n");
+}
+
+} // namespace
+
+double AecMetrics::Histogram::quantileUs(double q) const {
+    if (count == 0) {
+        return 0.0;
+    }
+    const double rank = q * count;
+    uint64_t below = 0;
+    for (size_t i = 0; i < kNumBuckets; ++i) {
+        if (below + buckets[i] >= rank && buckets[i] > 0) {
+            const double lower = i == 0 ? 0.0 : kBucketBoundsUs[i - 1];
+            // The open-ended bucket has no upper bound; report its floor
+            if (i + 1 == kNumBuckets) {
+                return lower;
+            }
+            const double upper = kBucketBoundsUs[i];
+            return lower + (upper - lower) * (rank - below) / buckets[i];
+        }
+        below += buckets[i];
+    }
+    return kBucketBoundsUs[kNumBuckets - 2];
+}
+
+AecMetrics::AecMetrics() {
+    reset();
+}
+
+void AecMetrics::reset() {
+    frames_.store(0, kRelaxed);
+    voice_frames_.store(0, kRelaxed);
+    echo_frames_.store(0, kRelaxed);
+    voice_.store(false, kRelaxed);
+    echo_.store(false, kRelaxed);
+    speech_probability_.store(0.0f, kRelaxed);
+
+    echo_valid_.store(false, kRelaxed);
+    erl_db_.store(0.0f, kRelaxed);
+    erle_db_.store(0.0f, kRelaxed);
+    a_nlp_db_.store(0.0f, kRelaxed);
+    divergent_fraction_.store(0.0f, kRelaxed);
+    delay_median_ms_.store(0, kRelaxed);
+    delay_std_ms_.store(0, kRelaxed);
+    fraction_poor_delays_.store(0.0f, kRelaxed);
+
+    clear(process_);
+    clear(frame_);
+}
+
+void AecMetrics::recordFrame(int64_t process_ns, int64_t frame_ns, bool voice, bool echo,
+                             float speech_probability) {
+    frames_.fetch_add(1, kRelaxed);
+    if (voice) {
+        voice_frames_.fetch_add(1, kRelaxed);
+    }
+    if (echo) {
+        echo_frames_.fetch_add(1, kRelaxed);
+    }
+    voice_.store(voice, kRelaxed);
+    echo_.store(echo, kRelaxed);
+    speech_probability_.store(speech_probability, kRelaxed);
+    record(process_, process_ns);
+    record(frame_, frame_ns);
+}
+
+void AecMetrics::recordEcho(const Echo& echo) {
+    erl_db_.store(echo.erl_db, kRelaxed);
+    erle_db_.store(echo.erle_db, kRelaxed);
+    a_nlp_db_.store(echo.a_nlp_db, kRelaxed);
+    divergent_fraction_.store(echo.divergent_fraction, kRelaxed);
+    delay_median_ms_.store(echo.delay_median_ms, kRelaxed);
+    delay_std_ms_.store(echo.delay_std_ms, kRelaxed);
+    fraction_poor_delays_.store(echo.fraction_poor_delays, kRelaxed);
+    echo_valid_.store(echo.valid, kRelaxed);
+}
+
+AecMetrics::Snapshot AecMetrics::snapshot() const {
+    Snapshot s;
+    s.frames = frames_.load(kRelaxed);
+    s.voice_frames = voice_frames_.load(kRelaxed);
+    s.echo_frames = echo_frames_.load(kRelaxed);
+    s.voice = voice_.load(kRelaxed);
+    s.echo = echo_.load(kRelaxed);
+    s.speech_probability = speech_probability_.load(kRelaxed);
+
+    s.echo_metrics.valid = echo_valid_.load(kRelaxed);
+    s.echo_metrics.erl_db = erl_db_.load(kRelaxed);
+    s.echo_metrics.erle_db = erle_db_.load(kRelaxed);
+    s.echo_metrics.a_nlp_db = a_nlp_db_.load(kRelaxed);
+    s.echo_metrics.divergent_fraction = divergent_fraction_.load(kRelaxed);
+    s.echo_metrics.delay_median_ms = delay_median_ms_.load(kRelaxed);
+    s.echo_metrics.delay_std_ms = delay_std_ms_.load(kRelaxed);
+    s.echo_metrics.fraction_poor_delays = fraction_poor_delays_.load(kRelaxed);
+
+    load(process_, &s.process);
+    load(frame_, &s.frame);
+    return s;
+}
+
+void AecMetrics::record(AtomicHistogram& h, int64_t ns) {
+    const int64_t us = ns / 1000;
+    size_t bucket = 0;
+    while (bucket < kNumBuckets - 1 && us > kBucketBoundsUs[bucket]) {
+        ++bucket;
+    }
+    h.buckets[bucket].fetch_add(1, kRelaxed);
+    h.count.fetch_add(1, kRelaxed);
+    h.sum_ns.fetch_add(static_cast<uint64_t>(ns > 0 ? ns : 0), kRelaxed);
+}
+
+void AecMetrics::load(const AtomicHistogram& h, Histogram* out) {
+    for (size_t i = 0; i < kNumBuckets; ++i) {
+        out->buckets[i] = h.buckets[i].load(kRelaxed);
+    }
+    out->count = h.count.load(kRelaxed);
+    out->sum_ns = h.sum_ns.load(kRelaxed);
+}
+
+void AecMetrics::clear(AtomicHistogram& h) {
+    for (size_t i = 0; i < kNumBuckets; ++i) {
+        h.buckets[i].store(0, kRelaxed);
+    }
+    h.count.store(0, kRelaxed);
+    h.sum_ns.store(0, kRelaxed);
+}
+
+std::string AecMetrics::formatPrometheus(const Snapshot& s) {
+    std::ostringstream out;
+    writeCounter(out, "aec_frames_total", "10 ms frames processed.", s.frames);
+    writeCounter(out, "aec_voice_frames_total", "Frames the VAD flagged as voice.", s.voice_frames);
+    writeCounter(out, "aec_echo_frames_total", "Frames the AEC flagged as containing echo.", s.echo_frames);
+    writeGauge(out, "aec_voice_active", "VAD decision for the last frame.", s.voice ? 1 : 0);
+    writeGauge(out, "aec_speech_probability", "Noise suppressor speech probability, last frame.",
+               s.speech_probability);
+    if (s.echo_metrics.valid) {
+        const Echo& e = s.echo_metrics;
+        writeGauge(out, "aec_erl_db", "Echo return loss, average.", e.erl_db);
+        writeGauge(out, "aec_erle_db", "Echo return loss enhancement, average.", e.erle_db);
+        writeGauge(out, "aec_a_nlp_db", "Non-linear processor suppression, average.", e.a_nlp_db);
+        writeGauge(out, "aec_divergent_filter_fraction", "Fraction of frames with a diverged filter.",
+                   e.divergent_fraction);
+        writeGauge(out, "aec_delay_median_ms", "Median echo delay seen by the AEC.", e.delay_median_ms);
+        writeGauge(out, "aec_delay_std_ms", "Standard deviation of the echo delay.", e.delay_std_ms);
+        writeGauge(out, "aec_fraction_poor_delays", "Fraction of delay estimates out of range.",
+                   e.fraction_poor_delays);
+    }
+    writeHistogram(out, "aec_process_seconds", "Time spent in WebrtcAEC3::process() per frame.", s.process);
+    writeHistogram(out, "aec_frame_seconds", "Time spent handling one captured frame.", s.frame);
+    return out.str();
+}
+
+std::string AecMetrics::formatJson(const Snapshot& s) {
+    std::ostringstream out;
+    const Echo& e = s.echo_metrics;
+    out << "{\n"
+        << "  \"frames\": " << s.frames << ",\n"
+        << "  \"voice_frames\": " << s.voice_frames << ",\n"
+        << "  \"echo_frames\": " << s.echo_frames << ",\n"
+        << "  \"voice_active\": " << (s.voice ? "true" : "false") << ",\n"
+        << "  \"speech_probability\": " << number(s.speech_probability) << ",\n";
+    if (e.valid) {
+        out << "  \"echo\": {\"erl_db\": " << number(e.erl_db)
+            << ", \"erle_db\": " << number(e.erle_db)
+            << ", \"a_nlp_db\": " << number(e.a_nlp_db)
+            << ", \"divergent_filter_fraction\": " << number(e.divergent_fraction)
+            << ", \"delay_median_ms\": " << e.delay_median_ms
+            << ", \"delay_std_ms\": " << e.delay_std_ms
+            << ", \"fraction_poor_delays\": " << number(e.fraction_poor_delays) << "},\n";
+    } else {
+        out << "  \"echo\": null,\n";
+    }
+    writeJsonHistogram(out, "process", s.process, false);
+    writeJsonHistogram(out, "frame", s.frame, true);
+    out << "}\n";
+    return out.str();
+}
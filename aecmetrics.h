@@ -0,0 +1,112 @@
+#ifndef AECMETRICS_H
+#define AECMETRICS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Lock-free collector for the health of a running echo canceller.
+//
+// The audio thread records every frame (processing time, VAD and echo flags)
+// and, about once a second, the echo canceller's own statistics; any other
+// thread may take a snapshot() at any time. Every field is a relaxed atomic,
+// so a snapshot is not a single consistent instant but never blocks or
+// tears a value.
+//
+// Processing times go into fixed-bucket histograms whose bounds are chosen
+// around the 10 ms frame budget; quantiles are interpolated from them.
+class AecMetrics {
+public:
+    static const size_t kNumBuckets = 10;
+    // Upper bucket bounds in microseconds; the last bucket is unbounded
+    static const int64_t kBucketBoundsUs[kNumBuckets - 1];
+
+    struct Histogram {
+        uint64_t buckets[kNumBuckets];   // non-cumulative counts
+        uint64_t count;
+        uint64_t sum_ns;
+
+        // Interpolated from the buckets; 0 when empty
+        double quantileUs(double q) const;
+    };
+
+    // Echo canceller statistics, from WebrtcAEC3::getEchoMetrics(); dB
+    // values are long-term averages
+    struct Echo {
+        bool valid;                  // false until AEC has produced numbers
+        float erl_db;                // echo return loss
+        float erle_db;               // echo return loss enhancement
+        float a_nlp_db;              // suppression by the non-linear processor
+        float divergent_fraction;    // frames where the linear filter diverged
+        int delay_median_ms;
+        int delay_std_ms;
+        float fraction_poor_delays;
+    };
+
+    struct Snapshot {
+        uint64_t frames;
+        uint64_t voice_frames;
+        uint64_t echo_frames;
+        bool voice;                  // state of the last frame
+        bool echo;
+        float speech_probability;
+        Echo echo_metrics;
+        Histogram process;           // WebrtcAEC3::process() alone
+        Histogram frame;             // the whole frame: playout, AEC, delay tracking
+    };
+
+    AecMetrics();
+
+    // Zeroes everything. Not synchronised with recordFrame(); call while the
+    // audio thread is idle.
+    void reset();
+
+    // Audio thread, once per frame
+    void recordFrame(int64_t process_ns, int64_t frame_ns, bool voice, bool echo,
+                     float speech_probability);
+    // Audio thread, whenever fresh echo statistics were read
+    void recordEcho(const Echo& echo);
+
+    Snapshot snapshot() const;
+
+    // Prometheus text exposition format (version 0.0.4), metric names
+    // prefixed with "aec_"
+    static std::string formatPrometheus(const Snapshot& s);
+    static std::string formatJson(const Snapshot& s);
+
+private:
+    struct AtomicHistogram {
+        std::atomic<uint64_t> buckets[kNumBuckets];
+        std::atomic<uint64_t> count;
+        std::atomic<uint64_t> sum_ns;
+    };
+
+    static void record(AtomicHistogram& h, int64_t ns);
+    static void load(const AtomicHistogram& h, Histogram* out);
+    static void clear(AtomicHistogram& h);
+
+    std::atomic<uint64_t> frames_;
+    std::atomic<uint64_t> voice_frames_;
+    std::atomic<uint64_t> echo_frames_;
+    std::atomic<bool> voice_;
+    std::atomic<bool> echo_;
+    std::atomic<float> speech_probability_;
+
+    std::atomic<bool> echo_valid_;
+    std::atomic<float> erl_db_;
+    std::atomic<float> erle_db_;
+    std::atomic<float> a_nlp_db_;
+    std::atomic<float> divergent_fraction_;
+    std::atomic<int> delay_median_ms_;
+    std::atomic<int> delay_std_ms_;
+    std::atomic<float> fraction_poor_delays_;
+
+    AtomicHistogram process_;
+    AtomicHistogram frame_;
+
+    AecMetrics(const AecMetrics&);
+    AecMetrics& operator=(const AecMetrics&);
+};
+
+#endif // AECMETRICS_H
@@ -0,0 +1,246 @@
+#include "aecrecorder.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+const char AecRecorder::kMagic[8] = { 'A', 'E', 'C', 'R', 'E', 'C', '1', '\0' };
+
+namespace {
+
+// How often the writer looks at the ring when nothing wakes it. The audio
+// thread never signals it, so this bounds how stale the file can be.
+const std::chrono::milliseconds kWriterPollInterval(20);
+
+size_t padded(size_t bytes) {
+    return (bytes + 3) & ~static_cast<size_t>(3);
+}
+
+} // namespace
+
+AecRecorder::AecRecorder(size_t buffer_bytes)
+    : capacity_(padded(std::max<size_t>(buffer_bytes, 64 * 1024)))
+    , ring_(capacity_)
+    , head_(0)
+    , tail_(0)
+    , file_(nullptr)
+    , writer_stop_(false)
+    , write_failed_(false)
+    , accepting_(false)
+    , format_recorded_(false)
+    , writers_(0)
+    , near_samples_(0)
+    , far_samples_(0)
+    , frames_recorded_(0)
+    , frames_dropped_(0)
+    , bytes_written_(0) {
+}
+
+AecRecorder::~AecRecorder() {
+    close();
+}
+
+void AecRecorder::open(const std::string& path) {
+    close();
+
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+        throw std::runtime_error("Cannot create recording " + path + ": " + std::strerror(errno));
+    }
+    uint32_t header[2] = { kVersion, 0 };
+    if (std::fwrite(kMagic, 1, sizeof(kMagic), file) != sizeof(kMagic)
+        || std::fwrite(header, 1, sizeof(header), file) != sizeof(header)) {
+        std::fclose(file);
+        throw std::runtime_error("Cannot write recording " + path);
+    }
+
+    file_ = file;
+    head_.store(0);
+    tail_.store(0);
+    frames_recorded_.store(0);
+    frames_dropped_.store(0);
+    bytes_written_.store(kFileHeaderBytes);
+    format_recorded_.store(false);
+    writer_stop_ = false;
+    write_failed_ = false;
+    writer_ = std::thread(&AecRecorder::writerLoop, this);
+    accepting_.store(true);
+}
+
+void AecRecorder::close() {
+    if (!file_) {
+        return;
+    }
+
+    // A process() that loaded the recorder before it was detached may still
+    // be copying a frame; that is at most one frame's worth of memcpy
+    accepting_.store(false);
+    while (writers_.load() != 0) {
+        std::this_thread::yield();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(writer_mutex_);
+        writer_stop_ = true;
+    }
+    writer_cv_.notify_one();
+    writer_.join();
+
+    if (!write_failed_) {
+        uint32_t chunk[2] = { kTagEnd, 16 };
+        uint64_t counts[2] = { frames_recorded_.load(), frames_dropped_.load() };
+        std::fwrite(chunk, 1, sizeof(chunk), file_);
+        std::fwrite(counts, 1, sizeof(counts), file_);
+        bytes_written_.fetch_add(sizeof(chunk) + sizeof(counts));
+    }
+    std::fclose(file_);
+    file_ = nullptr;
+}
+
+bool AecRecorder::needsFormat() const {
+    return accepting_.load() && !format_recorded_.load(std::memory_order_relaxed);
+}
+
+void AecRecorder::recordFormat(int sample_rate, size_t capture_channels, size_t render_channels,
+                               size_t frame_samples) {
+    WriterScope scope(this);
+    if (!accepting_.load()) {
+        return;
+    }
+    int32_t payload[4] = {
+        sample_rate,
+        static_cast<int32_t>(capture_channels),
+        static_cast<int32_t>(render_channels),
+        static_cast<int32_t>(frame_samples)
+    };
+    const void* parts[1] = { payload };
+    const size_t sizes[1] = { sizeof(payload) };
+    if (pushChunk(kTagFormat, parts, sizes, 1)) {
+        near_samples_ = frame_samples * capture_channels;
+        far_samples_ = frame_samples * render_channels;
+        format_recorded_.store(true, std::memory_order_relaxed);
+    }
+}
+
+void AecRecorder::recordConfig(int config_id, const ConfigValue& value) {
+    WriterScope scope(this);
+    if (!accepting_.load() || !format_recorded_.load(std::memory_order_relaxed)) {
+        return;
+    }
+    int32_t payload[3] = { config_id, static_cast<int32_t>(value.type), 0 };
+    switch (value.type) {
+    case ConfigValue::INT:
+        payload[2] = value.int_val;
+        break;
+    case ConfigValue::BOOL:
+        payload[2] = value.bool_val ? 1 : 0;
+        break;
+    case ConfigValue::FLOAT:
+        std::memcpy(&payload[2], &value.float_val, sizeof(float));
+        break;
+    }
+    const void* parts[1] = { payload };
+    const size_t sizes[1] = { sizeof(payload) };
+    pushChunk(kTagConfig, parts, sizes, 1);
+}
+
+void AecRecorder::recordFrame(uint64_t frame_index, int delay_ms, const int16_t* near_in,
+                              const int16_t* far_in, const int16_t* out) {
+    WriterScope scope(this);
+    if (!accepting_.load() || !format_recorded_.load(std::memory_order_relaxed)) {
+        return;
+    }
+    char header[kFrameHeaderBytes] = {};
+    const int32_t delay = delay_ms;
+    std::memcpy(header, &frame_index, sizeof(frame_index));
+    std::memcpy(header + 8, &delay, sizeof(delay));
+
+    const void* parts[4] = { header, near_in, far_in, out };
+    const size_t sizes[4] = {
+        sizeof(header),
+        near_samples_ * sizeof(int16_t),
+        far_samples_ * sizeof(int16_t),
+        near_samples_ * sizeof(int16_t)
+    };
+    if (pushChunk(kTagFrame, parts, sizes, 4)) {
+        frames_recorded_.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        frames_dropped_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+bool AecRecorder::pushChunk(uint32_t tag, const void* const* parts, const size_t* sizes,
+                            size_t num_parts) {
+    size_t payload = 0;
+    for (size_t i = 0; i < num_parts; ++i) {
+        payload += sizes[i];
+    }
+    const size_t total = kChunkHeaderBytes + padded(payload);
+
+    const uint64_t head = head_.load(std::memory_order_relaxed);
+    const uint64_t tail = tail_.load(std::memory_order_acquire);
+    if (capacity_ - static_cast<size_t>(head - tail) < total) {
+        return false;
+    }
+
+    // Copies |n| bytes at ring offset |pos|, wrapping at the end
+    size_t pos = static_cast<size_t>(head % capacity_);
+    auto put = [&](const void* src, size_t n) {
+        const char* bytes = static_cast<const char*>(src);
+        const size_t first = std::min(n, capacity_ - pos);
+        std::memcpy(&ring_[pos], bytes, first);
+        std::memcpy(&ring_[0], bytes + first, n - first);
+        pos = (pos + n) % capacity_;
+    };
+    const uint32_t chunk_header[2] = { tag, static_cast<uint32_t>(payload) };
+    put(chunk_header, sizeof(chunk_header));
+    for (size_t i = 0; i < num_parts; ++i) {
+        put(parts[i], sizes[i]);
+    }
+    static const char kPad[4] = {};
+    put(kPad, padded(payload) - payload);
+
+    head_.store(head + total, std::memory_order_release);
+    return true;
+}
+
+void AecRecorder::writerLoop() {
+    std::unique_lock<std::mutex> lock(writer_mutex_);
+    while (!writer_stop_) {
+        lock.unlock();
+        drain();
+        lock.lock();
+        writer_cv_.wait_for(lock, kWriterPollInterval);
+    }
+    lock.unlock();
+    drain();
+}
+
+size_t AecRecorder::drain() {
+    const uint64_t head = head_.load(std::memory_order_acquire);
+    uint64_t tail = tail_.load(std::memory_order_relaxed);
+    size_t written = 0;
+    while (tail != head) {
+        const size_t pos = static_cast<size_t>(tail % capacity_);
+        const size_t n = std::min(static_cast<size_t>(head - tail), capacity_ - pos);
+        // After a failed write (disk full) the ring is still drained so the
+        // audio thread keeps going, but nothing more is written: the file
+        // stays valid up to its last complete chunk
+        if (!write_failed_) {
+            if (std::fwrite(&ring_[pos], 1, n, file_) == n) {
+                written += n;
+            } else {
+                write_failed_ = true;
+            }
+        }
+        tail += n;
+        tail_.store(tail, std::memory_order_release);
+    }
+    if (written) {
+        std::fflush(file_);
+        bytes_written_.fetch_add(written, std::memory_order_relaxed);
+    }
+    return written;
+}
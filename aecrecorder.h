@@ -0,0 +1,117 @@
+#ifndef AECRECORDER_H
+#define AECRECORDER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "WebrtcAEC3.h"
+
+// Session recording for WebrtcAEC3: everything needed to replay a call
+// through the echo canceller bit-exactly on another machine.
+//
+// File layout (all integers little-endian, as written by the host):
+//   header   8 bytes magic "AECREC1\0", uint32 version, uint32 reserved
+//   chunks   uint32 tag, uint32 payload bytes, payload padded to 4 bytes
+// Chunks, in the order process() saw them:
+//   FMT   int32 sample rate, uint32 capture channels, uint32 render
+//         channels, uint32 samples per channel per frame; once, first
+//   CONF  int32 ConfigId, int32 ConfigValue::Type, 4 bytes value; the full
+//         configuration after FMT, then every change when it was applied
+//   FRAM  uint64 frame index since start()/reset(), int32 stream delay ms,
+//         uint32 reserved, then interleaved int16 near, far and output
+//   END   uint64 frames recorded, uint64 frames dropped; written by close()
+// A file cut short by a crash is valid up to its last complete chunk.
+//
+// The audio thread only copies into a preallocated ring; a write-behind
+// thread drains it to disk. When the disk falls behind, frames are dropped
+// (and counted) rather than stalling the audio thread; the gap shows up in
+// the frame indices.
+class AecRecorder {
+public:
+    enum ChunkTag {
+        kTagFormat = 0x20544d46,   // "FMT "
+        kTagConfig = 0x464e4f43,   // "CONF"
+        kTagFrame = 0x4d415246,    // "FRAM"
+        kTagEnd = 0x20444e45       // "END "
+    };
+    static const char kMagic[8];
+    static const uint32_t kVersion = 1;
+    static const size_t kFileHeaderBytes = 16;
+    static const size_t kChunkHeaderBytes = 8;
+    static const size_t kFrameHeaderBytes = 16;
+
+    // |buffer_bytes| of ring between the audio thread and the disk; the 4 MB
+    // default holds over a second of mono 48 kHz audio
+    explicit AecRecorder(size_t buffer_bytes = 4 << 20);
+    ~AecRecorder();
+
+    // Control thread. open() truncates |path| and starts the writer; throws
+    // std::runtime_error when the file cannot be created. Attach the
+    // recorder with WebrtcAEC3::setRecorder() after open() and detach it
+    // before close(), which drains the ring, writes END and joins the writer.
+    void open(const std::string& path);
+    void close();
+    bool isOpen() const { return file_ != nullptr; }
+
+    // Frames are counted when queued; bytesWritten() is what reached the file
+    uint64_t framesRecorded() const { return frames_recorded_.load(std::memory_order_relaxed); }
+    uint64_t framesDropped() const { return frames_dropped_.load(std::memory_order_relaxed); }
+    uint64_t bytesWritten() const { return bytes_written_.load(std::memory_order_relaxed); }
+
+    // Audio thread, called by WebrtcAEC3::process(); never block. Nothing is
+    // recorded until recordFormat() has been called for the session.
+    bool needsFormat() const;
+    void recordFormat(int sample_rate, size_t capture_channels, size_t render_channels,
+                      size_t frame_samples);
+    void recordConfig(int config_id, const ConfigValue& value);
+    void recordFrame(uint64_t frame_index, int delay_ms, const int16_t* near_in,
+                     const int16_t* far_in, const int16_t* out);
+
+private:
+    // Marks an audio-thread call in flight so close() can wait it out
+    class WriterScope {
+    public:
+        explicit WriterScope(const AecRecorder* r) : r_(r) { r_->writers_.fetch_add(1); }
+        ~WriterScope() { r_->writers_.fetch_sub(1); }
+    private:
+        const AecRecorder* r_;
+    };
+
+    bool pushChunk(uint32_t tag, const void* const* parts, const size_t* sizes, size_t num_parts);
+    void writerLoop();
+    size_t drain();
+
+    const size_t capacity_;
+    std::vector<char> ring_;
+    // Total bytes ever pushed / written out; the difference is the fill
+    std::atomic<uint64_t> head_;
+    std::atomic<uint64_t> tail_;
+
+    std::FILE* file_;
+    std::thread writer_;
+    std::mutex writer_mutex_;
+    std::condition_variable writer_cv_;
+    bool writer_stop_;
+    bool write_failed_;     // writer thread, then close()
+
+    std::atomic<bool> accepting_;
+    std::atomic<bool> format_recorded_;
+    mutable std::atomic<int> writers_;
+    size_t near_samples_;
+    size_t far_samples_;
+
+    std::atomic<uint64_t> frames_recorded_;
+    std::atomic<uint64_t> frames_dropped_;
+    std::atomic<uint64_t> bytes_written_;
+
+    AecRecorder(const AecRecorder&);
+    AecRecorder& operator=(const AecRecorder&);
+};
+
+#endif // AECRECORDER_H
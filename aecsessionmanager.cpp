@@ -0,0 +1,262 @@
+#include "aecsessionmanager.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+
+// Frames a worker processes for one session before yielding back to the
+// pool, so a backlogged session cannot starve the others.
+const size_t kMaxFramesPerDrain = 4;
+
+} // namespace
+
+struct AecSessionManager::Session {
+    SessionId id;
+    WebrtcAEC3 processor;
+    OutputCallback callback;
+    size_t frame_samples;
+    // Interleaved samples per frame: frame_samples times the channel count
+    size_t near_samples;
+    size_t far_samples;
+
+    // Guards the frame ring and the scheduling flags
+    std::mutex mutex;
+    // Signalled when a drain task ends, for destroySession()
+    std::condition_variable drained;
+    std::vector<int16_t> near_slots;
+    std::vector<int16_t> far_slots;
+    size_t capacity;
+    size_t head;
+    size_t count;
+    bool scheduled;
+    bool draining;
+    bool closed;
+
+    // Only touched by the worker currently draining this session
+    std::vector<int16_t> out_frame;
+
+    std::atomic<uint64_t> frames_processed;
+    std::atomic<uint64_t> frames_dropped;
+    std::atomic<uint64_t> processing_errors;
+
+    Session()
+        : id(0)
+        , frame_samples(0)
+        , near_samples(0)
+        , far_samples(0)
+        , capacity(0)
+        , head(0)
+        , count(0)
+        , scheduled(false)
+        , draining(false)
+        , closed(false)
+        , frames_processed(0)
+        , frames_dropped(0)
+        , processing_errors(0) {}
+};
+
+AecSessionManager::AecSessionManager(size_t num_threads, size_t max_queued_frames)
+    : max_queued_frames_(std::max<size_t>(1, max_queued_frames))
+    , next_id_(1)
+    , pool_(num_threads) {
+}
+
+AecSessionManager::~AecSessionManager() {
+    std::lock_guard<std::mutex> lock(sessions_mutex_);
+    for (std::map<SessionId, SessionPtr>::iterator it = sessions_.begin(); it != sessions_.end(); ++it) {
+        std::lock_guard<std::mutex> session_lock(it->second->mutex);
+        it->second->closed = true;
+    }
+}
+
+AecSessionManager::SessionId AecSessionManager::createSession(const SessionConfig& config,
+                                                              OutputCallback callback) {
+    SessionPtr session = std::make_shared<Session>();
+    for (size_t i = 0; i < config.size(); ++i) {
+        session->processor.setConfig(config[i].first, config[i].second);
+    }
+    session->processor.start();
+
+    session->callback = callback;
+    session->frame_samples = session->processor.chunkSamples();
+    session->near_samples = session->frame_samples * session->processor.captureChannels();
+    session->far_samples = session->frame_samples * session->processor.renderChannels();
+    session->capacity = max_queued_frames_;
+
+    // All per-frame storage is allocated up front; submitFrame() and drain()
+    // never touch the heap.
+    session->near_slots.resize(session->capacity * session->near_samples);
+    session->far_slots.resize(session->capacity * session->far_samples);
+    session->out_frame.resize(session->near_samples);
+
+    std::lock_guard<std::mutex> lock(sessions_mutex_);
+    session->id = next_id_++;
+    sessions_[session->id] = session;
+    return session->id;
+}
+
+void AecSessionManager::destroySession(SessionId id) {
+    SessionPtr session;
+    {
+        std::lock_guard<std::mutex> lock(sessions_mutex_);
+        std::map<SessionId, SessionPtr>::iterator it = sessions_.find(id);
+        if (it == sessions_.end()) {
+            return;
+        }
+        session = it->second;
+        sessions_.erase(it);
+    }
+
+    // A pending drain task still holds a reference and releases it when it
+    // sees the flag; one already running may be inside the callback, so wait
+    // for it to end.
+    std::unique_lock<std::mutex> lock(session->mutex);
+    session->closed = true;
+    session->count = 0;
+    session->drained.wait(lock, [&session]() { return !session->draining; });
+}
+
+bool AecSessionManager::submitFrame(SessionId id, const int16_t* near, const int16_t* far) {
+    SessionPtr session = findSession(id);
+    if (!session) {
+        return false;
+    }
+
+    bool need_schedule = false;
+    {
+        std::lock_guard<std::mutex> lock(session->mutex);
+        if (session->closed) {
+            return false;
+        }
+        if (session->count == session->capacity) {
+            session->frames_dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        size_t slot = (session->head + session->count) % session->capacity;
+        const size_t near_n = session->near_samples;
+        const size_t far_n = session->far_samples;
+        std::copy(near, near + near_n, session->near_slots.begin() + slot * near_n);
+        std::copy(far, far + far_n, session->far_slots.begin() + slot * far_n);
+        ++session->count;
+
+        if (!session->scheduled) {
+            session->scheduled = true;
+            need_schedule = true;
+        }
+    }
+
+    if (need_schedule) {
+        schedule(session);
+    }
+    return true;
+}
+
+void AecSessionManager::schedule(const SessionPtr& session) {
+    pool_.submit([this, session]() { drain(session); });
+}
+
+void AecSessionManager::drain(const SessionPtr& session) {
+    {
+        std::lock_guard<std::mutex> lock(session->mutex);
+        session->draining = true;
+    }
+    processQueued(session);
+
+    // Still backlogged: requeue at the back of the pool instead of looping,
+    // which keeps per-session order (scheduled stays set) and stays fair.
+    bool requeue;
+    {
+        std::lock_guard<std::mutex> lock(session->mutex);
+        session->draining = false;
+        requeue = !session->closed && session->count > 0;
+        if (!requeue) {
+            session->scheduled = false;
+        }
+    }
+    session->drained.notify_all();
+    if (requeue) {
+        schedule(session);
+    }
+}
+
+void AecSessionManager::processQueued(const SessionPtr& session) {
+    const size_t n = session->frame_samples;
+    const size_t near_n = session->near_samples;
+    const size_t far_n = session->far_samples;
+
+    for (size_t i = 0; i < kMaxFramesPerDrain; ++i) {
+        size_t slot;
+        {
+            std::lock_guard<std::mutex> lock(session->mutex);
+            if (session->closed || session->count == 0) {
+                return;
+            }
+            slot = session->head;
+        }
+
+        // The head slot stays owned by this worker until it is popped below,
+        // so it can be processed in place without holding the lock.
+        bool ok = true;
+        try {
+            session->processor.process(&session->near_slots[slot * near_n], &session->far_slots[slot * far_n],
+                                       session->out_frame.data(), n);
+        } catch (const std::exception& e) {
+            ok = false;
+            session->processing_errors.fetch_add(1, std::memory_order_relaxed);
+            std::cerr << "[Session " << session->id << "] Processing failed: " << e.what() << std::endl;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(session->mutex);
+            // Destroyed meanwhile: the queue is already cleared and the
+            // output must not be delivered
+            if (session->closed) {
+                return;
+            }
+            session->head = (session->head + 1) % session->capacity;
+            --session->count;
+        }
+        if (!ok) {
+            continue;
+        }
+        session->frames_processed.fetch_add(1, std::memory_order_relaxed);
+
+        if (session->callback) {
+            session->callback(session->id, session->out_frame.data(), near_n);
+        }
+    }
+}
+
+AecSessionManager::SessionPtr AecSessionManager::findSession(SessionId id) const {
+    std::lock_guard<std::mutex> lock(sessions_mutex_);
+    std::map<SessionId, SessionPtr>::const_iterator it = sessions_.find(id);
+    return it != sessions_.end() ? it->second : SessionPtr();
+}
+
+size_t AecSessionManager::frameSamples(SessionId id) const {
+    SessionPtr session = findSession(id);
+    return session ? session->frame_samples : 0;
+}
+
+bool AecSessionManager::sessionStats(SessionId id, SessionStats* stats) const {
+    SessionPtr session = findSession(id);
+    if (!session) {
+        return false;
+    }
+    stats->frames_processed = session->frames_processed.load(std::memory_order_relaxed);
+    stats->frames_dropped = session->frames_dropped.load(std::memory_order_relaxed);
+    stats->processing_errors = session->processing_errors.load(std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock(session->mutex);
+    stats->queued_frames = session->count;
+    return true;
+}
+
+size_t AecSessionManager::sessionCount() const {
+    std::lock_guard<std::mutex> lock(sessions_mutex_);
+    return sessions_.size();
+}
@@ -0,0 +1,86 @@
+#ifndef AECSESSIONMANAGER_H
+#define AECSESSIONMANAGER_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "WebrtcAEC3.h"
+#include "workstealingpool.h"
+
+// Hosts many independent echo-cancellation sessions in one process. Every
+// session owns a WebrtcAEC3 instance and a bounded queue of pending 10 ms
+// frames; frames are processed on a shared WorkStealingPool. A session is
+// scheduled on at most one worker at a time, so its frames are always
+// processed in submission order while different sessions run in parallel.
+class AecSessionManager {
+public:
+    typedef uint32_t SessionId;
+    typedef std::vector<std::pair<int, ConfigValue>> SessionConfig;
+
+    // Called on a pool thread with one processed frame: chunkSamples() times
+    // CAPTURE_CHANNELS interleaved samples. Must not block.
+    typedef std::function<void(SessionId id, const int16_t* out, size_t num_samples)> OutputCallback;
+
+    struct SessionStats {
+        uint64_t frames_processed;
+        uint64_t frames_dropped;
+        uint64_t processing_errors;
+        size_t queued_frames;
+    };
+
+    // |num_threads| == 0 uses one worker per core. |max_queued_frames| bounds
+    // the per-session backlog; submitFrame() drops beyond that.
+    explicit AecSessionManager(size_t num_threads = 0, size_t max_queued_frames = 16);
+    ~AecSessionManager();
+
+    // Creates and starts a session. |config| is applied with
+    // WebrtcAEC3::setConfig() before start(); throws on invalid settings.
+    SessionId createSession(const SessionConfig& config, OutputCallback callback);
+
+    // Stops accepting frames. Frames already queued are discarded; a frame
+    // currently being processed completes but its output is not delivered.
+    // Blocks while a worker is inside the session's callback, so once this
+    // returns the callback is never called again and its state can be freed.
+    // Must not be called from that callback.
+    void destroySession(SessionId id);
+
+    // Copies one 10 ms frame of near and far audio into the session queue,
+    // interleaved with CAPTURE_CHANNELS and RENDER_CHANNELS channels.
+    // Returns false if the session does not exist or its queue is full.
+    bool submitFrame(SessionId id, const int16_t* near, const int16_t* far);
+
+    // Samples per channel in one frame
+    size_t frameSamples(SessionId id) const;
+    bool sessionStats(SessionId id, SessionStats* stats) const;
+    size_t sessionCount() const;
+    size_t numThreads() const { return pool_.numThreads(); }
+
+private:
+    struct Session;
+    typedef std::shared_ptr<Session> SessionPtr;
+
+    SessionPtr findSession(SessionId id) const;
+    void schedule(const SessionPtr& session);
+    void drain(const SessionPtr& session);
+    void processQueued(const SessionPtr& session);
+
+    const size_t max_queued_frames_;
+
+    mutable std::mutex sessions_mutex_;
+    std::map<SessionId, SessionPtr> sessions_;
+    SessionId next_id_;
+
+    // Declared last so workers are joined before sessions are torn down
+    WorkStealingPool pool_;
+
+    AecSessionManager(const AecSessionManager&);
+    AecSessionManager& operator=(const AecSessionManager&);
+};
+
+#endif // AECSESSIONMANAGER_H
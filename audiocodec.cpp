@@ -0,0 +1,487 @@
+#include "audiocodec.h"
+#include "audiopacket.h"
+#include "dtx.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define AUDIO_CODEC_SSE2 1
+#endif
+
+namespace {
+
+// G.711, scalar references (CCITT / Sun g711.c formulation)
+
+const int kUlawBias = 0x84;
+const int kUlawClip = 32635;
+
+inline uint8_t linearToUlaw(int16_t sample) {
+    int v = sample;
+    int sign = 0;
+    if (v < 0) {
+        v = -v;
+        sign = 0x80;
+    }
+    v = std::min(v, kUlawClip) + kUlawBias;
+    int exponent = 7;
+    for (int mask = 0x4000; !(v & mask) && exponent > 0; mask >>= 1) {
+        --exponent;
+    }
+    int mantissa = (v >> (exponent + 3)) & 0x0F;
+    return static_cast<uint8_t>(~(sign | (exponent << 4) | mantissa));
+}
+
+inline int16_t ulawToLinear(uint8_t code) {
+    int u = ~code & 0xFF;
+    int t = (((u & 0x0F) << 3) + kUlawBias) << ((u >> 4) & 0x07);
+    return static_cast<int16_t>((u & 0x80) ? kUlawBias - t : t - kUlawBias);
+}
+
+inline uint8_t linearToAlaw(int16_t sample) {
+    int v = sample >> 3;
+    int mask = 0xD5;
+    if (v < 0) {
+        v = -v - 1;
+        mask = 0x55;
+    }
+    int seg = 0;
+    while (seg < 8 && v >= (0x20 << seg)) {
+        ++seg;
+    }
+    int aval = seg << 4;
+    aval |= (seg < 2) ? ((v >> 1) & 0x0F) : ((v >> seg) & 0x0F);
+    return static_cast<uint8_t>(aval ^ mask);
+}
+
+inline int16_t alawToLinear(uint8_t code) {
+    int a = code ^ 0x55;
+    int t = (a & 0x0F) << 4;
+    int seg = (a & 0x70) >> 4;
+    if (seg == 0) {
+        t += 8;
+    } else {
+        t = (t + 0x108) << (seg - 1);
+    }
+    return static_cast<int16_t>((a & 0x80) ? t : -t);
+}
+
+#if AUDIO_CODEC_SSE2
+
+// The float exponent trick: an int32 converted to float has floor(log2(v))
+// in its exponent field and the bits right below the leading one at the top
+// of its mantissa. Shifting the float bits right by 19 yields
+// (exponent << 4) | top-4-mantissa-bits, which is exactly a G.711 segment
+// and step once the exponent bias is subtracted. No per-lane variable
+// shifts or leading-zero counts are needed.
+
+inline __m128i floatBitsTop(__m128i v32) {
+    return _mm_srli_epi32(_mm_castps_si128(_mm_cvtepi32_ps(v32)), 19);
+}
+
+// Builds 2^e for per-lane integer exponents 0..7 as floats
+inline __m128 pow2Sse2(__m128i e) {
+    return _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(e, _mm_set1_epi32(127)), 23));
+}
+
+// 8 int16 -> 8 codes in the low 8 bytes
+inline __m128i ulawEncode8(__m128i s) {
+    __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16);
+    __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16);
+    __m128i out[2];
+    __m128i in[2] = { lo, hi };
+    for (int k = 0; k < 2; ++k) {
+        __m128i v = in[k];
+        __m128i neg = _mm_srai_epi32(v, 31);
+        __m128i mag = _mm_sub_epi32(_mm_xor_si128(v, neg), neg);
+        __m128i clip = _mm_set1_epi32(kUlawClip);
+        __m128i over = _mm_cmpgt_epi32(mag, clip);
+        mag = _mm_or_si128(_mm_and_si128(over, clip), _mm_andnot_si128(over, mag));
+        mag = _mm_add_epi32(mag, _mm_set1_epi32(kUlawBias));
+        // biased value >= 0x84 so the float exponent is 7 + segment
+        __m128i code = _mm_sub_epi32(floatBitsTop(mag), _mm_set1_epi32((127 + 7) << 4));
+        code = _mm_or_si128(code, _mm_and_si128(neg, _mm_set1_epi32(0x80)));
+        out[k] = _mm_xor_si128(code, _mm_set1_epi32(0xFF));
+    }
+    __m128i packed = _mm_packs_epi32(out[0], out[1]);
+    return _mm_packus_epi16(packed, packed);
+}
+
+inline __m128i alawEncode8(__m128i s) {
+    __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16 + 3);
+    __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16 + 3);
+    __m128i out[2];
+    __m128i in[2] = { lo, hi };
+    for (int k = 0; k < 2; ++k) {
+        __m128i v = in[k];
+        __m128i neg = _mm_srai_epi32(v, 31);
+        v = _mm_xor_si128(v, neg); // -v - 1 for negatives
+        // Segments 1..7: exponent is 4 + segment; segment 0 is linear
+        __m128i high = _mm_sub_epi32(floatBitsTop(v), _mm_set1_epi32((127 + 4) << 4));
+        __m128i low = _mm_srli_epi32(v, 1);
+        __m128i small = _mm_cmplt_epi32(v, _mm_set1_epi32(32));
+        __m128i aval = _mm_or_si128(_mm_and_si128(small, low), _mm_andnot_si128(small, high));
+        __m128i mask = _mm_or_si128(_mm_and_si128(neg, _mm_set1_epi32(0x55)),
+                                    _mm_andnot_si128(neg, _mm_set1_epi32(0xD5)));
+        out[k] = _mm_xor_si128(aval, mask);
+    }
+    __m128i packed = _mm_packs_epi32(out[0], out[1]);
+    return _mm_packus_epi16(packed, packed);
+}
+
+// 4 codes (one per int32 lane) -> 4 int32 samples
+inline __m128i ulawDecode4(__m128i code) {
+    __m128i u = _mm_xor_si128(code, _mm_set1_epi32(0xFF));
+    __m128i mantissa = _mm_and_si128(u, _mm_set1_epi32(0x0F));
+    __m128i exponent = _mm_and_si128(_mm_srli_epi32(u, 4), _mm_set1_epi32(0x07));
+    __m128i base = _mm_add_epi32(_mm_slli_epi32(mantissa, 3), _mm_set1_epi32(kUlawBias));
+    // (base << exponent) is at most 32256, exact in float
+    __m128i t = _mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(base), pow2Sse2(exponent)));
+    t = _mm_sub_epi32(t, _mm_set1_epi32(kUlawBias));
+    __m128i neg = _mm_cmpeq_epi32(_mm_and_si128(u, _mm_set1_epi32(0x80)), _mm_set1_epi32(0x80));
+    return _mm_sub_epi32(_mm_xor_si128(t, neg), neg);
+}
+
+inline __m128i alawDecode4(__m128i code) {
+    __m128i a = _mm_xor_si128(code, _mm_set1_epi32(0x55));
+    __m128i t = _mm_slli_epi32(_mm_and_si128(a, _mm_set1_epi32(0x0F)), 4);
+    __m128i seg = _mm_and_si128(_mm_srli_epi32(a, 4), _mm_set1_epi32(0x07));
+    __m128i seg0 = _mm_cmpeq_epi32(seg, _mm_setzero_si128());
+    __m128i offset = _mm_or_si128(_mm_and_si128(seg0, _mm_set1_epi32(8)),
+                                  _mm_andnot_si128(seg0, _mm_set1_epi32(0x108)));
+    __m128i shift = _mm_andnot_si128(seg0, _mm_sub_epi32(seg, _mm_set1_epi32(1)));
+    t = _mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(_mm_add_epi32(t, offset)), pow2Sse2(shift)));
+    // Sign bit clear means negative in A-law
+    __m128i neg = _mm_cmpeq_epi32(_mm_and_si128(a, _mm_set1_epi32(0x80)), _mm_setzero_si128());
+    return _mm_sub_epi32(_mm_xor_si128(t, neg), neg);
+}
+
+typedef __m128i (*Encode8Fn)(__m128i);
+typedef __m128i (*Decode4Fn)(__m128i);
+
+template <Encode8Fn kernel, uint8_t (*scalar)(int16_t)>
+void encodeG711(const int16_t* src, size_t n, uint8_t* dst) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i codes = kernel(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + i), codes);
+    }
+    for (; i < n; ++i) {
+        dst[i] = scalar(src[i]);
+    }
+}
+
+template <Decode4Fn kernel, int16_t (*scalar)(uint8_t)>
+void decodeG711(const uint8_t* src, size_t n, int16_t* dst) {
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i));
+        __m128i words = _mm_unpacklo_epi8(bytes, zero);
+        __m128i lo = kernel(_mm_unpacklo_epi16(words, zero));
+        __m128i hi = kernel(_mm_unpackhi_epi16(words, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packs_epi32(lo, hi));
+    }
+    for (; i < n; ++i) {
+        dst[i] = scalar(src[i]);
+    }
+}
+
+void encodeUlaw(const int16_t* src, size_t n, uint8_t* dst) {
+    encodeG711<ulawEncode8, linearToUlaw>(src, n, dst);
+}
+void encodeAlaw(const int16_t* src, size_t n, uint8_t* dst) {
+    encodeG711<alawEncode8, linearToAlaw>(src, n, dst);
+}
+void decodeUlaw(const uint8_t* src, size_t n, int16_t* dst) {
+    decodeG711<ulawDecode4, ulawToLinear>(src, n, dst);
+}
+void decodeAlaw(const uint8_t* src, size_t n, int16_t* dst) {
+    decodeG711<alawDecode4, alawToLinear>(src, n, dst);
+}
+
+#else
+
+void encodeUlaw(const int16_t* src, size_t n, uint8_t* dst) {
+    for (size_t i = 0; i < n; ++i) dst[i] = linearToUlaw(src[i]);
+}
+void encodeAlaw(const int16_t* src, size_t n, uint8_t* dst) {
+    for (size_t i = 0; i < n; ++i) dst[i] = linearToAlaw(src[i]);
+}
+void decodeUlaw(const uint8_t* src, size_t n, int16_t* dst) {
+    for (size_t i = 0; i < n; ++i) dst[i] = ulawToLinear(src[i]);
+}
+void decodeAlaw(const uint8_t* src, size_t n, int16_t* dst) {
+    for (size_t i = 0; i < n; ++i) dst[i] = alawToLinear(src[i]);
+}
+
+#endif // AUDIO_CODEC_SSE2
+
+// IMA-ADPCM (IMA/DVI reference tables)
+
+const int kImaIndexTable[16] = {
+    -1, -1, -1, -1, 2, 4, 6, 8,
+    -1, -1, -1, -1, 2, 4, 6, 8
+};
+
+const int kImaStepTable[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+    253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+    1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+    3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442,
+    11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794,
+    32767
+};
+
+// Block layout per channel: first sample (int16 LE), step index, reserved
+// byte, then the remaining samples as 4-bit codes, low nibble first.
+const size_t kImaBlockHeaderBytes = 4;
+
+size_t imaBlockBytes(size_t samples) {
+    // samples - 1 codes, rounded up to whole bytes
+    return samples == 0 ? 0 : kImaBlockHeaderBytes + samples / 2;
+}
+
+inline int clampIndex(int index) {
+    return std::min(88, std::max(0, index));
+}
+
+// Applies |nibble| to the predictor; shared by encoder and decoder so both
+// reconstruct identically
+inline void imaStep(int nibble, int* predictor, int* index) {
+    int step = kImaStepTable[*index];
+    int diff = step >> 3;
+    if (nibble & 4) diff += step;
+    if (nibble & 2) diff += step >> 1;
+    if (nibble & 1) diff += step >> 2;
+    *predictor += (nibble & 8) ? -diff : diff;
+    *predictor = std::min(32767, std::max(-32768, *predictor));
+    *index = clampIndex(*index + kImaIndexTable[nibble]);
+}
+
+class PcmCodec : public AudioCodec {
+public:
+    uint8_t payloadType() const { return kPayloadPcm16; }
+    const char* name() const { return "pcm"; }
+    size_t encodedBytes(size_t samples, size_t channels) const {
+        return samples * channels * sizeof(int16_t);
+    }
+    size_t encode(const int16_t* pcm, size_t samples, size_t channels, uint8_t* out) {
+        const size_t bytes = encodedBytes(samples, channels);
+        memcpy(out, pcm, bytes); // host order is little-endian on all targets
+        return bytes;
+    }
+    bool decode(const uint8_t* data, size_t bytes, size_t samples, size_t channels, int16_t* pcm) {
+        if (bytes != encodedBytes(samples, channels)) {
+            return false;
+        }
+        memcpy(pcm, data, bytes);
+        return true;
+    }
+};
+
+class G711Codec : public AudioCodec {
+public:
+    explicit G711Codec(bool ulaw) : ulaw_(ulaw) {}
+
+    uint8_t payloadType() const { return ulaw_ ? kPayloadPcmu : kPayloadPcma; }
+    const char* name() const { return ulaw_ ? "pcmu" : "pcma"; }
+    size_t encodedBytes(size_t samples, size_t channels) const {
+        return samples * channels;
+    }
+    size_t encode(const int16_t* pcm, size_t samples, size_t channels, uint8_t* out) {
+        const size_t n = samples * channels;
+        if (ulaw_) {
+            encodeUlaw(pcm, n, out);
+        } else {
+            encodeAlaw(pcm, n, out);
+        }
+        return n;
+    }
+    bool decode(const uint8_t* data, size_t bytes, size_t samples, size_t channels, int16_t* pcm) {
+        const size_t n = samples * channels;
+        if (bytes != n) {
+            return false;
+        }
+        if (ulaw_) {
+            decodeUlaw(data, n, pcm);
+        } else {
+            decodeAlaw(data, n, pcm);
+        }
+        return true;
+    }
+
+private:
+    bool ulaw_;
+};
+
+class ImaAdpcmCodec : public AudioCodec {
+public:
+    ImaAdpcmCodec() { reset(); }
+
+    uint8_t payloadType() const { return kPayloadImaAdpcm; }
+    const char* name() const { return "adpcm"; }
+    size_t encodedBytes(size_t samples, size_t channels) const {
+        return imaBlockBytes(samples) * channels;
+    }
+    void reset() {
+        std::fill(index_, index_ + kMaxChannels, 0);
+    }
+
+    size_t encode(const int16_t* pcm, size_t samples, size_t channels, uint8_t* out) {
+        const size_t block = imaBlockBytes(samples);
+        for (size_t ch = 0; ch < channels; ++ch) {
+            uint8_t* dst = out + ch * block;
+            // The step index carries over from the previous frame so the
+            // quantiser does not re-adapt from scratch every 10 ms
+            int index = ch < kMaxChannels ? index_[ch] : 0;
+            int predictor = pcm[ch];
+            dst[0] = static_cast<uint8_t>(predictor & 0xFF);
+            dst[1] = static_cast<uint8_t>((predictor >> 8) & 0xFF);
+            dst[2] = static_cast<uint8_t>(index);
+            dst[3] = 0;
+
+            uint8_t* codes = dst + kImaBlockHeaderBytes;
+            for (size_t i = 1; i < samples; ++i) {
+                int diff = pcm[i * channels + ch] - predictor;
+                int nibble = 0;
+                if (diff < 0) {
+                    nibble = 8;
+                    diff = -diff;
+                }
+                int step = kImaStepTable[index];
+                if (diff >= step) { nibble |= 4; diff -= step; }
+                step >>= 1;
+                if (diff >= step) { nibble |= 2; diff -= step; }
+                step >>= 1;
+                if (diff >= step) { nibble |= 1; }
+                imaStep(nibble, &predictor, &index);
+
+                const size_t k = i - 1;
+                if (k & 1) {
+                    codes[k / 2] |= static_cast<uint8_t>(nibble << 4);
+                } else {
+                    codes[k / 2] = static_cast<uint8_t>(nibble);
+                }
+            }
+            if (ch < kMaxChannels) {
+                index_[ch] = index;
+            }
+        }
+        return block * channels;
+    }
+
+    bool decode(const uint8_t* data, size_t bytes, size_t samples, size_t channels, int16_t* pcm) {
+        const size_t block = imaBlockBytes(samples);
+        if (bytes != block * channels) {
+            return false;
+        }
+        for (size_t ch = 0; ch < channels; ++ch) {
+            const uint8_t* src = data + ch * block;
+            int predictor = static_cast<int16_t>(src[0] | (src[1] << 8));
+            int index = clampIndex(src[2]);
+            pcm[ch] = static_cast<int16_t>(predictor);
+
+            const uint8_t* codes = src + kImaBlockHeaderBytes;
+            for (size_t i = 1; i < samples; ++i) {
+                const size_t k = i - 1;
+                int nibble = (k & 1) ? (codes[k / 2] >> 4) : (codes[k / 2] & 0x0F);
+                imaStep(nibble, &predictor, &index);
+                pcm[i * channels + ch] = static_cast<int16_t>(predictor);
+            }
+        }
+        return true;
+    }
+
+private:
+    static const size_t kMaxChannels = 8;
+    int index_[kMaxChannels];
+};
+
+const uint8_t kPreference[] = { kPayloadImaAdpcm, kPayloadPcmu, kPayloadPcma, kPayloadPcm16 };
+
+} // namespace
+
+std::unique_ptr<AudioCodec> createAudioCodec(uint8_t payload_type) {
+    switch (payload_type) {
+    case kPayloadPcm16:
+        return std::unique_ptr<AudioCodec>(new PcmCodec());
+    case kPayloadPcmu:
+        return std::unique_ptr<AudioCodec>(new G711Codec(true));
+    case kPayloadPcma:
+        return std::unique_ptr<AudioCodec>(new G711Codec(false));
+    case kPayloadImaAdpcm:
+        return std::unique_ptr<AudioCodec>(new ImaAdpcmCodec());
+    default:
+        return std::unique_ptr<AudioCodec>();
+    }
+}
+
+size_t audioCodecFrameBytes(uint8_t payload_type, size_t samples_per_channel, size_t channels) {
+    switch (payload_type) {
+    case kPayloadPcm16:
+        return samples_per_channel * channels * sizeof(int16_t);
+    case kPayloadPcmu:
+    case kPayloadPcma:
+        return samples_per_channel * channels;
+    case kPayloadImaAdpcm:
+        return imaBlockBytes(samples_per_channel) * channels;
+    case kPayloadComfortNoise:
+        return kSidBytes;
+    default:
+        return 0;
+    }
+}
+
+const char* audioCodecName(uint8_t payload_type) {
+    switch (payload_type) {
+    case kPayloadPcm16: return "pcm";
+    case kPayloadPcmu: return "pcmu";
+    case kPayloadPcma: return "pcma";
+    case kPayloadImaAdpcm: return "adpcm";
+    case kPayloadComfortNoise: return "cn";
+    default: return "unknown";
+    }
+}
+
+bool audioCodecFromName(const std::string& name, uint8_t* payload_type) {
+    for (size_t i = 0; i < sizeof(kPreference); ++i) {
+        if (name == audioCodecName(kPreference[i])) {
+            *payload_type = kPreference[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+const uint8_t* audioCodecPreference(size_t* count) {
+    *count = sizeof(kPreference);
+    return kPreference;
+}
+
+std::vector<std::string> audioCodecOffer(uint8_t preferred) {
+    std::vector<std::string> offer;
+    offer.push_back(audioCodecName(preferred));
+    for (size_t i = 0; i < sizeof(kPreference); ++i) {
+        if (kPreference[i] != preferred) {
+            offer.push_back(audioCodecName(kPreference[i]));
+        }
+    }
+    // Not a codec to send with, but tells the peer it may use DTX
+    offer.push_back(audioCodecName(kPayloadComfortNoise));
+    return offer;
+}
+
+uint8_t audioCodecNegotiate(uint8_t preferred, const std::vector<std::string>& peer_offer) {
+    if (std::find(peer_offer.begin(), peer_offer.end(), audioCodecName(preferred)) != peer_offer.end()) {
+        return preferred;
+    }
+    for (size_t i = 0; i < sizeof(kPreference); ++i) {
+        if (std::find(peer_offer.begin(), peer_offer.end(), audioCodecName(kPreference[i])) != peer_offer.end()) {
+            return kPreference[i];
+        }
+    }
+    return kPayloadPcm16;
+}
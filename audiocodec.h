@@ -0,0 +1,77 @@
+#ifndef AUDIOCODEC_H
+#define AUDIOCODEC_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Frame codecs for the WebSocket transport.
+//
+// A codec turns one 10 ms frame of interleaved int16 into a fixed number of
+// bytes and back. Every encoded frame decodes on its own, so frames can be
+// split out of a batch, reordered and lost independently. The codec is
+// identified on the wire by the packet's payload_type (AudioPayloadType in
+// audiopacket.h).
+//
+// Built in:
+//   pcm    16-bit PCM, 768 kbit/s at 48 kHz mono
+//   pcmu   G.711 mu-law, 2:1
+//   pcma   G.711 A-law, 2:1
+//   adpcm  IMA-ADPCM, ~3.9:1; each frame carries its own predictor state
+//
+// The G.711 kernels have SSE2 paths that are bit-exact with the scalar
+// reference. IMA-ADPCM is inherently sequential and stays scalar.
+//
+// A variable-rate codec can be added by implementing AudioCodec, but will
+// need per-frame lengths in the packet, i.e. a new packet version.
+class AudioCodec {
+public:
+    virtual ~AudioCodec() {}
+
+    virtual uint8_t payloadType() const = 0;
+    virtual const char* name() const = 0;
+
+    // Bytes of one encoded frame
+    virtual size_t encodedBytes(size_t samples_per_channel, size_t channels) const = 0;
+
+    // Encodes one interleaved frame into encodedBytes() bytes at |out| and
+    // returns that count.
+    virtual size_t encode(const int16_t* pcm, size_t samples_per_channel, size_t channels,
+                          uint8_t* out) = 0;
+
+    // Decodes one frame produced by encode(). Returns false, leaving |pcm|
+    // untouched, if |bytes| does not match encodedBytes().
+    virtual bool decode(const uint8_t* data, size_t bytes, size_t samples_per_channel,
+                        size_t channels, int16_t* pcm) = 0;
+
+    // Forgets state carried between frames (encoder adaptation only)
+    virtual void reset() {}
+};
+
+// New codec for |payload_type|, or nullptr if it is not supported. Comfort
+// noise is not a codec: its frame size is kSidBytes, but it is decoded by
+// the jitter buffer (see dtx.h).
+std::unique_ptr<AudioCodec> createAudioCodec(uint8_t payload_type);
+
+// Encoded frame size for |payload_type|; 0 if it is not supported.
+size_t audioCodecFrameBytes(uint8_t payload_type, size_t samples_per_channel, size_t channels);
+
+// Short names ("pcm", "pcmu", "pcma", "adpcm", "cn") used in negotiation and
+// UI.
+// audioCodecFromName() returns false for unknown names.
+const char* audioCodecName(uint8_t payload_type);
+bool audioCodecFromName(const std::string& name, uint8_t* payload_type);
+
+// Supported payload types, most compact first; the order senders prefer.
+const uint8_t* audioCodecPreference(size_t* count);
+
+// Negotiation. A side offers the names of every codec it can decode,
+// |preferred| first, and "cn" last if it accepts comfort noise. The sender
+// then picks |preferred| if the peer offered it, else the most compact codec
+// in both lists, else PCM.
+std::vector<std::string> audioCodecOffer(uint8_t preferred);
+uint8_t audioCodecNegotiate(uint8_t preferred, const std::vector<std::string>& peer_offer);
+
+#endif // AUDIOCODEC_H
@@ -1,42 +1,222 @@
 #include "audiocontroller.h"
+#include "codecnegotiation.h"
 #include <QDebug>
 #include <QHostAddress>
+#include <QThread>
+#include <algorithm>
 
 AudioController::AudioController(QObject *parent)
     : QObject(parent)
-    , audioInput_(nullptr)
-    , audioOutput_(nullptr)
-    , inputDevice_(nullptr)
-    , outputDevice_(nullptr)
-    , audioTimer_(new QTimer(this))
+    , engineThread_(new QThread(this))
+    , engine_(nullptr)
+    , realtimePriority_(0)
+    , driftCompensation_(true)
+    , farDelayFrames_(3)
+    , processedData_(static_cast<int>(kAudioPacketHeaderBytes) + kMaxFramesPerPacket * kFrameBytes, '\0')
+    , framesPerPacket_(1)
+    , batchedFrames_(0)
+    , framePool_(kFrameSamples, kFramePoolFrames)
+    , jitterBuffer_(kFrameSamples, 48000)
+    , jitterStats_(jitterBuffer_.stats())
+    , txSequence_(0)
+    , txTimestamp_(0)
+    , rxLegacySequence_(0)
+    , packetsRejected_(0)
+    , preferredPayload_(kPayloadImaAdpcm)
+    , negotiatedPayload_(kPayloadPcm16)
+    , rxFrame_(kMaxNetworkRate / 100, 0)
+    , dtx_(true)
+    , peerComfortNoise_(false)
+    , dtxEncoder_(kFrameSamples)
+    , farRing_(kFrameSamples, 16)
+    , sendRing_(kFrameSamples, 32)
+    , farQueueDepth_(16)
+    , framesSinceStats_(0)
     , server_(nullptr)
     , clientSocket_(nullptr)
+    , conference_(nullptr)
+    , conferenceMode_(false)
+    , prewarmedProcessors_(4)
+    , metricsServer_(nullptr)
+    , metricsPort_(0)
     , mode_(ServerMode)
     , isConnected_(false)
     , serverPort_(8080)
     , audioInitialized_(false)
+    , timeToFirstFrameMs_(-1)
+    , enableAEC_(true)
+    , aecLevel_(2)
+    , noiseSuppressionLevel_(1)
+    , agcMode_(WebrtcAEC3::AGC_MODE_ADAPTIVE_DIGITAL)
 {
     setStatusMessage("Ready");
 
     // Initialize WebRTC processor
     processor_.setConfig(WebrtcAEC3::SAMPLE_RATE, ConfigValue(48000));
-    processor_.setConfig(WebrtcAEC3::ENABLE_AEC, ConfigValue(true));
-    processor_.setConfig(WebrtcAEC3::AEC_LEVEL, ConfigValue(2));
+    processor_.setConfig(WebrtcAEC3::ENABLE_AEC, ConfigValue(enableAEC_));
+    processor_.setConfig(WebrtcAEC3::AEC_LEVEL, ConfigValue(aecLevel_));
     processor_.setConfig(WebrtcAEC3::ENABLE_AGC, ConfigValue(true));
-    processor_.setConfig(WebrtcAEC3::SYSTEM_DELAY_MS, ConfigValue(8));
+    processor_.setConfig(WebrtcAEC3::AGC_MODE, ConfigValue(agcMode_));
+    processor_.setConfig(WebrtcAEC3::SYSTEM_DELAY_MS, ConfigValue(8)); // initial guess, tracked at runtime
     processor_.setConfig(WebrtcAEC3::ENABLE_HP_FILTER, ConfigValue(true));
     processor_.setConfig(WebrtcAEC3::AEC_DELAY_AGNOSTIC, ConfigValue(false));
     processor_.setConfig(WebrtcAEC3::AEC_EXTENDED_FILTER, ConfigValue(false));
-    processor_.setConfig(WebrtcAEC3::ENABLE_VOICE_DETECTION, ConfigValue(false));
-    processor_.setConfig(WebrtcAEC3::NOISE_SUPPRESSION_LEVEL, ConfigValue(1));
+    processor_.setConfig(WebrtcAEC3::ENABLE_VOICE_DETECTION, ConfigValue(dtx_)); // drives DTX
+    processor_.setConfig(WebrtcAEC3::NOISE_SUPPRESSION_LEVEL, ConfigValue(noiseSuppressionLevel_));
     processor_.setConfig(WebrtcAEC3::ENABLE_TRANSIENT_SUPPRESSION, ConfigValue(false));
 
-    connect(audioTimer_, &QTimer::timeout, this, &AudioController::processAudio);
+    // Capture and AEC run on their own thread, away from QML rendering
+    engine_ = new AudioEngine(&processor_, &framePool_, &jitterBuffer_, &farRing_, &sendRing_);
+    engine_->moveToThread(engineThread_);
+    connect(engineThread_, &QThread::finished, engine_, &QObject::deleteLater);
+    connect(engine_, &AudioEngine::framesReady, this, &AudioController::sendProcessedFrames);
+    connect(engine_, &AudioEngine::failed, this, &AudioController::onEngineFailed);
+    connect(engine_, &AudioEngine::delayEstimateChanged, this, &AudioController::delayEstimateChanged);
+    engineThread_->start(QThread::TimeCriticalPriority);
+
+    // The collector lives in the engine and is only ever read from here
+    metrics_ = engine_->metrics().snapshot();
+    metricsServer_ = new MetricsServer(&engine_->metrics(), this);
 }
 
 AudioController::~AudioController() {
+    // Reads the engine's collector; stop serving before the engine goes
+    delete metricsServer_;
+    metricsServer_ = nullptr;
+    stopRecording();
     cleanupAudio();
     cleanupNetwork();
+
+    engineThread_->quit();
+    engineThread_->wait();
+}
+
+void AudioController::setRealtimePriority(int priority) {
+    priority = qBound(0, priority, 99);
+    if (realtimePriority_ != priority) {
+        realtimePriority_ = priority;
+        emit realtimePriorityChanged();
+    }
+}
+
+void AudioController::setDriftCompensation(bool enabled) {
+    if (driftCompensation_ != enabled) {
+        driftCompensation_ = enabled;
+        emit driftCompensationChanged();
+    }
+}
+
+quint64 AudioController::deadlineMisses() const {
+    return engine_->deadlineMisses();
+}
+
+int AudioController::captureBacklog() const {
+    return engine_->lastBacklogFrames();
+}
+
+int AudioController::maxCaptureBacklog() const {
+    return engine_->maxBacklogFrames();
+}
+
+void AudioController::setAutoDelay(bool enabled) {
+    if (engine_->autoDelay() != enabled) {
+        engine_->setAutoDelay(enabled);
+        emit autoDelayChanged();
+    }
+}
+
+bool AudioController::applyProcessorConfig(int configId, ConfigValue value) {
+    // Queued by the processor and applied on the engine thread at the next
+    // frame boundary, so this is safe mid-call
+    try {
+        processor_.setConfig(configId, value);
+    } catch (const std::exception &e) {
+        qWarning() << "Rejected processor setting" << configId << ":" << e.what();
+        return false;
+    }
+    return true;
+}
+
+void AudioController::setEnableAEC(bool value) {
+    if (enableAEC_ != value && applyProcessorConfig(WebrtcAEC3::ENABLE_AEC, ConfigValue(value))) {
+        enableAEC_ = value;
+        emit enableAECChanged();
+    }
+}
+
+void AudioController::setAecLevel(int level) {
+    if (aecLevel_ != level && applyProcessorConfig(WebrtcAEC3::AEC_LEVEL, ConfigValue(level))) {
+        aecLevel_ = level;
+        emit aecLevelChanged();
+    }
+}
+
+void AudioController::setNoiseSuppressionLevel(int level) {
+    if (noiseSuppressionLevel_ != level
+        && applyProcessorConfig(WebrtcAEC3::NOISE_SUPPRESSION_LEVEL, ConfigValue(level))) {
+        noiseSuppressionLevel_ = level;
+        emit noiseSuppressionLevelChanged();
+    }
+}
+
+void AudioController::setAgcMode(int mode) {
+    if (agcMode_ != mode && applyProcessorConfig(WebrtcAEC3::AGC_MODE, ConfigValue(mode))) {
+        agcMode_ = mode;
+        emit agcModeChanged();
+    }
+}
+
+bool AudioController::setProcessorConfig(int configId, ConfigValue value) {
+    // A value of the wrong type falls through to the processor, which
+    // rejects it with the usual message
+    switch (configId) {
+    case WebrtcAEC3::ENABLE_AEC:
+        if (value.type == ConfigValue::BOOL) {
+            setEnableAEC(value.bool_val);
+            return enableAEC_ == value.bool_val;
+        }
+        break;
+    case WebrtcAEC3::AEC_LEVEL:
+        if (value.type == ConfigValue::INT) {
+            setAecLevel(value.int_val);
+            return aecLevel_ == value.int_val;
+        }
+        break;
+    case WebrtcAEC3::NOISE_SUPPRESSION_LEVEL:
+        if (value.type == ConfigValue::INT) {
+            setNoiseSuppressionLevel(value.int_val);
+            return noiseSuppressionLevel_ == value.int_val;
+        }
+        break;
+    case WebrtcAEC3::AGC_MODE:
+        if (value.type == ConfigValue::INT) {
+            setAgcMode(value.int_val);
+            return agcMode_ == value.int_val;
+        }
+        break;
+    case WebrtcAEC3::CAPTURE_CHANNELS:
+    case WebrtcAEC3::RENDER_CHANNELS:
+        if (value.type == ConfigValue::INT && value.int_val != 1) {
+            qWarning() << "Rejected processor setting" << configId << ": the audio engine is mono";
+            return false;
+        }
+        break;
+    default:
+        break;
+    }
+    return applyProcessorConfig(configId, value);
+}
+
+void AudioController::setDtx(bool enabled) {
+    if (dtx_ == enabled
+        || !applyProcessorConfig(WebrtcAEC3::ENABLE_VOICE_DETECTION, ConfigValue(enabled))) {
+        return;
+    }
+    // Back to plain frames at once; the peer leaves comfort noise on the
+    // first one
+    dtx_ = enabled;
+    dtxEncoder_.reset();
+    emit dtxChanged();
 }
 
 void AudioController::setServerPort(int port) {
@@ -46,6 +226,89 @@ void AudioController::setServerPort(int port) {
     }
 }
 
+void AudioController::setMetricsPort(int port) {
+    port = qBound(0, port, 65535);
+    if (metricsPort_ == port) {
+        return;
+    }
+    metricsPort_ = port;
+    if (port == 0) {
+        metricsServer_->close();
+    } else if (!metricsServer_->listen(static_cast<quint16>(port))) {
+        setStatusMessage("Metrics endpoint failed: " + metricsServer_->errorString());
+    }
+    emit metricsPortChanged();
+}
+
+void AudioController::startRecording(const QString &path) {
+    stopRecording();
+    try {
+        recorder_.open(path.toStdString());
+    } catch (const std::exception &e) {
+        setStatusMessage(QString("Recording failed: %1").arg(e.what()));
+        return;
+    }
+    processor_.setRecorder(&recorder_);
+    qDebug() << "Recording AEC session to" << path;
+    emit recordingChanged();
+}
+
+void AudioController::stopRecording() {
+    if (!recorder_.isOpen()) {
+        return;
+    }
+    processor_.setRecorder(nullptr);
+    recorder_.close();
+    qDebug() << "Recording stopped. Frames:" << recorder_.framesRecorded()
+             << "dropped:" << recorder_.framesDropped()
+             << "bytes:" << recorder_.bytesWritten();
+    emit recordingChanged();
+}
+
+void AudioController::setFarQueueDepth(int frames) {
+    // Room for the delayed reference plus the frame just played
+    frames = qMax(frames, farDelayFrames_ + 1);
+    if (farQueueDepth_ != frames) {
+        farQueueDepth_ = frames;
+        emit farQueueDepthChanged();
+    }
+}
+
+void AudioController::setFramesPerPacket(int frames) {
+    frames = qBound(1, frames, static_cast<int>(kMaxFramesPerPacket));
+    if (framesPerPacket_ != frames) {
+        framesPerPacket_ = frames;
+        emit framesPerPacketChanged();
+    }
+}
+
+void AudioController::setPreferredCodec(const QString &name) {
+    uint8_t payload;
+    if (!audioCodecFromName(name.toStdString(), &payload)) {
+        qWarning() << "Unknown codec" << name;
+        return;
+    }
+    if (preferredPayload_ != payload) {
+        preferredPayload_ = payload;
+        emit preferredCodecChanged();
+    }
+}
+
+void AudioController::setConferenceMode(bool enabled) {
+    if (conferenceMode_ != enabled) {
+        conferenceMode_ = enabled;
+        emit conferenceModeChanged();
+    }
+}
+
+void AudioController::setPrewarmedProcessors(int count) {
+    count = qBound(0, count, 1000);
+    if (prewarmedProcessors_ != count) {
+        prewarmedProcessors_ = count;
+        emit prewarmedProcessorsChanged();
+    }
+}
+
 void AudioController::setMode(int mode) {
     if (mode_ != static_cast<Mode>(mode)) {
         mode_ = static_cast<Mode>(mode);
@@ -66,6 +329,11 @@ void AudioController::startServer() {
 
     cleanupNetwork();
 
+    if (conferenceMode_) {
+        startConference();
+        return;
+    }
+
     server_ = new QWebSocketServer(QStringLiteral("AudioServer"),
                                    QWebSocketServer::NonSecureMode, this);
 
@@ -83,6 +351,28 @@ void AudioController::startServer() {
     }
 }
 
+void AudioController::startConference() {
+    // Every participant gets the same processing as the local processor;
+    // the mixer substitutes its own SAMPLE_RATE
+    ConferenceMixer::ParticipantConfig config;
+    for (int id = 0; id < WebrtcAEC3::NUM_CONFIG_IDS; ++id) {
+        config.push_back(std::make_pair(id, processor_.getConfig(id)));
+    }
+
+    conference_ = new ConferenceServer(config, preferredPayload_, this);
+    if (conference_->listen(serverPort_)) {
+        connect(conference_, &ConferenceServer::participantCountChanged,
+                this, &AudioController::participantCountChanged);
+        conference_->reserveProcessors(prewarmedProcessors_);
+        setStatusMessage(QString("Conference listening on port %1").arg(serverPort_));
+    } else {
+        setStatusMessage("Failed to start conference");
+        qDebug() << "Conference failed to start:" << conference_->errorString();
+        delete conference_;
+        conference_ = nullptr;
+    }
+}
+
 void AudioController::connectToServer(const QString &serverAddress) {
     if (mode_ != ClientMode) {
         setStatusMessage("Error: Not in client mode");
@@ -101,6 +391,8 @@ void AudioController::connectToServer(const QString &serverAddress) {
             this, &AudioController::onWebSocketError);
     connect(clientSocket_, &QWebSocket::binaryMessageReceived,
             this, &AudioController::onBinaryMessageReceived);
+    connect(clientSocket_, &QWebSocket::textMessageReceived,
+            this, &AudioController::onTextMessageReceived);
 
     QString url = QString("ws://%1:%2").arg(serverAddress).arg(serverPort_);
     setStatusMessage("Connecting...");
@@ -171,6 +463,8 @@ void AudioController::onNewConnection() {
 
     connect(socket, &QWebSocket::binaryMessageReceived,
             this, &AudioController::onBinaryMessageReceived);
+    connect(socket, &QWebSocket::textMessageReceived,
+            this, &AudioController::onTextMessageReceived);
 
     connectedClients_.append(socket);
 
@@ -180,6 +474,7 @@ void AudioController::onNewConnection() {
         emit connectionStatusChanged();
         setStatusMessage("Client connected");
     }
+    sendHello(socket);
 
     qDebug() << "Client connected from" << socket->peerAddress().toString();
 }
@@ -189,6 +484,7 @@ void AudioController::onNewConnection() {
 
 void AudioController::onWebSocketConnected() {
     initializeAudio();
+    sendHello(clientSocket_);
     isConnected_ = true;
     emit connectionStatusChanged();
     setStatusMessage("Connected to server");
@@ -209,31 +505,106 @@ void AudioController::onWebSocketError(QAbstractSocket::SocketError error) {
 }
 
 void AudioController::onBinaryMessageReceived(const QByteArray &message) {
-    if (!audioInitialized_ || !outputDevice_) {
+    if (!audioInitialized_) {
+        return;
+    }
+
+    // Received audio data from remote peer; the engine plays it out of the
+    // jitter buffer and uses it as the "far" echo reference
+    const uint8_t *data = reinterpret_cast<const uint8_t *>(message.constData());
+    if (message.size() == kFrameBytes) { // legacy: bare 10ms mono PCM
+        quint32 seq = rxLegacySequence_++;
+        jitterBuffer_.insert(seq, seq * kFrameSamples, reinterpret_cast<const int16_t *>(data));
         return;
     }
 
-    // Received audio data from remote peer - play it as "far" audio
-    if (message.size() == 480 * 2) { // 10ms mono PCM
-        // Convert to int16_t vector for far buffer
-        std::vector<int16_t> farAudio(480);
-        memcpy(farAudio.data(), message.constData(), message.size());
+    AudioPacketHeader header;
+    const uint8_t *payload = nullptr;
+    if (!parseAudioPacket(data, message.size(), &header, &payload)
+        || header.channels != 1
+        || header.sample_rate > static_cast<uint32_t>(kMaxNetworkRate)) {
+        if (packetsRejected_++ == 0) {
+            qWarning() << "Rejecting audio message of" << message.size() << "bytes";
+        }
+        return;
+    }
+
+    // A silence descriptor stands in for one frame; the jitter buffer turns
+    // it into comfort noise at our rate
+    if (header.payload_type == kPayloadComfortNoise) {
+        const uint32_t timestamp = static_cast<int>(header.sample_rate) == AudioEngine::kPipelineRate
+                                   ? header.timestamp : header.sequence * kFrameSamples;
+        jitterBuffer_.insertSid(header.sequence, timestamp, payload, header.frameBytes());
+        return;
+    }
+
+    // Any codec we know may arrive regardless of what we send with
+    if (!rxCodec_ || rxCodec_->payloadType() != header.payload_type) {
+        rxCodec_ = createAudioCodec(header.payload_type);
+    }
+
+    // Peers at another rate are converted to ours before the jitter buffer
+    const int rate = static_cast<int>(header.sample_rate);
+    if (rate != AudioEngine::kPipelineRate && (!rxResampler_ || rxResampler_->inRate() != rate)) {
+        rxResampler_.reset(new Resampler(rate, AudioEngine::kPipelineRate, kMaxNetworkRate / 100));
+        qDebug() << "Resampling received audio from" << rate << "Hz";
+    }
 
-        // Add to far buffer queue for echo cancellation
-        farBufferQueue_.enqueue(farAudio);
-        if (farBufferQueue_.size() > farDelayFrames_) {
-            farBufferQueue_.dequeue();
+    // Split the batch; frame i carries sequence + i
+    // Each frame is decoded (or resampled) straight into a pooled frame
+    // that the jitter buffer, playout and echo reference then share
+    const size_t frameSamples = header.frameSamples();
+    const size_t frameBytes = header.frameBytes();
+    for (int i = 0; i < header.frame_count; ++i) {
+        FrameRef frame = framePool_.acquire();
+        if (frame.isNull()) {
+            // Pool exhausted (counted there); the jitter buffer conceals
+            // the missing frame like a lost one
+            continue;
+        }
+        if (rate == AudioEngine::kPipelineRate) {
+            rxCodec_->decode(payload + i * frameBytes, frameBytes, frameSamples, 1, frame.data());
+            jitterBuffer_.insert(header.sequence + i,
+                                 header.timestamp + i * kFrameSamples,
+                                 std::move(frame));
+        } else {
+            // Every frame is 10ms, so the sequence number gives the
+            // timestamp at our rate
+            rxCodec_->decode(payload + i * frameBytes, frameBytes, frameSamples, 1, rxFrame_.data());
+            rxResampler_->process(rxFrame_.data(), frameSamples, frame.data());
+            jitterBuffer_.insert(header.sequence + i,
+                                 (header.sequence + i) * kFrameSamples,
+                                 std::move(frame));
         }
+    }
+}
 
-        // Play the received audio
-        outputDevice_->write(message);
+void AudioController::onTextMessageReceived(const QString &message) {
+    uint8_t chosen;
+    bool comfortNoise = false;
+    if (!parseCodecHello(message, preferredPayload_, &chosen, &comfortNoise)) {
+        return;
+    }
+
+    qDebug() << "Peer hello received, sending with" << audioCodecName(chosen)
+             << (comfortNoise ? "with DTX" : "without DTX");
+    peerComfortNoise_ = comfortNoise;
+    if (negotiatedPayload_ != chosen) {
+        negotiatedPayload_ = chosen;
+        emit activeCodecChanged();
     }
 }
 
+void AudioController::sendHello(QWebSocket *socket) {
+    socket->sendTextMessage(codecHelloMessage(preferredPayload_));
+}
+
 void AudioController::initializeAudio() {
     if (audioInitialized_) {
         return;
     }
+    setupTimer_.start();
+    timeToFirstFrameMs_ = -1;
 
     // Audio format config
     QAudioFormat format;
@@ -257,22 +628,52 @@ void AudioController::initializeAudio() {
         format = outputInfo.nearestFormat(format);
     }
 
-    audioInput_ = new QAudioInput(inputInfo, format, this);
-    audioOutput_ = new QAudioOutput(outputInfo, format, this);
-
-    inputDevice_ = audioInput_->start();
-    outputDevice_ = audioOutput_->start();
+    // Resize the far ring while nothing is using it
+    if (farRing_.capacity() != static_cast<size_t>(farQueueDepth_)) {
+        farRing_.reset(kFrameSamples, farQueueDepth_);
+    } else {
+        farRing_.clear();
+    }
+    sendRing_.clear();
+    jitterBuffer_.reset();
+    txSequence_ = 0;
+    txTimestamp_ = 0;
+    rxLegacySequence_ = 0;
+    rxResampler_.reset();
+    packetsRejected_ = 0;
+    batchedFrames_ = 0;
+    peerComfortNoise_ = false;
+    dtxEncoder_.reset();
+    // PCM until the peer's hello says otherwise
+    if (negotiatedPayload_ != kPayloadPcm16) {
+        negotiatedPayload_ = kPayloadPcm16;
+        emit activeCodecChanged();
+    }
+    framesSinceStats_ = 0;
 
-    // Start WebRTC processor
+    // Start WebRTC processor, then hand capture and playout to the engine
+    // thread. The engine is idle here, so configuring it from this thread is
+    // safe. After the first call the processor is only reset: its settings
+    // are current, and rebuilding AudioProcessing would just slow setup.
     try {
-        processor_.start();
-        audioTimer_->start(10); // Every 10ms
-        audioInitialized_ = true;
-        qDebug() << "Audio initialized successfully";
+        if (processor_.isStarted()) {
+            processor_.reset();
+        } else {
+            processor_.start();
+        }
     } catch (const std::exception &e) {
         qWarning() << "Failed to start audio processor:" << e.what();
-        cleanupAudio();
+        return;
     }
+
+    engine_->setDevices(inputInfo, outputInfo, format);
+    engine_->setFarDelayFrames(qMin(farDelayFrames_, static_cast<int>(farRing_.capacity()) - 1));
+    engine_->setRealtimePriority(realtimePriority_);
+    engine_->setDriftCompensation(driftCompensation_);
+    QMetaObject::invokeMethod(engine_, "start", Qt::QueuedConnection);
+
+    audioInitialized_ = true;
+    qDebug() << "Audio initialized successfully";
 }
 
 void AudioController::cleanupAudio() {
@@ -280,29 +681,47 @@ void AudioController::cleanupAudio() {
         return;
     }
 
-    audioTimer_->stop();
-
-    if (audioInput_) {
-        audioInput_->stop();
-        audioInput_->deleteLater();
-        audioInput_ = nullptr;
-    }
+    // Wait for the engine so the rings and processor are idle afterwards
+    QMetaObject::invokeMethod(engine_, "stop", Qt::BlockingQueuedConnection);
+    // Start the next session from the delay the estimator converged to
+    farDelayFrames_ = engine_->farDelayFrames();
+    audioInitialized_ = false;
 
-    if (audioOutput_) {
-        audioOutput_->stop();
-        audioOutput_->deleteLater();
-        audioOutput_ = nullptr;
-    }
+    qDebug() << "Audio cleaned up. Far queue overruns:" << farRing_.overruns()
+             << "underruns:" << farRing_.underruns()
+             << "discarded:" << farRing_.discarded();
+    emitStats();
+    qDebug() << "Jitter buffer late:" << jitterStats_.late
+             << "lost:" << jitterStats_.lost
+             << "discarded:" << jitterStats_.discarded
+             << "underruns:" << jitterStats_.underruns;
+    const FramePool::Stats pool = framePool_.stats();
+    qDebug() << "Frame pool capacity:" << pool.capacity
+             << "high water:" << pool.high_water
+             << "exhausted:" << pool.exhausted;
+}
 
-    inputDevice_ = nullptr;
-    outputDevice_ = nullptr;
-    farBufferQueue_.clear();
-    audioInitialized_ = false;
+void AudioController::emitStats() {
+    jitterStats_ = jitterBuffer_.stats();
+    emit farQueueStatsChanged();
+    emit audioStatsChanged();
+    emit jitterStatsChanged();
+    metrics_ = engine_->metrics().snapshot();
+    emit metricsChanged();
+}
 
-    qDebug() << "Audio cleaned up";
+void AudioController::onEngineFailed(const QString &reason) {
+    setStatusMessage(reason);
+    cleanupAudio();
 }
 
 void AudioController::cleanupNetwork() {
+    if (conference_) {
+        delete conference_;
+        conference_ = nullptr;
+        emit participantCountChanged();
+    }
+
     if (server_) {
         server_->close();
         for (QWebSocket *client : connectedClients_) {
@@ -327,39 +746,97 @@ void AudioController::setStatusMessage(const QString &message) {
     }
 }
 
-void AudioController::processAudio() {
-    if (!audioInitialized_ || !inputDevice_ || !isConnected_) {
-        return;
-    }
+void AudioController::sendProcessedFrames() {
+    // Re-arm the engine's notification before draining so a frame pushed
+    // while we are in this loop raises a new framesReady()
+    engine_->acknowledgeFrames();
 
-    const int frameSize = 480 * 2; // 10ms mono PCM
-    if (audioInput_->bytesReady() >= frameSize) {
-        QByteArray rawData = inputDevice_->read(frameSize);
+    if (timeToFirstFrameMs_ < 0 && audioInitialized_ && sendRing_.front()) {
+        timeToFirstFrameMs_ = static_cast<int>(setupTimer_.elapsed());
+        qDebug() << "First processed frame" << timeToFirstFrameMs_ << "ms after audio setup began";
+        emit audioStatsChanged();
+    }
 
-        // Convert to int16_t vector
-        std::vector<int16_t> near(frameSize / 2);
-        memcpy(near.data(), rawData.constData(), frameSize);
+    while (const int16_t *frame = sendRing_.front()) {
+        DtxEncoder::Decision decision = DtxEncoder::kSendSpeech;
+        if (dtx_ && peerComfortNoise_) {
+            decision = dtxEncoder_.process(frame, (sendRing_.frontFlags() & AudioEngine::kFrameVoice) != 0);
+        }
 
-        // Get far buffer for echo cancellation
-        std::vector<int16_t> far;
-        if (farBufferQueue_.size() >= farDelayFrames_) {
-            far = farBufferQueue_.dequeue();
+        if (decision != DtxEncoder::kSendSpeech) {
+            // A batch only holds consecutive frames, so close it first. The
+            // skipped frame keeps its sequence number: the peer sees a DTX
+            // gap, not loss.
+            flushBatch();
+            if (decision == DtxEncoder::kSendSid) {
+                sendSid(dtxEncoder_.sid());
+            }
+            ++txSequence_;
+            txTimestamp_ += kFrameSamples;
+            sendRing_.pop();
         } else {
-            far.resize(near.size(), 0); // fallback to zero
+            if (batchedFrames_ == 0 && (!txCodec_ || txCodec_->payloadType() != negotiatedPayload_)) {
+                txCodec_ = createAudioCodec(negotiatedPayload_);
+            }
+            const int encodedBytes = static_cast<int>(txCodec_->encodedBytes(kFrameSamples, 1));
+            uint8_t *dst = reinterpret_cast<uint8_t *>(processedData_.data())
+                           + kAudioPacketHeaderBytes + batchedFrames_ * encodedBytes;
+            txCodec_->encode(frame, kFrameSamples, 1, dst);
+            sendRing_.pop();
+
+            // Send processed audio to remote peer once the batch is full
+            if (++batchedFrames_ >= framesPerPacket_) {
+                flushBatch();
+            }
         }
 
-        std::vector<int16_t> out;
-        try {
-            processor_.process(near, far, out);
-        } catch (const std::exception &e) {
-            qWarning() << "Processing failed:" << e.what();
-            return;
+        if (++framesSinceStats_ >= 100) { // once a second
+            framesSinceStats_ = 0;
+            emitStats();
         }
+    }
+}
+
+void AudioController::flushBatch() {
+    if (batchedFrames_ == 0) {
+        return;
+    }
+
+    AudioPacketHeader header;
+    header.payload_type = txCodec_->payloadType();
+    header.channels = 1;
+    header.frame_count = static_cast<uint8_t>(batchedFrames_);
+    header.sequence = txSequence_;
+    header.timestamp = txTimestamp_;
+    header.sample_rate = kFrameSamples * 100;
+    writeAudioPacketHeader(header, reinterpret_cast<uint8_t *>(processedData_.data()));
+
+    const int encodedBytes = static_cast<int>(txCodec_->encodedBytes(kFrameSamples, 1));
+    txSequence_ += batchedFrames_;
+    txTimestamp_ += batchedFrames_ * kFrameSamples;
+    const int bytes = static_cast<int>(kAudioPacketHeaderBytes) + batchedFrames_ * encodedBytes;
+    batchedFrames_ = 0;
+
+    if (isConnected_) {
+        // Raw view of the preallocated buffer; sendBinaryMessage copies
+        sendAudioData(QByteArray::fromRawData(processedData_.constData(), bytes));
+    }
+}
 
-        // Send processed audio to remote peer
-        QByteArray processedData(reinterpret_cast<const char*>(out.data()),
-                               out.size() * sizeof(int16_t));
-        sendAudioData(processedData);
+void AudioController::sendSid(const uint8_t *sid) {
+    AudioPacketHeader header;
+    header.payload_type = kPayloadComfortNoise;
+    header.channels = 1;
+    header.frame_count = 1;
+    header.sequence = txSequence_;
+    header.timestamp = txTimestamp_;
+    header.sample_rate = kFrameSamples * 100;
+
+    uint8_t packet[kAudioPacketHeaderBytes + kSidBytes];
+    writeAudioPacketHeader(header, packet);
+    std::copy(sid, sid + kSidBytes, packet + kAudioPacketHeaderBytes);
+    if (isConnected_) {
+        sendAudioData(QByteArray::fromRawData(reinterpret_cast<const char *>(packet), sizeof(packet)));
     }
 }
 
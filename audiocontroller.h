@@ -2,14 +2,25 @@
 #define AUDIOCONTROLLER_H
 
 #include <QObject>
-#include <QAudioInput>
-#include <QAudioOutput>
+#include <QElapsedTimer>
 #include <QIODevice>
-#include <QTimer>
+#include <QThread>
 #include <QWebSocket>
 #include <QWebSocketServer>
-#include <QQueue>
+#include <memory>
+#include <vector>
 #include "WebrtcAEC3.h"
+#include "aecrecorder.h"
+#include "framering.h"
+#include "audiocodec.h"
+#include "audioengine.h"
+#include "audiopacket.h"
+#include "conferenceserver.h"
+#include "dtx.h"
+#include "framepool.h"
+#include "jitterbuffer.h"
+#include "metricsserver.h"
+#include "resampler.h"
 
 class AudioController : public QObject {
     Q_OBJECT
@@ -18,6 +29,57 @@ class AudioController : public QObject {
     Q_PROPERTY(QString statusMessage READ statusMessage NOTIFY statusMessageChanged)
     Q_PROPERTY(int serverPort READ serverPort WRITE setServerPort NOTIFY serverPortChanged)
     Q_PROPERTY(bool enableAEC READ enableAEC WRITE setEnableAEC NOTIFY enableAECChanged)
+    Q_PROPERTY(int aecLevel READ aecLevel WRITE setAecLevel NOTIFY aecLevelChanged)
+    Q_PROPERTY(int noiseSuppressionLevel READ noiseSuppressionLevel WRITE setNoiseSuppressionLevel NOTIFY noiseSuppressionLevelChanged)
+    Q_PROPERTY(int agcMode READ agcMode WRITE setAgcMode NOTIFY agcModeChanged)
+    Q_PROPERTY(int farQueueDepth READ farQueueDepth WRITE setFarQueueDepth NOTIFY farQueueDepthChanged)
+    Q_PROPERTY(quint64 farOverruns READ farOverruns NOTIFY farQueueStatsChanged)
+    Q_PROPERTY(quint64 farUnderruns READ farUnderruns NOTIFY farQueueStatsChanged)
+    Q_PROPERTY(quint64 farDiscarded READ farDiscarded NOTIFY farQueueStatsChanged)
+    Q_PROPERTY(int realtimePriority READ realtimePriority WRITE setRealtimePriority NOTIFY realtimePriorityChanged)
+    Q_PROPERTY(bool driftCompensation READ driftCompensation WRITE setDriftCompensation NOTIFY driftCompensationChanged)
+    Q_PROPERTY(float remoteClockDriftPpm READ remoteClockDriftPpm NOTIFY audioStatsChanged)
+    Q_PROPERTY(float playoutClockDriftPpm READ playoutClockDriftPpm NOTIFY audioStatsChanged)
+    Q_PROPERTY(quint64 deadlineMisses READ deadlineMisses NOTIFY audioStatsChanged)
+    Q_PROPERTY(int captureBacklog READ captureBacklog NOTIFY audioStatsChanged)
+    Q_PROPERTY(int maxCaptureBacklog READ maxCaptureBacklog NOTIFY audioStatsChanged)
+    Q_PROPERTY(quint64 framePoolExhausted READ framePoolExhausted NOTIFY audioStatsChanged)
+    Q_PROPERTY(int framePoolInUse READ framePoolInUse NOTIFY audioStatsChanged)
+    Q_PROPERTY(int timeToFirstFrameMs READ timeToFirstFrameMs NOTIFY audioStatsChanged)
+    Q_PROPERTY(bool autoDelay READ autoDelay WRITE setAutoDelay NOTIFY autoDelayChanged)
+    Q_PROPERTY(int echoDelayMs READ echoDelayMs NOTIFY delayEstimateChanged)
+    Q_PROPERTY(float delayConfidence READ delayConfidence NOTIFY delayEstimateChanged)
+    Q_PROPERTY(int farDelayFrames READ farDelayFrames NOTIFY delayEstimateChanged)
+    Q_PROPERTY(int streamDelayMs READ streamDelayMs NOTIFY delayEstimateChanged)
+    Q_PROPERTY(int networkJitterMs READ networkJitterMs NOTIFY jitterStatsChanged)
+    Q_PROPERTY(int jitterTargetMs READ jitterTargetMs NOTIFY jitterStatsChanged)
+    Q_PROPERTY(int jitterDelayMs READ jitterDelayMs NOTIFY jitterStatsChanged)
+    Q_PROPERTY(quint64 packetsLate READ packetsLate NOTIFY jitterStatsChanged)
+    Q_PROPERTY(quint64 packetsLost READ packetsLost NOTIFY jitterStatsChanged)
+    Q_PROPERTY(quint64 packetsDiscarded READ packetsDiscarded NOTIFY jitterStatsChanged)
+    Q_PROPERTY(quint64 packetsRejected READ packetsRejected NOTIFY jitterStatsChanged)
+    Q_PROPERTY(int framesPerPacket READ framesPerPacket WRITE setFramesPerPacket NOTIFY framesPerPacketChanged)
+    Q_PROPERTY(QString preferredCodec READ preferredCodec WRITE setPreferredCodec NOTIFY preferredCodecChanged)
+    Q_PROPERTY(QString activeCodec READ activeCodec NOTIFY activeCodecChanged)
+    Q_PROPERTY(bool dtx READ dtx WRITE setDtx NOTIFY dtxChanged)
+    Q_PROPERTY(bool dtxActive READ dtxActive NOTIFY audioStatsChanged)
+    Q_PROPERTY(quint64 framesSuppressed READ framesSuppressed NOTIFY audioStatsChanged)
+    Q_PROPERTY(quint64 comfortNoiseFrames READ comfortNoiseFrames NOTIFY jitterStatsChanged)
+    Q_PROPERTY(bool conferenceMode READ conferenceMode WRITE setConferenceMode NOTIFY conferenceModeChanged)
+    Q_PROPERTY(int participantCount READ participantCount NOTIFY participantCountChanged)
+    Q_PROPERTY(int prewarmedProcessors READ prewarmedProcessors WRITE setPrewarmedProcessors NOTIFY prewarmedProcessorsChanged)
+    Q_PROPERTY(float erlDb READ erlDb NOTIFY metricsChanged)
+    Q_PROPERTY(float erleDb READ erleDb NOTIFY metricsChanged)
+    Q_PROPERTY(float aNlpDb READ aNlpDb NOTIFY metricsChanged)
+    Q_PROPERTY(int aecDelayMedianMs READ aecDelayMedianMs NOTIFY metricsChanged)
+    Q_PROPERTY(int aecDelayStdMs READ aecDelayStdMs NOTIFY metricsChanged)
+    Q_PROPERTY(bool voiceActive READ voiceActive NOTIFY metricsChanged)
+    Q_PROPERTY(float speechProbability READ speechProbability NOTIFY metricsChanged)
+    Q_PROPERTY(double processP50Us READ processP50Us NOTIFY metricsChanged)
+    Q_PROPERTY(double processP99Us READ processP99Us NOTIFY metricsChanged)
+    Q_PROPERTY(double frameP99Us READ frameP99Us NOTIFY metricsChanged)
+    Q_PROPERTY(int metricsPort READ metricsPort WRITE setMetricsPort NOTIFY metricsPortChanged)
+    Q_PROPERTY(bool recording READ recording NOTIFY recordingChanged)
 
 
 public:
@@ -32,28 +94,156 @@ public:
     // Properties
     bool isConnected() const { return isConnected_; }
     bool isServer() const { return mode_ == ServerMode; }
+    // A server or conference is accepting connections
+    bool isListening() const { return server_ != nullptr || conference_ != nullptr; }
     QString statusMessage() const { return statusMessage_; }
     int serverPort() const { return serverPort_; }
     void setServerPort(int port);
 
-    void setEnableAEC(bool value)
-    {
-        if (enableAEC_ != value) {
-            enableAEC_ = value;
-            processor_.enable_aec_ = value;
-            emit enableAECChanged();
-        }
-    }
-
+    // Processing settings; all of them can be changed during a call and
+    // take effect within a frame or two without interrupting audio
+    void setEnableAEC(bool value);
     bool enableAEC(){
         return enableAEC_;
     }
+    // Echo suppression aggressiveness, 0 (low) .. 2 (high)
+    int aecLevel() const { return aecLevel_; }
+    void setAecLevel(int level);
+    // 0 (low) .. 3 (very high)
+    int noiseSuppressionLevel() const { return noiseSuppressionLevel_; }
+    void setNoiseSuppressionLevel(int level);
+    // WebrtcAEC3::AgcMode
+    int agcMode() const { return agcMode_; }
+    void setAgcMode(int mode);
+    // Any WebrtcAEC3::ConfigId, for settings without a property of their
+    // own; ids that have one go through its setter. SAMPLE_RATE only takes
+    // effect while audio is stopped, and the channel counts must stay 1
+    // (the engine is mono). Returns false, with a warning, if rejected.
+    bool setProcessorConfig(int configId, ConfigValue value);
+
+    // Capacity of the far-end reference ring in 10ms frames. A new depth
+    // takes effect the next time audio is initialized.
+    int farQueueDepth() const { return farQueueDepth_; }
+    void setFarQueueDepth(int frames);
+
+    quint64 farOverruns() const { return farRing_.overruns(); }
+    quint64 farUnderruns() const { return farRing_.underruns(); }
+    quint64 farDiscarded() const { return farRing_.discarded(); }
+
+    // SCHED_FIFO priority for the audio thread (1-99), 0 for the default
+    // policy. Applied the next time audio is initialized.
+    int realtimePriority() const { return realtimePriority_; }
+    void setRealtimePriority(int priority);
+    // Resample received and played audio to the capture clock. Applied the
+    // next time audio is initialized.
+    bool driftCompensation() const { return driftCompensation_; }
+    void setDriftCompensation(bool enabled);
+    // Clock offsets against capture found by drift compensation, in ppm
+    float remoteClockDriftPpm() const { return engine_->remoteDriftPpm(); }
+    float playoutClockDriftPpm() const { return engine_->playoutDriftPpm(); }
+
+    quint64 deadlineMisses() const;
+    int captureBacklog() const;
+    int maxCaptureBacklog() const;
+    // Frames dropped because the frame pool was empty, and frames currently
+    // held by the jitter buffer, rings and engine
+    quint64 framePoolExhausted() const { return framePool_.stats().exhausted; }
+    int framePoolInUse() const { return static_cast<int>(framePool_.stats().in_use); }
+    // From the start of the last call's audio setup to its first processed
+    // frame reaching the sender; -1 until then
+    int timeToFirstFrameMs() const { return timeToFirstFrameMs_; }
+
+    // Automatic echo-path delay tracking; when off, farDelayFrames and
+    // streamDelayMs stay at their last values
+    bool autoDelay() const { return engine_->autoDelay(); }
+    void setAutoDelay(bool enabled);
+    int echoDelayMs() const { return engine_->echoDelayMs(); }
+    float delayConfidence() const { return engine_->delayConfidence(); }
+    int farDelayFrames() const { return engine_->farDelayFrames(); }
+    int streamDelayMs() const { return engine_->streamDelayMs(); }
+
+    // Jitter buffer state; refreshed once a second via jitterStatsChanged()
+    int networkJitterMs() const { return jitterStats_.jitter_ms; }
+    int jitterTargetMs() const { return jitterStats_.target_delay_ms; }
+    int jitterDelayMs() const { return jitterStats_.current_delay_ms; }
+    quint64 packetsLate() const { return jitterStats_.late; }
+    quint64 packetsLost() const { return jitterStats_.lost; }
+    quint64 packetsDiscarded() const { return jitterStats_.discarded; }
+    // Messages that failed to parse or carry a format we cannot play
+    quint64 packetsRejected() const { return packetsRejected_; }
+
+    // 10ms frames sent per WebSocket message (1..kMaxFramesPerPacket).
+    // Larger batches cut per-message overhead at the cost of latency.
+    int framesPerPacket() const { return framesPerPacket_; }
+    void setFramesPerPacket(int frames);
+
+    // Codec we ask the peer to accept ("adpcm", "pcmu", "pcma" or "pcm").
+    // Each side announces its codecs when a connection opens and sends with
+    // the preferred one if the peer supports it, otherwise the most compact
+    // one both support. Peers that never announce get plain PCM.
+    QString preferredCodec() const { return QString::fromLatin1(audioCodecName(preferredPayload_)); }
+    void setPreferredCodec(const QString &name);
+    // Codec currently used for sending
+    QString activeCodec() const { return QString::fromLatin1(audioCodecName(negotiatedPayload_)); }
+
+    // Discontinuous transmission: during silence, send a silence descriptor
+    // every 100 ms or so instead of every frame, and let the peer play
+    // comfort noise. Turns voice detection on; only used with peers whose
+    // hello offers comfort noise. Takes effect immediately.
+    bool dtx() const { return dtx_; }
+    void setDtx(bool enabled);
+    // The sender is in a silence period right now
+    bool dtxActive() const { return dtx_ && peerComfortNoise_ && dtxEncoder_.inDtx(); }
+    // Frames not sent because of DTX since audio started or DTX was enabled
+    quint64 framesSuppressed() const { return dtxEncoder_.framesSuppressed(); }
+    // Frames of comfort noise played for the peer's silence
+    quint64 comfortNoiseFrames() const { return jitterStats_.comfort_noise; }
+
+    // Server mode only: instead of a two-party call, host an N-party
+    // conference where every client hears the echo-cancelled mix of all
+    // others. The host's own audio devices are not used. Takes effect on
+    // the next startServer().
+    bool conferenceMode() const { return conferenceMode_; }
+    void setConferenceMode(bool enabled);
+    int participantCount() const { return conference_ ? conference_->participantCount() : 0; }
+    // Conference participants' processors kept built ahead of joins, so a
+    // burst of joins only resets them (see ProcessorPool). Takes effect on
+    // the next startServer().
+    int prewarmedProcessors() const { return prewarmedProcessors_; }
+    void setPrewarmedProcessors(int count);
+
+    // Echo canceller health, refreshed once a second via metricsChanged().
+    // ERL/ERLE/A-NLP are 0 and the AEC delays -1 until the AEC reports them.
+    float erlDb() const { return metrics_.echo_metrics.valid ? metrics_.echo_metrics.erl_db : 0.0f; }
+    float erleDb() const { return metrics_.echo_metrics.valid ? metrics_.echo_metrics.erle_db : 0.0f; }
+    float aNlpDb() const { return metrics_.echo_metrics.valid ? metrics_.echo_metrics.a_nlp_db : 0.0f; }
+    int aecDelayMedianMs() const { return metrics_.echo_metrics.valid ? metrics_.echo_metrics.delay_median_ms : -1; }
+    int aecDelayStdMs() const { return metrics_.echo_metrics.valid ? metrics_.echo_metrics.delay_std_ms : -1; }
+    bool voiceActive() const { return metrics_.voice; }
+    float speechProbability() const { return metrics_.speech_probability; }
+    // Time spent in the AEC and on the whole frame, from the engine's
+    // histograms since the audio started
+    double processP50Us() const { return metrics_.process.quantileUs(0.5); }
+    double processP99Us() const { return metrics_.process.quantileUs(0.99); }
+    double frameP99Us() const { return metrics_.frame.quantileUs(0.99); }
+
+    // Loopback HTTP port serving /metrics (Prometheus) and /metrics.json,
+    // 0 to disable. Takes effect immediately.
+    int metricsPort() const { return metricsPort_; }
+    void setMetricsPort(int port);
+
+    // Session recording for tools/aec_replay: near, far, output, delay and
+    // every setting change as the AEC saw them. Start it before connecting
+    // for a recording that replays bit-exactly.
+    bool recording() const { return recorder_.isOpen(); }
 
 public slots:
     void startServer();
     void connectToServer(const QString &serverAddress);
     void disconnect();
     void setMode(int mode); // 0 = Server, 1 = Client
+    void startRecording(const QString &path);
+    void stopRecording();
 
 signals:
     void connectionStatusChanged();
@@ -61,6 +251,27 @@ signals:
     void statusMessageChanged();
     void serverPortChanged();
     void enableAECChanged();
+    void aecLevelChanged();
+    void noiseSuppressionLevelChanged();
+    void agcModeChanged();
+    void farQueueDepthChanged();
+    void farQueueStatsChanged();
+    void realtimePriorityChanged();
+    void driftCompensationChanged();
+    void audioStatsChanged();
+    void autoDelayChanged();
+    void delayEstimateChanged();
+    void jitterStatsChanged();
+    void framesPerPacketChanged();
+    void preferredCodecChanged();
+    void activeCodecChanged();
+    void dtxChanged();
+    void conferenceModeChanged();
+    void participantCountChanged();
+    void prewarmedProcessorsChanged();
+    void metricsChanged();
+    void metricsPortChanged();
+    void recordingChanged();
 
 private slots:
     void onNewConnection();
@@ -68,29 +279,100 @@ private slots:
     void onWebSocketDisconnected();
     void onWebSocketError(QAbstractSocket::SocketError error);
     void onBinaryMessageReceived(const QByteArray &message);
-    void processAudio();
+    void onTextMessageReceived(const QString &message);
+    void sendProcessedFrames();
+    void onEngineFailed(const QString &reason);
 
 private:
     void initializeAudio();
     void cleanupAudio();
     void cleanupNetwork();
+    void startConference();
     void setStatusMessage(const QString &message);
     void sendAudioData(const QByteArray &data);
+    void emitStats();
+    bool applyProcessorConfig(int configId, ConfigValue value);
+    void sendHello(QWebSocket *socket);
+    void flushBatch();
+    void sendSid(const uint8_t *sid);
+
+    static const int kFrameSamples = AudioEngine::kFrameSamples;
+    static const int kFrameBytes = AudioEngine::kFrameBytes;
+    // Messages use the audiopacket.h framing; bare kFrameBytes messages from
+    // older peers are still accepted
+    static const int kMaxFramesPerPacket = 10;
+    // Highest rate accepted from the network; anything but kPipelineRate is
+    // resampled on receipt
+    static const int kMaxNetworkRate = 96000;
+    // Enough for a full jitter buffer, far queue and send ring at the
+    // default depths; the pool never grows, frames beyond it are dropped
+    // and counted in framePoolExhausted
+    static const int kFramePoolFrames = 128;
 
-    // Audio components
-    QAudioInput *audioInput_;
-    QAudioOutput *audioOutput_;
-    QIODevice *inputDevice_;
-    QIODevice *outputDevice_;
-    QTimer *audioTimer_;
+    // Audio components. Capture, playout and processing all live on
+    // engineThread_; this thread only moves packets.
+    QThread *engineThread_;
+    AudioEngine *engine_;
+    int realtimePriority_;
+    bool driftCompensation_;
     WebrtcAEC3 processor_;
-    QQueue<std::vector<int16_t>> farBufferQueue_;
-    const int farDelayFrames_ = 3; // 3*10ms = 30ms delay for echo
+    // Written by the engine thread through processor_, drained to disk by
+    // its own thread
+    AecRecorder recorder_;
+    // Starting far-queue depth (3*10ms = 30ms delay for echo); the engine's
+    // delay estimator refines it and it is carried over between sessions
+    int farDelayFrames_;
+
+    // Outgoing message, allocated once for the largest batch so sending
+    // never touches the heap; batchedFrames_ frames are filled in
+    QByteArray processedData_;
+    int framesPerPacket_;
+    int batchedFrames_;
+
+    // Frames that travel from decode through playout to the echo reference,
+    // and from the AEC to the sender, by reference. Declared before every
+    // holder of its frames so it is destroyed after them.
+    FramePool framePool_;
+
+    // Frames from the network, reordered and paced for playout; producer is
+    // onBinaryMessageReceived(), consumer is the engine thread
+    JitterBuffer jitterBuffer_;
+    JitterBuffer::Stats jitterStats_;
+    quint32 txSequence_;
+    quint32 txTimestamp_;
+    quint32 rxLegacySequence_;
+    quint64 packetsRejected_;
+
+    // Codecs; the sender switches only between batches
+    uint8_t preferredPayload_;
+    uint8_t negotiatedPayload_;
+    std::unique_ptr<AudioCodec> txCodec_;
+    std::unique_ptr<AudioCodec> rxCodec_;
+    std::vector<int16_t> rxFrame_;
+    std::unique_ptr<Resampler> rxResampler_;
+
+    // DTX; the encoder sees every processed frame while enabled
+    bool dtx_;
+    bool peerComfortNoise_;
+    DtxEncoder dtxEncoder_;
+    // Played frames waiting to be used as the echo reference; both ends are
+    // on the engine thread
+    FrameRing farRing_;
+    // Processed frames from the engine thread waiting to be sent
+    FrameRing sendRing_;
+    int farQueueDepth_;
+    int framesSinceStats_;
 
     // Network components
     QWebSocketServer *server_;
     QWebSocket *clientSocket_;
     QList<QWebSocket *> connectedClients_;
+    ConferenceServer *conference_;
+    bool conferenceMode_;
+    int prewarmedProcessors_;
+    MetricsServer *metricsServer_;
+    int metricsPort_;
+    AecMetrics::Snapshot metrics_;
 
     // State
     Mode mode_;
@@ -98,8 +380,13 @@ private:
     QString statusMessage_;
     int serverPort_;
     bool audioInitialized_;
+    QElapsedTimer setupTimer_;
+    int timeToFirstFrameMs_;
 
     bool enableAEC_;
+    int aecLevel_;
+    int noiseSuppressionLevel_;
+    int agcMode_;
 };
 
 #endif // AUDIOCONTROLLER_H
@@ -0,0 +1,507 @@
+#include "audioengine.h"
+#include <QDebug>
+#include <QThread>
+
+#ifdef Q_OS_LINUX
+#include <pthread.h>
+#include <sched.h>
+#include <cstring>
+#endif
+
+namespace {
+
+// Frames that may legitimately be waiting at a wakeup (one being filled by
+// the device plus one of scheduling slack). More than this means captured
+// audio sat in the buffer past its 10ms deadline.
+const int kBacklogToleranceFrames = 2;
+const qint64 kFrameBudgetNs = 10 * 1000 * 1000;
+const int kFrameMs = 10;
+
+// Estimates below this confidence are published but not acted on
+const float kMinDelayConfidence = 0.6f;
+// Two consecutive estimates must agree this closely before being applied,
+// and must differ from the current setting by more than it
+const int kDelayToleranceMs = 4;
+// Residual left to set_stream_delay_ms() after filling the far queue with
+// whole frames; keeps the AEC's own delay search centred
+const int kTargetStreamDelayMs = 10;
+const int kMaxStreamDelayMs = 500;
+
+// Drift tracking: fill-level smoothing and controller response. Network
+// jitter moves the jitter buffer by whole frames, so the remote loop
+// averages longer and reacts more slowly than the playout one.
+const double kRemoteDriftSmoothingS = 4.0;
+const double kRemoteDriftResponseS = 30.0;
+const double kPlayoutDriftSmoothingS = 1.0;
+const double kPlayoutDriftResponseS = 10.0;
+
+// The AEC's ERL/ERLE figures are long-term averages; sampling them once a
+// second is plenty and keeps GetMetrics() off most frames
+const quint64 kEchoMetricsIntervalFrames = 100;
+
+} // namespace
+
+AudioEngine::AudioEngine(WebrtcAEC3 *processor, FramePool *framePool, JitterBuffer *jitterBuffer,
+                         FrameRing *farRing, FrameRing *sendRing, QObject *parent)
+    : QObject(parent)
+    , processor_(processor)
+    , framePool_(framePool)
+    , jitterBuffer_(jitterBuffer)
+    , farRing_(farRing)
+    , sendRing_(sendRing)
+    , audioInput_(nullptr)
+    , inputDevice_(nullptr)
+    , audioOutput_(nullptr)
+    , outputDevice_(nullptr)
+    , realtimePriority_(0)
+    , driftCompensation_(true)
+    , nearFrame_(kFrameSamples, 0)
+    , silentFrame_(kFrameSamples, 0)
+    , scratchFrame_(kFrameSamples, 0)
+    , deviceFrameBytes_(kFrameBytes)
+    , aecFrameSamples_(kFrameSamples)
+    , remoteDrift_(kPipelineRate, kRemoteDriftSmoothingS, kRemoteDriftResponseS)
+    , playoutDrift_(kPipelineRate, kPlayoutDriftSmoothingS, kPlayoutDriftResponseS)
+    , remoteSteady_(false)
+    , captureFrames_(0)
+    , lastCandidateMs_(-1)
+    , processingNs_(0)
+    , farDelayFrames_(3)
+    , autoDelay_(true)
+    , echoDelayMs_(-1)
+    , delayConfidence_(0.0f)
+    , streamDelayMs_(0)
+    , remoteDriftPpm_(0.0f)
+    , playoutDriftPpm_(0.0f)
+    , notifyPending_(false)
+    , framesProcessed_(0)
+    , deadlineMisses_(0)
+    , processingErrors_(0)
+    , playoutDrops_(0)
+    , lastBacklog_(0)
+    , maxBacklog_(0)
+{
+}
+
+AudioEngine::~AudioEngine() {
+    stop();
+}
+
+void AudioEngine::setDevices(const QAudioDeviceInfo &input, const QAudioDeviceInfo &output,
+                             const QAudioFormat &format) {
+    inputInfo_ = input;
+    outputInfo_ = output;
+    format_ = format;
+}
+
+void AudioEngine::start() {
+    if (audioInput_) {
+        return;
+    }
+
+    if (!setUpRateConversion()) {
+        return;
+    }
+
+    applyRealtimePriority();
+
+    framesProcessed_.store(0);
+    deadlineMisses_.store(0);
+    processingErrors_.store(0);
+    playoutDrops_.store(0);
+    lastBacklog_.store(0);
+    maxBacklog_.store(0);
+    notifyPending_.store(false);
+    processingNs_ = 0;
+    metrics_.reset();
+
+    // The estimator sees pipeline-rate frames whatever the devices run at
+    lastCandidateMs_ = -1;
+    echoDelayMs_.store(-1);
+    delayConfidence_.store(0.0f);
+    streamDelayMs_.store(processor_->system_delay_ms_);
+    try {
+        delayEstimator_.reset(new DelayEstimator(kPipelineRate));
+    } catch (const std::exception &e) {
+        delayEstimator_.reset();
+        qWarning() << "Delay estimation disabled:" << e.what();
+    }
+
+    // Created here so both devices live in (and notify) the engine thread
+    audioOutput_ = new QAudioOutput(outputInfo_, format_, this);
+    outputDevice_ = audioOutput_->start();
+    if (!outputDevice_) {
+        qWarning() << "Audio engine failed to start playout:" << audioOutput_->error();
+        delete audioOutput_;
+        audioOutput_ = nullptr;
+        emit failed(QStringLiteral("Failed to start audio playout"));
+        return;
+    }
+
+    audioInput_ = new QAudioInput(inputInfo_, format_, this);
+    inputDevice_ = audioInput_->start();
+    if (!inputDevice_) {
+        qWarning() << "Audio engine failed to start capture:" << audioInput_->error();
+        delete audioInput_;
+        audioInput_ = nullptr;
+        audioOutput_->stop();
+        delete audioOutput_;
+        audioOutput_ = nullptr;
+        outputDevice_ = nullptr;
+        emit failed(QStringLiteral("Failed to start audio capture"));
+        return;
+    }
+
+    connect(inputDevice_, &QIODevice::readyRead, this, &AudioEngine::drainInput);
+
+    qDebug() << "Audio engine started on thread" << QThread::currentThread();
+    emit started();
+}
+
+void AudioEngine::stop() {
+    if (!audioInput_) {
+        return;
+    }
+
+    audioInput_->stop();
+    delete audioInput_;
+    audioInput_ = nullptr;
+    inputDevice_ = nullptr;
+
+    audioOutput_->stop();
+    delete audioOutput_;
+    audioOutput_ = nullptr;
+    outputDevice_ = nullptr;
+
+    qDebug() << "Audio engine stopped. Frames:" << framesProcessed_.load()
+             << "deadline misses:" << deadlineMisses_.load()
+             << "max backlog:" << maxBacklog_.load()
+             << "playout drops:" << playoutDrops_.load();
+    if (delayEstimator_ && processingNs_ > 0) {
+        qDebug() << "Delay estimator used"
+                 << 100.0 * delayEstimator_->processingNs() / processingNs_
+                 << "% of frame time; echo delay" << echoDelayMs_.load()
+                 << "ms, confidence" << delayConfidence_.load();
+    }
+    if (remoteResampler_) {
+        qDebug() << "Clock drift against capture: remote" << remoteDriftPpm_.load()
+                 << "ppm, playout" << playoutDriftPpm_.load() << "ppm";
+    }
+}
+
+bool AudioEngine::setUpRateConversion() {
+    // nearestFormat() may hand us anything; only the rate is converted
+    const int deviceRate = format_.sampleRate();
+    if (format_.channelCount() != 1 || format_.sampleSize() != 16
+        || format_.sampleType() != QAudioFormat::SignedInt || deviceRate <= 0 || deviceRate % 100 != 0) {
+        qWarning() << "Unsupported device format" << format_;
+        emit failed(QStringLiteral("Audio device format not supported"));
+        return false;
+    }
+
+    const size_t deviceFrameSamples = static_cast<size_t>(deviceRate / 100);
+    deviceFrameBytes_ = static_cast<int>(deviceFrameSamples * 2);
+    deviceFrame_.assign(deviceFrameSamples, 0);
+    devicePlayFrame_.assign(deviceFrameSamples, 0);
+    if (deviceRate != kPipelineRate) {
+        captureResampler_.reset(new Resampler(deviceRate, kPipelineRate));
+        playoutResampler_.reset(new Resampler(kPipelineRate, deviceRate));
+        qDebug() << "Resampling device audio" << deviceRate << "Hz <->" << kPipelineRate << "Hz";
+    } else {
+        captureResampler_.reset();
+        playoutResampler_.reset();
+    }
+
+    const int aecRate = processor_->sample_rate_;
+    aecFrameSamples_ = processor_->chunkSamples();
+    if (aecRate != kPipelineRate) {
+        nearAec_.assign(aecFrameSamples_, 0);
+        farAec_.assign(aecFrameSamples_, 0);
+        outAec_.assign(aecFrameSamples_, 0);
+        nearDownsampler_.reset(new Resampler(kPipelineRate, aecRate));
+        farDownsampler_.reset(new Resampler(kPipelineRate, aecRate));
+        outUpsampler_.reset(new Resampler(aecRate, kPipelineRate));
+        qDebug() << "Running the AEC at" << aecRate << "Hz";
+    } else {
+        nearDownsampler_.reset();
+        farDownsampler_.reset();
+        outUpsampler_.reset();
+    }
+
+    captureFrames_ = 0;
+    remoteSteady_ = false;
+    remoteDrift_.reset();
+    playoutDrift_.reset();
+    remoteDriftPpm_.store(0.0f);
+    playoutDriftPpm_.store(0.0f);
+    if (driftCompensation_) {
+        remoteResampler_.reset(new FractionalResampler(2 * kFrameSamples));
+        playoutDriftResampler_.reset(new FractionalResampler(deviceFrameSamples));
+        // Within kDefaultMaxPpm a frame gains at most one sample, plus one
+        // carried over from the frame before
+        driftPlayFrame_.assign(deviceFrameSamples + 4, 0);
+    } else {
+        remoteResampler_.reset();
+        playoutDriftResampler_.reset();
+    }
+    return true;
+}
+
+void AudioEngine::applyRealtimePriority() {
+    QThread::currentThread()->setPriority(QThread::TimeCriticalPriority);
+
+#ifdef Q_OS_LINUX
+    if (realtimePriority_ > 0) {
+        sched_param param;
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = realtimePriority_;
+        int rc = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (rc != 0) {
+            // Usually missing CAP_SYS_NICE / rtprio limits; keep running
+            qWarning() << "SCHED_FIFO priority" << realtimePriority_
+                       << "unavailable:" << strerror(rc);
+        } else {
+            qDebug() << "Audio engine running SCHED_FIFO priority" << realtimePriority_;
+        }
+    }
+#endif
+}
+
+void AudioEngine::drainInput() {
+    if (!audioInput_ || !inputDevice_) {
+        return;
+    }
+
+    int backlog = audioInput_->bytesReady() / deviceFrameBytes_;
+    lastBacklog_.store(backlog, std::memory_order_relaxed);
+    if (backlog > maxBacklog_.load(std::memory_order_relaxed)) {
+        maxBacklog_.store(backlog, std::memory_order_relaxed);
+    }
+    if (backlog > kBacklogToleranceFrames) {
+        deadlineMisses_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Drain every complete frame, not just one per wakeup
+    int16_t *captured = captureResampler_ ? deviceFrame_.data() : nearFrame_.data();
+    while (audioInput_->bytesReady() >= deviceFrameBytes_) {
+        if (inputDevice_->read(reinterpret_cast<char *>(captured), deviceFrameBytes_) != deviceFrameBytes_) {
+            break;
+        }
+        if (captureResampler_) {
+            // Exactly one pipeline frame per 10ms device frame
+            captureResampler_->process(captured, deviceFrameBytes_ / 2, nearFrame_.data());
+        }
+        processFrame();
+    }
+}
+
+void AudioEngine::processFrame() {
+    frameTimer_.start();
+    ++captureFrames_;
+
+    // Playout, one frame per captured frame. The jitter buffer fills the
+    // frame with concealment, comfort noise or silence when nothing is
+    // ready, so the output and the echo reference never stall. The frame
+    // the device played is the one queued as the reference.
+    FrameRef playFrame;
+    if (remoteResampler_) {
+        pullRemoteFrame(&playFrame);
+    } else {
+        jitterBuffer_->pop(&playFrame);
+    }
+    // Null only when a frame pool ran dry; that frame is dropped and
+    // silence played instead
+    const int16_t *played = playFrame.isNull() ? silentFrame_.data() : playFrame.data();
+    if (playoutResampler_) {
+        playoutResampler_->process(played, kFrameSamples, devicePlayFrame_.data());
+        writePlayout(devicePlayFrame_.data());
+    } else {
+        writePlayout(played);
+    }
+    if (playFrame.isNull()) {
+        farRing_->push(played);
+    } else {
+        farRing_->push(std::move(playFrame));
+    }
+
+    // Get far buffer for echo cancellation. Invariant: the reference is the
+    // frame played exactly delayFrames frames ago, so the ring keeps that
+    // many frames plus the one just pushed (delay 0 is the frame itself).
+    // Older frames are stale and dropped; fewer means the reference
+    // underran.
+    const size_t delayFrames = static_cast<size_t>(farDelayFrames_.load(std::memory_order_relaxed));
+    farRing_->discardTo(delayFrames + 1);
+    const int16_t *far = silentFrame_.data(); // fallback to zero
+    const bool farFromRing = farRing_->size() == delayFrames + 1;
+    if (farFromRing) {
+        far = farRing_->front();
+    } else {
+        farRing_->countUnderrun();
+    }
+
+    // Processed straight into the frame the sender will read. Without one
+    // (pool exhausted, counted there) the frame is still processed, to keep
+    // the AEC's state continuous, but not sent.
+    FrameRef outFrame = framePool_->acquire();
+    int16_t *out = outFrame.isNull() ? scratchFrame_.data() : outFrame.data();
+    bool ok = true;
+    const qint64 processStartNs = frameTimer_.nsecsElapsed();
+    try {
+        if (nearDownsampler_) {
+            nearDownsampler_->process(nearFrame_.data(), kFrameSamples, nearAec_.data());
+            farDownsampler_->process(far, kFrameSamples, farAec_.data());
+            processor_->process(nearAec_.data(), farAec_.data(), outAec_.data(), aecFrameSamples_);
+            outUpsampler_->process(outAec_.data(), aecFrameSamples_, out);
+        } else {
+            processor_->process(nearFrame_.data(), far, out, kFrameSamples);
+        }
+    } catch (const std::exception &e) {
+        ok = false;
+        processingErrors_.fetch_add(1, std::memory_order_relaxed);
+        qWarning() << "Processing failed:" << e.what();
+    }
+    const qint64 processNs = frameTimer_.nsecsElapsed() - processStartNs;
+
+    // The estimate is relative to the reference as the AEC saw it, i.e.
+    // already delayed by the far queue
+    if (delayEstimator_ && delayEstimator_->update(nearFrame_.data(), far, kFrameSamples)) {
+        updateDelay(static_cast<int>(delayFrames));
+    }
+
+    if (farFromRing) {
+        farRing_->pop();
+    }
+
+    if (ok) {
+        framesProcessed_.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (ok && !outFrame.isNull()) {
+        // With voice detection off every frame counts as speech, so DTX
+        // never suppresses anything
+        const bool voice = !processor_->getConfig(WebrtcAEC3::ENABLE_VOICE_DETECTION).bool_val
+                           || processor_->hasVoice();
+        sendRing_->push(std::move(outFrame), voice ? kFrameVoice : 0);
+        if (!notifyPending_.exchange(true)) {
+            emit framesReady();
+        }
+    }
+
+    const qint64 elapsed = frameTimer_.nsecsElapsed();
+    processingNs_ += elapsed;
+    if (elapsed > kFrameBudgetNs) {
+        deadlineMisses_.fetch_add(1, std::memory_order_relaxed);
+    }
+    recordMetrics(processNs, elapsed);
+}
+
+void AudioEngine::pullRemoteFrame(FrameRef *frame) {
+    // Usually one jitter buffer frame per call; now and then none or two
+    while (remoteResampler_->available() < static_cast<size_t>(kFrameSamples)) {
+        FrameRef received;
+        remoteSteady_ = jitterBuffer_->pop(&received) == JitterBuffer::kFrame;
+        remoteResampler_->push(received.isNull() ? silentFrame_.data() : received.data(), kFrameSamples);
+    }
+    // Pulled either way so the resampler stays in step; without a pooled
+    // frame it is dropped
+    *frame = framePool_->acquire();
+    remoteResampler_->pull(frame->isNull() ? scratchFrame_.data() : frame->data(), kFrameSamples);
+
+    // Rebuffering, loss and DTX say nothing about the sender's clock
+    const double nowS = captureFrames_ * kFrameMs / 1000.0;
+    if (!remoteSteady_) {
+        remoteDrift_.hold(nowS);
+        return;
+    }
+    const JitterBuffer::Stats stats = jitterBuffer_->stats();
+    const int samplesPerMs = kPipelineRate / 1000;
+    // Read after a pop, while the buffer checks its depth before one: half a
+    // frame under its target sits between growing and shrinking
+    remoteDrift_.setTarget(stats.target_delay_ms * samplesPerMs - kFrameSamples / 2);
+    remoteResampler_->setRatio(remoteDrift_.update(nowS, stats.current_delay_ms * samplesPerMs));
+    remoteDriftPpm_.store(static_cast<float>(remoteDrift_.driftPpm()), std::memory_order_relaxed);
+}
+
+void AudioEngine::writePlayout(const int16_t *samples) {
+    qint64 bytes = deviceFrameBytes_;
+    if (playoutDriftResampler_) {
+        playoutDriftResampler_->push(samples, deviceFrameBytes_ / 2);
+        samples = driftPlayFrame_.data();
+        bytes = 2 * static_cast<qint64>(playoutDriftResampler_->pull(driftPlayFrame_.data(), driftPlayFrame_.size()));
+
+        // Queue level before this write, in pipeline-rate samples. A device
+        // that plays fast drains it, so its drift is the negated estimate.
+        const int queuedBytes = audioOutput_->bufferSize() - audioOutput_->bytesFree();
+        const double queued = queuedBytes / 2 * static_cast<double>(kPipelineRate) / format_.sampleRate();
+        playoutDriftResampler_->setRatio(playoutDrift_.update(captureFrames_ * kFrameMs / 1000.0, queued));
+        playoutDriftPpm_.store(static_cast<float>(-playoutDrift_.driftPpm()), std::memory_order_relaxed);
+    }
+    if (outputDevice_->write(reinterpret_cast<const char *>(samples), bytes) != bytes) {
+        playoutDrops_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void AudioEngine::recordMetrics(qint64 processNs, qint64 frameNs) {
+    metrics_.recordFrame(processNs, frameNs, processor_->hasVoice(), processor_->hasEcho(),
+                         processor_->getSpeechProbability());
+
+    if (framesProcessed_.load(std::memory_order_relaxed) % kEchoMetricsIntervalFrames != 0) {
+        return;
+    }
+    WebrtcAEC3::EchoMetrics echo;
+    AecMetrics::Echo sample;
+    sample.valid = processor_->getEchoMetrics(&echo);
+    if (sample.valid) {
+        sample.erl_db = echo.erl_db;
+        sample.erle_db = echo.erle_db;
+        sample.a_nlp_db = echo.a_nlp_db;
+        sample.divergent_fraction = echo.divergent_filter_fraction;
+        sample.delay_median_ms = echo.delay_median_ms;
+        sample.delay_std_ms = echo.delay_std_ms;
+        sample.fraction_poor_delays = echo.fraction_poor_delays;
+    } else {
+        sample = AecMetrics::Echo();
+    }
+    metrics_.recordEcho(sample);
+}
+
+void AudioEngine::updateDelay(int queuedFrames) {
+    const DelayEstimator::Estimate estimate = delayEstimator_->estimate();
+    const int totalMs = queuedFrames * kFrameMs + estimate.delay_ms;
+    delayConfidence_.store(estimate.confidence, std::memory_order_relaxed);
+    if (estimate.confidence >= kMinDelayConfidence) {
+        echoDelayMs_.store(totalMs, std::memory_order_relaxed);
+    }
+    emit delayEstimateChanged();
+
+    if (!autoDelay_.load(std::memory_order_relaxed) || estimate.confidence < kMinDelayConfidence) {
+        lastCandidateMs_ = -1;
+        return;
+    }
+
+    // Hysteresis: act on a stable estimate only, and only when it moved
+    const bool stable = lastCandidateMs_ >= 0 && qAbs(totalMs - lastCandidateMs_) <= kDelayToleranceMs;
+    lastCandidateMs_ = totalMs;
+    const int currentMs = queuedFrames * kFrameMs + streamDelayMs_.load(std::memory_order_relaxed);
+    if (!stable || qAbs(totalMs - currentMs) <= kDelayToleranceMs) {
+        return;
+    }
+
+    // Whole frames go to the far queue (bounded by its capacity), the rest
+    // to the AEC's stream delay. Zero frames is valid: the reference is
+    // then the frame just played.
+    const int maxFrames = static_cast<int>(farRing_->capacity()) - 1;
+    const int frames = qBound(0, (totalMs - kTargetStreamDelayMs) / kFrameMs, maxFrames);
+    const int streamMs = qBound(0, totalMs - frames * kFrameMs, kMaxStreamDelayMs);
+
+    processor_->setStreamDelayMs(streamMs);
+    streamDelayMs_.store(streamMs, std::memory_order_relaxed);
+    if (frames != queuedFrames) {
+        farDelayFrames_.store(frames, std::memory_order_relaxed);
+        // History was collected against the old queue depth
+        delayEstimator_->reset();
+        lastCandidateMs_ = -1;
+    }
+
+    qDebug() << "Echo delay" << totalMs << "ms: far queue" << frames
+             << "frames, stream delay" << streamMs << "ms";
+}
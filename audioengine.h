@@ -0,0 +1,203 @@
+#ifndef AUDIOENGINE_H
+#define AUDIOENGINE_H
+
+#include <QObject>
+#include <QAudioDeviceInfo>
+#include <QAudioFormat>
+#include <QAudioInput>
+#include <QAudioOutput>
+#include <QElapsedTimer>
+#include <QIODevice>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "WebrtcAEC3.h"
+#include "aecmetrics.h"
+#include "delayestimator.h"
+#include "driftestimator.h"
+#include "framepool.h"
+#include "fractionalresampler.h"
+#include "framering.h"
+#include "jitterbuffer.h"
+#include "resampler.h"
+
+// Capture, playout and echo cancellation on a dedicated thread.
+//
+// The engine is moved to its own QThread by AudioController. It owns the
+// QAudioInput and QAudioOutput and is woken by the input's readyRead,
+// draining every complete 10ms frame on each wakeup instead of one frame per
+// GUI timer tick. Playout is clocked by capture: for every captured frame
+// one frame is pulled from |jitterBuffer|, written to the output and queued
+// in |farRing| as the echo reference. The captured frame is paired with the
+// far reference from |farRing|, run through |processor| into a frame from
+// |framePool| and pushed into |sendRing|; framesReady() tells the GUI thread
+// there is something to send. Played and processed frames move between the
+// queues as FrameRefs, so none of these hand-offs copies samples.
+//
+// With automatic delay enabled, a DelayEstimator watches the near and far
+// frames and re-splits the measured echo delay between the far-queue depth
+// (whole frames) and the stream delay reported to the AEC (the remainder).
+//
+// Everything between the devices and the AEC runs at kPipelineRate. Devices
+// that only offer another rate (44.1 kHz headsets) are converted on the way
+// in and out, and so is the AEC when |processor| was configured for a
+// different SAMPLE_RATE; each conversion is a streaming Resampler.
+//
+// The capture clock is the reference. With drift compensation on, the
+// remote sender's clock and the playout device's clock are each tracked by
+// a DriftEstimator on the fill level of the buffer in front of them (the
+// jitter buffer and the output device's queue) and followed by a
+// FractionalResampler: received audio is stretched or shortened to exactly
+// one frame per captured frame, and playout to whatever keeps the device
+// queue level. Played audio, and with it the echo, then stays aligned with
+// the far reference for the whole call instead of drifting until the
+// jitter buffer drops or repeats a frame.
+class AudioEngine : public QObject {
+    Q_OBJECT
+
+public:
+    AudioEngine(WebrtcAEC3 *processor, FramePool *framePool, JitterBuffer *jitterBuffer,
+                FrameRing *farRing, FrameRing *sendRing, QObject *parent = nullptr);
+    ~AudioEngine();
+
+    // Configuration; only call while the engine is stopped
+    void setDevices(const QAudioDeviceInfo &input, const QAudioDeviceInfo &output,
+                    const QAudioFormat &format);
+    // Age of the far reference in frames, 0 .. farRing capacity - 1
+    void setFarDelayFrames(int frames) { farDelayFrames_.store(frames); }
+    int farDelayFrames() const { return farDelayFrames_.load(); }
+    // SCHED_FIFO priority (1-99) for the engine thread, 0 to stay SCHED_OTHER
+    void setRealtimePriority(int priority) { realtimePriority_ = priority; }
+    // Let the delay estimator adjust farDelayFrames and the stream delay
+    void setAutoDelay(bool enabled) { autoDelay_.store(enabled); }
+    bool autoDelay() const { return autoDelay_.load(); }
+    // Resample remote and playout audio to the capture clock
+    void setDriftCompensation(bool enabled) { driftCompensation_ = enabled; }
+
+    // Must be called by the consumer of sendRing before draining it, so the
+    // next push raises framesReady() again
+    void acknowledgeFrames() { notifyPending_.store(false); }
+
+    // Counters, readable from any thread
+    quint64 framesProcessed() const { return framesProcessed_.load(std::memory_order_relaxed); }
+    quint64 deadlineMisses() const { return deadlineMisses_.load(std::memory_order_relaxed); }
+    quint64 processingErrors() const { return processingErrors_.load(std::memory_order_relaxed); }
+    // Playout frames the output device had no room for
+    quint64 playoutDrops() const { return playoutDrops_.load(std::memory_order_relaxed); }
+    // Complete frames waiting at the last wakeup, and the worst seen
+    int lastBacklogFrames() const { return lastBacklog_.load(std::memory_order_relaxed); }
+    int maxBacklogFrames() const { return maxBacklog_.load(std::memory_order_relaxed); }
+    // Latest render-to-capture delay estimate (queue plus residual) and its
+    // confidence in 0..1; -1 ms until the estimator has produced one
+    int echoDelayMs() const { return echoDelayMs_.load(std::memory_order_relaxed); }
+    float delayConfidence() const { return delayConfidence_.load(std::memory_order_relaxed); }
+    // Delay currently passed to set_stream_delay_ms()
+    int streamDelayMs() const { return streamDelayMs_.load(std::memory_order_relaxed); }
+    // Estimated clock offsets against capture in ppm, positive when the
+    // other clock runs fast; 0 while drift compensation is off
+    float remoteDriftPpm() const { return remoteDriftPpm_.load(std::memory_order_relaxed); }
+    float playoutDriftPpm() const { return playoutDriftPpm_.load(std::memory_order_relaxed); }
+    // Per-frame timings, VAD and echo statistics; snapshot() from any thread
+    const AecMetrics &metrics() const { return metrics_; }
+
+    static const int kPipelineRate = 48000;
+    static const int kFrameSamples = kPipelineRate / 100; // 10ms mono PCM
+    static const int kFrameBytes = kFrameSamples * 2;
+    // sendRing frame flag: the VAD heard speech (see DtxEncoder)
+    static const uint32_t kFrameVoice = 1;
+
+public slots:
+    void start();
+    void stop();
+
+signals:
+    void started();
+    void failed(const QString &reason);
+    void framesReady();
+    void delayEstimateChanged();
+
+private slots:
+    void drainInput();
+
+private:
+    void applyRealtimePriority();
+    bool setUpRateConversion();
+    void processFrame();
+    void pullRemoteFrame(FrameRef *frame);
+    void writePlayout(const int16_t *samples);
+    void updateDelay(int queuedFrames);
+    void recordMetrics(qint64 processNs, qint64 frameNs);
+
+    WebrtcAEC3 *processor_;
+    FramePool *framePool_;
+    JitterBuffer *jitterBuffer_;
+    FrameRing *farRing_;
+    FrameRing *sendRing_;
+
+    QAudioDeviceInfo inputInfo_;
+    QAudioDeviceInfo outputInfo_;
+    QAudioFormat format_;
+    QAudioInput *audioInput_;
+    QIODevice *inputDevice_;
+    QAudioOutput *audioOutput_;
+    QIODevice *outputDevice_;
+    int realtimePriority_;
+    bool driftCompensation_;
+
+    std::vector<int16_t> nearFrame_;
+    std::vector<int16_t> silentFrame_;
+    // Output that has no pooled frame to go to and is dropped
+    std::vector<int16_t> scratchFrame_;
+
+    // Device side at the device's rate; resamplers only exist when it
+    // differs from kPipelineRate
+    int deviceFrameBytes_;
+    std::vector<int16_t> deviceFrame_;
+    std::vector<int16_t> devicePlayFrame_;
+    std::unique_ptr<Resampler> captureResampler_;
+    std::unique_ptr<Resampler> playoutResampler_;
+
+    // AEC side at the processor's rate, same rule
+    size_t aecFrameSamples_;
+    std::vector<int16_t> nearAec_;
+    std::vector<int16_t> farAec_;
+    std::vector<int16_t> outAec_;
+    std::unique_ptr<Resampler> nearDownsampler_;
+    std::unique_ptr<Resampler> farDownsampler_;
+    std::unique_ptr<Resampler> outUpsampler_;
+
+    // Drift compensation; resamplers only exist while it is on. Remote at
+    // the pipeline rate, playout at the device rate.
+    std::unique_ptr<FractionalResampler> remoteResampler_;
+    std::unique_ptr<FractionalResampler> playoutDriftResampler_;
+    std::vector<int16_t> driftPlayFrame_;
+    DriftEstimator remoteDrift_;
+    DriftEstimator playoutDrift_;
+    bool remoteSteady_;
+    // Capture clock in frames since start()
+    quint64 captureFrames_;
+
+    // Engine thread only
+    std::unique_ptr<DelayEstimator> delayEstimator_;
+    int lastCandidateMs_;
+    quint64 processingNs_;
+
+    QElapsedTimer frameTimer_;
+    std::atomic<int> farDelayFrames_;
+    std::atomic<bool> autoDelay_;
+    std::atomic<int> echoDelayMs_;
+    std::atomic<float> delayConfidence_;
+    std::atomic<int> streamDelayMs_;
+    std::atomic<float> remoteDriftPpm_;
+    std::atomic<float> playoutDriftPpm_;
+    std::atomic<bool> notifyPending_;
+    std::atomic<quint64> framesProcessed_;
+    std::atomic<quint64> deadlineMisses_;
+    std::atomic<quint64> processingErrors_;
+    std::atomic<quint64> playoutDrops_;
+    std::atomic<int> lastBacklog_;
+    std::atomic<int> maxBacklog_;
+    AecMetrics metrics_;
+};
+
+#endif // AUDIOENGINE_H
@@ -0,0 +1,67 @@
+#include "audiopacket.h"
+#include "audiocodec.h"
+
+namespace {
+
+void putLe32(uint8_t* p, uint32_t v) {
+    p[0] = static_cast<uint8_t>(v);
+    p[1] = static_cast<uint8_t>(v >> 8);
+    p[2] = static_cast<uint8_t>(v >> 16);
+    p[3] = static_cast<uint8_t>(v >> 24);
+}
+
+uint32_t getLe32(const uint8_t* p) {
+    return static_cast<uint32_t>(p[0])
+        | (static_cast<uint32_t>(p[1]) << 8)
+        | (static_cast<uint32_t>(p[2]) << 16)
+        | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+} // namespace
+
+size_t AudioPacketHeader::frameBytes() const {
+    return audioCodecFrameBytes(payload_type, frameSamples(), channels);
+}
+
+void writeAudioPacketHeader(const AudioPacketHeader& header, uint8_t* dst) {
+    dst[0] = header.version;
+    dst[1] = header.payload_type;
+    dst[2] = header.channels;
+    dst[3] = header.frame_count;
+    putLe32(dst + 4, header.sequence);
+    putLe32(dst + 8, header.timestamp);
+    putLe32(dst + 12, header.sample_rate);
+}
+
+bool parseAudioPacket(const uint8_t* data, size_t size,
+                      AudioPacketHeader* header, const uint8_t** payload) {
+    if (size < kAudioPacketHeaderBytes) {
+        return false;
+    }
+
+    AudioPacketHeader h;
+    h.version = data[0];
+    h.payload_type = data[1];
+    h.channels = data[2];
+    h.frame_count = data[3];
+    h.sequence = getLe32(data + 4);
+    h.timestamp = getLe32(data + 8);
+    h.sample_rate = getLe32(data + 12);
+
+    if (h.version != kAudioPacketVersion || h.channels == 0 || h.frame_count == 0
+        || h.sample_rate == 0 || h.sample_rate % 100 != 0) {
+        return false;
+    }
+
+    const size_t frame_bytes = h.frameBytes();
+    if (frame_bytes == 0 || size - kAudioPacketHeaderBytes != frame_bytes * h.frame_count) {
+        return false;
+    }
+    if (h.payload_type == kPayloadComfortNoise && h.frame_count != 1) {
+        return false;
+    }
+
+    *header = h;
+    *payload = data + kAudioPacketHeaderBytes;
+    return true;
+}
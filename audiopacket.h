@@ -0,0 +1,67 @@
+#ifndef AUDIOPACKET_H
+#define AUDIOPACKET_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Binary framing for audio sent over the WebSocket link.
+//
+// Every message is a 16-byte little-endian header followed by |frame_count|
+// consecutive 10 ms frames of interleaved audio:
+//
+//   offset  size  field
+//        0     1  version        (kAudioPacketVersion)
+//        1     1  payload_type   (AudioPayloadType)
+//        2     1  channels
+//        3     1  frame_count    (1..255)
+//        4     4  sequence       sequence number of the first frame
+//        8     4  timestamp      capture time of the first frame, in samples
+//       12     4  sample_rate    Hz, a multiple of 100
+//
+// Frame i of a message has sequence + i and timestamp + i * sample_rate / 100,
+// so a receiver can split a batch into independent frames. A comfort noise
+// message carries one silence descriptor in place of the frame with its
+// sequence number; DTX leaves gaps in the sequence that are not loss.
+
+const uint8_t kAudioPacketVersion = 1;
+const size_t kAudioPacketHeaderBytes = 16;
+
+// Codec of the frames; see audiocodec.h
+enum AudioPayloadType {
+    kPayloadPcm16 = 0,    // little-endian int16
+    kPayloadPcmu = 1,     // G.711 mu-law
+    kPayloadPcma = 2,     // G.711 A-law
+    kPayloadImaAdpcm = 3, // IMA-ADPCM, one self-contained block per channel
+    kPayloadComfortNoise = 4 // silence descriptor (dtx.h); frame_count 1, any channels
+};
+
+struct AudioPacketHeader {
+    uint8_t version;
+    uint8_t payload_type;
+    uint8_t channels;
+    uint8_t frame_count;
+    uint32_t sequence;
+    uint32_t timestamp;
+    uint32_t sample_rate;
+
+    AudioPacketHeader()
+        : version(kAudioPacketVersion), payload_type(kPayloadPcm16), channels(1),
+          frame_count(1), sequence(0), timestamp(0), sample_rate(48000) {}
+
+    // Samples per channel in one 10 ms frame
+    size_t frameSamples() const { return sample_rate / 100; }
+    // Encoded bytes of one frame, all channels; 0 for unknown payload types
+    size_t frameBytes() const;
+};
+
+// Writes |header| to the first kAudioPacketHeaderBytes of |dst|.
+void writeAudioPacketHeader(const AudioPacketHeader& header, uint8_t* dst);
+
+// Parses and validates a whole message. On success fills |header|, points
+// |payload| at the first frame and returns true; the payload size has been
+// checked against frame_count. Returns false for unknown versions or payload
+// types and for truncated or inconsistent messages.
+bool parseAudioPacket(const uint8_t* data, size_t size,
+                      AudioPacketHeader* header, const uint8_t** payload);
+
+#endif // AUDIOPACKET_H
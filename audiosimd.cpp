@@ -0,0 +1,554 @@
+#include "audiosimd.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define AUDIO_SIMD_SSE2 1
+#endif
+
+#if AUDIO_SIMD_SSE2 && defined(__GNUC__)
+#include <immintrin.h>
+#define AUDIO_SIMD_AVX2 1
+#define AUDIO_SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define AUDIO_SIMD_NEON 1
+#endif
+
+namespace {
+
+const float kS16ToFloatPos = 1.0f / 32767.0f;
+const float kS16ToFloatNeg = 1.0f / 32768.0f;
+
+// Scalar references, identical to webrtc's audio_util.h
+
+inline float s16ToFloat(int16_t v) {
+    return v * (v > 0 ? kS16ToFloatPos : kS16ToFloatNeg);
+}
+
+inline int16_t floatToS16(float v) {
+    if (v > 0) {
+        return v >= 1 ? 32767 : static_cast<int16_t>(v * 32767.0f + 0.5f);
+    }
+    return v <= -1 ? -32768 : static_cast<int16_t>(v * 32768.0f - 0.5f);
+}
+
+void monoS16ToFloatScalar(const int16_t* src, size_t n, float* dst) {
+    for (size_t i = 0; i < n; ++i) {
+        dst[i] = s16ToFloat(src[i]);
+    }
+}
+
+void monoFloatToS16Scalar(const float* src, size_t n, int16_t* dst) {
+    for (size_t i = 0; i < n; ++i) {
+        dst[i] = floatToS16(src[i]);
+    }
+}
+
+void stereoS16ToFloatScalar(const int16_t* src, size_t n, float* left, float* right) {
+    for (size_t i = 0; i < n; ++i) {
+        left[i] = s16ToFloat(src[2 * i]);
+        right[i] = s16ToFloat(src[2 * i + 1]);
+    }
+}
+
+void stereoFloatToS16Scalar(const float* left, const float* right, size_t n, int16_t* dst) {
+    for (size_t i = 0; i < n; ++i) {
+        dst[2 * i] = floatToS16(left[i]);
+        dst[2 * i + 1] = floatToS16(right[i]);
+    }
+}
+
+void accumulateScalar(const int16_t* src, size_t n, int32_t* acc) {
+    for (size_t i = 0; i < n; ++i) {
+        acc[i] += src[i];
+    }
+}
+
+void subtractSaturateScalar(const int32_t* total, const int16_t* minus, size_t n, int16_t* out) {
+    for (size_t i = 0; i < n; ++i) {
+        int32_t v = total[i] - minus[i];
+        out[i] = static_cast<int16_t>(v > 32767 ? 32767 : (v < -32768 ? -32768 : v));
+    }
+}
+
+float dotProductScalar(const float* a, const float* b, size_t n) {
+    float sum = 0.0f;
+    for (size_t i = 0; i < n; ++i) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+#if AUDIO_SIMD_SSE2
+
+inline __m128 s16ToFloatSse2(__m128i v32) {
+    __m128 f = _mm_cvtepi32_ps(v32);
+    __m128 positive = _mm_cmpgt_ps(f, _mm_setzero_ps());
+    __m128 scale = _mm_or_ps(_mm_and_ps(positive, _mm_set1_ps(kS16ToFloatPos)),
+                             _mm_andnot_ps(positive, _mm_set1_ps(kS16ToFloatNeg)));
+    return _mm_mul_ps(f, scale);
+}
+
+// Scales, rounds half away from zero and clamps so the truncating convert
+// lands exactly where the scalar reference does.
+inline __m128i floatToS32Sse2(__m128 v) {
+    __m128 positive = _mm_cmpgt_ps(v, _mm_setzero_ps());
+    __m128 scale = _mm_or_ps(_mm_and_ps(positive, _mm_set1_ps(32767.0f)),
+                             _mm_andnot_ps(positive, _mm_set1_ps(32768.0f)));
+    __m128 half = _mm_or_ps(_mm_and_ps(positive, _mm_set1_ps(0.5f)),
+                            _mm_andnot_ps(positive, _mm_set1_ps(-0.5f)));
+    __m128 x = _mm_add_ps(_mm_mul_ps(v, scale), half);
+    x = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(-32768.0f)), _mm_set1_ps(32767.0f));
+    return _mm_cvttps_epi32(x);
+}
+
+void monoS16ToFloatSse2(const int16_t* src, size_t n, float* dst) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        // Sign-extend int16 -> int32 without SSE4.1
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16);
+        _mm_storeu_ps(dst + i, s16ToFloatSse2(lo));
+        _mm_storeu_ps(dst + i + 4, s16ToFloatSse2(hi));
+    }
+    monoS16ToFloatScalar(src + i, n - i, dst + i);
+}
+
+void monoFloatToS16Sse2(const float* src, size_t n, int16_t* dst) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i lo = floatToS32Sse2(_mm_loadu_ps(src + i));
+        __m128i hi = floatToS32Sse2(_mm_loadu_ps(src + i + 4));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packs_epi32(lo, hi));
+    }
+    monoFloatToS16Scalar(src + i, n - i, dst + i);
+}
+
+// A stereo frame is one 32-bit lane: left in the low half, right in the
+// high half, so shifts split and join the channels without shuffles.
+void stereoS16ToFloatSse2(const int16_t* src, size_t n, float* left, float* right) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * i));
+        _mm_storeu_ps(left + i, s16ToFloatSse2(_mm_srai_epi32(_mm_slli_epi32(s, 16), 16)));
+        _mm_storeu_ps(right + i, s16ToFloatSse2(_mm_srai_epi32(s, 16)));
+    }
+    stereoS16ToFloatScalar(src + 2 * i, n - i, left + i, right + i);
+}
+
+void stereoFloatToS16Sse2(const float* left, const float* right, size_t n, int16_t* dst) {
+    const __m128i low_mask = _mm_set1_epi32(0xFFFF);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        // Already clamped to the int16 range, so no pack is needed
+        __m128i l = floatToS32Sse2(_mm_loadu_ps(left + i));
+        __m128i r = floatToS32Sse2(_mm_loadu_ps(right + i));
+        __m128i frames = _mm_or_si128(_mm_and_si128(l, low_mask), _mm_slli_epi32(r, 16));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 2 * i), frames);
+    }
+    stereoFloatToS16Scalar(left + i, right + i, n - i, dst + 2 * i);
+}
+
+void accumulateSse2(const int16_t* src, size_t n, int32_t* acc) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16);
+        __m128i* a = reinterpret_cast<__m128i*>(acc + i);
+        _mm_storeu_si128(a, _mm_add_epi32(_mm_loadu_si128(a), lo));
+        _mm_storeu_si128(a + 1, _mm_add_epi32(_mm_loadu_si128(a + 1), hi));
+    }
+    accumulateScalar(src + i, n - i, acc + i);
+}
+
+void subtractSaturateSse2(const int32_t* total, const int16_t* minus, size_t n, int16_t* out) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i m = _mm_loadu_si128(reinterpret_cast<const __m128i*>(minus + i));
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(m, m), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(m, m), 16);
+        const __m128i* t = reinterpret_cast<const __m128i*>(total + i);
+        lo = _mm_sub_epi32(_mm_loadu_si128(t), lo);
+        hi = _mm_sub_epi32(_mm_loadu_si128(t + 1), hi);
+        // packs saturates int32 -> int16
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packs_epi32(lo, hi));
+    }
+    subtractSaturateScalar(total + i, minus + i, n - i, out + i);
+}
+
+float dotProductSse2(const float* a, const float* b, size_t n) {
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, _mm_add_ps(acc0, acc1));
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + dotProductScalar(a + i, b + i, n - i);
+}
+
+#endif // AUDIO_SIMD_SSE2
+
+#if AUDIO_SIMD_AVX2
+
+AUDIO_SIMD_TARGET_AVX2
+void monoS16ToFloatAvx2(const int16_t* src, size_t n, float* dst) {
+    const __m256 pos = _mm256_set1_ps(kS16ToFloatPos);
+    const __m256 neg = _mm256_set1_ps(kS16ToFloatNeg);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        __m256 lo = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(s)));
+        __m256 hi = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(s, 1)));
+        __m256 lo_scale = _mm256_blendv_ps(neg, pos, _mm256_cmp_ps(lo, _mm256_setzero_ps(), _CMP_GT_OQ));
+        __m256 hi_scale = _mm256_blendv_ps(neg, pos, _mm256_cmp_ps(hi, _mm256_setzero_ps(), _CMP_GT_OQ));
+        _mm256_storeu_ps(dst + i, _mm256_mul_ps(lo, lo_scale));
+        _mm256_storeu_ps(dst + i + 8, _mm256_mul_ps(hi, hi_scale));
+    }
+    monoS16ToFloatScalar(src + i, n - i, dst + i);
+}
+
+AUDIO_SIMD_TARGET_AVX2
+inline __m256i floatToS32Avx2(__m256 v) {
+    __m256 positive = _mm256_cmp_ps(v, _mm256_setzero_ps(), _CMP_GT_OQ);
+    __m256 scale = _mm256_blendv_ps(_mm256_set1_ps(32768.0f), _mm256_set1_ps(32767.0f), positive);
+    __m256 half = _mm256_blendv_ps(_mm256_set1_ps(-0.5f), _mm256_set1_ps(0.5f), positive);
+    // Separate mul and add: a fused multiply-add would round differently
+    // from the scalar reference.
+    __m256 x = _mm256_add_ps(_mm256_mul_ps(v, scale), half);
+    x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(-32768.0f)), _mm256_set1_ps(32767.0f));
+    return _mm256_cvttps_epi32(x);
+}
+
+AUDIO_SIMD_TARGET_AVX2
+void monoFloatToS16Avx2(const float* src, size_t n, int16_t* dst) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i lo = floatToS32Avx2(_mm256_loadu_ps(src + i));
+        __m256i hi = floatToS32Avx2(_mm256_loadu_ps(src + i + 8));
+        // packs works per 128-bit lane; permute restores sample order
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xD8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), packed);
+    }
+    monoFloatToS16Scalar(src + i, n - i, dst + i);
+}
+
+AUDIO_SIMD_TARGET_AVX2
+inline __m256 s16ToFloatAvx2(__m256i v32) {
+    __m256 f = _mm256_cvtepi32_ps(v32);
+    __m256 scale = _mm256_blendv_ps(_mm256_set1_ps(kS16ToFloatNeg), _mm256_set1_ps(kS16ToFloatPos),
+                                    _mm256_cmp_ps(f, _mm256_setzero_ps(), _CMP_GT_OQ));
+    return _mm256_mul_ps(f, scale);
+}
+
+AUDIO_SIMD_TARGET_AVX2
+void stereoS16ToFloatAvx2(const int16_t* src, size_t n, float* left, float* right) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 2 * i));
+        _mm256_storeu_ps(left + i, s16ToFloatAvx2(_mm256_srai_epi32(_mm256_slli_epi32(s, 16), 16)));
+        _mm256_storeu_ps(right + i, s16ToFloatAvx2(_mm256_srai_epi32(s, 16)));
+    }
+    stereoS16ToFloatScalar(src + 2 * i, n - i, left + i, right + i);
+}
+
+AUDIO_SIMD_TARGET_AVX2
+void stereoFloatToS16Avx2(const float* left, const float* right, size_t n, int16_t* dst) {
+    const __m256i low_mask = _mm256_set1_epi32(0xFFFF);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i l = floatToS32Avx2(_mm256_loadu_ps(left + i));
+        __m256i r = floatToS32Avx2(_mm256_loadu_ps(right + i));
+        __m256i frames = _mm256_or_si256(_mm256_and_si256(l, low_mask), _mm256_slli_epi32(r, 16));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 2 * i), frames);
+    }
+    stereoFloatToS16Scalar(left + i, right + i, n - i, dst + 2 * i);
+}
+
+AUDIO_SIMD_TARGET_AVX2
+void accumulateAvx2(const int16_t* src, size_t n, int32_t* acc) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        __m256i lo = _mm256_cvtepi16_epi32(_mm256_castsi256_si128(s));
+        __m256i hi = _mm256_cvtepi16_epi32(_mm256_extracti128_si256(s, 1));
+        __m256i* a = reinterpret_cast<__m256i*>(acc + i);
+        _mm256_storeu_si256(a, _mm256_add_epi32(_mm256_loadu_si256(a), lo));
+        _mm256_storeu_si256(a + 1, _mm256_add_epi32(_mm256_loadu_si256(a + 1), hi));
+    }
+    accumulateScalar(src + i, n - i, acc + i);
+}
+
+AUDIO_SIMD_TARGET_AVX2
+void subtractSaturateAvx2(const int32_t* total, const int16_t* minus, size_t n, int16_t* out) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i m = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(minus + i));
+        const __m256i* t = reinterpret_cast<const __m256i*>(total + i);
+        __m256i lo = _mm256_sub_epi32(_mm256_loadu_si256(t), _mm256_cvtepi16_epi32(_mm256_castsi256_si128(m)));
+        __m256i hi = _mm256_sub_epi32(_mm256_loadu_si256(t + 1), _mm256_cvtepi16_epi32(_mm256_extracti128_si256(m, 1)));
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xD8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), packed);
+    }
+    subtractSaturateScalar(total + i, minus + i, n - i, out + i);
+}
+
+AUDIO_SIMD_TARGET_AVX2
+float dotProductAvx2(const float* a, const float* b, size_t n) {
+    // Two accumulators hide the add latency; no FMA so the result does not
+    // depend on whether the CPU has it
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+        acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8)));
+    }
+    __m256 acc = _mm256_add_ps(acc0, acc1);
+    __m128 sum4 = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    float lanes[4];
+    _mm_storeu_ps(lanes, sum4);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + dotProductScalar(a + i, b + i, n - i);
+}
+
+#endif // AUDIO_SIMD_AVX2
+
+#if AUDIO_SIMD_NEON
+
+inline float32x4_t s16ToFloatNeon(int16x4_t s) {
+    float32x4_t f = vcvtq_f32_s32(vmovl_s16(s));
+    uint32x4_t positive = vcgtq_f32(f, vdupq_n_f32(0.0f));
+    float32x4_t scale = vbslq_f32(positive, vdupq_n_f32(kS16ToFloatPos), vdupq_n_f32(kS16ToFloatNeg));
+    return vmulq_f32(f, scale);
+}
+
+inline int32x4_t floatToS32Neon(float32x4_t v) {
+    uint32x4_t positive = vcgtq_f32(v, vdupq_n_f32(0.0f));
+    float32x4_t scale = vbslq_f32(positive, vdupq_n_f32(32767.0f), vdupq_n_f32(32768.0f));
+    float32x4_t half = vbslq_f32(positive, vdupq_n_f32(0.5f), vdupq_n_f32(-0.5f));
+    float32x4_t x = vaddq_f32(vmulq_f32(v, scale), half);
+    x = vminq_f32(vmaxq_f32(x, vdupq_n_f32(-32768.0f)), vdupq_n_f32(32767.0f));
+    return vcvtq_s32_f32(x); // truncates toward zero
+}
+
+void monoS16ToFloatNeon(const int16_t* src, size_t n, float* dst) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        int16x8_t s = vld1q_s16(src + i);
+        vst1q_f32(dst + i, s16ToFloatNeon(vget_low_s16(s)));
+        vst1q_f32(dst + i + 4, s16ToFloatNeon(vget_high_s16(s)));
+    }
+    monoS16ToFloatScalar(src + i, n - i, dst + i);
+}
+
+void monoFloatToS16Neon(const float* src, size_t n, int16_t* dst) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        int16x4_t lo = vqmovn_s32(floatToS32Neon(vld1q_f32(src + i)));
+        int16x4_t hi = vqmovn_s32(floatToS32Neon(vld1q_f32(src + i + 4)));
+        vst1q_s16(dst + i, vcombine_s16(lo, hi));
+    }
+    monoFloatToS16Scalar(src + i, n - i, dst + i);
+}
+
+void stereoS16ToFloatNeon(const int16_t* src, size_t n, float* left, float* right) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        int16x8x2_t s = vld2q_s16(src + 2 * i);
+        vst1q_f32(left + i, s16ToFloatNeon(vget_low_s16(s.val[0])));
+        vst1q_f32(left + i + 4, s16ToFloatNeon(vget_high_s16(s.val[0])));
+        vst1q_f32(right + i, s16ToFloatNeon(vget_low_s16(s.val[1])));
+        vst1q_f32(right + i + 4, s16ToFloatNeon(vget_high_s16(s.val[1])));
+    }
+    stereoS16ToFloatScalar(src + 2 * i, n - i, left + i, right + i);
+}
+
+void stereoFloatToS16Neon(const float* left, const float* right, size_t n, int16_t* dst) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        int16x8x2_t frames;
+        frames.val[0] = vcombine_s16(vqmovn_s32(floatToS32Neon(vld1q_f32(left + i))),
+                                     vqmovn_s32(floatToS32Neon(vld1q_f32(left + i + 4))));
+        frames.val[1] = vcombine_s16(vqmovn_s32(floatToS32Neon(vld1q_f32(right + i))),
+                                     vqmovn_s32(floatToS32Neon(vld1q_f32(right + i + 4))));
+        vst2q_s16(dst + 2 * i, frames);
+    }
+    stereoFloatToS16Scalar(left + i, right + i, n - i, dst + 2 * i);
+}
+
+void accumulateNeon(const int16_t* src, size_t n, int32_t* acc) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        int16x8_t s = vld1q_s16(src + i);
+        vst1q_s32(acc + i, vaddw_s16(vld1q_s32(acc + i), vget_low_s16(s)));
+        vst1q_s32(acc + i + 4, vaddw_s16(vld1q_s32(acc + i + 4), vget_high_s16(s)));
+    }
+    accumulateScalar(src + i, n - i, acc + i);
+}
+
+void subtractSaturateNeon(const int32_t* total, const int16_t* minus, size_t n, int16_t* out) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        int16x8_t m = vld1q_s16(minus + i);
+        int32x4_t lo = vsubw_s16(vld1q_s32(total + i), vget_low_s16(m));
+        int32x4_t hi = vsubw_s16(vld1q_s32(total + i + 4), vget_high_s16(m));
+        vst1q_s16(out + i, vcombine_s16(vqmovn_s32(lo), vqmovn_s32(hi)));
+    }
+    subtractSaturateScalar(total + i, minus + i, n - i, out + i);
+}
+
+float dotProductNeon(const float* a, const float* b, size_t n) {
+    float32x4_t acc0 = vdupq_n_f32(0.0f);
+    float32x4_t acc1 = vdupq_n_f32(0.0f);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        acc0 = vmlaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+        acc1 = vmlaq_f32(acc1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+    }
+    float32x4_t acc = vaddq_f32(acc0, acc1);
+    float32x2_t sum2 = vadd_f32(vget_low_f32(acc), vget_high_f32(acc));
+    return vget_lane_f32(vpadd_f32(sum2, sum2), 0) + dotProductScalar(a + i, b + i, n - i);
+}
+
+#endif // AUDIO_SIMD_NEON
+
+typedef void (*MonoS16ToFloatFn)(const int16_t*, size_t, float*);
+typedef void (*MonoFloatToS16Fn)(const float*, size_t, int16_t*);
+typedef void (*StereoS16ToFloatFn)(const int16_t*, size_t, float*, float*);
+typedef void (*StereoFloatToS16Fn)(const float*, const float*, size_t, int16_t*);
+typedef void (*AccumulateFn)(const int16_t*, size_t, int32_t*);
+typedef void (*SubtractSaturateFn)(const int32_t*, const int16_t*, size_t, int16_t*);
+typedef float (*DotProductFn)(const float*, const float*, size_t);
+
+struct Kernels {
+    const char* isa;
+    MonoS16ToFloatFn mono_s16_to_float;
+    MonoFloatToS16Fn mono_float_to_s16;
+    StereoS16ToFloatFn stereo_s16_to_float;
+    StereoFloatToS16Fn stereo_float_to_s16;
+    AccumulateFn accumulate;
+    SubtractSaturateFn subtract_saturate;
+    DotProductFn dot_product;
+};
+
+Kernels selectKernels() {
+    Kernels k = { "scalar", monoS16ToFloatScalar, monoFloatToS16Scalar,
+                  stereoS16ToFloatScalar, stereoFloatToS16Scalar,
+                  accumulateScalar, subtractSaturateScalar, dotProductScalar };
+#if AUDIO_SIMD_SSE2
+    k.isa = "sse2";
+    k.mono_s16_to_float = monoS16ToFloatSse2;
+    k.mono_float_to_s16 = monoFloatToS16Sse2;
+    k.stereo_s16_to_float = stereoS16ToFloatSse2;
+    k.stereo_float_to_s16 = stereoFloatToS16Sse2;
+    k.accumulate = accumulateSse2;
+    k.subtract_saturate = subtractSaturateSse2;
+    k.dot_product = dotProductSse2;
+#endif
+#if AUDIO_SIMD_AVX2
+    if (__builtin_cpu_supports("avx2")) {
+        k.isa = "avx2";
+        k.mono_s16_to_float = monoS16ToFloatAvx2;
+        k.mono_float_to_s16 = monoFloatToS16Avx2;
+        k.stereo_s16_to_float = stereoS16ToFloatAvx2;
+        k.stereo_float_to_s16 = stereoFloatToS16Avx2;
+        k.accumulate = accumulateAvx2;
+        k.subtract_saturate = subtractSaturateAvx2;
+        k.dot_product = dotProductAvx2;
+    }
+#endif
+#if AUDIO_SIMD_NEON
+    k.isa = "neon";
+    k.mono_s16_to_float = monoS16ToFloatNeon;
+    k.mono_float_to_s16 = monoFloatToS16Neon;
+    k.stereo_s16_to_float = stereoS16ToFloatNeon;
+    k.stereo_float_to_s16 = stereoFloatToS16Neon;
+    k.accumulate = accumulateNeon;
+    k.subtract_saturate = subtractSaturateNeon;
+    k.dot_product = dotProductNeon;
+#endif
+    return k;
+}
+
+// Frames per channel converted at a time for more than two channels
+const size_t kChannelBlockFrames = 256;
+
+// Resolved once; thread-safe under C++11 static initialisation rules
+const Kernels& kernels() {
+    static const Kernels k = selectKernels();
+    return k;
+}
+
+} // namespace
+
+void deinterleaveS16ToFloat(const int16_t* interleaved, size_t num_frames,
+                            size_t num_channels, float* const* planes) {
+    const Kernels& k = kernels();
+    if (num_channels == 1) {
+        k.mono_s16_to_float(interleaved, num_frames, planes[0]);
+        return;
+    }
+    if (num_channels == 2) {
+        k.stereo_s16_to_float(interleaved, num_frames, planes[0], planes[1]);
+        return;
+    }
+    // Mic arrays: gather each channel into a small contiguous block, then
+    // convert it with the mono kernel
+    int16_t block[kChannelBlockFrames];
+    for (size_t pos = 0; pos < num_frames; pos += kChannelBlockFrames) {
+        const size_t n = num_frames - pos < kChannelBlockFrames ? num_frames - pos : kChannelBlockFrames;
+        const int16_t* src = interleaved + pos * num_channels;
+        for (size_t ch = 0; ch < num_channels; ++ch) {
+            for (size_t i = 0; i < n; ++i) {
+                block[i] = src[i * num_channels + ch];
+            }
+            k.mono_s16_to_float(block, n, planes[ch] + pos);
+        }
+    }
+}
+
+void interleaveFloatToS16(const float* const* planes, size_t num_frames,
+                          size_t num_channels, int16_t* interleaved) {
+    const Kernels& k = kernels();
+    if (num_channels == 1) {
+        k.mono_float_to_s16(planes[0], num_frames, interleaved);
+        return;
+    }
+    if (num_channels == 2) {
+        k.stereo_float_to_s16(planes[0], planes[1], num_frames, interleaved);
+        return;
+    }
+    int16_t block[kChannelBlockFrames];
+    for (size_t pos = 0; pos < num_frames; pos += kChannelBlockFrames) {
+        const size_t n = num_frames - pos < kChannelBlockFrames ? num_frames - pos : kChannelBlockFrames;
+        int16_t* dst = interleaved + pos * num_channels;
+        for (size_t ch = 0; ch < num_channels; ++ch) {
+            k.mono_float_to_s16(planes[ch] + pos, n, block);
+            for (size_t i = 0; i < n; ++i) {
+                dst[i * num_channels + ch] = block[i];
+            }
+        }
+    }
+}
+
+void accumulateS16(const int16_t* src, size_t n, int32_t* acc) {
+    kernels().accumulate(src, n, acc);
+}
+
+void subtractSaturateS16(const int32_t* total, const int16_t* minus, size_t n, int16_t* out) {
+    kernels().subtract_saturate(total, minus, n, out);
+}
+
+float dotProductFloat(const float* a, const float* b, size_t n) {
+    return kernels().dot_product(a, b, n);
+}
+
+const char* audioSimdIsa() {
+    return kernels().isa;
+}
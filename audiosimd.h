@@ -0,0 +1,42 @@
+#ifndef AUDIOSIMD_H
+#define AUDIOSIMD_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Vectorised sample-format kernels shared by the processing paths.
+//
+// Every kernel has a scalar reference implementation and SSE2, AVX2 and NEON
+// variants; the fastest one the CPU supports is picked on first use. All
+// variants produce bit-identical results to webrtc::S16ToFloat() /
+// webrtc::FloatToS16(), i.e. int16 maps to [-1, 1] with an asymmetric scale
+// and float->int16 rounds half away from zero with saturation.
+
+// Converts |num_frames| frames of interleaved int16 into one float plane per
+// channel, e.g. straight into ChannelBuffer<float>::channels(). Mono and
+// stereo have dedicated kernels; more channels go through the mono kernel a
+// block at a time.
+void deinterleaveS16ToFloat(const int16_t* interleaved, size_t num_frames,
+                            size_t num_channels, float* const* planes);
+
+// Converts one float plane per channel into interleaved, saturated int16.
+void interleaveFloatToS16(const float* const* planes, size_t num_frames,
+                          size_t num_channels, int16_t* interleaved);
+
+// Mixing: adds |n| int16 samples into an int32 accumulator, acc[i] += src[i].
+void accumulateS16(const int16_t* src, size_t n, int32_t* acc);
+
+// Mix-minus: out[i] = saturate16(total[i] - minus[i]), i.e. a mix of
+// everything but |minus| from the accumulator built with accumulateS16().
+void subtractSaturateS16(const int32_t* total, const int16_t* minus, size_t n, int16_t* out);
+
+// Filtering: returns sum(a[i] * b[i]) over |n| floats. Unlike the conversion
+// kernels the summation order differs per instruction set, so results may
+// differ from the scalar reference in the last bits.
+float dotProductFloat(const float* a, const float* b, size_t n);
+
+// Name of the instruction set the kernels dispatch to ("avx2", "sse2",
+// "neon" or "scalar"), for logs and benchmark reports.
+const char* audioSimdIsa();
+
+#endif // AUDIOSIMD_H
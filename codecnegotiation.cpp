@@ -0,0 +1,40 @@
+#include "codecnegotiation.h"
+#include "audiocodec.h"
+#include "audiopacket.h"
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <algorithm>
+
+QString codecHelloMessage(uint8_t preferred) {
+    QJsonArray codecs;
+    const std::vector<std::string> offer = audioCodecOffer(preferred);
+    for (size_t i = 0; i < offer.size(); ++i) {
+        codecs.append(QString::fromStdString(offer[i]));
+    }
+
+    QJsonObject hello;
+    hello.insert("type", QStringLiteral("hello"));
+    hello.insert("version", static_cast<int>(kAudioPacketVersion));
+    hello.insert("codecs", codecs);
+    return QString::fromUtf8(QJsonDocument(hello).toJson(QJsonDocument::Compact));
+}
+
+bool parseCodecHello(const QString &message, uint8_t preferred, uint8_t *chosen,
+                     bool *comfortNoise) {
+    QJsonObject hello = QJsonDocument::fromJson(message.toUtf8()).object();
+    if (hello.value("type").toString() != QLatin1String("hello")) {
+        return false;
+    }
+
+    std::vector<std::string> peerCodecs;
+    for (const QJsonValue &codec : hello.value("codecs").toArray()) {
+        peerCodecs.push_back(codec.toString().toStdString());
+    }
+    *chosen = audioCodecNegotiate(preferred, peerCodecs);
+    if (comfortNoise) {
+        *comfortNoise = std::find(peerCodecs.begin(), peerCodecs.end(),
+                                  audioCodecName(kPayloadComfortNoise)) != peerCodecs.end();
+    }
+    return true;
+}
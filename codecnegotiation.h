@@ -0,0 +1,20 @@
+#ifndef CODECNEGOTIATION_H
+#define CODECNEGOTIATION_H
+
+#include <QString>
+#include <cstdint>
+
+// The per-connection codec handshake. Each side sends
+//   {"type":"hello","version":1,"codecs":["adpcm","pcmu",...]}
+// as a text message when a connection opens, listing what it can decode
+// with its preference first (see audioCodecOffer()).
+
+QString codecHelloMessage(uint8_t preferred);
+
+// If |message| is a hello, stores the codec to send with in |chosen| and
+// returns true; other text messages return false. |comfortNoise|, if given,
+// is set to whether the peer accepts DTX (it offered "cn").
+bool parseCodecHello(const QString &message, uint8_t preferred, uint8_t *chosen,
+                     bool *comfortNoise = nullptr);
+
+#endif // CODECNEGOTIATION_H
@@ -0,0 +1,367 @@
+#include "conferencemixer.h"
+#include "audiosimd.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+
+const std::chrono::milliseconds kTickPeriod(10);
+// After a stall longer than this the schedule restarts from now instead of
+// running a burst of back-to-back ticks
+const int kMaxCatchUpTicks = 5;
+// Jitter buffer depth per participant, in frames
+const size_t kJitterCapacityFrames = 50;
+
+// Same policy as AudioEngine: act on confident estimates that moved
+const float kMinDelayConfidence = 0.6f;
+const int kDelayToleranceMs = 4;
+const int kMaxStreamDelayMs = 500;
+
+// Counts outstanding tasks of one parallel phase; the tick thread waits
+// until all have finished
+class Latch {
+public:
+    explicit Latch(size_t count) : count_(count) {}
+
+    void countDown() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--count_ == 0) {
+            cv_.notify_one();
+        }
+    }
+
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this]() { return count_ == 0; });
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    size_t count_;
+};
+
+} // namespace
+
+struct ConferenceMixer::Participant {
+    ParticipantId id;
+    ProcessorPool* pool;
+    std::unique_ptr<WebrtcAEC3> processor;
+    JitterBuffer jitter;
+    DelayEstimator delay_estimator;
+    MixCallback callback;
+
+    // Only touched inside a tick
+    std::vector<int16_t> near_frame;
+    std::vector<int16_t> clean_frame;
+    std::vector<int16_t> mix_frame;   // sent last tick; this tick's far reference
+    int stream_delay_ms;
+
+    std::atomic<uint64_t> frames_mixed;
+    std::atomic<uint64_t> input_missing;
+    std::atomic<uint64_t> processing_errors;
+    std::atomic<int> echo_delay_ms;
+
+    std::chrono::steady_clock::time_point joined;
+    int64_t setup_us;
+    std::atomic<int64_t> first_frame_us;
+
+    Participant(ProcessorPool* processor_pool, size_t frame_samples, int sample_rate)
+        : id(0)
+        , pool(processor_pool)
+        , jitter(frame_samples, sample_rate, kJitterCapacityFrames)
+        , delay_estimator(sample_rate)
+        , near_frame(frame_samples, 0)
+        , clean_frame(frame_samples, 0)
+        , mix_frame(frame_samples, 0)
+        , stream_delay_ms(0)
+        , frames_mixed(0)
+        , input_missing(0)
+        , processing_errors(0)
+        , echo_delay_ms(-1)
+        , joined(std::chrono::steady_clock::now())
+        , setup_us(0)
+        , first_frame_us(-1) {}
+
+    ~Participant() {
+        pool->release(std::move(processor));
+    }
+};
+
+ConferenceMixer::ConferenceMixer(int sample_rate, size_t num_threads, size_t max_participants)
+    : sample_rate_(sample_rate)
+    , frame_samples_(static_cast<size_t>(sample_rate / 100))
+    , max_participants_(std::max<size_t>(2, max_participants))
+    , next_id_(1)
+    , total_(frame_samples_, 0)
+    , running_(false)
+    , ticks_(0)
+    , late_ticks_(0)
+    , skipped_ticks_(0)
+    , last_tick_ns_(0)
+    , max_tick_ns_(0)
+    , pool_(num_threads) {
+    // The tick copies participant pointers here; never reallocates later
+    active_.reserve(max_participants_);
+}
+
+ConferenceMixer::~ConferenceMixer() {
+    stop();
+}
+
+void ConferenceMixer::start() {
+    std::lock_guard<std::mutex> lock(run_mutex_);
+    if (running_) {
+        return;
+    }
+    running_ = true;
+    tick_thread_ = std::thread(&ConferenceMixer::tickLoop, this);
+}
+
+void ConferenceMixer::stop() {
+    {
+        std::lock_guard<std::mutex> lock(run_mutex_);
+        if (!running_) {
+            return;
+        }
+        running_ = false;
+    }
+    run_cv_.notify_all();
+    tick_thread_.join();
+}
+
+ConferenceMixer::ParticipantId ConferenceMixer::addParticipant(const ParticipantConfig& config,
+                                                               MixCallback callback) {
+    ParticipantPtr p = std::make_shared<Participant>(&processors_, frame_samples_, sample_rate_);
+    p->processor = processors_.acquire(atMixerRate(config));
+    p->stream_delay_ms = p->processor->system_delay_ms_;
+    p->callback = callback;
+    p->setup_us = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - p->joined).count();
+
+    std::lock_guard<std::mutex> lock(participants_mutex_);
+    if (participants_.size() >= max_participants_) {
+        throw std::runtime_error("Conference is full");
+    }
+    p->id = next_id_++;
+    participants_[p->id] = p;
+    return p->id;
+}
+
+void ConferenceMixer::reserveProcessors(const ParticipantConfig& config, size_t count) {
+    processors_.reserve(atMixerRate(config), count);
+}
+
+ConferenceMixer::ParticipantConfig ConferenceMixer::atMixerRate(const ParticipantConfig& config) const {
+    ParticipantConfig result;
+    for (size_t i = 0; i < config.size(); ++i) {
+        const int id = config[i].first;
+        // Jitter buffers, mixing and the per-participant frames are mono
+        if ((id == WebrtcAEC3::CAPTURE_CHANNELS || id == WebrtcAEC3::RENDER_CHANNELS)
+            && !(config[i].second.type == ConfigValue::INT && config[i].second.int_val == 1)) {
+            throw std::invalid_argument("ConferenceMixer: participants must be mono");
+        }
+        if (id != WebrtcAEC3::SAMPLE_RATE) {
+            result.push_back(config[i]);
+        }
+    }
+    result.push_back(std::make_pair(int(WebrtcAEC3::SAMPLE_RATE), ConfigValue(sample_rate_)));
+    return result;
+}
+
+void ConferenceMixer::removeParticipant(ParticipantId id) {
+    {
+        std::lock_guard<std::mutex> lock(participants_mutex_);
+        participants_.erase(id);
+    }
+    // The current tick may still hold it in active_; wait that tick out
+    std::lock_guard<std::mutex> tick_lock(tick_mutex_);
+}
+
+bool ConferenceMixer::submitFrame(ParticipantId id, uint32_t seq, uint32_t timestamp,
+                                  const int16_t* frame) {
+    ParticipantPtr p;
+    {
+        std::lock_guard<std::mutex> lock(participants_mutex_);
+        std::map<ParticipantId, ParticipantPtr>::const_iterator it = participants_.find(id);
+        if (it == participants_.end()) {
+            return false;
+        }
+        p = it->second;
+    }
+    p->jitter.insert(seq, timestamp, frame);
+    return true;
+}
+
+bool ConferenceMixer::submitSid(ParticipantId id, uint32_t seq, uint32_t timestamp,
+                                const uint8_t* sid, size_t bytes) {
+    ParticipantPtr p;
+    {
+        std::lock_guard<std::mutex> lock(participants_mutex_);
+        std::map<ParticipantId, ParticipantPtr>::const_iterator it = participants_.find(id);
+        if (it == participants_.end()) {
+            return false;
+        }
+        p = it->second;
+    }
+    p->jitter.insertSid(seq, timestamp, sid, bytes);
+    return true;
+}
+
+void ConferenceMixer::tick() {
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> tick_lock(tick_mutex_);
+
+    {
+        std::lock_guard<std::mutex> lock(participants_mutex_);
+        active_.clear();
+        for (std::map<ParticipantId, ParticipantPtr>::const_iterator it = participants_.begin();
+             it != participants_.end(); ++it) {
+            active_.push_back(it->second);
+        }
+    }
+
+    if (!active_.empty()) {
+        runParallel(&ConferenceMixer::cancelEcho);
+
+        std::fill(total_.begin(), total_.end(), 0);
+        for (size_t i = 0; i < active_.size(); ++i) {
+            accumulateS16(active_[i]->clean_frame.data(), frame_samples_, total_.data());
+        }
+
+        runParallel(&ConferenceMixer::mixMinus);
+    }
+
+    // Release removed participants here rather than inside the next tick
+    active_.clear();
+
+    const int64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - begin).count();
+    last_tick_ns_.store(elapsed, std::memory_order_relaxed);
+    if (elapsed > max_tick_ns_.load(std::memory_order_relaxed)) {
+        max_tick_ns_.store(elapsed, std::memory_order_relaxed);
+    }
+    ticks_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ConferenceMixer::runParallel(void (ConferenceMixer::*phase)(Participant&)) {
+    // One task per worker, each taking a strided share of the participants,
+    // instead of one task per participant
+    const size_t count = active_.size();
+    const size_t tasks = std::min(count, pool_.numThreads());
+    Latch latch(tasks);
+    for (size_t t = 0; t < tasks; ++t) {
+        pool_.submit([this, phase, t, tasks, count, &latch]() {
+            for (size_t i = t; i < count; i += tasks) {
+                (this->*phase)(*active_[i]);
+            }
+            latch.countDown();
+        });
+    }
+    latch.wait();
+}
+
+void ConferenceMixer::cancelEcho(Participant& p) {
+    const JitterBuffer::PopResult input = p.jitter.pop(p.near_frame.data());
+    if (input == JitterBuffer::kEmpty) {
+        p.input_missing.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    try {
+        p.processor->process(p.near_frame.data(), p.mix_frame.data(), p.clean_frame.data(), frame_samples_);
+    } catch (const std::exception& e) {
+        std::fill(p.clean_frame.begin(), p.clean_frame.end(), 0);
+        p.processing_errors.fetch_add(1, std::memory_order_relaxed);
+        std::cerr << "[Participant " << p.id << "] Processing failed: " << e.what() << std::endl;
+    }
+    if (input == JitterBuffer::kFrame && p.first_frame_us.load(std::memory_order_relaxed) < 0) {
+        p.first_frame_us.store(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - p.joined).count(), std::memory_order_relaxed);
+    }
+
+    // The mix reaches the participant's speaker a network round trip plus
+    // device latency before its echo comes back
+    if (p.delay_estimator.update(p.near_frame.data(), p.mix_frame.data(), frame_samples_)) {
+        DelayEstimator::Estimate estimate = p.delay_estimator.estimate();
+        if (estimate.confidence >= kMinDelayConfidence) {
+            const int delay = std::min(kMaxStreamDelayMs, std::max(0, estimate.delay_ms));
+            p.echo_delay_ms.store(delay, std::memory_order_relaxed);
+            if (std::abs(delay - p.stream_delay_ms) > kDelayToleranceMs) {
+                p.processor->setStreamDelayMs(delay);
+                p.stream_delay_ms = delay;
+            }
+        }
+    }
+}
+
+void ConferenceMixer::mixMinus(Participant& p) {
+    // mix_frame becomes next tick's far reference for this participant
+    subtractSaturateS16(total_.data(), p.clean_frame.data(), frame_samples_, p.mix_frame.data());
+    p.frames_mixed.fetch_add(1, std::memory_order_relaxed);
+    if (p.callback) {
+        p.callback(p.id, p.mix_frame.data(), frame_samples_);
+    }
+}
+
+void ConferenceMixer::tickLoop() {
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(run_mutex_);
+    while (running_) {
+        lock.unlock();
+        tick();
+        lock.lock();
+
+        deadline += kTickPeriod;
+        const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (now > deadline) {
+            late_ticks_.fetch_add(1, std::memory_order_relaxed);
+            if (now - deadline > kMaxCatchUpTicks * kTickPeriod) {
+                skipped_ticks_.fetch_add(static_cast<uint64_t>((now - deadline) / kTickPeriod),
+                                         std::memory_order_relaxed);
+                deadline = now;
+            }
+            continue;
+        }
+        run_cv_.wait_until(lock, deadline, [this]() { return !running_; });
+    }
+}
+
+size_t ConferenceMixer::participantCount() const {
+    std::lock_guard<std::mutex> lock(participants_mutex_);
+    return participants_.size();
+}
+
+bool ConferenceMixer::participantStats(ParticipantId id, ParticipantStats* stats) const {
+    ParticipantPtr p;
+    {
+        std::lock_guard<std::mutex> lock(participants_mutex_);
+        std::map<ParticipantId, ParticipantPtr>::const_iterator it = participants_.find(id);
+        if (it == participants_.end()) {
+            return false;
+        }
+        p = it->second;
+    }
+    stats->frames_mixed = p->frames_mixed.load(std::memory_order_relaxed);
+    stats->input_missing = p->input_missing.load(std::memory_order_relaxed);
+    stats->processing_errors = p->processing_errors.load(std::memory_order_relaxed);
+    stats->echo_delay_ms = p->echo_delay_ms.load(std::memory_order_relaxed);
+    stats->setup_us = p->setup_us;
+    stats->first_frame_us = p->first_frame_us.load(std::memory_order_relaxed);
+    stats->jitter = p->jitter.stats();
+    return true;
+}
+
+ConferenceMixer::TickStats ConferenceMixer::tickStats() const {
+    TickStats stats;
+    stats.ticks = ticks_.load(std::memory_order_relaxed);
+    stats.late_ticks = late_ticks_.load(std::memory_order_relaxed);
+    stats.skipped_ticks = skipped_ticks_.load(std::memory_order_relaxed);
+    stats.last_tick_ns = last_tick_ns_.load(std::memory_order_relaxed);
+    stats.max_tick_ns = max_tick_ns_.load(std::memory_order_relaxed);
+    stats.participants = participantCount();
+    return stats;
+}
@@ -0,0 +1,156 @@
+#ifndef CONFERENCEMIXER_H
+#define CONFERENCEMIXER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "WebrtcAEC3.h"
+#include "delayestimator.h"
+#include "jitterbuffer.h"
+#include "processorpool.h"
+#include "workstealingpool.h"
+
+// N-party mix-minus conference with per-participant echo cancellation.
+//
+// A dedicated tick thread runs every 10 ms. Each tick:
+//   1. every participant pulls one frame from its jitter buffer and runs it
+//      through its own WebrtcAEC3, with the mix it was sent on the previous
+//      tick as the far reference (in parallel on a WorkStealingPool);
+//   2. the cleaned frames are summed into an int32 accumulator (SIMD);
+//   3. every participant gets the accumulator minus its own frame,
+//      saturated to int16, through its MixCallback (in parallel again).
+// The tick thread waits for each parallel phase on a latch, so one tick's
+// latency is bounded by the slowest participant rather than their sum.
+//
+// A DelayEstimator per participant measures the network plus device round
+// trip between the mix and its echo and feeds it to set_stream_delay_ms().
+//
+// Participants' processors come from a ProcessorPool and go back to it when
+// they leave, so joining resets a started processor instead of building one;
+// reserveProcessors() keeps some ready before the first join.
+class ConferenceMixer {
+public:
+    typedef uint32_t ParticipantId;
+    typedef ProcessorPool::Config ParticipantConfig;
+
+    // Called on a pool thread once per tick with the participant's
+    // mix-minus. Must not block.
+    typedef std::function<void(ParticipantId id, const int16_t* mix, size_t num_samples)> MixCallback;
+
+    struct ParticipantStats {
+        uint64_t frames_mixed;
+        uint64_t input_missing;      // ticks without a frame from the participant
+        uint64_t processing_errors;
+        int echo_delay_ms;           // -1 until the estimator is confident
+        int64_t setup_us;            // time spent in addParticipant()
+        int64_t first_frame_us;      // addParticipant() to its first processed network
+                                     // frame, -1 until then
+        JitterBuffer::Stats jitter;
+    };
+
+    struct TickStats {
+        uint64_t ticks;
+        uint64_t late_ticks;         // finished after their deadline
+        uint64_t skipped_ticks;      // dropped to catch up after a stall
+        int64_t last_tick_ns;
+        int64_t max_tick_ns;
+        size_t participants;
+    };
+
+    // |num_threads| == 0 uses one worker per core
+    explicit ConferenceMixer(int sample_rate = 48000, size_t num_threads = 0,
+                             size_t max_participants = 64);
+    ~ConferenceMixer();
+
+    // Starts / stops the tick thread
+    void start();
+    void stop();
+
+    // Creates a participant with its own WebrtcAEC3 from the processor pool;
+    // |config| is applied with setConfig(), SAMPLE_RATE is forced to the
+    // mixer's. Throws std::runtime_error when the conference is full and
+    // std::invalid_argument for an invalid or multichannel configuration.
+    ParticipantId addParticipant(const ParticipantConfig& config, MixCallback callback);
+
+    // Keeps |count| processors for |config| built ahead of addParticipant()
+    void reserveProcessors(const ParticipantConfig& config, size_t count);
+
+    // Blocks until a tick in progress has finished; no callback for |id|
+    // runs after this returns. Must not be called from a MixCallback.
+    void removeParticipant(ParticipantId id);
+
+    // Network side: one decoded frame of the participant's audio. Returns
+    // false if the participant does not exist.
+    bool submitFrame(ParticipantId id, uint32_t seq, uint32_t timestamp, const int16_t* frame);
+    // Network side: a DTX silence descriptor (dtx.h) in place of frame |seq|;
+    // the participant is heard as comfort noise until its next frame.
+    bool submitSid(ParticipantId id, uint32_t seq, uint32_t timestamp, const uint8_t* sid,
+                   size_t bytes);
+
+    // Runs one tick on the calling thread; for tools and benchmarks while
+    // the tick thread is stopped.
+    void tick();
+
+    size_t frameSamples() const { return frame_samples_; }
+    size_t participantCount() const;
+    size_t numThreads() const { return pool_.numThreads(); }
+    bool participantStats(ParticipantId id, ParticipantStats* stats) const;
+    TickStats tickStats() const;
+    ProcessorPool::Stats processorStats() const { return processors_.stats(); }
+
+private:
+    struct Participant;
+    typedef std::shared_ptr<Participant> ParticipantPtr;
+
+    void tickLoop();
+    void runParallel(void (ConferenceMixer::*phase)(Participant&));
+    void cancelEcho(Participant& p);
+    void mixMinus(Participant& p);
+    // |config| with the mixer's SAMPLE_RATE; rejects channel counts other
+    // than 1
+    ParticipantConfig atMixerRate(const ParticipantConfig& config) const;
+
+    const int sample_rate_;
+    const size_t frame_samples_;
+    const size_t max_participants_;
+
+    // Declared before everything holding participants, which return their
+    // processors to it
+    ProcessorPool processors_;
+
+    mutable std::mutex participants_mutex_;
+    std::map<ParticipantId, ParticipantPtr> participants_;
+    ParticipantId next_id_;
+
+    // Held for a whole tick; tick-local state below is only touched under it
+    std::mutex tick_mutex_;
+    std::vector<ParticipantPtr> active_;
+    std::vector<int32_t> total_;
+
+    std::thread tick_thread_;
+    std::mutex run_mutex_;
+    std::condition_variable run_cv_;
+    bool running_;
+
+    std::atomic<uint64_t> ticks_;
+    std::atomic<uint64_t> late_ticks_;
+    std::atomic<uint64_t> skipped_ticks_;
+    std::atomic<int64_t> last_tick_ns_;
+    std::atomic<int64_t> max_tick_ns_;
+
+    // Declared last so workers are joined before participants are torn down
+    WorkStealingPool pool_;
+
+    ConferenceMixer(const ConferenceMixer&);
+    ConferenceMixer& operator=(const ConferenceMixer&);
+};
+
+#endif // CONFERENCEMIXER_H
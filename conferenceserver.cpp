@@ -0,0 +1,231 @@
+#include "conferenceserver.h"
+#include "audiocodec.h"
+#include "audiopacket.h"
+#include "codecnegotiation.h"
+#include "framering.h"
+#include <QDebug>
+#include <QHostAddress>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+struct ConferenceServer::Peer {
+    Peer(QWebSocket *s, uint8_t payload)
+        : socket(s)
+        , id(0)
+        , negotiatedPayload(payload)
+        , rxFrame(kFrameSamples, 0)
+        , outRing(kFrameSamples, kOutQueueFrames)
+        , packet(static_cast<int>(kAudioPacketHeaderBytes) + kFrameSamples * 2, '\0')
+        , txSequence(0)
+        , txTimestamp(0)
+        , rxLegacySequence(0)
+        , packetsRejected(0)
+    {}
+
+    QWebSocket *socket;
+    ConferenceMixer::ParticipantId id;
+
+    uint8_t negotiatedPayload;
+    std::unique_ptr<AudioCodec> txCodec;
+    std::unique_ptr<AudioCodec> rxCodec;
+    std::vector<int16_t> rxFrame;
+
+    // Producer is the peer's MixCallback on a mixer thread, consumer is
+    // flushOutputs()
+    FrameRing outRing;
+    QByteArray packet;
+    quint32 txSequence;
+    quint32 txTimestamp;
+    quint32 rxLegacySequence;
+    quint64 packetsRejected;
+};
+
+ConferenceServer::ConferenceServer(const ConferenceMixer::ParticipantConfig &participantConfig,
+                                   uint8_t preferredPayload, QObject *parent)
+    : QObject(parent)
+    , server_(new QWebSocketServer(QStringLiteral("ConferenceServer"),
+                                   QWebSocketServer::NonSecureMode, this))
+    , mixer_(48000)
+    , participantConfig_(participantConfig)
+    , preferredPayload_(preferredPayload)
+    , flushPending_(false)
+{
+    connect(server_, &QWebSocketServer::newConnection,
+            this, &ConferenceServer::onNewConnection);
+}
+
+ConferenceServer::~ConferenceServer() {
+    mixer_.stop();
+    server_->close();
+    for (Peer *peer : peers_) {
+        peer->socket->disconnect(this);
+        peer->socket->close();
+        peer->socket->deleteLater();
+        delete peer;
+    }
+    peers_.clear();
+}
+
+bool ConferenceServer::listen(quint16 port) {
+    if (!server_->listen(QHostAddress::Any, port)) {
+        return false;
+    }
+    mixer_.start();
+    qDebug() << "Conference started on port" << port << "with"
+             << mixer_.numThreads() << "mixer threads";
+    return true;
+}
+
+void ConferenceServer::reserveProcessors(int count) {
+    mixer_.reserveProcessors(participantConfig_, static_cast<size_t>(qMax(count, 0)));
+}
+
+void ConferenceServer::onNewConnection() {
+    QWebSocket *socket = server_->nextPendingConnection();
+
+    std::unique_ptr<Peer> peer(new Peer(socket, kPayloadPcm16));
+    FrameRing *ring = &peer->outRing;
+    try {
+        peer->id = mixer_.addParticipant(participantConfig_,
+            [this, ring](ConferenceMixer::ParticipantId, const int16_t *mix, size_t) {
+                ring->push(mix);
+                if (!flushPending_.exchange(true)) {
+                    QMetaObject::invokeMethod(this, "flushOutputs", Qt::QueuedConnection);
+                }
+            });
+    } catch (const std::exception &e) {
+        qDebug() << "Rejected participant from" << socket->peerAddress().toString() << ":" << e.what();
+        socket->close();
+        socket->deleteLater();
+        return;
+    }
+
+    connect(socket, &QWebSocket::disconnected,
+            this, &ConferenceServer::onDisconnected);
+    connect(socket, &QWebSocket::binaryMessageReceived,
+            this, &ConferenceServer::onBinaryMessageReceived);
+    connect(socket, &QWebSocket::textMessageReceived,
+            this, &ConferenceServer::onTextMessageReceived);
+
+    ConferenceMixer::ParticipantStats stats;
+    mixer_.participantStats(peer->id, &stats);
+    const ProcessorPool::Stats pool = mixer_.processorStats();
+
+    peers_.insert(socket, peer.release());
+    socket->sendTextMessage(codecHelloMessage(preferredPayload_));
+    emit participantCountChanged();
+
+    qDebug() << "Participant joined from" << socket->peerAddress().toString()
+             << "," << peers_.size() << "in conference; setup" << stats.setup_us / 1000.0
+             << "ms, processor pool hits" << pool.hits << "misses" << pool.misses;
+}
+
+void ConferenceServer::onBinaryMessageReceived(const QByteArray &message) {
+    Peer *peer = peers_.value(qobject_cast<QWebSocket *>(sender()));
+    if (!peer) {
+        return;
+    }
+
+    const uint8_t *data = reinterpret_cast<const uint8_t *>(message.constData());
+    if (message.size() == kFrameSamples * 2) { // legacy: bare 10ms mono PCM
+        quint32 seq = peer->rxLegacySequence++;
+        mixer_.submitFrame(peer->id, seq, seq * kFrameSamples,
+                           reinterpret_cast<const int16_t *>(data));
+        return;
+    }
+
+    AudioPacketHeader header;
+    const uint8_t *payload = nullptr;
+    if (!parseAudioPacket(data, message.size(), &header, &payload)
+        || header.channels != 1
+        || header.sample_rate != 48000
+        || header.frameSamples() != static_cast<size_t>(kFrameSamples)) {
+        if (peer->packetsRejected++ == 0) {
+            qWarning() << "Rejecting conference message of" << message.size() << "bytes";
+        }
+        return;
+    }
+
+    if (header.payload_type == kPayloadComfortNoise) {
+        mixer_.submitSid(peer->id, header.sequence, header.timestamp, payload, header.frameBytes());
+        return;
+    }
+
+    if (!peer->rxCodec || peer->rxCodec->payloadType() != header.payload_type) {
+        peer->rxCodec = createAudioCodec(header.payload_type);
+    }
+
+    const size_t frameBytes = header.frameBytes();
+    for (int i = 0; i < header.frame_count; ++i) {
+        peer->rxCodec->decode(payload + i * frameBytes, frameBytes, kFrameSamples, 1,
+                              peer->rxFrame.data());
+        mixer_.submitFrame(peer->id, header.sequence + i,
+                           header.timestamp + i * kFrameSamples, peer->rxFrame.data());
+    }
+}
+
+void ConferenceServer::onTextMessageReceived(const QString &message) {
+    Peer *peer = peers_.value(qobject_cast<QWebSocket *>(sender()));
+    uint8_t chosen;
+    if (!peer || !parseCodecHello(message, preferredPayload_, &chosen)) {
+        return;
+    }
+
+    // Takes effect on the next frame; every mix is a packet of its own
+    peer->negotiatedPayload = chosen;
+    qDebug() << "Participant" << peer->id << "receives" << audioCodecName(chosen);
+}
+
+void ConferenceServer::onDisconnected() {
+    removePeer(qobject_cast<QWebSocket *>(sender()));
+}
+
+void ConferenceServer::removePeer(QWebSocket *socket) {
+    Peer *peer = peers_.take(socket);
+    if (!peer) {
+        return;
+    }
+
+    ConferenceMixer::ParticipantStats stats;
+    if (mixer_.participantStats(peer->id, &stats)) {
+        qDebug() << "Participant" << peer->id << "first frame processed after"
+                 << stats.first_frame_us / 1000.0 << "ms";
+    }
+
+    // Waits out a tick in progress, so no callback touches outRing afterwards
+    mixer_.removeParticipant(peer->id);
+    qDebug() << "Participant" << peer->id << "left," << peers_.size() << "in conference";
+    delete peer;
+
+    socket->deleteLater();
+    emit participantCountChanged();
+}
+
+void ConferenceServer::flushOutputs() {
+    // Clear before draining so a mix pushed meanwhile queues another flush
+    flushPending_.store(false);
+
+    for (Peer *peer : peers_) {
+        while (const int16_t *mix = peer->outRing.front()) {
+            if (!peer->txCodec || peer->txCodec->payloadType() != peer->negotiatedPayload) {
+                peer->txCodec = createAudioCodec(peer->negotiatedPayload);
+            }
+            const int encodedBytes = static_cast<int>(peer->txCodec->encodedBytes(kFrameSamples, 1));
+            uint8_t *dst = reinterpret_cast<uint8_t *>(peer->packet.data());
+            peer->txCodec->encode(mix, kFrameSamples, 1, dst + kAudioPacketHeaderBytes);
+            peer->outRing.pop();
+
+            AudioPacketHeader header;
+            header.payload_type = peer->txCodec->payloadType();
+            header.sequence = peer->txSequence++;
+            header.timestamp = peer->txTimestamp;
+            header.sample_rate = 48000;
+            peer->txTimestamp += kFrameSamples;
+            writeAudioPacketHeader(header, dst);
+
+            peer->socket->sendBinaryMessage(QByteArray::fromRawData(
+                peer->packet.constData(), static_cast<int>(kAudioPacketHeaderBytes) + encodedBytes));
+        }
+    }
+}
@@ -0,0 +1,66 @@
+#ifndef CONFERENCESERVER_H
+#define CONFERENCESERVER_H
+
+#include <QHash>
+#include <QObject>
+#include <QWebSocket>
+#include <QWebSocketServer>
+#include <atomic>
+#include "conferencemixer.h"
+
+// WebSocket front end of a ConferenceMixer: every connection becomes a
+// participant, its audio messages (audiopacket.h framing, any codec) are
+// decoded into the mixer and its mix-minus is encoded and sent back with the
+// codec negotiated for that connection.
+//
+// The mixer calls back on its own threads; mixes are queued per peer in a
+// FrameRing and sent from this object's thread, at most one queued flush in
+// flight.
+class ConferenceServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    // |participantConfig| is applied to every participant's WebrtcAEC3;
+    // |preferredPayload| is the codec offered first in each hello.
+    ConferenceServer(const ConferenceMixer::ParticipantConfig &participantConfig,
+                     uint8_t preferredPayload, QObject *parent = nullptr);
+    ~ConferenceServer();
+
+    bool listen(quint16 port);
+    // Keeps |count| participant processors built ahead of joins
+    void reserveProcessors(int count);
+    QString errorString() const { return server_->errorString(); }
+
+    int participantCount() const { return peers_.size(); }
+    ConferenceMixer::TickStats tickStats() const { return mixer_.tickStats(); }
+
+signals:
+    void participantCountChanged();
+
+private slots:
+    void onNewConnection();
+    void onBinaryMessageReceived(const QByteArray &message);
+    void onTextMessageReceived(const QString &message);
+    void onDisconnected();
+    void flushOutputs();
+
+private:
+    struct Peer;
+
+    void removePeer(QWebSocket *socket);
+
+    static const int kFrameSamples = 480;
+    // Mixes waiting to be sent per peer; more than this and the peer's
+    // socket is falling behind and frames are dropped
+    static const int kOutQueueFrames = 16;
+
+    QWebSocketServer *server_;
+    ConferenceMixer mixer_;
+    ConferenceMixer::ParticipantConfig participantConfig_;
+    uint8_t preferredPayload_;
+    QHash<QWebSocket *, Peer *> peers_;
+    std::atomic<bool> flushPending_;
+};
+
+#endif // CONFERENCESERVER_H
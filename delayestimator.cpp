@@ -0,0 +1,266 @@
+#include "delayestimator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+
+// Everything below runs on the decimated signal
+const int kDecimatedRate = 4000;
+const int kSamplesPerMs = kDecimatedRate / 1000;
+
+const size_t kFftSize = 4096;
+const size_t kWindowSamples = 2048;                            // ~0.5 s of near audio
+const int kMaxDelayMs = 400;                                   // echo lagging the reference
+const int kMinDelayMs = -100;                                  // echo leading it (queue too deep)
+const size_t kLagSamples = kMaxDelayMs * kSamplesPerMs;
+const size_t kLeadSamples = -kMinDelayMs * kSamplesPerMs;
+const size_t kUpdateIntervalSamples = kDecimatedRate / 4;      // 250 ms
+
+// Cross spectra are averaged over updates; a single 0.5 s window is noisy
+const float kSpectrumSmoothing = 0.6f;
+// Segments quieter than about -50 dBFS carry no usable phase information
+const float kMinPower = 1e-5f;
+// Peak-to-sidelobe ratio mapped linearly onto 0..1 confidence
+const float kPsrFloor = 5.0f;
+const float kPsrRange = 10.0f;
+// Correlation samples around the peak excluded from the sidelobe statistics
+const int kPeakGuard = 4;
+
+static_assert(kWindowSamples + kLagSamples + kLeadSamples <= kFftSize,
+              "correlation window must fit the FFT without wrapping");
+
+size_t log2Size(size_t n) {
+    size_t bits = 0;
+    while ((size_t(1) << bits) < n) {
+        ++bits;
+    }
+    return bits;
+}
+
+} // namespace
+
+DelayEstimator::DelayEstimator(int sample_rate)
+    : decimation_(sample_rate / kDecimatedRate)
+    , far_history_len_(kWindowSamples + kLagSamples + kLeadSamples)
+    , near_history_len_(kWindowSamples + kLeadSamples)
+    , far_write_(0)
+    , near_write_(0)
+    , samples_seen_(0)
+    , far_acc_(0.0f)
+    , near_acc_(0.0f)
+    , far_acc_count_(0)
+    , near_acc_count_(0)
+    , samples_since_update_(0)
+    , have_smoothed_(false)
+    , processing_ns_(0) {
+    if (sample_rate <= 0 || sample_rate % kDecimatedRate != 0) {
+        throw std::invalid_argument("DelayEstimator: sample rate must be a multiple of 4 kHz");
+    }
+
+    far_history_.assign(far_history_len_, 0.0f);
+    near_history_.assign(near_history_len_, 0.0f);
+    far_spec_.assign(kFftSize, std::complex<float>());
+    near_spec_.assign(kFftSize, std::complex<float>());
+    smoothed_.assign(kFftSize, std::complex<float>());
+
+    const double kPi = 3.14159265358979323846;
+    twiddles_.resize(kFftSize / 2);
+    for (size_t k = 0; k < kFftSize / 2; ++k) {
+        double phase = -2.0 * kPi * static_cast<double>(k) / kFftSize;
+        twiddles_[k] = std::complex<float>(static_cast<float>(std::cos(phase)),
+                                           static_cast<float>(std::sin(phase)));
+    }
+
+    const size_t bits = log2Size(kFftSize);
+    bit_reverse_.resize(kFftSize);
+    for (size_t i = 0; i < kFftSize; ++i) {
+        uint32_t r = 0;
+        for (size_t b = 0; b < bits; ++b) {
+            r |= ((i >> b) & 1u) << (bits - 1 - b);
+        }
+        bit_reverse_[i] = r;
+    }
+
+    estimate_.delay_ms = 0;
+    estimate_.confidence = 0.0f;
+    estimate_.sequence = 0;
+}
+
+int DelayEstimator::minDelayMs() {
+    return kMinDelayMs;
+}
+
+int DelayEstimator::maxDelayMs() {
+    return kMaxDelayMs;
+}
+
+void DelayEstimator::reset() {
+    std::fill(far_history_.begin(), far_history_.end(), 0.0f);
+    std::fill(near_history_.begin(), near_history_.end(), 0.0f);
+    far_write_ = 0;
+    near_write_ = 0;
+    samples_seen_ = 0;
+    far_acc_ = 0.0f;
+    near_acc_ = 0.0f;
+    far_acc_count_ = 0;
+    near_acc_count_ = 0;
+    samples_since_update_ = 0;
+    have_smoothed_ = false;
+    estimate_.confidence = 0.0f;
+}
+
+void DelayEstimator::decimateInto(const int16_t* src, size_t n, float* acc, size_t* acc_count,
+                                  std::vector<float>* history, size_t* write_pos) {
+    // Box-car average then pick every |decimation_|th sample. The aliasing
+    // this lets through is harmless to a phase-only correlation.
+    const float scale = 1.0f / (32768.0f * decimation_);
+    const size_t len = history->size();
+    for (size_t i = 0; i < n; ++i) {
+        *acc += src[i];
+        if (++*acc_count == static_cast<size_t>(decimation_)) {
+            (*history)[*write_pos] = *acc * scale;
+            *write_pos = (*write_pos + 1) % len;
+            *acc = 0.0f;
+            *acc_count = 0;
+        }
+    }
+}
+
+bool DelayEstimator::update(const int16_t* near, const int16_t* far, size_t num_samples) {
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+
+    const size_t before = far_write_;
+    decimateInto(far, num_samples, &far_acc_, &far_acc_count_, &far_history_, &far_write_);
+    decimateInto(near, num_samples, &near_acc_, &near_acc_count_, &near_history_, &near_write_);
+    const size_t produced = (far_write_ + far_history_len_ - before) % far_history_len_;
+    samples_seen_ += produced;
+    samples_since_update_ += produced;
+
+    bool updated = false;
+    if (samples_seen_ >= far_history_len_ && samples_since_update_ >= kUpdateIntervalSamples) {
+        samples_since_update_ = 0;
+        computeEstimate();
+        updated = true;
+    }
+
+    processing_ns_ += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - begin).count());
+    return updated;
+}
+
+namespace {
+
+// In-place iterative radix-2 DIT FFT of size twiddles.size() * 2
+void fft(std::vector<std::complex<float> >* data,
+         const std::vector<std::complex<float> >& twiddles,
+         const std::vector<uint32_t>& bit_reverse) {
+    std::vector<std::complex<float> >& x = *data;
+    const size_t n = x.size();
+    for (size_t i = 0; i < n; ++i) {
+        size_t j = bit_reverse[i];
+        if (j > i) {
+            std::swap(x[i], x[j]);
+        }
+    }
+    for (size_t len = 2; len <= n; len <<= 1) {
+        const size_t half = len / 2;
+        const size_t step = n / len;
+        for (size_t start = 0; start < n; start += len) {
+            for (size_t k = 0; k < half; ++k) {
+                std::complex<float> t = twiddles[k * step] * x[start + k + half];
+                x[start + k + half] = x[start + k] - t;
+                x[start + k] += t;
+            }
+        }
+    }
+}
+
+} // namespace
+
+void DelayEstimator::computeEstimate() {
+    // Far segment: the whole history, oldest first. Near window: the oldest
+    // kWindowSamples of the near history, which leaves kLeadSamples of newer
+    // far audio after it so an echo leading the reference can still be seen.
+    float far_power = 0.0f;
+    for (size_t i = 0; i < kFftSize; ++i) {
+        float v = 0.0f;
+        if (i < far_history_len_) {
+            v = far_history_[(far_write_ + i) % far_history_len_];
+            far_power += v * v;
+        }
+        far_spec_[i] = std::complex<float>(v, 0.0f);
+    }
+    float near_power = 0.0f;
+    for (size_t i = 0; i < kFftSize; ++i) {
+        float v = 0.0f;
+        if (i < kWindowSamples) {
+            v = near_history_[(near_write_ + i) % near_history_len_];
+            near_power += v * v;
+        }
+        near_spec_[i] = std::complex<float>(v, 0.0f);
+    }
+
+    // Nothing playing or nothing captured: keep the previous estimate but
+    // let its confidence fade so callers stop acting on it
+    if (far_power / far_history_len_ < kMinPower || near_power / kWindowSamples < kMinPower) {
+        estimate_.confidence *= 0.5f;
+        return;
+    }
+
+    fft(&far_spec_, twiddles_, bit_reverse_);
+    fft(&near_spec_, twiddles_, bit_reverse_);
+
+    // Phase transform: keep only the phase of conj(Y)·F, then smooth
+    for (size_t k = 0; k < kFftSize; ++k) {
+        std::complex<float> g = std::conj(near_spec_[k]) * far_spec_[k];
+        float mag = std::abs(g);
+        g = mag > 1e-12f ? g / mag : std::complex<float>();
+        smoothed_[k] = have_smoothed_
+            ? kSpectrumSmoothing * smoothed_[k] + (1.0f - kSpectrumSmoothing) * g
+            : g;
+    }
+    smoothed_[0] = std::complex<float>();
+    have_smoothed_ = true;
+
+    // Inverse FFT via conjugation; far_spec_ is free to reuse as scratch
+    for (size_t k = 0; k < kFftSize; ++k) {
+        far_spec_[k] = std::conj(smoothed_[k]);
+    }
+    fft(&far_spec_, twiddles_, bit_reverse_);
+
+    // c[m] = sum_n near[n] far[n + m]; echo delay = kLagSamples - m
+    const size_t search = kLagSamples + kLeadSamples + 1;
+    size_t peak_index = 0;
+    float peak = -1.0f;
+    for (size_t m = 0; m < search; ++m) {
+        float v = std::fabs(far_spec_[m].real());
+        if (v > peak) {
+            peak = v;
+            peak_index = m;
+        }
+    }
+
+    double sum = 0.0;
+    double sum_sq = 0.0;
+    size_t count = 0;
+    for (size_t m = 0; m < search; ++m) {
+        if (std::abs(static_cast<int>(m) - static_cast<int>(peak_index)) <= kPeakGuard) {
+            continue;
+        }
+        double v = std::fabs(far_spec_[m].real());
+        sum += v;
+        sum_sq += v * v;
+        ++count;
+    }
+    const double mean = sum / count;
+    const double stddev = std::sqrt(std::max(0.0, sum_sq / count - mean * mean));
+    const float psr = stddev > 0.0 ? static_cast<float>((peak - mean) / stddev) : 0.0f;
+
+    const int delay_samples = static_cast<int>(kLagSamples) - static_cast<int>(peak_index);
+    estimate_.delay_ms = static_cast<int>(std::lround(static_cast<double>(delay_samples) / kSamplesPerMs));
+    estimate_.confidence = std::min(1.0f, std::max(0.0f, (psr - kPsrFloor) / kPsrRange));
+    ++estimate_.sequence;
+}
@@ -0,0 +1,84 @@
+#ifndef DELAYESTIMATOR_H
+#define DELAYESTIMATOR_H
+
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Render-to-capture delay estimator based on GCC-PHAT.
+//
+// Near and far audio are decimated to ~4 kHz and kept in short histories.
+// Every few hundred milliseconds the phase-transform-weighted cross spectrum
+// of the two is computed with one FFT pair, smoothed over time, and its
+// inverse is searched for the correlation peak. The peak position is the
+// delay of the echo in the near signal relative to the far signal that was
+// fed in; the peak-to-sidelobe ratio gives the confidence.
+//
+// The estimate is relative to the far frames passed to update(), so a caller
+// that already delays the reference must add that delay back. Cost is a few
+// FFTs of 4096 points four times a second, well under 1% of a 48 kHz AEC.
+class DelayEstimator {
+public:
+    struct Estimate {
+        int delay_ms;        // echo delay relative to the supplied far signal
+        float confidence;    // 0 (no idea) .. 1 (sharp, unambiguous peak)
+        uint64_t sequence;   // incremented on every new estimate
+    };
+
+    // |sample_rate| of the frames passed to update(); any multiple of 4 kHz
+    // (8, 16, 32 and 48 kHz as used by WebrtcAEC3).
+    explicit DelayEstimator(int sample_rate);
+
+    // Feeds one frame of near (capture) and far (reference) audio. Returns
+    // true when a new estimate was produced by this call.
+    bool update(const int16_t* near, const int16_t* far, size_t num_samples);
+
+    // Latest estimate; confidence is 0 until the first one is available.
+    Estimate estimate() const { return estimate_; }
+
+    // Forgets history and the smoothed spectrum, e.g. after the caller has
+    // changed the reference delay and past correlations no longer apply.
+    void reset();
+
+    // Search range of update(): echo may lead the far signal by up to
+    // minDelayMs() (negative) and lag it by up to maxDelayMs().
+    static int minDelayMs();
+    static int maxDelayMs();
+
+    // Wall time spent inside update(), for cost accounting
+    uint64_t processingNs() const { return processing_ns_; }
+
+private:
+    void decimateInto(const int16_t* src, size_t n, float* acc, size_t* acc_count,
+                      std::vector<float>* history, size_t* write_pos);
+    void computeEstimate();
+
+    int decimation_;
+    size_t far_history_len_;
+    size_t near_history_len_;
+
+    std::vector<float> far_history_;
+    std::vector<float> near_history_;
+    size_t far_write_;
+    size_t near_write_;
+    size_t samples_seen_;
+    float far_acc_;
+    float near_acc_;
+    size_t far_acc_count_;
+    size_t near_acc_count_;
+    size_t samples_since_update_;
+
+    // FFT workspace, all sized once in the constructor
+    std::vector<std::complex<float> > far_spec_;
+    std::vector<std::complex<float> > near_spec_;
+    std::vector<std::complex<float> > smoothed_;
+    std::vector<std::complex<float> > twiddles_;
+    std::vector<uint32_t> bit_reverse_;
+    bool have_smoothed_;
+
+    Estimate estimate_;
+    uint64_t processing_ns_;
+};
+
+#endif // DELAYESTIMATOR_H
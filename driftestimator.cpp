@@ -0,0 +1,72 @@
+#include "driftestimator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+DriftEstimator::DriftEstimator(int sample_rate, double smoothing_s, double response_s, int max_ppm)
+    : sample_rate_(sample_rate)
+    , smoothing_s_(smoothing_s)
+    , kp_(response_s > 0.0 ? 1.0 / response_s : 0.0)
+    // Half the critically damped kp^2 / 4, leaving margin for the lag the
+    // smoothing adds
+    , ki_(kp_ * kp_ / 8.0)
+    , max_ratio_offset_(max_ppm * 1e-6) {
+    if (sample_rate <= 0 || !(smoothing_s > 0.0) || !(response_s > 0.0) || max_ppm <= 0) {
+        throw std::invalid_argument("DriftEstimator: arguments must be positive");
+    }
+    reset();
+}
+
+void DriftEstimator::reset() {
+    started_ = false;
+    last_time_s_ = 0.0;
+    settle_s_ = 0.0;
+    fill_ = 0.0;
+    target_ = 0.0;
+    has_target_ = false;
+    integral_ = 0.0;
+    ratio_ = 1.0;
+}
+
+void DriftEstimator::setTarget(double target) {
+    target_ = target;
+    has_target_ = true;
+}
+
+void DriftEstimator::hold(double time_s) {
+    last_time_s_ = time_s;
+}
+
+double DriftEstimator::update(double time_s, double fill) {
+    if (!started_) {
+        started_ = true;
+        last_time_s_ = time_s;
+        fill_ = fill;
+        return ratio_;
+    }
+    const double dt = time_s - last_time_s_;
+    last_time_s_ = time_s;
+    if (!(dt > 0.0)) {
+        return ratio_;
+    }
+
+    fill_ += (fill - fill_) * (1.0 - std::exp(-dt / smoothing_s_));
+    if (!has_target_) {
+        settle_s_ += dt;
+        if (settle_s_ < smoothing_s_) {
+            return ratio_;
+        }
+        target_ = fill_;
+        has_target_ = true;
+    }
+
+    // Fill error as time; the integral accumulates it into a rate offset
+    const double error_s = (fill_ - target_) / sample_rate_;
+    integral_ = std::min(std::max(integral_ + ki_ * error_s * dt, -max_ratio_offset_),
+                         max_ratio_offset_);
+    const double offset = std::min(std::max(kp_ * error_s + integral_, -max_ratio_offset_),
+                                   max_ratio_offset_);
+    ratio_ = 1.0 + offset;
+    return ratio_;
+}
@@ -0,0 +1,73 @@
+#ifndef DRIFTESTIMATOR_H
+#define DRIFTESTIMATOR_H
+
+// Clock-drift estimator for a buffer between two independently clocked
+// streams.
+//
+// One side of the buffer runs on the reference clock (here: capture), the
+// other on a clock that is nominally the same rate but off by some parts
+// per million. Left alone the fill level walks away at that rate until the
+// buffer under- or overruns. update() takes the fill level with a timestamp
+// on the reference clock, smooths it over |smoothing_s| to average out
+// scheduling and network jitter, and runs a PI controller on its distance
+// from the target. The result is the ratio for a FractionalResampler on the
+// far side of the buffer: above 1 while the buffer is too full.
+//
+// The integral term converges on the clock offset itself, reported by
+// driftPpm(); the proportional term pulls the fill back to the target within
+// roughly |response_s|. Both are clamped to |max_ppm|, which bounds the
+// pitch change to well below what is audible.
+//
+// Without setTarget() the target is the smoothed fill after the first
+// |smoothing_s| of observations, for buffers (device queues) whose natural
+// level is not known up front.
+class DriftEstimator {
+public:
+    static const int kDefaultMaxPpm = 2000;
+
+    // |sample_rate| converts fill levels (in samples) to time. Throws
+    // std::invalid_argument for non-positive arguments.
+    DriftEstimator(int sample_rate, double smoothing_s, double response_s,
+                   int max_ppm = kDefaultMaxPpm);
+
+    // Forgets the fill history, target and drift
+    void reset();
+
+    // Fill level to hold, in samples
+    void setTarget(double target);
+
+    // One observation: |time_s| on the reference clock, |fill| in samples.
+    // Returns the new ratio.
+    double update(double time_s, double fill);
+
+    // Skips the period up to |time_s| (buffering, DTX, packet loss), when
+    // the fill level says nothing about the clocks. The ratio is kept.
+    void hold(double time_s);
+
+    // Input samples per output sample for the resampler
+    double ratio() const { return ratio_; }
+    // Estimated offset of the other clock against the reference, positive
+    // when it runs fast
+    double driftPpm() const { return integral_ * 1e6; }
+    // Smoothed fill level in samples
+    double fill() const { return fill_; }
+    bool hasTarget() const { return has_target_; }
+
+private:
+    const double sample_rate_;
+    const double smoothing_s_;
+    const double kp_;   // 1/s
+    const double ki_;   // 1/s^2
+    const double max_ratio_offset_;
+
+    bool started_;
+    double last_time_s_;
+    double settle_s_;   // observed time before an automatic target is taken
+    double fill_;
+    double target_;
+    bool has_target_;
+    double integral_;
+    double ratio_;
+};
+
+#endif // DRIFTESTIMATOR_H
@@ -0,0 +1,197 @@
+#include "dtx.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+namespace {
+
+// Weight of the newest frame in the smoothed noise autocorrelation
+const double kNoiseSmoothing = 0.2;
+// Reflection coefficients are clamped to this on decode so the synthesis
+// filter stays comfortably stable after quantisation
+const float kMaxReflection = 0.97f;
+const int kSilenceLevel = 127;
+const double kFullScalePower = 32768.0 * 32768.0;
+
+// Noise level in -dBov of |power|, a mean square in int16 units
+int levelFromPower(double power) {
+    if (power <= 0.0) {
+        return kSilenceLevel;
+    }
+    const double dbov = -10.0 * std::log10(power / kFullScalePower);
+    return std::min(std::max(static_cast<int>(dbov + 0.5), 0), kSilenceLevel);
+}
+
+} // namespace
+
+DtxEncoder::DtxEncoder(size_t frame_samples, int hangover_frames, int sid_interval_frames)
+    : frame_samples_(frame_samples)
+    , hangover_frames_(std::max(hangover_frames, 0))
+    , sid_interval_frames_(std::max(sid_interval_frames, 1)) {
+    reset();
+}
+
+void DtxEncoder::reset() {
+    // Start as if speech had just ended, so the noise estimate has the
+    // hangover to settle before the first SID
+    hangover_left_ = hangover_frames_;
+    in_dtx_ = false;
+    frames_since_sid_ = 0;
+    sent_level_ = kSilenceLevel;
+    std::fill(noise_acf_, noise_acf_ + kSidOrder + 1, 0.0);
+    have_noise_ = false;
+    std::fill(sid_, sid_ + kSidBytes, 0);
+    sid_[0] = kSilenceLevel;
+    frames_suppressed_ = 0;
+    sids_sent_ = 0;
+}
+
+DtxEncoder::Decision DtxEncoder::process(const int16_t* frame, bool voice) {
+    if (voice) {
+        hangover_left_ = hangover_frames_;
+        in_dtx_ = false;
+        return kSendSpeech;
+    }
+
+    analyze(frame);
+    if (hangover_left_ > 0) {
+        --hangover_left_;
+        return kSendSpeech;
+    }
+
+    if (!in_dtx_) {
+        in_dtx_ = true;
+        buildSid();
+        return kSendSid;
+    }
+
+    ++frames_since_sid_;
+    const int level = levelFromPower(noise_acf_[0] / frame_samples_);
+    if (frames_since_sid_ >= sid_interval_frames_ || std::abs(level - sent_level_) >= kSidUpdateDb) {
+        buildSid();
+        return kSendSid;
+    }
+    ++frames_suppressed_;
+    return kSuppress;
+}
+
+void DtxEncoder::analyze(const int16_t* frame) {
+    double acf[kSidOrder + 1];
+    for (size_t lag = 0; lag <= kSidOrder; ++lag) {
+        double sum = 0.0;
+        for (size_t i = lag; i < frame_samples_; ++i) {
+            sum += static_cast<double>(frame[i]) * frame[i - lag];
+        }
+        acf[lag] = sum;
+    }
+
+    for (size_t lag = 0; lag <= kSidOrder; ++lag) {
+        noise_acf_[lag] = have_noise_ ? noise_acf_[lag] + kNoiseSmoothing * (acf[lag] - noise_acf_[lag])
+                                      : acf[lag];
+    }
+    have_noise_ = true;
+}
+
+void DtxEncoder::buildSid() {
+    const int level = levelFromPower(noise_acf_[0] / frame_samples_);
+
+    // Levinson-Durbin on the smoothed autocorrelation. The slight white
+    // noise floor keeps it well conditioned for tonal or near-silent input.
+    double r[kSidOrder + 1];
+    std::copy(noise_acf_, noise_acf_ + kSidOrder + 1, r);
+    r[0] = r[0] * 1.0001 + 1e-9;
+
+    double a[kSidOrder + 1] = { 1.0 };
+    double k[kSidOrder] = {};
+    double err = r[0];
+    for (size_t i = 1; i <= kSidOrder && err > 0.0; ++i) {
+        double acc = r[i];
+        for (size_t j = 1; j < i; ++j) {
+            acc += a[j] * r[i - j];
+        }
+        const double ki = -acc / err;
+        double prev[kSidOrder + 1];
+        std::copy(a, a + kSidOrder + 1, prev);
+        for (size_t j = 1; j < i; ++j) {
+            a[j] = prev[j] + ki * prev[i - j];
+        }
+        a[i] = ki;
+        k[i - 1] = ki;
+        err *= 1.0 - ki * ki;
+    }
+
+    sid_[0] = static_cast<uint8_t>(level);
+    for (size_t i = 0; i < kSidOrder; ++i) {
+        const double q = (std::min(std::max(k[i], -1.0), 1.0) + 1.0) * 127.5;
+        sid_[1 + i] = static_cast<uint8_t>(q + 0.5);
+    }
+    sent_level_ = level;
+    frames_since_sid_ = 0;
+    ++sids_sent_;
+}
+
+ComfortNoiseGenerator::ComfortNoiseGenerator(size_t frame_samples)
+    : frame_samples_(frame_samples) {
+    reset();
+}
+
+void ComfortNoiseGenerator::reset() {
+    std::fill(lpc_, lpc_ + kSidOrder, 0.0f);
+    std::fill(history_, history_ + kSidOrder, 0.0f);
+    gain_ = 0.0f;
+    target_gain_ = 0.0f;
+    seed_ = 0x9e3779b9u;
+}
+
+bool ComfortNoiseGenerator::update(const uint8_t* sid, size_t bytes) {
+    if (bytes != kSidBytes) {
+        return false;
+    }
+
+    // Step-up from reflection coefficients to the direct-form predictor;
+    // the prediction error shrinks by (1 - k^2) per stage
+    float a[kSidOrder] = {};
+    double residual = 1.0;
+    for (size_t i = 0; i < kSidOrder; ++i) {
+        float ki = sid[1 + i] / 127.5f - 1.0f;
+        ki = std::min(std::max(ki, -kMaxReflection), kMaxReflection);
+        float prev[kSidOrder];
+        std::copy(a, a + kSidOrder, prev);
+        for (size_t j = 0; j < i; ++j) {
+            a[j] = prev[j] + ki * prev[i - 1 - j];
+        }
+        a[i] = ki;
+        residual *= 1.0 - ki * ki;
+    }
+    std::copy(a, a + kSidOrder, lpc_);
+
+    // Excitation power that gives the SID's level at the filter output;
+    // uniform noise in [-1, 1) has variance 1/3
+    const int level = std::min<int>(sid[0], kSilenceLevel);
+    const double power = level >= kSilenceLevel ? 0.0 : kFullScalePower * std::pow(10.0, -level / 10.0);
+    target_gain_ = static_cast<float>(std::sqrt(3.0 * power * residual));
+    return true;
+}
+
+void ComfortNoiseGenerator::generate(int16_t* out) {
+    const float step = (target_gain_ - gain_) / frame_samples_;
+    for (size_t n = 0; n < frame_samples_; ++n) {
+        // xorshift32; plenty for noise and identical on every platform
+        seed_ ^= seed_ << 13;
+        seed_ ^= seed_ >> 17;
+        seed_ ^= seed_ << 5;
+        const float white = static_cast<int32_t>(seed_) * (1.0f / 2147483648.0f);
+
+        float y = (gain_ + step * (n + 1)) * white;
+        for (size_t j = 0; j < kSidOrder; ++j) {
+            y -= lpc_[j] * history_[j];
+        }
+        for (size_t j = kSidOrder - 1; j > 0; --j) {
+            history_[j] = history_[j - 1];
+        }
+        history_[0] = y;
+        out[n] = static_cast<int16_t>(std::min(std::max(y, -32768.0f), 32767.0f));
+    }
+    gain_ = target_gain_;
+}
@@ -0,0 +1,115 @@
+#ifndef DTX_H
+#define DTX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Discontinuous transmission for the WebSocket link.
+//
+// While the near end is silent the sender stops sending frames and instead
+// sends a silence descriptor (SID) now and then, in the style of RFC 3389:
+//
+//   offset  size  field
+//        0     1  noise level in -dBov, 0..127 (127 = digital silence)
+//        1     4  reflection coefficients k1..k4, each (k + 1) * 127.5
+//
+// The receiver plays comfort noise of that level and spectral envelope
+// until speech resumes. The SID is sent as payload type kPayloadComfortNoise
+// (audiopacket.h), one per message, with the sequence number of the frame
+// it replaces; the frames skipped in between keep their sequence numbers,
+// so the receiver can tell DTX gaps from loss.
+//
+// Both classes work on mono frames of a fixed size and allocate nothing
+// after construction.
+
+const size_t kSidOrder = 4;
+const size_t kSidBytes = 1 + kSidOrder;
+
+// Sender side: smooths the VAD decision and decides per frame what to send.
+class DtxEncoder {
+public:
+    enum Decision {
+        kSendSpeech,  // encode and send the frame as usual
+        kSendSid,     // send sid() instead of the frame
+        kSuppress     // send nothing
+    };
+
+    // Frames of speech still sent after the VAD drops, so word endings and
+    // short pauses are not clipped
+    static const int kDefaultHangoverFrames = 20;
+    // SID refresh while the noise stays put; a level change of
+    // kSidUpdateDb or more sends one at once
+    static const int kDefaultSidIntervalFrames = 10;
+    static const int kSidUpdateDb = 3;
+
+    explicit DtxEncoder(size_t frame_samples,
+                        int hangover_frames = kDefaultHangoverFrames,
+                        int sid_interval_frames = kDefaultSidIntervalFrames);
+
+    // Back to speech, forgetting the noise estimate
+    void reset();
+
+    // One frame in capture order; |voice| is the raw VAD decision for it
+    // (WebrtcAEC3::hasVoice()).
+    Decision process(const int16_t* frame, bool voice);
+
+    // kSidBytes describing the current noise; valid after kSendSid
+    const uint8_t* sid() const { return sid_; }
+
+    // True between the first SID and the next speech frame
+    bool inDtx() const { return in_dtx_; }
+
+    uint64_t framesSuppressed() const { return frames_suppressed_; }
+    uint64_t sidsSent() const { return sids_sent_; }
+
+private:
+    void analyze(const int16_t* frame);
+    void buildSid();
+
+    const size_t frame_samples_;
+    const int hangover_frames_;
+    const int sid_interval_frames_;
+
+    int hangover_left_;
+    bool in_dtx_;
+    int frames_since_sid_;
+    int sent_level_;
+
+    // Smoothed autocorrelation of the noise, lags 0..kSidOrder
+    double noise_acf_[kSidOrder + 1];
+    bool have_noise_;
+
+    uint8_t sid_[kSidBytes];
+    uint64_t frames_suppressed_;
+    uint64_t sids_sent_;
+};
+
+// Receiver side: white noise shaped by the SID's all-pole filter and scaled
+// to its level. Level changes ramp over a frame so SID updates do not click.
+class ComfortNoiseGenerator {
+public:
+    explicit ComfortNoiseGenerator(size_t frame_samples);
+
+    // Silence until the next update()
+    void reset();
+
+    // Takes the parameters of a SID. Returns false, keeping the previous
+    // parameters, if |bytes| is not kSidBytes.
+    bool update(const uint8_t* sid, size_t bytes);
+
+    // Fills |out| with the next frame_samples of noise
+    void generate(int16_t* out);
+
+private:
+    const size_t frame_samples_;
+
+    // Direct-form predictor a1..aN and the synthesis filter's past outputs
+    float lpc_[kSidOrder];
+    float history_[kSidOrder];
+    float gain_;
+    float target_gain_;
+    uint32_t seed_;
+};
+
+#endif // DTX_H
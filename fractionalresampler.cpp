@@ -0,0 +1,94 @@
+#include "fractionalresampler.h"
+#include "audiosimd.h"
+
+#include <cmath>
+#include <stdexcept>
+
+FractionalResampler::FractionalResampler(size_t max_input_samples)
+    : pos_(1.0)
+    , ratio_(1.0) {
+    // Room for one chunk on top of what a pull can leave behind
+    buffer_.reserve(max_input_samples + 8);
+    out_buffer_.reserve(max_input_samples + 8);
+    reset();
+}
+
+void FractionalResampler::reset() {
+    buffer_.assign(1, 0.0f);
+    pos_ = 1.0;
+    ratio_ = 1.0;
+}
+
+void FractionalResampler::setRatio(double ratio) {
+    if (!(ratio > 0.0)) {
+        throw std::invalid_argument("FractionalResampler: ratio must be positive");
+    }
+    ratio_ = ratio;
+}
+
+void FractionalResampler::push(const int16_t* in, size_t num_in) {
+    const size_t old_size = buffer_.size();
+    buffer_.resize(old_size + num_in);
+    float* input = buffer_.data() + old_size;
+    deinterleaveS16ToFloat(in, num_in, 1, &input);
+}
+
+size_t FractionalResampler::available() const {
+    // Output k reads samples floor(x) - 1 .. floor(x) + 2 at x = pos_ + k *
+    // ratio_, so it needs x < size - 2. Counted with the same expression
+    // pull() uses, so rounding cannot make the two disagree.
+    const double limit = static_cast<double>(buffer_.size()) - 2.0;
+    if (!(pos_ < limit)) {
+        return 0;
+    }
+    size_t count = static_cast<size_t>(std::ceil((limit - pos_) / ratio_));
+    while (count > 0 && !(pos_ + (count - 1) * ratio_ < limit)) {
+        --count;
+    }
+    while (pos_ + count * ratio_ < limit) {
+        ++count;
+    }
+    return count;
+}
+
+size_t FractionalResampler::pull(int16_t* out, size_t max_out) {
+    const double limit = static_cast<double>(buffer_.size()) - 2.0;
+    if (out_buffer_.size() < max_out) {
+        out_buffer_.resize(max_out);
+    }
+
+    const float* x = buffer_.data();
+    size_t produced = 0;
+    for (; produced < max_out; ++produced) {
+        const double position = pos_ + produced * ratio_;
+        if (!(position < limit)) {
+            break;
+        }
+        const size_t i = static_cast<size_t>(position);
+        const float t = static_cast<float>(position - i);
+        const float xm1 = x[i - 1];
+        const float x0 = x[i];
+        const float x1 = x[i + 1];
+        const float x2 = x[i + 2];
+        // Catmull-Rom through x0 and x1
+        out_buffer_[produced] = x0 + 0.5f * t * (x1 - xm1
+            + t * (2.0f * xm1 - 5.0f * x0 + 4.0f * x1 - x2
+            + t * (3.0f * (x0 - x1) + x2 - xm1)));
+    }
+    pos_ += produced * ratio_;
+
+    // Keep one sample before the read position as history
+    const size_t consumed = static_cast<size_t>(pos_) - 1;
+    if (consumed > 0) {
+        buffer_.erase(buffer_.begin(), buffer_.begin() + consumed);
+        pos_ -= consumed;
+    }
+
+    const float* result = out_buffer_.data();
+    interleaveFloatToS16(&result, produced, 1, out);
+    return produced;
+}
+
+double FractionalResampler::buffered() const {
+    return static_cast<double>(buffer_.size()) - pos_;
+}
@@ -0,0 +1,56 @@
+#ifndef FRACTIONALRESAMPLER_H
+#define FRACTIONALRESAMPLER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Variable-ratio resampler for small clock-drift corrections.
+//
+// Each output sample is a 4-point cubic (Catmull-Rom) interpolation of the
+// input at a fractional position that advances by ratio() input samples
+// per output sample, so the ratio can change on every call and the stream
+// stays continuous at sub-sample precision. This is meant for ratios within
+// a fraction of a percent of 1, where a cubic is transparent for speech; it
+// is not a sample-rate converter (see Resampler for that).
+//
+// Input is pushed in any chunking and output pulled in any size: push one
+// frame and pull available() for a variable-length output, or push until
+// available() reaches a frame and pull exactly that for a fixed-length one.
+// About a dozen flops per output sample.
+class FractionalResampler {
+public:
+    // |max_input_samples| sizes the internal buffer; larger pushes still
+    // work but reallocate once.
+    explicit FractionalResampler(size_t max_input_samples = 0);
+
+    // Drops buffered input and returns to a ratio of 1
+    void reset();
+
+    // Input samples consumed per output sample: above 1 shortens the
+    // stream, below 1 stretches it. Throws std::invalid_argument unless
+    // positive.
+    void setRatio(double ratio);
+    double ratio() const { return ratio_; }
+
+    void push(const int16_t* in, size_t num_in);
+
+    // Output samples that can be pulled at the current ratio
+    size_t available() const;
+
+    // Writes min(|max_out|, available()) samples to |out|; returns how many
+    size_t pull(int16_t* out, size_t max_out);
+
+    // Input samples pushed but not yet passed by the read position
+    double buffered() const;
+
+private:
+    // Interpolation history, then everything not yet consumed
+    std::vector<float> buffer_;
+    std::vector<float> out_buffer_;
+    // Read position in buffer_, at least 1 so one sample of history exists
+    double pos_;
+    double ratio_;
+};
+
+#endif // FRACTIONALRESAMPLER_H
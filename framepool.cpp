@@ -0,0 +1,116 @@
+#include "framepool.h"
+
+#include <algorithm>
+#include <cassert>
+
+FrameRef::FrameRef(const FrameRef& other)
+    : frame_(other.frame_) {
+    if (frame_) {
+        frame_->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+FrameRef& FrameRef::operator=(FrameRef other) {
+    std::swap(frame_, other.frame_);
+    return *this;
+}
+
+void FrameRef::reset() {
+    if (!frame_) {
+        return;
+    }
+    // Acquire-release so the next owner sees every write made under this
+    // reference
+    if (frame_->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        frame_->pool->recycle(frame_);
+    }
+    frame_ = nullptr;
+}
+
+FramePool::FramePool(size_t frame_samples, size_t capacity)
+    : frame_samples_(frame_samples)
+    , capacity_(std::min<size_t>(std::max<size_t>(capacity, 1), kNoFrame))
+    , acquired_(0)
+    , exhausted_(0)
+    , in_use_(0)
+    , high_water_(0) {
+    // Whole cache lines per frame, so frames never share one
+    const size_t stride = (frame_samples_ * sizeof(int16_t) + 63) / 64 * 64 / sizeof(int16_t);
+    frames_.reset(new FrameRef::Frame[capacity_]);
+    samples_.reset(new int16_t[capacity_ * stride + 64 / sizeof(int16_t)]);
+
+    // Align the first frame to 64 bytes; the rest follow at |stride|
+    int16_t* base = samples_.get();
+    const uintptr_t misalign = reinterpret_cast<uintptr_t>(base) % 64;
+    if (misalign) {
+        base += (64 - misalign) / sizeof(int16_t);
+    }
+
+    // Chain every frame onto the free list, frame 0 on top
+    for (size_t i = 0; i < capacity_; ++i) {
+        frames_[i].refs.store(0, std::memory_order_relaxed);
+        frames_[i].pool = this;
+        frames_[i].samples = base + i * stride;
+        frames_[i].next_free.store(i + 1 < capacity_ ? static_cast<uint32_t>(i + 1) : kNoFrame,
+                                   std::memory_order_relaxed);
+    }
+    free_head_.store(0);
+}
+
+FramePool::~FramePool() {
+    // A frame still referenced here would recycle into freed memory later
+    assert(in_use_.load() == 0);
+}
+
+FrameRef FramePool::acquire() {
+    uint64_t head = free_head_.load(std::memory_order_acquire);
+    FrameRef::Frame* frame;
+    for (;;) {
+        const uint32_t index = static_cast<uint32_t>(head);
+        if (index == kNoFrame) {
+            exhausted_.fetch_add(1, std::memory_order_relaxed);
+            return FrameRef();
+        }
+        frame = &frames_[index];
+        // May be stale if another thread takes the frame first; the tag
+        // makes the exchange fail then
+        const uint64_t next = ((head >> 32) + 1) << 32 | frame->next_free.load(std::memory_order_relaxed);
+        if (free_head_.compare_exchange_weak(head, next, std::memory_order_acquire,
+                                             std::memory_order_acquire)) {
+            break;
+        }
+    }
+    frame->refs.store(1, std::memory_order_relaxed);
+
+    acquired_.fetch_add(1, std::memory_order_relaxed);
+    const size_t in_use = in_use_.fetch_add(1, std::memory_order_relaxed) + 1;
+    size_t high_water = high_water_.load(std::memory_order_relaxed);
+    while (in_use > high_water
+           && !high_water_.compare_exchange_weak(high_water, in_use, std::memory_order_relaxed)) {
+    }
+    return FrameRef(frame);
+}
+
+FramePool::Stats FramePool::stats() const {
+    Stats stats;
+    stats.acquired = acquired_.load(std::memory_order_relaxed);
+    stats.exhausted = exhausted_.load(std::memory_order_relaxed);
+    stats.capacity = capacity_;
+    stats.in_use = in_use_.load(std::memory_order_relaxed);
+    stats.high_water = high_water_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void FramePool::recycle(FrameRef::Frame* frame) {
+    in_use_.fetch_sub(1, std::memory_order_relaxed);
+
+    const uint32_t index = static_cast<uint32_t>(frame - frames_.get());
+    uint64_t head = free_head_.load(std::memory_order_relaxed);
+    uint64_t next;
+    do {
+        frame->next_free.store(static_cast<uint32_t>(head), std::memory_order_relaxed);
+        next = ((head >> 32) + 1) << 32 | index;
+        // Release publishes the frame's samples to whoever acquires it next
+    } while (!free_head_.compare_exchange_weak(head, next, std::memory_order_release,
+                                               std::memory_order_relaxed));
+}
@@ -0,0 +1,113 @@
+#ifndef FRAMEPOOL_H
+#define FRAMEPOOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+class FramePool;
+
+// Handle to one pooled int16 frame. Copies share the frame (reference
+// counted); the last one to go returns it to its pool. Handing a frame from
+// stage to stage (decoder, jitter buffer, playout, echo reference) is a
+// pointer move instead of a sample copy.
+//
+// The count is atomic, so handles may be copied and dropped on different
+// threads; the samples themselves are not synchronised. By convention only
+// the first owner writes, before the frame is shared.
+class FrameRef {
+public:
+    FrameRef() : frame_(nullptr) {}
+    FrameRef(const FrameRef& other);
+    FrameRef(FrameRef&& other) : frame_(other.frame_) { other.frame_ = nullptr; }
+    FrameRef& operator=(FrameRef other);
+    ~FrameRef() { reset(); }
+
+    // Drops this handle's reference
+    void reset();
+
+    bool isNull() const { return frame_ == nullptr; }
+    int16_t* data() const;
+    size_t samples() const;
+
+private:
+    friend class FramePool;
+    struct Frame;
+    explicit FrameRef(Frame* frame) : frame_(frame) {}
+
+    Frame* frame_;
+};
+
+// Fixed-size int16 frames, allocated once up front and recycled. The pool
+// never grows: acquire() on an empty pool returns a null FrameRef and counts
+// it, so a pool sized too small shows up in the counters and the caller
+// drops the frame instead of allocating on the audio path.
+//
+// The free list is a lock-free stack of frame indices, so acquire() and the
+// last release never block and are safe from any number of threads. The
+// pool must outlive every FrameRef it handed out.
+class FramePool {
+public:
+    struct Stats {
+        uint64_t acquired;     // frames handed out since construction
+        uint64_t exhausted;    // acquire() calls that found no free frame
+        size_t capacity;       // frames owned
+        size_t in_use;
+        size_t high_water;     // most frames in use at once
+    };
+
+    FramePool(size_t frame_samples, size_t capacity);
+    ~FramePool();
+
+    // A frame with unspecified contents, referenced once; null when all
+    // capacity() frames are in use
+    FrameRef acquire();
+
+    size_t frameSamples() const { return frame_samples_; }
+    size_t capacity() const { return capacity_; }
+    Stats stats() const;
+
+private:
+    friend class FrameRef;
+
+    void recycle(FrameRef::Frame* frame);
+
+    // Free list head: the top frame's index in the low 32 bits (kNoFrame
+    // when empty) and a tag bumped by every update in the high 32 bits, so
+    // a frame popped and pushed back meanwhile fails the compare-exchange
+    static const uint32_t kNoFrame = 0xffffffffu;
+
+    const size_t frame_samples_;
+    const size_t capacity_;
+
+    std::unique_ptr<FrameRef::Frame[]> frames_;
+    std::unique_ptr<int16_t[]> samples_;
+    std::atomic<uint64_t> free_head_;
+
+    std::atomic<uint64_t> acquired_;
+    std::atomic<uint64_t> exhausted_;
+    std::atomic<size_t> in_use_;
+    std::atomic<size_t> high_water_;
+
+    FramePool(const FramePool&);
+    FramePool& operator=(const FramePool&);
+};
+
+struct FrameRef::Frame {
+    std::atomic<int> refs;
+    FramePool* pool;
+    int16_t* samples;
+    // Next free frame while this one is on the free list
+    std::atomic<uint32_t> next_free;
+};
+
+inline int16_t* FrameRef::data() const {
+    return frame_ ? frame_->samples : nullptr;
+}
+
+inline size_t FrameRef::samples() const {
+    return frame_ ? frame_->pool->frameSamples() : 0;
+}
+
+#endif // FRAMEPOOL_H
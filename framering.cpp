@@ -0,0 +1,135 @@
+#include "framering.h"
+
+#include <algorithm>
+
+FrameRing::FrameRing(size_t frame_samples, size_t capacity_frames)
+    : frame_samples_(0)
+    , capacity_(0)
+    , read_index_(0)
+    , write_index_(0)
+    , overruns_(0)
+    , underruns_(0)
+    , discarded_(0) {
+    reset(frame_samples, capacity_frames);
+}
+
+void FrameRing::reset(size_t frame_samples, size_t capacity_frames) {
+    // Release every queued frame before its pool can go away
+    slots_.clear();
+    frame_samples_ = frame_samples;
+    capacity_ = std::max<size_t>(1, capacity_frames);
+    // Full ring plus a frame the consumer still holds and one being pushed
+    pool_.reset(new FramePool(frame_samples_, capacity_ + 2));
+    slots_.resize(capacity_);
+    flags_.assign(capacity_, 0);
+    clear();
+}
+
+void FrameRing::clear() {
+    for (size_t i = 0; i < slots_.size(); ++i) {
+        slots_[i].reset();
+    }
+    read_index_.store(0);
+    write_index_.store(0);
+    overruns_.store(0);
+    underruns_.store(0);
+    discarded_.store(0);
+}
+
+bool FrameRing::push(const int16_t* frame, uint32_t flags) {
+    const size_t write = write_index_.load(std::memory_order_relaxed);
+    const size_t read = read_index_.load(std::memory_order_acquire);
+    if (write - read >= capacity_) {
+        overruns_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    FrameRef copy = pool_->acquire();
+    if (copy.isNull()) {
+        overruns_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    std::copy(frame, frame + frame_samples_, copy.data());
+    slots_[write % capacity_] = std::move(copy);
+    flags_[write % capacity_] = flags;
+    write_index_.store(write + 1, std::memory_order_release);
+    return true;
+}
+
+bool FrameRing::push(FrameRef frame, uint32_t flags) {
+    const size_t write = write_index_.load(std::memory_order_relaxed);
+    const size_t read = read_index_.load(std::memory_order_acquire);
+    if (write - read >= capacity_) {
+        overruns_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    slots_[write % capacity_] = std::move(frame);
+    flags_[write % capacity_] = flags;
+    write_index_.store(write + 1, std::memory_order_release);
+    return true;
+}
+
+size_t FrameRing::size() const {
+    const size_t read = read_index_.load(std::memory_order_relaxed);
+    const size_t write = write_index_.load(std::memory_order_acquire);
+    return write - read;
+}
+
+const int16_t* FrameRing::front() const {
+    const size_t read = read_index_.load(std::memory_order_relaxed);
+    const size_t write = write_index_.load(std::memory_order_acquire);
+    if (write == read) {
+        return nullptr;
+    }
+    return slots_[read % capacity_].data();
+}
+
+FrameRef FrameRing::frontRef() const {
+    const size_t read = read_index_.load(std::memory_order_relaxed);
+    const size_t write = write_index_.load(std::memory_order_acquire);
+    if (write == read) {
+        return FrameRef();
+    }
+    return slots_[read % capacity_];
+}
+
+uint32_t FrameRing::frontFlags() const {
+    return flags_[read_index_.load(std::memory_order_relaxed) % capacity_];
+}
+
+void FrameRing::pop() {
+    const size_t read = read_index_.load(std::memory_order_relaxed);
+    if (write_index_.load(std::memory_order_acquire) != read) {
+        slots_[read % capacity_].reset();
+        read_index_.store(read + 1, std::memory_order_release);
+    }
+}
+
+bool FrameRing::pop(int16_t* frame) {
+    const int16_t* src = front();
+    if (!src) {
+        countUnderrun();
+        return false;
+    }
+    std::copy(src, src + frame_samples_, frame);
+    pop();
+    return true;
+}
+
+size_t FrameRing::discardTo(size_t max_frames) {
+    const size_t read = read_index_.load(std::memory_order_relaxed);
+    const size_t write = write_index_.load(std::memory_order_acquire);
+    const size_t queued = write - read;
+    if (queued <= max_frames) {
+        return 0;
+    }
+
+    const size_t dropped = queued - max_frames;
+    for (size_t i = 0; i < dropped; ++i) {
+        slots_[(read + i) % capacity_].reset();
+    }
+    read_index_.store(read + dropped, std::memory_order_release);
+    discarded_.fetch_add(dropped, std::memory_order_relaxed);
+    return dropped;
+}
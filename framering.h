@@ -0,0 +1,98 @@
+#ifndef FRAMERING_H
+#define FRAMERING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "framepool.h"
+
+// Lock-free single-producer/single-consumer ring of fixed-size int16 frames.
+//
+// Slots hold pooled frames (framepool.h). push(FrameRef) queues a frame
+// without copying it; push(const int16_t*) copies into a frame from the
+// ring's own pool, which reset() sizes to the ring. The calls only move two
+// atomic indices (and, for the copy, pop the pool's lock-free free list),
+// so the ring is safe with the producer and consumer on different threads
+// (for example network receive and the audio thread) and never blocks
+// either side.
+//
+// Producer side: push(). Consumer side: size(), front(), pop(), discardTo(),
+// countUnderrun(). Counters may be read from any thread.
+class FrameRing {
+public:
+    FrameRing(size_t frame_samples, size_t capacity_frames);
+
+    // Reallocates the ring. Not thread-safe: only call while neither side is
+    // running.
+    void reset(size_t frame_samples, size_t capacity_frames);
+
+    // Discards all queued frames and zeroes the counters. Same restriction as
+    // reset().
+    void clear();
+
+    size_t frameSamples() const { return frame_samples_; }
+    size_t capacity() const { return capacity_; }
+
+    // Producer: copies one frame in, with caller-defined |flags| that travel
+    // with it (e.g. AudioEngine::kFrameVoice). Returns false and counts an
+    // overrun if the ring is full, or the consumer holds so many frontRef()s
+    // that the pool is empty; the incoming frame is dropped.
+    bool push(const int16_t* frame, uint32_t flags = 0);
+    // Producer: queues |frame| itself, which must hold frameSamples() and
+    // not be null
+    bool push(FrameRef frame, uint32_t flags = 0);
+
+    // Consumer: number of queued frames. Exact for the consumer, a lower
+    // bound for anyone else.
+    size_t size() const;
+
+    // Consumer: oldest queued frame, or nullptr when empty. The pointer stays
+    // valid until pop().
+    const int16_t* front() const;
+    // Consumer: flags pushed with front(); only valid while it is non-null
+    uint32_t frontFlags() const;
+    // Consumer: another reference to front(), to keep it past pop()
+    FrameRef frontRef() const;
+    void pop();
+
+    // Consumer: copies the oldest frame out. Returns false and counts an
+    // underrun when empty.
+    bool pop(int16_t* frame);
+
+    // Consumer: drops the oldest frames until at most |max_frames| remain.
+    // Returns how many were dropped; they are counted as discarded.
+    size_t discardTo(size_t max_frames);
+
+    // Consumer: records that a frame was needed but not available.
+    void countUnderrun() { underruns_.fetch_add(1, std::memory_order_relaxed); }
+
+    uint64_t overruns() const { return overruns_.load(std::memory_order_relaxed); }
+    uint64_t underruns() const { return underruns_.load(std::memory_order_relaxed); }
+    uint64_t discarded() const { return discarded_.load(std::memory_order_relaxed); }
+
+private:
+    size_t frame_samples_;
+    size_t capacity_;
+    // For push(const int16_t*); declared first so it outlives slots_
+    std::unique_ptr<FramePool> pool_;
+    std::vector<FrameRef> slots_;
+    std::vector<uint32_t> flags_;
+
+    // Monotonic frame counters; slot = counter % capacity_. Padded apart so
+    // producer and consumer do not false-share a cache line.
+    std::atomic<size_t> read_index_;
+    char pad0_[64 - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> write_index_;
+    char pad1_[64 - sizeof(std::atomic<size_t>)];
+
+    std::atomic<uint64_t> overruns_;
+    std::atomic<uint64_t> underruns_;
+    std::atomic<uint64_t> discarded_;
+
+    FrameRing(const FrameRing&);
+    FrameRing& operator=(const FrameRing&);
+};
+
+#endif // FRAMERING_H
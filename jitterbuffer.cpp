@@ -0,0 +1,450 @@
+#include "jitterbuffer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+
+namespace {
+
+// Target delay covers this many times the smoothed jitter
+const double kJitterMultiple = 3.0;
+// Without underruns or late packets for this many pops (5 s of 10 ms
+// frames) the incident floor drops by one frame
+const int kFloorDecayPops = 500;
+// Run deeper than target + 1 for this many pops before dropping a frame
+const int kShrinkAfterPops = 50;
+// A burst of late packets or underruns raises the floor once, not per event
+const int kBumpIntervalPops = 10;
+// While shallower than target, repeat a frame (instead of advancing) at
+// most once per this many pops
+const int kGrowIntervalPops = 4;
+// Lost frames are replaced by the last good frame at half the previous
+// level; after this many in a row by silence
+const int kMaxConcealFrames = 3;
+// Pool frames beyond capacity: the last played frame and the ones the
+// playout side may still hold
+const size_t kSpareFrames = 4;
+
+// Wrap-safe sequence comparison
+inline int32_t seqDiff(uint32_t a, uint32_t b) {
+    return static_cast<int32_t>(a - b);
+}
+
+} // namespace
+
+JitterBuffer::JitterBuffer(size_t frame_samples, int sample_rate, size_t capacity_frames)
+    : frame_samples_(frame_samples)
+    , sample_rate_(sample_rate)
+    , capacity_(std::max<size_t>(4, capacity_frames))
+    , pool_(frame_samples_, capacity_ + kSpareFrames)
+    , slots_(capacity_)
+    , slot_seq_(capacity_, 0)
+    , slot_valid_(capacity_, kSlotEmpty)
+    , slot_sid_(capacity_ * kSidBytes, 0)
+    , scratch_(frame_samples_, 0)
+    , inbox_(2 * capacity_)
+    , inbox_read_(0)
+    , inbox_write_(0)
+    , rejected_(0)
+    , cng_(frame_samples_) {
+    reset();
+}
+
+void JitterBuffer::reset() {
+    for (size_t i = 0; i < inbox_.size(); ++i) {
+        inbox_[i].frame.reset();
+    }
+    inbox_read_.store(0);
+    inbox_write_.store(0);
+    rejected_.store(0);
+    clearSlots();
+    last_frame_.reset();
+    playing_ = false;
+    started_ = false;
+    next_seq_ = 0;
+    highest_seq_ = 0;
+    have_highest_ = false;
+    concealed_run_ = 0;
+    dtx_ = false;
+    cng_.reset();
+    have_last_ = false;
+    last_arrival_ = 0;
+    last_timestamp_ = 0;
+    jitter_ = 0.0;
+    target_frames_ = 1;
+    floor_frames_ = 1;
+    pops_since_incident_ = 0;
+    pops_since_bump_ = kBumpIntervalPops;
+    pops_above_target_ = 0;
+    pops_since_grow_ = 0;
+    stats_ = Stats();
+    publishStats();
+}
+
+void JitterBuffer::insert(uint32_t seq, uint32_t timestamp, const int16_t* frame) {
+    const int64_t now_us = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    insert(seq, timestamp, frame, now_us);
+}
+
+void JitterBuffer::insert(uint32_t seq, uint32_t timestamp, const int16_t* frame, int64_t arrival_us) {
+    FrameRef copy = pool_.acquire();
+    if (copy.isNull()) {
+        // Pool exhausted (counted there); the frame goes missing and is
+        // concealed like a lost one
+        return;
+    }
+    std::copy(frame, frame + frame_samples_, copy.data());
+    insert(seq, timestamp, std::move(copy), arrival_us);
+}
+
+void JitterBuffer::insert(uint32_t seq, uint32_t timestamp, FrameRef frame) {
+    const int64_t now_us = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    insert(seq, timestamp, std::move(frame), now_us);
+}
+
+void JitterBuffer::insert(uint32_t seq, uint32_t timestamp, FrameRef frame, int64_t arrival_us) {
+    assert(frame.samples() == frame_samples_);
+    Arrival* arrival = inboxSlot();
+    if (!arrival) {
+        return;
+    }
+    arrival->frame = std::move(frame);
+    arrival->sid = false;
+    arrival->seq = seq;
+    arrival->timestamp = timestamp;
+    arrival->arrival_us = arrival_us;
+    queueArrival();
+}
+
+void JitterBuffer::insertSid(uint32_t seq, uint32_t timestamp, const uint8_t* sid, size_t bytes) {
+    const int64_t now_us = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    insertSid(seq, timestamp, sid, bytes, now_us);
+}
+
+void JitterBuffer::insertSid(uint32_t seq, uint32_t timestamp, const uint8_t* sid, size_t bytes,
+                             int64_t arrival_us) {
+    if (bytes != kSidBytes) {
+        rejected_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    Arrival* arrival = inboxSlot();
+    if (!arrival) {
+        return;
+    }
+    arrival->sid = true;
+    arrival->seq = seq;
+    arrival->timestamp = timestamp;
+    arrival->arrival_us = arrival_us;
+    std::copy(sid, sid + kSidBytes, arrival->sid_bytes);
+    queueArrival();
+}
+
+JitterBuffer::Arrival* JitterBuffer::inboxSlot() {
+    const size_t write = inbox_write_.load(std::memory_order_relaxed);
+    const size_t read = inbox_read_.load(std::memory_order_acquire);
+    if (write - read >= inbox_.size()) {
+        rejected_.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    return &inbox_[write % inbox_.size()];
+}
+
+void JitterBuffer::queueArrival() {
+    inbox_write_.store(inbox_write_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+void JitterBuffer::takeArrivals() {
+    const size_t read = inbox_read_.load(std::memory_order_relaxed);
+    const size_t write = inbox_write_.load(std::memory_order_acquire);
+    for (size_t i = read; i != write; ++i) {
+        Arrival& arrival = inbox_[i % inbox_.size()];
+        const int slot = claimSlot(arrival.seq, arrival.timestamp, arrival.arrival_us);
+        if (slot >= 0) {
+            if (arrival.sid) {
+                std::copy(arrival.sid_bytes, arrival.sid_bytes + kSidBytes, &slot_sid_[slot * kSidBytes]);
+                slots_[slot].reset();
+                slot_valid_[slot] = kSlotSid;
+            } else {
+                slots_[slot] = std::move(arrival.frame);
+                slot_valid_[slot] = kSlotFrame;
+            }
+        }
+        arrival.frame.reset();
+    }
+    inbox_read_.store(write, std::memory_order_release);
+}
+
+int JitterBuffer::claimSlot(uint32_t seq, uint32_t timestamp, int64_t arrival_us) {
+    ++stats_.received;
+
+    // Interarrival jitter: J += (|D| - J) / 16, D in samples
+    const int64_t arrival = arrival_us * sample_rate_ / 1000000;
+    if (have_last_) {
+        int64_t d = (arrival - last_arrival_) - seqDiff(timestamp, last_timestamp_);
+        jitter_ += (std::abs(static_cast<double>(d)) - jitter_) / 16.0;
+    }
+    have_last_ = true;
+    last_arrival_ = arrival;
+    last_timestamp_ = timestamp;
+
+    const int32_t ahead = seqDiff(seq, next_seq_);
+    const int32_t window = static_cast<int32_t>(capacity_);
+    if (started_ && ahead < 0 && ahead > -window) {
+        // Its slot has already been played or concealed
+        ++stats_.late;
+        noteIncident();
+        return -1;
+    }
+
+    if (started_ && (ahead >= window || ahead <= -window)) {
+        // Far from the playout position (long outage or sender restart)
+        stats_.discarded += buffered_;
+        clearSlots();
+        playing_ = false;
+        started_ = false;
+        have_highest_ = false;
+        dtx_ = false;
+    }
+
+    if (!have_highest_ || seqDiff(seq, highest_seq_) > 0) {
+        highest_seq_ = seq;
+        have_highest_ = true;
+    }
+
+    const size_t slot = seq % capacity_;
+    if (slot_valid_[slot]) {
+        ++stats_.discarded; // duplicate, or an older frame never played
+        if (slot_seq_[slot] == seq) {
+            return -1;
+        }
+        --buffered_;
+    }
+
+    // The caller fills the slot
+    slot_seq_[slot] = seq;
+    ++buffered_;
+    updateTarget();
+    return static_cast<int>(slot);
+}
+
+JitterBuffer::PopResult JitterBuffer::pop(int16_t* out) {
+    takeArrivals();
+    const PopResult result = popNext(nullptr, out);
+    publishStats();
+    return result;
+}
+
+JitterBuffer::PopResult JitterBuffer::pop(FrameRef* out) {
+    takeArrivals();
+    const PopResult result = popNext(out, nullptr);
+    publishStats();
+    return result;
+}
+
+int16_t* JitterBuffer::generatedFrame(FrameRef* ref, int16_t* out) {
+    if (out) {
+        return out;
+    }
+    *ref = pool_.acquire();
+    // Pool exhausted: generate into scratch and hand out a null frame
+    return ref->isNull() ? scratch_.data() : ref->data();
+}
+
+JitterBuffer::PopResult JitterBuffer::popNext(FrameRef* ref, int16_t* out) {
+    if (!playing_) {
+        if (buffered_ == 0 || buffered_ < target_frames_) {
+            out = generatedFrame(ref, out);
+            std::fill(out, out + frame_samples_, 0);
+            return kEmpty;
+        }
+        // Start from the oldest buffered frame; after an underrun everything
+        // older than next_seq_ was rejected as late already
+        bool found = false;
+        for (size_t i = 0; i < capacity_; ++i) {
+            if (slot_valid_[i] && (!found || seqDiff(slot_seq_[i], next_seq_) < 0)) {
+                next_seq_ = slot_seq_[i];
+                found = true;
+            }
+        }
+        playing_ = true;
+        started_ = true;
+        pops_above_target_ = 0;
+    }
+
+    ++pops_since_bump_;
+    ++pops_since_grow_;
+    if (++pops_since_incident_ >= kFloorDecayPops) {
+        pops_since_incident_ = 0;
+        if (floor_frames_ > 1) {
+            --floor_frames_;
+            updateTarget();
+        }
+    }
+
+    // During DTX the sender sends nothing between descriptors; play comfort
+    // noise until the next real frame instead of concealing or rebuffering
+    const size_t next_slot = next_seq_ % capacity_;
+    const bool next_here = slot_valid_[next_slot] && slot_seq_[next_slot] == next_seq_;
+    if (next_here ? slot_valid_[next_slot] == kSlotSid : dtx_) {
+        return playComfortNoise(generatedFrame(ref, out));
+    }
+
+    // Shrink: drop one frame once the buffer has stayed too deep
+    if (bufferedSpan() > target_frames_ + 1) {
+        if (++pops_above_target_ >= kShrinkAfterPops) {
+            const size_t slot = next_seq_ % capacity_;
+            if (slot_valid_[slot] && slot_seq_[slot] == next_seq_) {
+                slots_[slot].reset();
+                slot_valid_[slot] = kSlotEmpty;
+                --buffered_;
+                ++stats_.discarded;
+            }
+            ++next_seq_;
+            pops_above_target_ = 0;
+        }
+    } else {
+        pops_above_target_ = 0;
+    }
+
+    // Grow: hold the playout position for one frame, filling it like a
+    // lost one, so the buffer deepens without waiting for an underrun
+    if (bufferedSpan() < target_frames_ && pops_since_grow_ >= kGrowIntervalPops
+        && concealed_run_ == 0) {
+        pops_since_grow_ = 0;
+        ++stats_.stretched;
+        conceal(generatedFrame(ref, out));
+        return kConcealed;
+    }
+
+    const size_t slot = next_seq_ % capacity_;
+    if (slot_valid_[slot] && slot_seq_[slot] == next_seq_) {
+        // Kept for concealment; handed out without a copy
+        last_frame_ = std::move(slots_[slot]);
+        if (out) {
+            std::copy(last_frame_.data(), last_frame_.data() + frame_samples_, out);
+        } else {
+            *ref = last_frame_;
+        }
+        slot_valid_[slot] = kSlotEmpty;
+        --buffered_;
+        ++next_seq_;
+        concealed_run_ = 0;
+        dtx_ = false;
+        return kFrame;
+    }
+
+    if (buffered_ > 0) {
+        // Later frames are here, so this one is lost rather than late
+        ++stats_.lost;
+        ++next_seq_;
+        conceal(generatedFrame(ref, out));
+        return kConcealed;
+    }
+
+    // Ran dry: rebuffer up to a deeper target
+    ++stats_.underruns;
+    playing_ = false;
+    noteIncident();
+    out = generatedFrame(ref, out);
+    std::fill(out, out + frame_samples_, 0);
+    return kEmpty;
+}
+
+JitterBuffer::Stats JitterBuffer::stats() const {
+    Stats s;
+    s.received = shared_stats_.received.load(std::memory_order_relaxed);
+    s.late = shared_stats_.late.load(std::memory_order_relaxed);
+    s.lost = shared_stats_.lost.load(std::memory_order_relaxed);
+    s.discarded = shared_stats_.discarded.load(std::memory_order_relaxed)
+                  + rejected_.load(std::memory_order_relaxed);
+    s.underruns = shared_stats_.underruns.load(std::memory_order_relaxed);
+    s.stretched = shared_stats_.stretched.load(std::memory_order_relaxed);
+    s.comfort_noise = shared_stats_.comfort_noise.load(std::memory_order_relaxed);
+    s.jitter_ms = shared_stats_.jitter_ms.load(std::memory_order_relaxed);
+    s.target_delay_ms = shared_stats_.target_delay_ms.load(std::memory_order_relaxed);
+    s.current_delay_ms = shared_stats_.current_delay_ms.load(std::memory_order_relaxed);
+    return s;
+}
+
+void JitterBuffer::publishStats() {
+    const int frame_ms = static_cast<int>(frame_samples_ * 1000 / sample_rate_);
+    shared_stats_.received.store(stats_.received, std::memory_order_relaxed);
+    shared_stats_.late.store(stats_.late, std::memory_order_relaxed);
+    shared_stats_.lost.store(stats_.lost, std::memory_order_relaxed);
+    shared_stats_.discarded.store(stats_.discarded, std::memory_order_relaxed);
+    shared_stats_.underruns.store(stats_.underruns, std::memory_order_relaxed);
+    shared_stats_.stretched.store(stats_.stretched, std::memory_order_relaxed);
+    shared_stats_.comfort_noise.store(stats_.comfort_noise, std::memory_order_relaxed);
+    shared_stats_.jitter_ms.store(static_cast<int>(jitter_ * 1000.0 / sample_rate_),
+                                  std::memory_order_relaxed);
+    shared_stats_.target_delay_ms.store(static_cast<int>(target_frames_) * frame_ms,
+                                        std::memory_order_relaxed);
+    shared_stats_.current_delay_ms.store(
+                static_cast<int>(playing_ ? bufferedSpan() : buffered_) * frame_ms,
+                std::memory_order_relaxed);
+}
+
+JitterBuffer::PopResult JitterBuffer::playComfortNoise(int16_t* out) {
+    const size_t slot = next_seq_ % capacity_;
+    if (slot_valid_[slot] == kSlotSid && slot_seq_[slot] == next_seq_) {
+        cng_.update(&slot_sid_[slot * kSidBytes], kSidBytes);
+        slot_valid_[slot] = kSlotEmpty;
+        --buffered_;
+        dtx_ = true;
+    }
+    ++next_seq_;
+    concealed_run_ = 0;
+    ++stats_.comfort_noise;
+    cng_.generate(out);
+    return kComfortNoise;
+}
+
+void JitterBuffer::clearSlots() {
+    for (size_t i = 0; i < capacity_; ++i) {
+        slots_[i].reset();
+    }
+    std::fill(slot_valid_.begin(), slot_valid_.end(), kSlotEmpty);
+    buffered_ = 0;
+}
+
+void JitterBuffer::conceal(int16_t* out) {
+    ++concealed_run_;
+    if (concealed_run_ > kMaxConcealFrames || last_frame_.isNull()) {
+        std::fill(out, out + frame_samples_, 0);
+        return;
+    }
+    const int shift = concealed_run_;
+    const int16_t* last = last_frame_.data();
+    for (size_t i = 0; i < frame_samples_; ++i) {
+        out[i] = static_cast<int16_t>(last[i] >> shift);
+    }
+}
+
+void JitterBuffer::noteIncident() {
+    pops_since_incident_ = 0;
+    if (pops_since_bump_ >= kBumpIntervalPops) {
+        pops_since_bump_ = 0;
+        floor_frames_ = std::min(std::max(floor_frames_, target_frames_) + 1, capacity_ - 2);
+        updateTarget();
+    }
+}
+
+size_t JitterBuffer::bufferedSpan() const {
+    // Frames from the playout position to the newest one, holes included
+    if (!have_highest_ || buffered_ == 0 || seqDiff(highest_seq_, next_seq_) < 0) {
+        return 0;
+    }
+    return static_cast<size_t>(seqDiff(highest_seq_, next_seq_)) + 1;
+}
+
+void JitterBuffer::updateTarget() {
+    const size_t jitter_frames = static_cast<size_t>(
+        std::ceil(kJitterMultiple * jitter_ / static_cast<double>(frame_samples_)));
+    target_frames_ = std::min(std::max(std::max(jitter_frames, floor_frames_), size_t(1)),
+                              capacity_ - 2);
+}
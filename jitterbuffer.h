@@ -0,0 +1,211 @@
+#ifndef JITTERBUFFER_H
+#define JITTERBUFFER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "dtx.h"
+#include "framepool.h"
+
+// Adaptive jitter buffer for fixed-size int16 frames arriving over the
+// network.
+//
+// Frames are slotted by sequence number, so reordered packets are played in
+// order and gaps are detected. The network side calls insert() as packets
+// arrive; the playout side calls pop() once per frame period. Interarrival
+// jitter is estimated from the sender timestamps as in RFC 3550, and the
+// target playout delay follows it: the buffer grows immediately after an
+// underrun or a late packet, and shrinks by dropping single frames once it
+// has run deeper than needed for a while.
+//
+// Silence descriptors from a DTX sender (dtx.h) take a slot like a frame.
+// From one of them until the next real frame the buffer plays comfort
+// noise, and missing sequence numbers are treated as suppressed, not lost.
+//
+// Frames are held as pooled FrameRefs (framepool.h): the FrameRef overloads
+// of insert() and pop() pass a decoded frame through to playout without
+// copying it. The pointer overloads copy in and out. Concealment, comfort
+// noise and silence are written into frames from the buffer's own pool,
+// which is sized up front and never grows.
+//
+// The two sides share no lock, so a real-time playout thread never waits on
+// the network thread. insert() only queues the arrival, stamped with its
+// receive time, in a preallocated single-producer/single-consumer ring;
+// pop() takes every queued arrival into the slots and then plays, so all
+// slot and adaptation state belongs to the playout side. One network-side
+// thread and one playout-side thread may run at once.
+class JitterBuffer {
+public:
+    enum PopResult {
+        kFrame,         // |out| holds the next frame
+        kConcealed,     // the next frame was lost; |out| holds a faded repeat
+        kComfortNoise,  // the sender is in DTX; |out| holds comfort noise
+        kEmpty          // buffering or underrun; |out| holds silence
+    };
+
+    struct Stats {
+        uint64_t received;
+        uint64_t late;           // arrived after their playout time
+        uint64_t lost;           // never arrived, concealed
+        uint64_t discarded;      // duplicates, overflow and frames dropped to shrink
+        uint64_t underruns;
+        uint64_t stretched;      // frames repeated to grow the buffer
+        uint64_t comfort_noise;  // frames of comfort noise played during DTX
+        int jitter_ms;        // smoothed interarrival jitter
+        int target_delay_ms;
+        int current_delay_ms;
+    };
+
+    // |sample_rate| converts timestamps (in samples) and frame counts to time
+    JitterBuffer(size_t frame_samples, int sample_rate, size_t capacity_frames = 50);
+
+    // Drops all frames, statistics and adaptation state. Not thread-safe:
+    // only call while neither side is running.
+    void reset();
+
+    // Network side: |seq| increments by one per frame, |timestamp| by
+    // frame_samples. |arrival_us| is the local receive time on any monotonic
+    // clock; the overload without it uses std::chrono::steady_clock.
+    void insert(uint32_t seq, uint32_t timestamp, const int16_t* frame);
+    void insert(uint32_t seq, uint32_t timestamp, const int16_t* frame, int64_t arrival_us);
+
+    // As above, keeping a reference to |frame| instead of copying it. The
+    // caller must not write to the frame afterwards; its pool must outlive
+    // this buffer and hold frames of frame_samples.
+    void insert(uint32_t seq, uint32_t timestamp, FrameRef frame);
+    void insert(uint32_t seq, uint32_t timestamp, FrameRef frame, int64_t arrival_us);
+
+    // Network side: a silence descriptor of kSidBytes in place of frame
+    // |seq|. Malformed descriptors are counted as discarded, and so is
+    // anything arriving while 2 * capacity arrivals wait for pop().
+    void insertSid(uint32_t seq, uint32_t timestamp, const uint8_t* sid, size_t bytes);
+    void insertSid(uint32_t seq, uint32_t timestamp, const uint8_t* sid, size_t bytes,
+                   int64_t arrival_us);
+
+    // Playout side: always fills |out| with frame_samples samples
+    PopResult pop(int16_t* out);
+
+    // Playout side: sets |out| to a frame of frame_samples. For kFrame it is
+    // the inserted frame itself. The frame may still be referenced by the
+    // buffer (for concealment), so treat it as read-only. A generated frame
+    // is null when the buffer's pool is exhausted; it is dropped then.
+    PopResult pop(FrameRef* out);
+
+    // Callable from any thread. Counters advance as pop() takes arrivals
+    // in; fields are each current but not read as one snapshot.
+    Stats stats() const;
+
+    size_t frameSamples() const { return frame_samples_; }
+    size_t capacity() const { return capacity_; }
+
+private:
+    enum SlotState { kSlotEmpty = 0, kSlotFrame, kSlotSid };
+
+    // A frame or silence descriptor queued by the network side
+    struct Arrival {
+        FrameRef frame;
+        bool sid;
+        uint32_t seq;
+        uint32_t timestamp;
+        int64_t arrival_us;
+        uint8_t sid_bytes[kSidBytes];
+    };
+
+    // Network side: the next free inbox entry, or nullptr (counted) when
+    // full; queueArrival() hands a filled one to the playout side
+    Arrival* inboxSlot();
+    void queueArrival();
+    // Playout side: moves every queued arrival into the slots
+    void takeArrivals();
+    // Jitter estimate and slot bookkeeping for one arrival; returns the
+    // slot to fill, or -1 to drop
+    int claimSlot(uint32_t seq, uint32_t timestamp, int64_t arrival_us);
+    // Shared pop; exactly one of |ref| and |out| is set
+    PopResult popNext(FrameRef* ref, int16_t* out);
+    // Copies stats_ and the delay figures for stats()
+    void publishStats();
+    // Where a generated frame goes: |out|, or a new pooled frame in |ref|
+    // (scratch_ when the pool is exhausted)
+    int16_t* generatedFrame(FrameRef* ref, int16_t* out);
+    void clearSlots();
+    PopResult playComfortNoise(int16_t* out);
+    size_t bufferedSpan() const;
+    void updateTarget();
+    void conceal(int16_t* out);
+    void noteIncident();
+
+    const size_t frame_samples_;
+    const int sample_rate_;
+    const size_t capacity_;
+
+    // Declared before everything holding its frames, so it is destroyed last
+    FramePool pool_;
+    std::vector<FrameRef> slots_;
+    std::vector<uint32_t> slot_seq_;
+    std::vector<char> slot_valid_;  // SlotState
+    std::vector<uint8_t> slot_sid_;
+    // Source for concealment; null until the first frame is played
+    FrameRef last_frame_;
+    std::vector<int16_t> scratch_;
+    size_t buffered_;
+
+    // Arrivals from the network side. Monotonic counters; entry =
+    // counter % inbox_.size(). Padded apart like FrameRing's.
+    std::vector<Arrival> inbox_;
+    std::atomic<size_t> inbox_read_;
+    char pad0_[64 - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> inbox_write_;
+    char pad1_[64 - sizeof(std::atomic<size_t>)];
+    // Network side: arrivals dropped before reaching the inbox
+    std::atomic<uint64_t> rejected_;
+
+    // Playout position. started_ stays set across underruns so frames older
+    // than next_seq_ are still rejected while rebuffering.
+    bool playing_;
+    bool started_;
+    uint32_t next_seq_;
+    uint32_t highest_seq_;
+    bool have_highest_;
+    int concealed_run_;
+
+    // Between a silence descriptor and the next frame
+    bool dtx_;
+    ComfortNoiseGenerator cng_;
+
+    // Jitter estimate (RFC 3550), in samples
+    bool have_last_;
+    int64_t last_arrival_;
+    uint32_t last_timestamp_;
+    double jitter_;
+
+    // Target delay in frames: max(jitter term, incident floor)
+    size_t target_frames_;
+    size_t floor_frames_;
+    int pops_since_incident_;
+    int pops_since_bump_;
+    int pops_above_target_;
+    int pops_since_grow_;
+
+    // Playout side's counters, and the copy other threads read
+    Stats stats_;
+    struct SharedStats {
+        std::atomic<uint64_t> received;
+        std::atomic<uint64_t> late;
+        std::atomic<uint64_t> lost;
+        std::atomic<uint64_t> discarded;
+        std::atomic<uint64_t> underruns;
+        std::atomic<uint64_t> stretched;
+        std::atomic<uint64_t> comfort_noise;
+        std::atomic<int> jitter_ms;
+        std::atomic<int> target_delay_ms;
+        std::atomic<int> current_delay_ms;
+    };
+    SharedStats shared_stats_;
+
+    JitterBuffer(const JitterBuffer&);
+    JitterBuffer& operator=(const JitterBuffer&);
+};
+
+#endif // JITTERBUFFER_H
@@ -1,6 +1,18 @@
+#include "aecdaemon.h"
+
+#ifdef AEC_HEADLESS
+
+int main(int argc, char *argv[])
+{
+    return runAecDaemon(argc, argv);
+}
+
+#else
+
 #include <QGuiApplication>
 #include <QQmlApplicationEngine>
 #include <QQmlContext>
+#include <cstring>
 #include "audiocontroller.h"
 #include "WebrtcAEC3.h"
 
@@ -8,6 +20,12 @@
 
 int main(int argc, char *argv[])
 {
+    // The GUI build can run as the service too; see aecdaemon.h
+    if (argc > 1 && strcmp(argv[1], "--headless") == 0) {
+        argv[1] = argv[0];
+        return runAecDaemon(argc - 1, argv + 1);
+    }
+
     QCoreApplication::setAttribute(Qt::AA_EnableHighDpiScaling);
 
     QGuiApplication app(argc, argv);
@@ -36,3 +54,5 @@ int main(int argc, char *argv[])
 
     return app.exec();
 }
+
+#endif // AEC_HEADLESS
@@ -0,0 +1,109 @@
+#include "metricsserver.h"
+#include <QDebug>
+#include <QHostAddress>
+#include <string>
+
+MetricsServer::MetricsServer(const AecMetrics *metrics, QObject *parent)
+    : QObject(parent)
+    , metrics_(metrics)
+    , server_(new QTcpServer(this))
+{
+    connect(server_, &QTcpServer::newConnection,
+            this, &MetricsServer::onNewConnection);
+}
+
+MetricsServer::~MetricsServer() {
+    close();
+}
+
+bool MetricsServer::listen(quint16 port) {
+    if (server_->isListening()) {
+        server_->close();
+    }
+    if (!server_->listen(QHostAddress::LocalHost, port)) {
+        qWarning() << "Metrics endpoint failed to listen on port" << port << ":"
+                   << server_->errorString();
+        return false;
+    }
+    qDebug() << "Metrics available at http://127.0.0.1:" << server_->serverPort() << "/metrics";
+    return true;
+}
+
+void MetricsServer::close() {
+    server_->close();
+}
+
+void MetricsServer::onNewConnection() {
+    while (QTcpSocket *socket = server_->nextPendingConnection()) {
+        connect(socket, &QTcpSocket::readyRead, this, &MetricsServer::onReadyRead);
+        connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+    }
+}
+
+void MetricsServer::onReadyRead() {
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+    if (!socket) {
+        return;
+    }
+
+    // Only the request line matters; wait until the whole head has arrived
+    // so the client is not cut off mid-send
+    QByteArray head = socket->property("requestHead").toByteArray();
+    head += socket->readAll();
+    if (head.size() > kMaxRequestBytes) {
+        socket->disconnect(this);
+        writeResponse(socket, "431 Request Header Fields Too Large", "text/plain", QByteArray());
+        return;
+    }
+    if (!head.contains("\r\n\r\n") && !head.contains("\n\n")) {
+        socket->setProperty("requestHead", head);
+        return;
+    }
+    socket->disconnect(this);
+
+    const int end = head.indexOf('\n');
+    respond(socket, head.left(end).trimmed());
+}
+
+void MetricsServer::respond(QTcpSocket *socket, const QByteArray &requestLine) {
+    const QList<QByteArray> parts = requestLine.split(' ');
+    if (parts.size() < 2 || parts.at(0) != "GET") {
+        writeResponse(socket, "405 Method Not Allowed", "text/plain", "GET only\n");
+        return;
+    }
+
+    // Ignore any query string
+    QByteArray path = parts.at(1);
+    const int query = path.indexOf('?');
+    if (query >= 0) {
+        path.truncate(query);
+    }
+
+    if (path == "/metrics") {
+        const std::string body = AecMetrics::formatPrometheus(metrics_->snapshot());
+        writeResponse(socket, "200 OK", "text/plain; version=0.0.4",
+                      QByteArray(body.data(), static_cast<int>(body.size())));
+    } else if (path == "/metrics.json") {
+        const std::string body = AecMetrics::formatJson(metrics_->snapshot());
+        writeResponse(socket, "200 OK", "application/json",
+                      QByteArray(body.data(), static_cast<int>(body.size())));
+    } else {
+        writeResponse(socket, "404 Not Found", "text/plain", "Try /metrics or /metrics.json\n");
+    }
+}
+
+void MetricsServer::writeResponse(QTcpSocket *socket, const char *status,
+                                  const char *contentType, const QByteArray &body) {
+    QByteArray response;
+    response.reserve(body.size() + 128);
+    response += "HTTP/1.0 ";
+    response += status;
+    response += "\r\nContent-Type: ";
+    response += contentType;
+    response += "\r\nContent-Length: ";
+    response += QByteArray::number(body.size());
+    response += "\r\nConnection: close\r\n\r\n";
+    response += body;
+    socket->write(response);
+    socket->disconnectFromHost();
+}
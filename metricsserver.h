@@ -0,0 +1,48 @@
+#ifndef METRICSSERVER_H
+#define METRICSSERVER_H
+
+#include <QObject>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include "aecmetrics.h"
+
+// Minimal HTTP/1.0 endpoint for scraping an AecMetrics collector.
+//
+// Listens on the loopback interface only and answers
+//   GET /metrics       Prometheus text exposition format
+//   GET /metrics.json  the same snapshot as JSON
+// with 404 for anything else; every response closes the connection. Runs on
+// the thread it lives on and only reads the collector, so it never touches
+// the audio thread.
+class MetricsServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    // |metrics| must outlive the server
+    explicit MetricsServer(const AecMetrics *metrics, QObject *parent = nullptr);
+    ~MetricsServer();
+
+    bool listen(quint16 port);
+    void close();
+    bool isListening() const { return server_->isListening(); }
+    quint16 port() const { return server_->serverPort(); }
+    QString errorString() const { return server_->errorString(); }
+
+private slots:
+    void onNewConnection();
+    void onReadyRead();
+
+private:
+    void respond(QTcpSocket *socket, const QByteArray &requestLine);
+    static void writeResponse(QTcpSocket *socket, const char *status,
+                              const char *contentType, const QByteArray &body);
+
+    // Longest request head we are willing to buffer before giving up
+    static const int kMaxRequestBytes = 8192;
+
+    const AecMetrics *metrics_;
+    QTcpServer *server_;
+};
+
+#endif // METRICSSERVER_H
@@ -0,0 +1,200 @@
+#include "processorpool.h"
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+
+// Same range WebrtcAEC3::setStreamDelayMs() accepts
+const int kMaxStreamDelayMs = 500;
+
+} // namespace
+
+ProcessorPool::ProcessorPool(size_t max_idle)
+    : max_idle_(max_idle)
+    , stop_(false)
+    , stats_() {
+}
+
+ProcessorPool::~ProcessorPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    refill_cv_.notify_one();
+    if (refill_thread_.joinable()) {
+        refill_thread_.join();
+    }
+}
+
+std::unique_ptr<WebrtcAEC3> ProcessorPool::configured(const Config& config) {
+    std::unique_ptr<WebrtcAEC3> processor(new WebrtcAEC3());
+    for (size_t i = 0; i < config.size(); ++i) {
+        processor->setConfig(config[i].first, config[i].second);
+    }
+    return processor;
+}
+
+std::string ProcessorPool::keyOf(const WebrtcAEC3& processor) {
+    std::string key;
+    for (int id = 0; id < WebrtcAEC3::NUM_CONFIG_IDS; ++id) {
+        if (id == WebrtcAEC3::SYSTEM_DELAY_MS) {
+            continue;
+        }
+        const ConfigValue value = processor.getConfig(id);
+        key += std::to_string(id);
+        switch (value.type) {
+        case ConfigValue::INT:
+            key += '=' + std::to_string(value.int_val);
+            break;
+        case ConfigValue::BOOL:
+            key += value.bool_val ? "=t" : "=f";
+            break;
+        case ConfigValue::FLOAT:
+            key += '=' + std::to_string(value.float_val);
+            break;
+        }
+        key += ';';
+    }
+    return key;
+}
+
+void ProcessorPool::reserve(const Config& config, size_t count) {
+    const std::string key = keyOf(*configured(config));
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (count == 0) {
+        reservations_.erase(key);
+        return;
+    }
+    Reservation& reservation = reservations_[key];
+    reservation.config = config;
+    reservation.count = count;
+    if (!refill_thread_.joinable()) {
+        refill_thread_ = std::thread(&ProcessorPool::refillLoop, this);
+    }
+    refill_cv_.notify_one();
+}
+
+std::unique_ptr<WebrtcAEC3> ProcessorPool::acquire(const Config& config) {
+    // Applying the configuration to a new, unstarted instance is cheap and
+    // gives the canonical key, defaults included
+    std::unique_ptr<WebrtcAEC3> fresh = configured(config);
+    const std::string key = keyOf(*fresh);
+
+    std::unique_ptr<WebrtcAEC3> processor;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::map<std::string, IdleList>::iterator it = idle_.find(key);
+        if (it != idle_.end() && !it->second.empty()) {
+            processor = std::move(it->second.back());
+            it->second.pop_back();
+            --stats_.idle;
+            ++stats_.hits;
+            if (reservations_.count(key)) {
+                refill_cv_.notify_one();
+            }
+        } else {
+            ++stats_.misses;
+        }
+    }
+
+    if (!processor) {
+        fresh->start();
+        return fresh;
+    }
+    processor->reset();
+    processor->setStreamDelayMs(std::min(std::max(fresh->system_delay_ms_, 0), kMaxStreamDelayMs));
+    return processor;
+}
+
+void ProcessorPool::release(std::unique_ptr<WebrtcAEC3> processor) {
+    if (!processor) {
+        return;
+    }
+    processor->setRecorder(nullptr);
+    // The key must describe what the instance will run with
+    const bool reusable = processor->isStarted() && processor->configSettled();
+    const std::string key = reusable ? keyOf(*processor) : std::string();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (reusable) {
+            size_t limit = max_idle_;
+            std::map<std::string, Reservation>::const_iterator r = reservations_.find(key);
+            if (r != reservations_.end()) {
+                limit = std::max(limit, r->second.count);
+            }
+            IdleList& list = idle_[key];
+            if (list.size() < limit) {
+                list.push_back(std::move(processor));
+                ++stats_.idle;
+                return;
+            }
+        }
+        ++stats_.discarded;
+    }
+    // Destroyed here, outside the lock
+}
+
+ProcessorPool::Stats ProcessorPool::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+std::map<std::string, ProcessorPool::Reservation>::iterator ProcessorPool::findShortfall() {
+    for (std::map<std::string, Reservation>::iterator it = reservations_.begin();
+         it != reservations_.end(); ++it) {
+        std::map<std::string, IdleList>::const_iterator idle = idle_.find(it->first);
+        const size_t ready = idle == idle_.end() ? 0 : idle->second.size();
+        if (ready + it->second.building < it->second.count) {
+            return it;
+        }
+    }
+    return reservations_.end();
+}
+
+void ProcessorPool::refillLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        std::map<std::string, Reservation>::iterator it;
+        refill_cv_.wait(lock, [this, &it]() {
+            return stop_ || (it = findShortfall()) != reservations_.end();
+        });
+        if (stop_) {
+            return;
+        }
+
+        const std::string key = it->first;
+        const Config config = it->second.config;
+        ++it->second.building;
+
+        // Built without the lock; acquire() and release() carry on meanwhile
+        lock.unlock();
+        std::unique_ptr<WebrtcAEC3> processor;
+        std::string error;
+        try {
+            processor = configured(config);
+            processor->start();
+        } catch (const std::exception& e) {
+            processor.reset();
+            error = e.what();
+        }
+        lock.lock();
+
+        it = reservations_.find(key);
+        if (it != reservations_.end()) {
+            --it->second.building;
+        }
+        if (!processor) {
+            // Would fail again on every pass
+            std::cerr << "[ProcessorPool] Dropping reservation: " << error << std::endl;
+            reservations_.erase(key);
+            continue;
+        }
+        idle_[key].push_back(std::move(processor));
+        ++stats_.idle;
+        ++stats_.prebuilt;
+    }
+}
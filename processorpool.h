@@ -0,0 +1,96 @@
+#ifndef PROCESSORPOOL_H
+#define PROCESSORPOOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "WebrtcAEC3.h"
+
+// Started WebrtcAEC3 instances kept ready for new streams.
+//
+// start() creates an AudioProcessing and configures every sub-module, which
+// dominates the cost of setting up a call. The pool keeps started instances
+// idle, keyed by their complete configuration, and acquire() hands one out
+// after reset(): adaptive state cleared, configuration kept. reserve() keeps
+// a number of them built ahead of demand on the pool's own thread, so a
+// burst of new calls pays only for the reset. When nothing matching is idle
+// acquire() builds one inline and counts a miss.
+//
+// SYSTEM_DELAY_MS is not part of the key: it follows each stream's echo
+// path, and acquire() sets it from the requested configuration.
+//
+// Thread-safe. Released instances must not be in use any more.
+class ProcessorPool {
+public:
+    typedef std::vector<std::pair<int, ConfigValue> > Config;
+
+    struct Stats {
+        uint64_t hits;       // acquire() served by an idle instance
+        uint64_t misses;     // acquire() that had to build one
+        uint64_t prebuilt;   // instances built ahead for reserve()
+        uint64_t discarded;  // released instances that were not kept
+        size_t idle;
+    };
+
+    static const size_t kDefaultMaxIdle = 16;
+
+    // Keeps at most |max_idle| released instances per configuration, or the
+    // reserved count if that is larger
+    explicit ProcessorPool(size_t max_idle = kDefaultMaxIdle);
+    ~ProcessorPool();
+
+    // From now on keep |count| idle instances with |config| ready, building
+    // them in the background; 0 stops topping this configuration up. Throws
+    // like WebrtcAEC3::setConfig() for an invalid configuration.
+    void reserve(const Config& config, size_t count);
+
+    // A started, freshly reset instance with |config| applied. Throws like
+    // WebrtcAEC3::setConfig() for an invalid configuration.
+    std::unique_ptr<WebrtcAEC3> acquire(const Config& config);
+
+    // Takes an instance back for reuse. Instances with a setting change
+    // still queued or rebuilding, or beyond the idle limit, are destroyed.
+    void release(std::unique_ptr<WebrtcAEC3> processor);
+
+    Stats stats() const;
+
+private:
+    struct Reservation {
+        Config config;
+        size_t count;
+        size_t building;
+    };
+    typedef std::vector<std::unique_ptr<WebrtcAEC3> > IdleList;
+
+    // Not started; validates |config| on the way
+    static std::unique_ptr<WebrtcAEC3> configured(const Config& config);
+    static std::string keyOf(const WebrtcAEC3& processor);
+    // A reservation short of instances, or reservations_.end(). Lock held.
+    std::map<std::string, Reservation>::iterator findShortfall();
+    void refillLoop();
+
+    const size_t max_idle_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable refill_cv_;
+    std::map<std::string, IdleList> idle_;
+    std::map<std::string, Reservation> reservations_;
+    bool stop_;
+    Stats stats_;
+
+    // Started by the first reserve()
+    std::thread refill_thread_;
+
+    ProcessorPool(const ProcessorPool&);
+    ProcessorPool& operator=(const ProcessorPool&);
+};
+
+#endif // PROCESSORPOOL_H
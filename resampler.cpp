@@ -0,0 +1,148 @@
+#include "resampler.h"
+#include "audiosimd.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+
+// Band edges as fractions of the lower Nyquist frequency: flat up to the
+// passband edge, and at least kStopbandDb down from the stopband edge on,
+// so nothing folds back into the output band
+const double kPassbandEdge = 0.90;
+const double kStopbandEdge = 1.0;
+const double kStopbandDb = 90.0;
+// Kaiser's formulas, with a few dB of margin since they are approximate:
+// window beta, and prototype length in taps per radian of transition band
+const double kDesignDb = kStopbandDb + 6.0;
+const double kKaiserBeta = 0.1102 * (kDesignDb - 8.7);
+const double kTapsPerTransition = (kDesignDb - 8.0) / 2.285;
+
+size_t gcd(size_t a, size_t b) {
+    while (b) {
+        size_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// Zeroth-order modified Bessel function of the first kind
+double besselI0(double x) {
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 50; ++k) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < sum * 1e-12) {
+            break;
+        }
+    }
+    return sum;
+}
+
+} // namespace
+
+Resampler::Resampler(int in_rate, int out_rate, size_t max_input_samples)
+    : in_rate_(in_rate)
+    , out_rate_(out_rate)
+    , interp_(1)
+    , decim_(1)
+    , taps_(0)
+    , phase_(0)
+{
+    if (in_rate <= 0 || out_rate <= 0) {
+        throw std::invalid_argument("Resampler rates must be positive");
+    }
+
+    const size_t g = gcd(static_cast<size_t>(in_rate), static_cast<size_t>(out_rate));
+    interp_ = static_cast<size_t>(out_rate) / g;
+    decim_ = static_cast<size_t>(in_rate) / g;
+
+    // The transition band at the L-times upsampled rate, in radians per
+    // sample, sets the prototype length; each phase gets 1/L of it
+    const double transition = 2.0 * M_PI * (kStopbandEdge - kPassbandEdge) * 0.5
+                              / static_cast<double>(std::max(interp_, decim_));
+    const double length = kTapsPerTransition / transition + 1.0;
+    taps_ = static_cast<size_t>(std::ceil(length / static_cast<double>(interp_)));
+    taps_ = (taps_ + 7) & ~static_cast<size_t>(7);
+
+    designFilter();
+
+    if (max_input_samples == 0) {
+        max_input_samples = static_cast<size_t>(in_rate) / 100;
+    }
+    buffer_.assign(taps_ - 1 + max_input_samples, 0.0f);
+    out_buffer_.assign(maxOutput(max_input_samples), 0.0f);
+}
+
+void Resampler::designFilter() {
+    // Prototype low-pass at the L-times upsampled rate
+    const size_t length = taps_ * interp_;
+    // Centred in the transition band, where a Kaiser design is 6 dB down
+    const double cutoff = (kPassbandEdge + kStopbandEdge) * 0.25
+                          / static_cast<double>(std::max(interp_, decim_));
+    const double center = (length - 1) / 2.0;
+    const double norm = besselI0(kKaiserBeta);
+
+    std::vector<double> prototype(length);
+    for (size_t n = 0; n < length; ++n) {
+        const double x = n - center;
+        const double sinc = x == 0.0 ? 2.0 * cutoff
+                                     : std::sin(2.0 * M_PI * cutoff * x) / (M_PI * x);
+        const double r = x / (center + 0.5);
+        const double window = besselI0(kKaiserBeta * std::sqrt(std::max(0.0, 1.0 - r * r))) / norm;
+        // Gain L restores the level lost to the zero-stuffed upsampling
+        prototype[n] = sinc * window * interp_;
+    }
+
+    // Phase p uses prototype taps p, p + L, p + 2L, ...; stored reversed so
+    // the dot product runs forward over the input
+    bank_.resize(length);
+    for (size_t p = 0; p < interp_; ++p) {
+        for (size_t j = 0; j < taps_; ++j) {
+            bank_[p * taps_ + j] = static_cast<float>(prototype[p + (taps_ - 1 - j) * interp_]);
+        }
+    }
+}
+
+void Resampler::reset() {
+    std::fill(buffer_.begin(), buffer_.end(), 0.0f);
+    phase_ = 0;
+}
+
+size_t Resampler::maxOutput(size_t num_in) const {
+    // The carried-over phase is always below M, so at most ceil(n * L / M)
+    return (num_in * interp_ + decim_ - 1) / decim_;
+}
+
+size_t Resampler::process(const int16_t* in, size_t num_in, int16_t* out) {
+    const size_t history = taps_ - 1;
+    if (buffer_.size() < history + num_in) {
+        buffer_.resize(history + num_in, 0.0f);
+        out_buffer_.resize(maxOutput(num_in));
+    }
+
+    float* input = buffer_.data() + history;
+    deinterleaveS16ToFloat(in, num_in, 1, &input);
+
+    // Output at position t (in 1/L input samples) sums the taps_ inputs up
+    // to and including floor(t / L), weighted by phase t % L
+    const size_t end = num_in * interp_;
+    size_t t = phase_;
+    size_t produced = 0;
+    for (; t < end; t += decim_) {
+        const size_t base = t / interp_;
+        const size_t p = t - base * interp_;
+        out_buffer_[produced++] = dotProductFloat(bank_.data() + p * taps_, buffer_.data() + base, taps_);
+    }
+    phase_ = t - end;
+
+    // Keep the newest taps_ - 1 samples as history for the next call
+    std::copy(buffer_.begin() + num_in, buffer_.begin() + num_in + history, buffer_.begin());
+
+    const float* result = out_buffer_.data();
+    interleaveFloatToS16(&result, produced, 1, out);
+    return produced;
+}
@@ -0,0 +1,70 @@
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Streaming polyphase sample-rate converter for mono int16 audio.
+//
+// The ratio out_rate / in_rate is reduced to L / M and a windowed-sinc
+// low-pass for the L-times upsampled signal is split into L phases of K taps
+// each, all computed in the constructor. Every output sample is then one
+// K-tap dot product (dotProductFloat(), vectorised) against the most recent
+// input, so the cost is proportional to the output rate and independent of
+// how awkward the ratio is (44.1 <-> 48 kHz is L/M = 160/147).
+//
+// K follows from Kaiser's formulas for the band edges: flat (within 0.001
+// dB) up to 90% of the lower Nyquist frequency, -3 dB at about 94%, and
+// about 90 dB rejection from the lower Nyquist frequency on, which is where
+// int16 output noise sits anyway. That is 128-136 taps per phase between 48
+// kHz and 44.1 kHz and more for large decimations (744 for 48 -> 8 kHz);
+// aec_bench --resampler reports the measured response. Group delay is
+// about K/2 input samples.
+//
+// State carries over between process() calls, so audio can be fed in any
+// chunking. When both rates are multiples of 100 Hz, every 10 ms input chunk
+// produces exactly one 10 ms output chunk.
+class Resampler {
+public:
+    // Throws std::invalid_argument for non-positive rates.
+    // |max_input_samples| sizes the internal buffer; larger process() calls
+    // still work but reallocate once.
+    Resampler(int in_rate, int out_rate, size_t max_input_samples = 0);
+
+    // Clears the filter history, e.g. after a discontinuity in the input
+    void reset();
+
+    // Converts |num_in| samples and returns how many were written to |out|,
+    // which must have room for maxOutput(num_in).
+    size_t process(const int16_t* in, size_t num_in, int16_t* out);
+
+    size_t maxOutput(size_t num_in) const;
+
+    int inRate() const { return in_rate_; }
+    int outRate() const { return out_rate_; }
+    size_t tapsPerPhase() const { return taps_; }
+    size_t numPhases() const { return interp_; }
+
+private:
+    void designFilter();
+
+    int in_rate_;
+    int out_rate_;
+    size_t interp_;     // L
+    size_t decim_;      // M
+    size_t taps_;       // K, a multiple of 8 so the SIMD loops have no tail
+
+    // bank_[p * taps_ + j] multiplies the input sample taps_ - 1 - j before
+    // the current position, for phase p
+    std::vector<float> bank_;
+
+    // taps_ - 1 samples of history followed by the current input, as float
+    std::vector<float> buffer_;
+    std::vector<float> out_buffer_;
+    // Position of the next output in units of 1/L input samples, relative
+    // to the first sample of the next input chunk
+    size_t phase_;
+};
+
+#endif // RESAMPLER_H
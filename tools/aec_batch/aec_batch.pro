@@ -0,0 +1,13 @@
+TARGET = aec_batch
+TEMPLATE = app
+
+include(../common/common.pri)
+
+SOURCES += \
+        main.cpp \
+        $$AEC_ROOT/aecsessionmanager.cpp \
+        $$AEC_ROOT/workstealingpool.cpp
+
+HEADERS += \
+        $$AEC_ROOT/aecsessionmanager.h \
+        $$AEC_ROOT/workstealingpool.h
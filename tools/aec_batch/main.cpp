@@ -0,0 +1,596 @@
+// Offline batch echo cancellation.
+//
+// Feeds near/far recordings through WebrtcAEC3::processStream() as fast as
+// the CPU allows and writes the cancelled near-end signal. File pairs are
+// spread over a pool of worker threads; each worker owns one WebrtcAEC3
+// instance that is reset() between files, so no state leaks from one
+// recording into the next.
+//
+// With --sessions every pair instead becomes a session of one
+// AecSessionManager and all of them are streamed at once, 10 ms frame by
+// frame, the way a gateway hosts many calls in one process. --verify then
+// checks each session's output bit for bit against the direct path above,
+// which catches any frame processed out of order.
+
+#include "WebrtcAEC3.h"
+#include "aecsessionmanager.h"
+#include "wavfile.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct Options {
+    int threads;
+    int raw_rate;
+    int delay_ms;
+    int aec_level;
+    int ns_level;
+    int agc_mode;
+    bool enable_aec;
+    bool enable_agc;
+    bool enable_hp_filter;
+    bool sessions;
+    bool verify;
+
+    Options()
+        : threads(0)
+        , raw_rate(48000)
+        , delay_ms(8)
+        , aec_level(2)
+        , ns_level(1)
+        , agc_mode(WebrtcAEC3::AGC_MODE_ADAPTIVE_DIGITAL)
+        , enable_aec(true)
+        , enable_agc(true)
+        , enable_hp_filter(true)
+        , sessions(false)
+        , verify(false) {}
+};
+
+struct Job {
+    std::string near_path;
+    std::string far_path;
+    std::string out_path;
+};
+
+struct JobResult {
+    bool ok;
+    std::string error;
+    double audio_seconds;
+    double process_seconds;
+
+    JobResult() : ok(false), audio_seconds(0.0), process_seconds(0.0) {}
+};
+
+void printUsage(const char* argv0) {
+    std::cerr
+        << "Usage: " << argv0 << " [options] NEAR FAR OUT [NEAR FAR OUT ...]\n"
+        << "       " << argv0 << " [options] --list FILE\n"
+        << "\n"
+        << "Files ending in .wav are read/written as WAV, anything else as raw\n"
+        << "little-endian 16-bit mono PCM. WAV files may have up to 8 channels;\n"
+        << "the output has the near file's channels.\n"
+        << "\n"
+        << "Options:\n"
+        << "  --list FILE       read whitespace separated NEAR FAR OUT triples\n"
+        << "  --threads N       worker threads (default: all cores)\n"
+        << "  --raw-rate HZ     sample rate of raw PCM files (default 48000)\n"
+        << "  --delay MS        stream delay for set_stream_delay_ms (default 8)\n"
+        << "  --aec-level N     echo suppression level 0..2 (default 2)\n"
+        << "  --ns-level N      noise suppression level 0..3, -1 disables (default 1)\n"
+        << "  --agc-mode N      0 analog, 1 adaptive digital, 2 fixed digital (default 1)\n"
+        << "  --no-aec          disable echo cancellation\n"
+        << "  --no-agc          disable automatic gain control\n"
+        << "  --no-hpf          disable the high pass filter\n"
+        << "  --sessions        stream all pairs at once as AecSessionManager sessions\n"
+        << "                    (every file is held in memory)\n"
+        << "  --verify          with --sessions, check each output against direct\n"
+        << "                    processing\n";
+}
+
+int parseInt(const char* flag, const char* value) {
+    char* end = nullptr;
+    long v = strtol(value, &end, 10);
+    if (!*value || *end) {
+        throw std::invalid_argument(std::string("Invalid value for ") + flag + ": " + value);
+    }
+    return static_cast<int>(v);
+}
+
+void readJobList(const std::string& path, std::vector<Job>* jobs) {
+    std::ifstream in(path.c_str());
+    if (!in) {
+        throw std::runtime_error("Cannot open job list " + path);
+    }
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::istringstream fields(line);
+        Job job;
+        if (!(fields >> job.near_path >> job.far_path >> job.out_path)) {
+            throw std::runtime_error("Malformed line in " + path + ": " + line);
+        }
+        jobs->push_back(job);
+    }
+}
+
+AecSessionManager::SessionConfig processorConfig(const Options& opts, int sample_rate,
+                                                int capture_channels, int render_channels) {
+    AecSessionManager::SessionConfig config;
+    config.push_back(std::make_pair(int(WebrtcAEC3::SAMPLE_RATE), ConfigValue(sample_rate)));
+    config.push_back(std::make_pair(int(WebrtcAEC3::CAPTURE_CHANNELS), ConfigValue(capture_channels)));
+    config.push_back(std::make_pair(int(WebrtcAEC3::RENDER_CHANNELS), ConfigValue(render_channels)));
+    config.push_back(std::make_pair(int(WebrtcAEC3::SYSTEM_DELAY_MS), ConfigValue(opts.delay_ms)));
+    config.push_back(std::make_pair(int(WebrtcAEC3::ENABLE_AEC), ConfigValue(opts.enable_aec)));
+    config.push_back(std::make_pair(int(WebrtcAEC3::AEC_LEVEL), ConfigValue(opts.aec_level)));
+    config.push_back(std::make_pair(int(WebrtcAEC3::ENABLE_AGC), ConfigValue(opts.enable_agc)));
+    config.push_back(std::make_pair(int(WebrtcAEC3::AGC_MODE), ConfigValue(opts.agc_mode)));
+    config.push_back(std::make_pair(int(WebrtcAEC3::ENABLE_HP_FILTER), ConfigValue(opts.enable_hp_filter)));
+    config.push_back(std::make_pair(int(WebrtcAEC3::ENABLE_NOISE_SUPPRESSION), ConfigValue(opts.ns_level >= 0)));
+    if (opts.ns_level >= 0) {
+        config.push_back(std::make_pair(int(WebrtcAEC3::NOISE_SUPPRESSION_LEVEL), ConfigValue(opts.ns_level)));
+    }
+    return config;
+}
+
+std::unique_ptr<WebrtcAEC3> createProcessor(const Options& opts, int sample_rate,
+                                            int capture_channels, int render_channels) {
+    std::unique_ptr<WebrtcAEC3> processor(new WebrtcAEC3());
+    const AecSessionManager::SessionConfig config =
+            processorConfig(opts, sample_rate, capture_channels, render_channels);
+    for (size_t i = 0; i < config.size(); ++i) {
+        processor->setConfig(config[i].first, config[i].second);
+    }
+    processor->start();
+    return processor;
+}
+
+// Runs one near/far pair through |processor|, which must already be started
+// with the files' sample rate and channel counts. Returns the wall time spent
+// inside the AEC loop.
+double cancelEcho(WebrtcAEC3& processor, const PcmAudio& near, const PcmAudio& far,
+                  PcmAudio* out) {
+    const size_t num_frames = near.numFrames();
+    const size_t far_frames = far.numFrames();
+    const size_t near_ch = near.channels;
+    const size_t far_ch = far.channels;
+
+    // A far-end shortfall is zero padded
+    std::vector<int16_t> far_padded;
+    const int16_t* far_in = far.samples.data();
+    if (far_frames < num_frames) {
+        far_padded.assign(num_frames * far_ch, 0);
+        std::copy(far.samples.begin(), far.samples.end(), far_padded.begin());
+        far_in = far_padded.data();
+    }
+
+    out->sample_rate = near.sample_rate;
+    out->channels = near.channels;
+    out->samples.resize((num_frames + processor.chunkSamples()) * near_ch);
+
+    // The whole file in one call; the trailing partial frame is flushed
+    // zero padded
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    size_t written = processor.processStream(near.samples.data(), far_in, num_frames,
+                                             out->samples.data());
+    written += processor.flushStream(out->samples.data() + written * near_ch);
+    out->samples.resize(written * near_ch);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+    return elapsed.count();
+}
+
+// Format the worker's processor was started with
+struct ProcessorFormat {
+    int sample_rate;
+    int capture_channels;
+    int render_channels;
+
+    ProcessorFormat() : sample_rate(0), capture_channels(0), render_channels(0) {}
+    bool operator==(const ProcessorFormat& o) const {
+        return sample_rate == o.sample_rate && capture_channels == o.capture_channels
+               && render_channels == o.render_channels;
+    }
+};
+
+// Reads a job's recordings and checks they can be processed together
+void loadJob(const Job& job, const Options& opts, PcmAudio* near, PcmAudio* far) {
+    *near = readPcmFile(job.near_path, opts.raw_rate, 1);
+    *far = readPcmFile(job.far_path, opts.raw_rate, 1);
+
+    if (near->channels < 1 || near->channels > WEBRTC_AEC3_MAX_CHANNELS
+        || far->channels < 1 || far->channels > WEBRTC_AEC3_MAX_CHANNELS) {
+        throw std::runtime_error("unsupported channel count");
+    }
+    if (near->sample_rate != far->sample_rate) {
+        throw std::runtime_error("near and far sample rates differ");
+    }
+    if (near->sample_rate % 100 != 0) {
+        throw std::runtime_error("sample rate must be a multiple of 100 Hz");
+    }
+}
+
+JobResult runJob(const Job& job, const Options& opts, std::unique_ptr<WebrtcAEC3>* processor,
+                 ProcessorFormat* processor_format) {
+    JobResult result;
+    try {
+        PcmAudio near;
+        PcmAudio far;
+        loadJob(job, opts, &near, &far);
+
+        // Reuse the worker's processor when the format matches, otherwise rebuild
+        ProcessorFormat format;
+        format.sample_rate = near.sample_rate;
+        format.capture_channels = near.channels;
+        format.render_channels = far.channels;
+        if (!*processor || !(*processor_format == format)) {
+            *processor = createProcessor(opts, format.sample_rate,
+                                         format.capture_channels, format.render_channels);
+            *processor_format = format;
+        } else {
+            (*processor)->reset();
+        }
+
+        PcmAudio out;
+        result.process_seconds = cancelEcho(**processor, near, far, &out);
+        result.audio_seconds = near.durationSeconds();
+
+        writePcmFile(job.out_path, out);
+        result.ok = true;
+    } catch (const std::exception& e) {
+        result.error = e.what();
+    }
+    return result;
+}
+
+// One job streamed through an AecSessionManager session
+struct StreamJob {
+    PcmAudio near;
+    PcmAudio far;
+    PcmAudio out;
+    size_t frame_samples;
+    size_t num_frames;      // 10 ms frames, the last one zero padded
+    size_t submitted;
+    bool open;
+
+    // Written by the session callback on a pool thread
+    size_t delivered;
+    std::atomic<int> in_callback;
+    std::atomic<bool> overlapped;
+
+    AecSessionManager::SessionId id;
+    JobResult result;
+
+    StreamJob()
+        : frame_samples(0)
+        , num_frames(0)
+        , submitted(0)
+        , open(false)
+        , delivered(0)
+        , in_callback(0)
+        , overlapped(false)
+        , id(0) {}
+};
+
+// Frame |index| of |audio|, or a zero padded copy in |scratch| past its end
+const int16_t* streamFrame(const PcmAudio& audio, size_t index, size_t frame_samples,
+                           std::vector<int16_t>* scratch) {
+    const size_t ch = audio.channels;
+    const size_t begin = index * frame_samples;
+    if (begin + frame_samples <= audio.numFrames()) {
+        return audio.samples.data() + begin * ch;
+    }
+    scratch->assign(frame_samples * ch, 0);
+    if (begin < audio.numFrames()) {
+        std::copy(audio.samples.begin() + begin * ch, audio.samples.end(), scratch->begin());
+    }
+    return scratch->data();
+}
+
+// Index of the first frame where |a| and |b| differ, or -1
+long firstMismatch(const PcmAudio& a, const PcmAudio& b, size_t frame_samples) {
+    const size_t frame = frame_samples * a.channels;
+    if (a.channels != b.channels) {
+        return 0;
+    }
+    const size_t n = std::min(a.samples.size(), b.samples.size());
+    for (size_t i = 0; i < n; ++i) {
+        if (a.samples[i] != b.samples[i]) {
+            return static_cast<long>(i / frame);
+        }
+    }
+    return a.samples.size() == b.samples.size() ? -1 : static_cast<long>(n / frame);
+}
+
+// --sessions: every job is a session and all of them advance together, one
+// frame per session per round, as long as the session's queue has room.
+int runSessions(const std::vector<Job>& jobs, const Options& opts) {
+    const size_t kQueueFrames = 16;
+    AecSessionManager manager(opts.threads > 0 ? static_cast<size_t>(opts.threads) : 0, kQueueFrames);
+
+    std::vector<std::unique_ptr<StreamJob>> streams;
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        std::unique_ptr<StreamJob> stream(new StreamJob());
+        StreamJob* s = stream.get();
+        try {
+            loadJob(jobs[i], opts, &s->near, &s->far);
+            s->id = manager.createSession(
+                        processorConfig(opts, s->near.sample_rate, s->near.channels, s->far.channels),
+                        [s](AecSessionManager::SessionId, const int16_t* out, size_t num_samples) {
+                            // Frames of one session must arrive one at a time
+                            if (s->in_callback.fetch_add(1) != 0) {
+                                s->overlapped.store(true);
+                            }
+                            std::copy(out, out + num_samples,
+                                      s->out.samples.begin() + s->delivered * num_samples);
+                            ++s->delivered;
+                            s->in_callback.fetch_sub(1);
+                        });
+            s->open = true;
+            s->frame_samples = manager.frameSamples(s->id);
+            s->num_frames = (s->near.numFrames() + s->frame_samples - 1) / s->frame_samples;
+            s->out.sample_rate = s->near.sample_rate;
+            s->out.channels = s->near.channels;
+            s->out.samples.resize(s->num_frames * s->frame_samples * s->near.channels);
+            s->result.audio_seconds = s->near.durationSeconds();
+        } catch (const std::exception& e) {
+            s->result.error = e.what();
+        }
+        streams.push_back(std::move(stream));
+    }
+
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+
+    std::vector<int16_t> near_scratch;
+    std::vector<int16_t> far_scratch;
+    for (;;) {
+        bool pending = false;
+        bool progressed = false;
+        for (size_t i = 0; i < streams.size(); ++i) {
+            StreamJob& s = *streams[i];
+            if (!s.open || s.submitted == s.num_frames) {
+                continue;
+            }
+            pending = true;
+            // Only this thread submits, so room now is room at submitFrame()
+            AecSessionManager::SessionStats stats;
+            if (!manager.sessionStats(s.id, &stats) || stats.queued_frames >= kQueueFrames) {
+                continue;
+            }
+            const int16_t* near = streamFrame(s.near, s.submitted, s.frame_samples, &near_scratch);
+            const int16_t* far = streamFrame(s.far, s.submitted, s.frame_samples, &far_scratch);
+            if (manager.submitFrame(s.id, near, far)) {
+                ++s.submitted;
+                progressed = true;
+            }
+        }
+        if (!pending) {
+            break;
+        }
+        if (!progressed) {
+            std::this_thread::yield();
+        }
+    }
+
+    // Wait for every session's queue to run dry, then close them
+    for (size_t i = 0; i < streams.size(); ++i) {
+        StreamJob& s = *streams[i];
+        if (!s.open) {
+            continue;
+        }
+        AecSessionManager::SessionStats stats;
+        while (manager.sessionStats(s.id, &stats)
+               && stats.frames_processed + stats.processing_errors < s.num_frames) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        manager.destroySession(s.id);
+
+        if (stats.processing_errors > 0) {
+            s.result.error = std::to_string(stats.processing_errors) + " frames failed";
+        } else if (s.overlapped.load()) {
+            s.result.error = "frames delivered concurrently";
+        } else if (s.delivered != s.num_frames) {
+            s.result.error = "frames lost";
+        } else {
+            s.out.samples.resize(s.near.numFrames() * s.near.channels);
+            s.result.ok = true;
+        }
+    }
+
+    std::chrono::duration<double> wall = std::chrono::steady_clock::now() - begin;
+
+    size_t failed = 0;
+    double total_audio = 0.0;
+    for (size_t i = 0; i < streams.size(); ++i) {
+        StreamJob& s = *streams[i];
+        const Job& job = jobs[i];
+        if (s.result.ok && opts.verify) {
+            try {
+                std::unique_ptr<WebrtcAEC3> processor =
+                        createProcessor(opts, s.near.sample_rate, s.near.channels, s.far.channels);
+                PcmAudio direct;
+                cancelEcho(*processor, s.near, s.far, &direct);
+                long frame = firstMismatch(s.out, direct, s.frame_samples);
+                if (frame >= 0) {
+                    s.result.ok = false;
+                    s.result.error = "differs from direct processing at frame " + std::to_string(frame);
+                }
+            } catch (const std::exception& e) {
+                s.result.ok = false;
+                s.result.error = e.what();
+            }
+        }
+        if (s.result.ok) {
+            try {
+                writePcmFile(job.out_path, s.out);
+            } catch (const std::exception& e) {
+                s.result.ok = false;
+                s.result.error = e.what();
+            }
+        }
+
+        if (s.result.ok) {
+            total_audio += s.result.audio_seconds;
+            printf("[ok]   %s -> %s  audio %.2f s%s\n", job.near_path.c_str(), job.out_path.c_str(),
+                   s.result.audio_seconds, opts.verify ? "  verified" : "");
+        } else {
+            ++failed;
+            printf("[fail] %s: %s\n", job.near_path.c_str(), s.result.error.c_str());
+        }
+    }
+
+    printf("%zu sessions, %zu failed, %zu threads: %.1f s audio in %.2f s wall (%.1fx real time)\n",
+           streams.size(), failed, manager.numThreads(), total_audio, wall.count(),
+           wall.count() > 0.0 ? total_audio / wall.count() : 0.0);
+
+    return failed == 0 ? 0 : 1;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options opts;
+    std::vector<Job> jobs;
+    std::vector<std::string> positional;
+
+    try {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            bool has_value = i + 1 < argc;
+            if (arg == "-h" || arg == "--help") {
+                printUsage(argv[0]);
+                return 0;
+            } else if (arg == "--list" && has_value) {
+                readJobList(argv[++i], &jobs);
+            } else if (arg == "--threads" && has_value) {
+                opts.threads = parseInt("--threads", argv[++i]);
+            } else if (arg == "--raw-rate" && has_value) {
+                opts.raw_rate = parseInt("--raw-rate", argv[++i]);
+            } else if (arg == "--delay" && has_value) {
+                opts.delay_ms = parseInt("--delay", argv[++i]);
+            } else if (arg == "--aec-level" && has_value) {
+                opts.aec_level = parseInt("--aec-level", argv[++i]);
+            } else if (arg == "--ns-level" && has_value) {
+                opts.ns_level = parseInt("--ns-level", argv[++i]);
+            } else if (arg == "--agc-mode" && has_value) {
+                opts.agc_mode = parseInt("--agc-mode", argv[++i]);
+            } else if (arg == "--no-aec") {
+                opts.enable_aec = false;
+            } else if (arg == "--no-agc") {
+                opts.enable_agc = false;
+            } else if (arg == "--no-hpf") {
+                opts.enable_hp_filter = false;
+            } else if (arg == "--sessions") {
+                opts.sessions = true;
+            } else if (arg == "--verify") {
+                opts.verify = true;
+            } else if (!arg.empty() && arg[0] == '-') {
+                throw std::invalid_argument("Unknown option " + arg);
+            } else {
+                positional.push_back(arg);
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        printUsage(argv[0]);
+        return 2;
+    }
+
+    if (positional.size() % 3 != 0) {
+        std::cerr << "Expected NEAR FAR OUT triples" << std::endl;
+        printUsage(argv[0]);
+        return 2;
+    }
+    for (size_t i = 0; i < positional.size(); i += 3) {
+        Job job;
+        job.near_path = positional[i];
+        job.far_path = positional[i + 1];
+        job.out_path = positional[i + 2];
+        jobs.push_back(job);
+    }
+    if (jobs.empty()) {
+        printUsage(argv[0]);
+        return 2;
+    }
+    if (opts.sessions) {
+        return runSessions(jobs, opts);
+    }
+
+    size_t num_threads = opts.threads > 0 ? static_cast<size_t>(opts.threads)
+                                          : std::thread::hardware_concurrency();
+    if (num_threads == 0) {
+        num_threads = 1;
+    }
+    num_threads = std::min(num_threads, jobs.size());
+
+    std::vector<JobResult> results(jobs.size());
+    std::atomic<size_t> next_job(0);
+    std::mutex print_mutex;
+
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < num_threads; ++t) {
+        workers.push_back(std::thread([&]() {
+            std::unique_ptr<WebrtcAEC3> processor;
+            ProcessorFormat processor_format;
+            for (;;) {
+                size_t index = next_job.fetch_add(1);
+                if (index >= jobs.size()) {
+                    break;
+                }
+                const Job& job = jobs[index];
+                JobResult result = runJob(job, opts, &processor, &processor_format);
+                results[index] = result;
+
+                std::lock_guard<std::mutex> lock(print_mutex);
+                if (result.ok) {
+                    double rtf = result.audio_seconds > 0.0
+                            ? result.process_seconds / result.audio_seconds : 0.0;
+                    printf("[ok]   %s -> %s  audio %.2f s  proc %.3f s  RTF %.4f (%.1fx)\n",
+                           job.near_path.c_str(), job.out_path.c_str(),
+                           result.audio_seconds, result.process_seconds, rtf,
+                           rtf > 0.0 ? 1.0 / rtf : 0.0);
+                } else {
+                    printf("[fail] %s: %s\n", job.near_path.c_str(), result.error.c_str());
+                }
+                fflush(stdout);
+            }
+        }));
+    }
+    for (size_t t = 0; t < workers.size(); ++t) {
+        workers[t].join();
+    }
+
+    std::chrono::duration<double> wall = std::chrono::steady_clock::now() - begin;
+
+    size_t failed = 0;
+    double total_audio = 0.0;
+    for (size_t i = 0; i < results.size(); ++i) {
+        if (results[i].ok) {
+            total_audio += results[i].audio_seconds;
+        } else {
+            ++failed;
+        }
+    }
+
+    printf("%zu files, %zu failed, %zu threads: %.1f s audio in %.2f s wall (%.1fx real time)\n",
+           results.size(), failed, num_threads, total_audio, wall.count(),
+           wall.count() > 0.0 ? total_audio / wall.count() : 0.0);
+
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,14 @@
+TARGET = aec_bench
+TEMPLATE = app
+
+include(../common/common.pri)
+
+# Makes WebrtcAEC3::process() record per-stage timings
+DEFINES += WEBRTC_AEC3_STAGE_TIMING
+
+# Benchmark numbers are meaningless without optimisation
+CONFIG += release
+CONFIG -= debug
+
+SOURCES += \
+        main.cpp
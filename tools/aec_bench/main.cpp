@@ -0,0 +1,584 @@
+// Per-stage microbenchmark for WebrtcAEC3::process().
+//
+// Built with WEBRTC_AEC3_STAGE_TIMING so process() records how long each of
+// its sections took. Every combination of the feature toggles (AEC, AGC, NS
+// level, HP filter, transient suppression, extended filter) is run over the
+// same input, and per-frame p50/p99/max latency per stage plus the CPU cost
+// of the whole configuration are printed as CSV or JSON.
+//
+// With --resampler the Resampler is measured instead: per-10ms-frame cost of
+// every device/network rate conversion the application performs, and its
+// measured frequency response (passband ripple, -3 dB point, and the worst
+// image, alias or noise level relative to a test tone).
+
+#include "WebrtcAEC3.h"
+#include "audiosimd.h"
+#include "resampler.h"
+#include "wavfile.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+const char* const kStageNames[WebrtcAEC3::NUM_STAGES] = {
+    "s16_to_float",
+    "set_delay",
+    "reverse_stream",
+    "forward_stream",
+    "float_to_s16",
+};
+
+struct Options {
+    int sample_rate;
+    int frames;
+    int warmup_frames;
+    int delay_ms;
+    bool json;
+    bool resampler;
+    std::string near_path;
+    std::string far_path;
+
+    Options()
+        : sample_rate(48000)
+        , frames(2000)
+        , warmup_frames(200)
+        , delay_ms(8)
+        , json(false)
+        , resampler(false) {}
+};
+
+struct BenchConfig {
+    bool aec;
+    bool agc;
+    int ns_level; // -1 = noise suppression off
+    bool hp_filter;
+    bool transient_suppression;
+    bool extended_filter;
+
+    std::string name() const {
+        std::ostringstream s;
+        s << "aec=" << aec << ",agc=" << agc << ",ns=" << ns_level
+          << ",hpf=" << hp_filter << ",ts=" << transient_suppression
+          << ",ef=" << extended_filter;
+        return s.str();
+    }
+};
+
+struct Percentiles {
+    double p50_us;
+    double p99_us;
+    double max_us;
+};
+
+struct BenchResult {
+    BenchConfig config;
+    Percentiles stages[WebrtcAEC3::NUM_STAGES];
+    Percentiles total;
+    double cpu_seconds;
+    double audio_seconds;
+};
+
+// Silences the [NS]/[AGC] banner configureProcessing() prints to stdout so
+// it cannot corrupt the machine-readable report.
+class ScopedCoutMute {
+public:
+    ScopedCoutMute() : saved_(std::cout.rdbuf(nullptr)) {}
+    ~ScopedCoutMute() { std::cout.rdbuf(saved_); }
+private:
+    std::streambuf* saved_;
+};
+
+double threadCpuSeconds() {
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+Percentiles percentiles(std::vector<int64_t>& ns) {
+    Percentiles p = {0.0, 0.0, 0.0};
+    if (ns.empty()) {
+        return p;
+    }
+    size_t i50 = ns.size() / 2;
+    size_t i99 = std::min(ns.size() - 1, static_cast<size_t>(ns.size() * 0.99));
+    std::nth_element(ns.begin(), ns.begin() + i50, ns.end());
+    p.p50_us = ns[i50] / 1000.0;
+    std::nth_element(ns.begin(), ns.begin() + i99, ns.end());
+    p.p99_us = ns[i99] / 1000.0;
+    p.max_us = *std::max_element(ns.begin(), ns.end()) / 1000.0;
+    return p;
+}
+
+// Deterministic stand-in for a call: far end is band-limited noise with a
+// speech-like on/off envelope, near end is its attenuated, delayed echo plus
+// a quieter independent talker.
+void synthesizeInput(const Options& opts, PcmAudio* near, PcmAudio* far) {
+    const size_t n = static_cast<size_t>(opts.frames + opts.warmup_frames) * (opts.sample_rate / 100);
+    const size_t echo_delay = static_cast<size_t>(opts.sample_rate / 1000 * 40);
+
+    far->sample_rate = near->sample_rate = opts.sample_rate;
+    far->channels = near->channels = 1;
+    far->samples.assign(n, 0);
+    near->samples.assign(n, 0);
+
+    uint32_t seed = 12345;
+    float lp_far = 0.0f;
+    float lp_near = 0.0f;
+    for (size_t i = 0; i < n; ++i) {
+        seed = seed * 1664525u + 1013904223u;
+        float white_far = static_cast<int32_t>(seed) / 2147483648.0f;
+        seed = seed * 1664525u + 1013904223u;
+        float white_near = static_cast<int32_t>(seed) / 2147483648.0f;
+
+        lp_far += 0.2f * (white_far - lp_far);
+        lp_near += 0.2f * (white_near - lp_near);
+
+        double t = static_cast<double>(i) / opts.sample_rate;
+        float far_env = std::sin(2.0 * M_PI * 0.3 * t) > 0.0 ? 1.0f : 0.05f;
+        float near_env = std::sin(2.0 * M_PI * 0.17 * t + 1.0) > 0.5 ? 1.0f : 0.02f;
+
+        far->samples[i] = static_cast<int16_t>(20000.0f * far_env * lp_far);
+        float echo = i >= echo_delay ? 0.3f * far->samples[i - echo_delay] : 0.0f;
+        near->samples[i] = static_cast<int16_t>(
+                std::max(-32768.0f, std::min(32767.0f, echo + 8000.0f * near_env * lp_near)));
+    }
+}
+
+std::vector<BenchConfig> allConfigs() {
+    std::vector<BenchConfig> configs;
+    for (int aec = 0; aec < 2; ++aec)
+    for (int agc = 0; agc < 2; ++agc)
+    for (int ns = -1; ns <= WebrtcAEC3::NS_LEVEL_VERY_HIGH; ++ns)
+    for (int hpf = 0; hpf < 2; ++hpf)
+    for (int ts = 0; ts < 2; ++ts)
+    for (int ef = 0; ef < 2; ++ef) {
+        BenchConfig c;
+        c.aec = aec != 0;
+        c.agc = agc != 0;
+        c.ns_level = ns;
+        c.hp_filter = hpf != 0;
+        c.transient_suppression = ts != 0;
+        c.extended_filter = ef != 0;
+        configs.push_back(c);
+    }
+    return configs;
+}
+
+BenchResult runConfig(const Options& opts, const BenchConfig& config,
+                      const PcmAudio& near, const PcmAudio& far) {
+    WebrtcAEC3 processor;
+    processor.setConfig(WebrtcAEC3::SAMPLE_RATE, ConfigValue(opts.sample_rate));
+    processor.setConfig(WebrtcAEC3::SYSTEM_DELAY_MS, ConfigValue(opts.delay_ms));
+    processor.setConfig(WebrtcAEC3::ENABLE_AEC, ConfigValue(config.aec));
+    processor.setConfig(WebrtcAEC3::ENABLE_AGC, ConfigValue(config.agc));
+    processor.setConfig(WebrtcAEC3::AGC_MODE, ConfigValue(static_cast<int>(WebrtcAEC3::AGC_MODE_ADAPTIVE_DIGITAL)));
+    processor.setConfig(WebrtcAEC3::ENABLE_NOISE_SUPPRESSION, ConfigValue(config.ns_level >= 0));
+    if (config.ns_level >= 0) {
+        processor.setConfig(WebrtcAEC3::NOISE_SUPPRESSION_LEVEL, ConfigValue(config.ns_level));
+    }
+    processor.setConfig(WebrtcAEC3::ENABLE_HP_FILTER, ConfigValue(config.hp_filter));
+    processor.setConfig(WebrtcAEC3::ENABLE_TRANSIENT_SUPPRESSION, ConfigValue(config.transient_suppression));
+    processor.setConfig(WebrtcAEC3::AEC_EXTENDED_FILTER, ConfigValue(config.extended_filter));
+    {
+        ScopedCoutMute mute;
+        processor.start();
+    }
+
+    const size_t chunk = processor.chunkSamples();
+    const size_t available = std::min(near.numFrames(), far.numFrames()) / chunk;
+    const size_t total_frames = static_cast<size_t>(opts.frames + opts.warmup_frames);
+    if (available < 1) {
+        throw std::runtime_error("input shorter than one frame");
+    }
+
+    std::vector<int16_t> near_frame(chunk);
+    std::vector<int16_t> far_frame(chunk);
+    std::vector<int16_t> out_frame(chunk);
+
+    std::vector<std::vector<int64_t> > stage_ns(WebrtcAEC3::NUM_STAGES);
+    std::vector<int64_t> total_ns;
+    for (size_t s = 0; s < stage_ns.size(); ++s) {
+        stage_ns[s].reserve(opts.frames);
+    }
+    total_ns.reserve(opts.frames);
+
+    double cpu_begin = 0.0;
+    for (size_t f = 0; f < total_frames; ++f) {
+        if (f == static_cast<size_t>(opts.warmup_frames)) {
+            cpu_begin = threadCpuSeconds();
+        }
+
+        // Loop over short input files
+        size_t offset = (f % available) * chunk;
+        std::copy(near.samples.begin() + offset, near.samples.begin() + offset + chunk, near_frame.begin());
+        std::copy(far.samples.begin() + offset, far.samples.begin() + offset + chunk, far_frame.begin());
+
+        processor.process(near_frame.data(), far_frame.data(), out_frame.data(), chunk);
+
+        if (f < static_cast<size_t>(opts.warmup_frames)) {
+            continue;
+        }
+        const int64_t* ns = processor.lastStageTimesNs();
+        int64_t sum = 0;
+        for (int s = 0; s < WebrtcAEC3::NUM_STAGES; ++s) {
+            stage_ns[s].push_back(ns[s]);
+            sum += ns[s];
+        }
+        total_ns.push_back(sum);
+    }
+
+    BenchResult result;
+    result.config = config;
+    result.cpu_seconds = threadCpuSeconds() - cpu_begin;
+    result.audio_seconds = opts.frames / 100.0;
+    for (int s = 0; s < WebrtcAEC3::NUM_STAGES; ++s) {
+        result.stages[s] = percentiles(stage_ns[s]);
+    }
+    result.total = percentiles(total_ns);
+    return result;
+}
+
+void printCsvHeader() {
+    printf("config,aec,agc,ns_level,hpf,ts,ef,cpu_percent_of_realtime");
+    for (int s = 0; s < WebrtcAEC3::NUM_STAGES; ++s) {
+        printf(",%s_p50_us,%s_p99_us,%s_max_us", kStageNames[s], kStageNames[s], kStageNames[s]);
+    }
+    printf(",total_p50_us,total_p99_us,total_max_us\n");
+}
+
+void printCsvRow(const BenchResult& r) {
+    const BenchConfig& c = r.config;
+    printf("\"%s\",%d,%d,%d,%d,%d,%d,%.3f", c.name().c_str(), c.aec, c.agc, c.ns_level,
+           c.hp_filter, c.transient_suppression, c.extended_filter,
+           100.0 * r.cpu_seconds / r.audio_seconds);
+    for (int s = 0; s < WebrtcAEC3::NUM_STAGES; ++s) {
+        printf(",%.3f,%.3f,%.3f", r.stages[s].p50_us, r.stages[s].p99_us, r.stages[s].max_us);
+    }
+    printf(",%.3f,%.3f,%.3f\n", r.total.p50_us, r.total.p99_us, r.total.max_us);
+    fflush(stdout);
+}
+
+void printJsonPercentiles(const char* name, const Percentiles& p, bool last) {
+    printf("        \"%s\": {\"p50_us\": %.3f, \"p99_us\": %.3f, \"max_us\": %.3f}%s\n",
+           name, p.p50_us, p.p99_us, p.max_us, last ? "" : ",");
+}
+
+void printJson(const Options& opts, const std::vector<BenchResult>& results) {
+    printf("{\n  \"sample_rate\": %d,\n  \"frames\": %d,\n  \"simd\": \"%s\",\n  \"results\": [\n",
+           opts.sample_rate, opts.frames, audioSimdIsa());
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult& r = results[i];
+        const BenchConfig& c = r.config;
+        printf("    {\n");
+        printf("      \"config\": {\"aec\": %s, \"agc\": %s, \"ns_level\": %d, \"hpf\": %s, "
+               "\"ts\": %s, \"ef\": %s},\n",
+               c.aec ? "true" : "false", c.agc ? "true" : "false", c.ns_level,
+               c.hp_filter ? "true" : "false", c.transient_suppression ? "true" : "false",
+               c.extended_filter ? "true" : "false");
+        printf("      \"cpu_percent_of_realtime\": %.3f,\n", 100.0 * r.cpu_seconds / r.audio_seconds);
+        printf("      \"stages\": {\n");
+        for (int s = 0; s < WebrtcAEC3::NUM_STAGES; ++s) {
+            printJsonPercentiles(kStageNames[s], r.stages[s], false);
+        }
+        printJsonPercentiles("total", r.total, true);
+        printf("      }\n    }%s\n", i + 1 < results.size() ? "," : "");
+    }
+    printf("  ]\n}\n");
+}
+
+struct ResamplerResponse {
+    double ripple_db;     // worst gain error up to 90% of the lower Nyquist
+    double minus3db_hz;   // highest tone at most 3 dB down
+    double rejection_db;  // worst non-tone output relative to the tone
+};
+
+struct ResamplerResult {
+    int in_rate;
+    int out_rate;
+    size_t taps;
+    size_t phases;
+    Percentiles frame;
+    double cpu_seconds;
+    double audio_seconds;
+    ResamplerResponse response;
+};
+
+// One second of a near full-scale tone at |freq| through a fresh Resampler.
+// |gain_db| is the tone's level in the output, |residual_db| everything else
+// (images, aliases, int16 noise); both relative to the input tone. A tone
+// above the output's Nyquist frequency has no output level of its own, so
+// all of its output is residual.
+void measureTone(int in_rate, int out_rate, double freq, double* gain_db, double* residual_db) {
+    const double amplitude = 30000.0;
+    Resampler resampler(in_rate, out_rate, static_cast<size_t>(in_rate));
+    std::vector<int16_t> in(static_cast<size_t>(in_rate));
+    for (size_t i = 0; i < in.size(); ++i) {
+        in[i] = static_cast<int16_t>(std::lrint(amplitude * std::sin(2.0 * M_PI * freq * i / in_rate)));
+    }
+    std::vector<int16_t> out(resampler.maxOutput(in.size()));
+    const size_t produced = resampler.process(in.data(), in.size(), out.data());
+
+    // Least-squares fit of the tone after the filter has settled
+    const bool in_band = freq < out_rate / 2.0;
+    const size_t begin = produced / 4;
+    double ss = 0.0, cc = 0.0, sc = 0.0, ys = 0.0, yc = 0.0;
+    for (size_t i = begin; i < produced && in_band; ++i) {
+        const double w = 2.0 * M_PI * freq * i / out_rate;
+        const double s = std::sin(w);
+        const double c = std::cos(w);
+        ss += s * s;
+        cc += c * c;
+        sc += s * c;
+        ys += out[i] * s;
+        yc += out[i] * c;
+    }
+    const double det = ss * cc - sc * sc;
+    const double a = in_band ? (ys * cc - yc * sc) / det : 0.0;
+    const double b = in_band ? (yc * ss - ys * sc) / det : 0.0;
+
+    double residual = 0.0;
+    for (size_t i = begin; i < produced; ++i) {
+        const double w = 2.0 * M_PI * freq * i / out_rate;
+        const double v = out[i] - a * std::sin(w) - b * std::cos(w);
+        residual += v * v;
+    }
+    residual /= static_cast<double>(produced - begin);
+    *gain_db = 20.0 * std::log10(std::max(std::sqrt(a * a + b * b), 1e-9) / amplitude);
+    *residual_db = 10.0 * std::log10(std::max(residual, 1e-12) / (amplitude * amplitude / 2.0));
+}
+
+ResamplerResponse measureResponse(int in_rate, int out_rate) {
+    const double nyquist = std::min(in_rate, out_rate) / 2.0;
+    ResamplerResponse response;
+    response.ripple_db = 0.0;
+    response.minus3db_hz = 0.0;
+    response.rejection_db = -200.0;
+
+    double gain_db;
+    double residual_db;
+    for (int step = 1; step <= 45; ++step) {
+        measureTone(in_rate, out_rate, 0.02 * step * nyquist, &gain_db, &residual_db);
+        response.ripple_db = std::max(response.ripple_db, std::fabs(gain_db));
+        response.rejection_db = std::max(response.rejection_db, residual_db);
+    }
+    for (int step = 0; step <= 50; ++step) {
+        const double freq = (0.9 + 0.002 * step) * nyquist;
+        measureTone(in_rate, out_rate, freq, &gain_db, &residual_db);
+        if (gain_db >= -3.0) {
+            response.minus3db_hz = freq;
+        }
+    }
+    // Downsampling: input above the output's Nyquist frequency must not
+    // fold back
+    if (in_rate > out_rate) {
+        const double top = 0.995 * in_rate / 2.0;
+        for (int step = 0; step <= 100; ++step) {
+            measureTone(in_rate, out_rate, nyquist + (top - nyquist) * step / 100.0, &gain_db, &residual_db);
+            response.rejection_db = std::max(response.rejection_db, residual_db);
+        }
+    }
+    return response;
+}
+
+// Rate pairs the application converts: device rates to and from the 48 kHz
+// pipeline, and narrowband peers on the network
+std::vector<std::pair<int, int> > resamplerPairs() {
+    const int rates[] = { 8000, 16000, 32000, 44100 };
+    std::vector<std::pair<int, int> > pairs;
+    for (size_t i = 0; i < sizeof(rates) / sizeof(rates[0]); ++i) {
+        pairs.push_back(std::make_pair(rates[i], 48000));
+        pairs.push_back(std::make_pair(48000, rates[i]));
+    }
+    return pairs;
+}
+
+ResamplerResult runResampler(const Options& opts, int in_rate, int out_rate, const PcmAudio& input) {
+    Resampler resampler(in_rate, out_rate);
+    const size_t chunk = static_cast<size_t>(in_rate / 100);
+    const size_t total_frames = static_cast<size_t>(opts.frames + opts.warmup_frames);
+
+    // The synthetic far signal, reinterpreted at |in_rate|; the content only
+    // matters for denormals, which a real signal does not produce either
+    const size_t available = input.samples.size() / chunk;
+    if (available < 1) {
+        throw std::runtime_error("input shorter than one frame");
+    }
+
+    std::vector<int16_t> out(resampler.maxOutput(chunk));
+    std::vector<int64_t> frame_ns;
+    frame_ns.reserve(opts.frames);
+
+    double cpu_begin = 0.0;
+    for (size_t f = 0; f < total_frames; ++f) {
+        if (f == static_cast<size_t>(opts.warmup_frames)) {
+            cpu_begin = threadCpuSeconds();
+        }
+        const int16_t* in = input.samples.data() + (f % available) * chunk;
+
+        timespec begin;
+        timespec end;
+        clock_gettime(CLOCK_MONOTONIC, &begin);
+        resampler.process(in, chunk, out.data());
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        if (f >= static_cast<size_t>(opts.warmup_frames)) {
+            frame_ns.push_back((end.tv_sec - begin.tv_sec) * 1000000000LL + (end.tv_nsec - begin.tv_nsec));
+        }
+    }
+
+    ResamplerResult result;
+    result.in_rate = in_rate;
+    result.out_rate = out_rate;
+    result.taps = resampler.tapsPerPhase();
+    result.phases = resampler.numPhases();
+    result.cpu_seconds = threadCpuSeconds() - cpu_begin;
+    result.audio_seconds = opts.frames / 100.0;
+    result.frame = percentiles(frame_ns);
+    result.response = measureResponse(in_rate, out_rate);
+    return result;
+}
+
+void printResamplerReport(const Options& opts, const std::vector<ResamplerResult>& results) {
+    if (!opts.json) {
+        printf("in_rate,out_rate,taps,phases,cpu_percent_of_realtime,frame_p50_us,frame_p99_us,frame_max_us,"
+               "ripple_db,minus3db_hz,rejection_db\n");
+        for (size_t i = 0; i < results.size(); ++i) {
+            const ResamplerResult& r = results[i];
+            printf("%d,%d,%zu,%zu,%.4f,%.3f,%.3f,%.3f,%.4f,%.0f,%.1f\n", r.in_rate, r.out_rate, r.taps,
+                   r.phases, 100.0 * r.cpu_seconds / r.audio_seconds, r.frame.p50_us, r.frame.p99_us,
+                   r.frame.max_us, r.response.ripple_db, r.response.minus3db_hz, r.response.rejection_db);
+        }
+        return;
+    }
+
+    printf("{\n  \"frames\": %d,\n  \"simd\": \"%s\",\n  \"resampler\": [\n", opts.frames, audioSimdIsa());
+    for (size_t i = 0; i < results.size(); ++i) {
+        const ResamplerResult& r = results[i];
+        printf("    {\"in_rate\": %d, \"out_rate\": %d, \"taps\": %zu, \"phases\": %zu, "
+               "\"cpu_percent_of_realtime\": %.4f, \"frame\": {\"p50_us\": %.3f, \"p99_us\": %.3f, "
+               "\"max_us\": %.3f}, \"response\": {\"ripple_db\": %.4f, \"minus3db_hz\": %.0f, "
+               "\"rejection_db\": %.1f}}%s\n",
+               r.in_rate, r.out_rate, r.taps, r.phases, 100.0 * r.cpu_seconds / r.audio_seconds,
+               r.frame.p50_us, r.frame.p99_us, r.frame.max_us, r.response.ripple_db,
+               r.response.minus3db_hz, r.response.rejection_db, i + 1 < results.size() ? "," : "");
+    }
+    printf("  ]\n}\n");
+}
+
+void printUsage(const char* argv0) {
+    std::cerr
+        << "Usage: " << argv0 << " [options]\n"
+        << "\n"
+        << "Options:\n"
+        << "  --frames N      measured 10 ms frames per configuration (default 2000)\n"
+        << "  --warmup N      unmeasured frames before each run (default 200)\n"
+        << "  --rate HZ       sample rate for synthetic input (default 48000)\n"
+        << "  --delay MS      stream delay (default 8)\n"
+        << "  --near FILE     near-end input instead of synthetic audio (WAV)\n"
+        << "  --far FILE      far-end input instead of synthetic audio (WAV)\n"
+        << "  --json          JSON report instead of CSV\n"
+        << "  --resampler     benchmark the sample-rate converter instead of the AEC\n";
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options opts;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--frames" && has_value) {
+            opts.frames = atoi(argv[++i]);
+        } else if (arg == "--warmup" && has_value) {
+            opts.warmup_frames = atoi(argv[++i]);
+        } else if (arg == "--rate" && has_value) {
+            opts.sample_rate = atoi(argv[++i]);
+        } else if (arg == "--delay" && has_value) {
+            opts.delay_ms = atoi(argv[++i]);
+        } else if (arg == "--near" && has_value) {
+            opts.near_path = argv[++i];
+        } else if (arg == "--far" && has_value) {
+            opts.far_path = argv[++i];
+        } else if (arg == "--json") {
+            opts.json = true;
+        } else if (arg == "--resampler") {
+            opts.resampler = true;
+        } else {
+            printUsage(argv[0]);
+            return arg == "-h" || arg == "--help" ? 0 : 2;
+        }
+    }
+    if (opts.frames <= 0 || opts.warmup_frames < 0 || opts.sample_rate <= 0 || opts.sample_rate % 100) {
+        printUsage(argv[0]);
+        return 2;
+    }
+
+    PcmAudio near;
+    PcmAudio far;
+    try {
+        if (!opts.near_path.empty() || !opts.far_path.empty()) {
+            near = readWavFile(opts.near_path);
+            far = readWavFile(opts.far_path);
+            if (near.channels != 1 || far.channels != 1 || near.sample_rate != far.sample_rate) {
+                throw std::runtime_error("near/far must be mono at the same sample rate");
+            }
+            opts.sample_rate = near.sample_rate;
+        } else {
+            synthesizeInput(opts, &near, &far);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    if (opts.resampler) {
+        std::vector<std::pair<int, int> > pairs = resamplerPairs();
+        std::vector<ResamplerResult> results;
+        try {
+            for (size_t i = 0; i < pairs.size(); ++i) {
+                results.push_back(runResampler(opts, pairs[i].first, pairs[i].second, far));
+            }
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+        printResamplerReport(opts, results);
+        return 0;
+    }
+
+    std::vector<BenchConfig> configs = allConfigs();
+    std::vector<BenchResult> results;
+
+    if (!opts.json) {
+        printCsvHeader();
+    }
+    for (size_t i = 0; i < configs.size(); ++i) {
+        try {
+            BenchResult r = runConfig(opts, configs[i], near, far);
+            results.push_back(r);
+            if (!opts.json) {
+                printCsvRow(r);
+            }
+        } catch (const std::exception& e) {
+            std::cerr << configs[i].name() << ": " << e.what() << std::endl;
+            return 1;
+        }
+        std::cerr << "\r" << (i + 1) << "/" << configs.size() << std::flush;
+    }
+    std::cerr << std::endl;
+
+    if (opts.json) {
+        printJson(opts, results);
+    }
+    return 0;
+}
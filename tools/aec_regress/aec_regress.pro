@@ -0,0 +1,14 @@
+TARGET = aec_regress
+TEMPLATE = app
+
+include(../common/common.pri)
+
+SOURCES += \
+        main.cpp
+
+# "make regress" runs the gate; the corpus and baseline live outside the
+# repository and are passed through make, e.g.
+#   make regress AEC_REGRESS_ARGS="--corpus corpus.txt --baseline baseline.txt"
+regress.commands = ./$$TARGET --synthetic $(AEC_REGRESS_ARGS)
+regress.depends = $$TARGET
+QMAKE_EXTRA_TARGETS += regress
@@ -0,0 +1,660 @@
+// Echo-quality and speed regression gate for WebrtcAEC3.
+//
+// Every case of a corpus is run through every configuration of a matrix and
+// scored on objective numbers:
+//   erle_db       echo return loss enhancement over far-only frames
+//   residual_dbfs output level left over in those frames
+//   preservation  normalized correlation between the near-end talker and the
+//                 output over near-only frames (1 = untouched, gain aside)
+//   mean_us, p99_us  CPU time of process() per 10 ms frame
+// The results are compared with a stored baseline and the tool exits 1 when
+// any case got worse than the tolerances allow, so a new libwebrtc_aec.a or
+// a change to configureProcessing() is caught before it ships.
+//
+// A corpus case is NAME NEAR FAR [CLEAN] or NAME RECORDING.rec. CLEAN is
+// the near-end talker alone; with it, far-only and near-only frames are
+// told apart exactly, without it any frame with far-end activity counts as
+// far-only and near-only frames are those with near activity and none on
+// the far side. Recordings from AecRecorder contribute their near and far
+// streams. --synthetic adds a generated case with known segments, so the
+// gate also runs without a corpus.
+//
+// Exit status: 0 when nothing regressed, 1 on a regression, 2 on usage or
+// file errors.
+
+#include "WebrtcAEC3.h"
+#include "recordingreader.h"
+#include "wavfile.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+struct Options {
+    std::string corpus_path;
+    std::string matrix_path;
+    std::string baseline_path;
+    std::string write_baseline_path;
+    bool synthetic;
+    int raw_rate;
+    int delay_ms;
+    int settle_ms;
+    double erle_tolerance_db;
+    double residual_tolerance_db;
+    double preservation_tolerance;
+    double cpu_tolerance;   // fractional slowdown allowed, < 0 disables
+
+    Options()
+        : synthetic(false)
+        , raw_rate(48000)
+        , delay_ms(8)
+        , settle_ms(1000)
+        , erle_tolerance_db(1.0)
+        , residual_tolerance_db(1.0)
+        , preservation_tolerance(0.02)
+        , cpu_tolerance(0.25) {}
+};
+
+struct Case {
+    std::string name;
+    PcmAudio near;
+    PcmAudio far;
+    PcmAudio clean;     // empty when the corpus has no reference
+};
+
+struct MatrixEntry {
+    std::string name;
+    std::vector<std::pair<int, ConfigValue> > settings;
+};
+
+// NaN marks a metric the case has no frames for
+struct Scores {
+    double erle_db;
+    double residual_dbfs;
+    double preservation;
+    double mean_us;
+    double p99_us;
+};
+
+const double kMissing = std::numeric_limits<double>::quiet_NaN();
+
+// Frame activity threshold; quieter frames count as silence
+const double kActiveDbfs = -50.0;
+const double kMaxErleDb = 100.0;
+
+const struct {
+    const char* name;
+    int id;
+} kConfigNames[] = {
+    { "SYSTEM_DELAY_MS", WebrtcAEC3::SYSTEM_DELAY_MS },
+    { "NOISE_SUPPRESSION_LEVEL", WebrtcAEC3::NOISE_SUPPRESSION_LEVEL },
+    { "AEC_LEVEL", WebrtcAEC3::AEC_LEVEL },
+    { "ENABLE_AEC", WebrtcAEC3::ENABLE_AEC },
+    { "ENABLE_AGC", WebrtcAEC3::ENABLE_AGC },
+    { "ENABLE_HP_FILTER", WebrtcAEC3::ENABLE_HP_FILTER },
+    { "ENABLE_NOISE_SUPPRESSION", WebrtcAEC3::ENABLE_NOISE_SUPPRESSION },
+    { "ENABLE_TRANSIENT_SUPPRESSION", WebrtcAEC3::ENABLE_TRANSIENT_SUPPRESSION },
+    { "AEC_DELAY_AGNOSTIC", WebrtcAEC3::AEC_DELAY_AGNOSTIC },
+    { "AEC_EXTENDED_FILTER", WebrtcAEC3::AEC_EXTENDED_FILTER },
+    { "ENABLE_VOICE_DETECTION", WebrtcAEC3::ENABLE_VOICE_DETECTION },
+    { "AGC_MODE", WebrtcAEC3::AGC_MODE },
+};
+
+void printUsage(const char* argv0) {
+    std::cerr
+        << "Usage: " << argv0 << " [options] (--corpus FILE | --synthetic)\n"
+        << "\n"
+        << "Options:\n"
+        << "  --corpus FILE         cases, one per line: NAME NEAR FAR [CLEAN] or NAME FILE.rec\n"
+        << "  --synthetic           add a generated double-talk case\n"
+        << "  --matrix FILE         configurations, one per line: NAME [SETTING=VALUE ...]\n"
+        << "                        (default: a built-in matrix over AEC level, NS, AGC,\n"
+        << "                        extended filter and delay agnostic mode)\n"
+        << "  --baseline FILE       compare with a stored baseline; exit 1 on regression\n"
+        << "  --write-baseline FILE store this run's results as the new baseline\n"
+        << "  --raw-rate HZ         sample rate of raw PCM files (default 48000)\n"
+        << "  --delay MS            stream delay for set_stream_delay_ms (default 8)\n"
+        << "  --settle-ms MS        ignore the first MS of each case while the AEC\n"
+        << "                        converges (default 1000)\n"
+        << "  --erle-tol DB         allowed ERLE drop (default 1.0)\n"
+        << "  --residual-tol DB     allowed residual echo rise (default 1.0)\n"
+        << "  --preservation-tol X  allowed near-end preservation drop (default 0.02)\n"
+        << "  --cpu-tol FRACTION    allowed mean CPU time increase, negative to\n"
+        << "                        disable the speed gate (default 0.25)\n"
+        << "\n"
+        << "SETTING is a WebrtcAEC3 ConfigId name (e.g. AEC_LEVEL) or number; VALUE is\n"
+        << "an integer or true/false.\n";
+}
+
+int parseInt(const std::string& flag, const std::string& value) {
+    char* end = nullptr;
+    long v = strtol(value.c_str(), &end, 10);
+    if (value.empty() || *end) {
+        throw std::invalid_argument("Invalid value for " + flag + ": " + value);
+    }
+    return static_cast<int>(v);
+}
+
+double parseDouble(const std::string& flag, const std::string& value) {
+    char* end = nullptr;
+    double v = strtod(value.c_str(), &end);
+    if (value.empty() || *end) {
+        throw std::invalid_argument("Invalid value for " + flag + ": " + value);
+    }
+    return v;
+}
+
+std::pair<int, ConfigValue> parseSetting(const std::string& text) {
+    const size_t eq = text.find('=');
+    if (eq == std::string::npos) {
+        throw std::invalid_argument("Expected SETTING=VALUE, got " + text);
+    }
+    const std::string key = text.substr(0, eq);
+    const std::string value = text.substr(eq + 1);
+    int id = -1;
+    for (size_t i = 0; i < sizeof(kConfigNames) / sizeof(kConfigNames[0]); ++i) {
+        if (key == kConfigNames[i].name) {
+            id = kConfigNames[i].id;
+        }
+    }
+    if (id < 0) {
+        id = parseInt("setting", key);
+    }
+    if (value == "true" || value == "false") {
+        return std::make_pair(id, ConfigValue(value == "true"));
+    }
+    return std::make_pair(id, ConfigValue(parseInt(key, value)));
+}
+
+std::vector<MatrixEntry> defaultMatrix() {
+    const char* const kLines[] = {
+        "default",
+        "aec_low AEC_LEVEL=0",
+        "aec_moderate AEC_LEVEL=1",
+        "ns_off ENABLE_NOISE_SUPPRESSION=false",
+        "agc_off ENABLE_AGC=false",
+        "extended_filter AEC_EXTENDED_FILTER=true",
+        "delay_agnostic AEC_DELAY_AGNOSTIC=true",
+    };
+    std::vector<MatrixEntry> matrix;
+    for (size_t i = 0; i < sizeof(kLines) / sizeof(kLines[0]); ++i) {
+        std::istringstream fields(kLines[i]);
+        MatrixEntry entry;
+        fields >> entry.name;
+        std::string setting;
+        while (fields >> setting) {
+            entry.settings.push_back(parseSetting(setting));
+        }
+        matrix.push_back(entry);
+    }
+    return matrix;
+}
+
+std::vector<MatrixEntry> readMatrix(const std::string& path) {
+    std::ifstream in(path.c_str());
+    if (!in) {
+        throw std::runtime_error("Cannot open matrix " + path);
+    }
+    std::vector<MatrixEntry> matrix;
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        MatrixEntry entry;
+        if (!(fields >> entry.name) || entry.name[0] == '#') {
+            continue;
+        }
+        std::string setting;
+        while (fields >> setting) {
+            entry.settings.push_back(parseSetting(setting));
+        }
+        matrix.push_back(entry);
+    }
+    return matrix;
+}
+
+bool endsWith(const std::string& s, const std::string& suffix) {
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+void loadRecording(const std::string& path, Case* c) {
+    RecordingReader reader(path);
+    c->near.sample_rate = c->far.sample_rate = reader.sampleRate();
+    c->near.channels = static_cast<int>(reader.captureChannels());
+    c->far.channels = static_cast<int>(reader.renderChannels());
+    const size_t near_len = reader.frameSamples() * reader.captureChannels();
+    const size_t far_len = reader.frameSamples() * reader.renderChannels();
+    RecordingReader::Record record;
+    while (reader.next(&record)) {
+        if (record.type == RecordingReader::Record::kFrame) {
+            c->near.samples.insert(c->near.samples.end(), record.frame.near_in, record.frame.near_in + near_len);
+            c->far.samples.insert(c->far.samples.end(), record.frame.far_in, record.frame.far_in + far_len);
+        }
+    }
+}
+
+std::vector<Case> readCorpus(const std::string& path, int raw_rate) {
+    std::ifstream in(path.c_str());
+    if (!in) {
+        throw std::runtime_error("Cannot open corpus " + path);
+    }
+    std::vector<Case> cases;
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        std::vector<std::string> f;
+        std::string field;
+        while (fields >> field) {
+            f.push_back(field);
+        }
+        if (f.empty() || f[0][0] == '#') {
+            continue;
+        }
+        Case c;
+        c.name = f[0];
+        if (f.size() == 2 && endsWith(f[1], ".rec")) {
+            loadRecording(f[1], &c);
+        } else if (f.size() == 3 || f.size() == 4) {
+            c.near = readPcmFile(f[1], raw_rate, 1);
+            c.far = readPcmFile(f[2], raw_rate, 1);
+            if (f.size() == 4) {
+                c.clean = readPcmFile(f[3], raw_rate, 1);
+                if (c.clean.channels != c.near.channels || c.clean.sample_rate != c.near.sample_rate) {
+                    throw std::runtime_error(c.name + ": CLEAN must match NEAR's format");
+                }
+            }
+        } else {
+            throw std::runtime_error("Malformed line in " + path + ": " + line);
+        }
+        if (c.near.sample_rate != c.far.sample_rate) {
+            throw std::runtime_error(c.name + ": NEAR and FAR sample rates differ");
+        }
+        cases.push_back(c);
+    }
+    return cases;
+}
+
+// Four seconds each of far-only, near-only and double talk at 48 kHz. The
+// echo is the far signal delayed by 40 ms, attenuated and slightly smeared.
+Case synthesizeCase() {
+    const int rate = 48000;
+    const size_t segment = 4 * rate;
+    const size_t n = 3 * segment;
+    const size_t echo_delay = 40 * rate / 1000;
+
+    Case c;
+    c.name = "synthetic";
+    c.near.sample_rate = c.far.sample_rate = c.clean.sample_rate = rate;
+    c.near.channels = c.far.channels = c.clean.channels = 1;
+    c.near.samples.assign(n, 0);
+    c.far.samples.assign(n, 0);
+    c.clean.samples.assign(n, 0);
+
+    uint32_t seed = 12345;
+    float lp_far = 0.0f;
+    float lp_near = 0.0f;
+    float echo = 0.0f;
+    for (size_t i = 0; i < n; ++i) {
+        seed = seed * 1664525u + 1013904223u;
+        float white_far = static_cast<int32_t>(seed) / 2147483648.0f;
+        seed = seed * 1664525u + 1013904223u;
+        float white_near = static_cast<int32_t>(seed) / 2147483648.0f;
+        lp_far += 0.2f * (white_far - lp_far);
+        lp_near += 0.3f * (white_near - lp_near);
+
+        // Syllable-like 4 Hz and 3 Hz envelopes
+        float env_far = 0.5f + 0.5f * std::sin(2.0f * 3.14159265f * 4.0f * i / rate);
+        float env_near = 0.5f + 0.5f * std::sin(2.0f * 3.14159265f * 3.0f * i / rate);
+        bool far_on = i < segment || i >= 2 * segment;
+        bool near_on = i >= segment;
+
+        c.far.samples[i] = far_on ? static_cast<int16_t>(20000.0f * env_far * lp_far) : 0;
+        c.clean.samples[i] = near_on ? static_cast<int16_t>(12000.0f * env_near * lp_near) : 0;
+        if (i >= echo_delay) {
+            echo += 0.5f * (0.3f * c.far.samples[i - echo_delay] - echo);
+        }
+        int v = c.clean.samples[i] + static_cast<int>(echo);
+        c.near.samples[i] = static_cast<int16_t>(std::max(-32768, std::min(32767, v)));
+    }
+    return c;
+}
+
+double energy(const int16_t* p, size_t n) {
+    double e = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        e += static_cast<double>(p[i]) * p[i];
+    }
+    return e;
+}
+
+bool isActive(const int16_t* p, size_t n) {
+    const double mean = energy(p, n) / n;
+    return 10.0 * std::log10(mean / (32768.0 * 32768.0) + 1e-20) > kActiveDbfs;
+}
+
+Scores runCase(const Case& c, const MatrixEntry& config, const Options& opts) {
+    const size_t near_ch = c.near.channels;
+    const size_t far_ch = c.far.channels;
+    const size_t chunk = static_cast<size_t>(c.near.sample_rate / 100);
+    const size_t frames = c.near.numFrames() / chunk;
+    const size_t settle_frames = static_cast<size_t>(opts.settle_ms / 10);
+
+    WebrtcAEC3 processor;
+    processor.setConfig(WebrtcAEC3::SAMPLE_RATE, ConfigValue(c.near.sample_rate));
+    processor.setConfig(WebrtcAEC3::CAPTURE_CHANNELS, ConfigValue(static_cast<int>(near_ch)));
+    processor.setConfig(WebrtcAEC3::RENDER_CHANNELS, ConfigValue(static_cast<int>(far_ch)));
+    processor.setConfig(WebrtcAEC3::SYSTEM_DELAY_MS, ConfigValue(opts.delay_ms));
+    for (size_t i = 0; i < config.settings.size(); ++i) {
+        processor.setConfig(config.settings[i].first, config.settings[i].second);
+    }
+    {
+        // configureProcessing() prints a banner per instance
+        std::streambuf* saved = std::cout.rdbuf(nullptr);
+        processor.start();
+        std::cout.rdbuf(saved);
+    }
+
+    std::vector<int16_t> far_frame(chunk * far_ch, 0);
+    std::vector<int16_t> out(chunk * near_ch);
+    std::vector<int64_t> frame_ns;
+    frame_ns.reserve(frames);
+
+    double echo_in = 0.0, echo_out = 0.0;
+    size_t far_only_samples = 0;
+    double dot = 0.0, ref_energy = 0.0, out_energy = 0.0;
+
+    for (size_t f = 0; f < frames; ++f) {
+        const int16_t* near = &c.near.samples[f * chunk * near_ch];
+        const size_t far_pos = f * chunk;
+        std::fill(far_frame.begin(), far_frame.end(), 0);
+        if (far_pos < c.far.numFrames()) {
+            const size_t n = std::min(chunk, c.far.numFrames() - far_pos) * far_ch;
+            std::copy(c.far.samples.begin() + far_pos * far_ch, c.far.samples.begin() + far_pos * far_ch + n,
+                      far_frame.begin());
+        }
+
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        processor.process(near, far_frame.data(), out.data(), chunk);
+        frame_ns.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - begin).count());
+
+        if (f < settle_frames) {
+            continue;
+        }
+        const size_t len = chunk * near_ch;
+        const int16_t* talker = c.clean.samples.empty() ? near : &c.clean.samples[f * len];
+        const bool far_active = isActive(far_frame.data(), far_frame.size());
+        const bool near_active = c.clean.samples.empty() ? !far_active && isActive(near, len)
+                                                         : isActive(talker, len);
+        if (far_active && !near_active) {
+            echo_in += energy(near, len);
+            echo_out += energy(out.data(), len);
+            far_only_samples += len;
+        } else if (near_active && !far_active) {
+            for (size_t i = 0; i < len; ++i) {
+                dot += static_cast<double>(talker[i]) * out[i];
+            }
+            ref_energy += energy(talker, len);
+            out_energy += energy(out.data(), len);
+        }
+    }
+
+    Scores s;
+    s.erle_db = kMissing;
+    s.residual_dbfs = kMissing;
+    s.preservation = kMissing;
+    if (far_only_samples > 0 && echo_in > 0.0) {
+        s.erle_db = std::min(kMaxErleDb, 10.0 * std::log10(echo_in / std::max(echo_out, 1e-3)));
+        s.residual_dbfs = 10.0 * std::log10(echo_out / far_only_samples / (32768.0 * 32768.0) + 1e-20);
+    }
+    if (ref_energy > 0.0) {
+        s.preservation = out_energy > 0.0 ? dot / std::sqrt(ref_energy * out_energy) : 0.0;
+    }
+
+    double total = 0.0;
+    for (size_t i = 0; i < frame_ns.size(); ++i) {
+        total += frame_ns[i];
+    }
+    s.mean_us = frame_ns.empty() ? 0.0 : total / frame_ns.size() / 1000.0;
+    if (!frame_ns.empty()) {
+        size_t i99 = std::min(frame_ns.size() - 1, static_cast<size_t>(frame_ns.size() * 0.99));
+        std::nth_element(frame_ns.begin(), frame_ns.begin() + i99, frame_ns.end());
+        s.p99_us = frame_ns[i99] / 1000.0;
+    } else {
+        s.p99_us = 0.0;
+    }
+    return s;
+}
+
+std::string formatValue(double v, int decimals) {
+    if (std::isnan(v)) {
+        return "-";
+    }
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.*f", decimals, v);
+    return buf;
+}
+
+double parseValue(const std::string& s) {
+    return s == "-" ? kMissing : parseDouble("baseline", s);
+}
+
+typedef std::map<std::pair<std::string, std::string>, Scores> ResultMap;
+
+void writeBaseline(const std::string& path, const ResultMap& results) {
+    std::ofstream out(path.c_str());
+    if (!out) {
+        throw std::runtime_error("Cannot create baseline " + path);
+    }
+    out << "# aec_regress baseline\n"
+        << "# case config erle_db residual_dbfs preservation mean_us p99_us\n";
+    for (ResultMap::const_iterator it = results.begin(); it != results.end(); ++it) {
+        const Scores& s = it->second;
+        out << it->first.first << ' ' << it->first.second << ' '
+            << formatValue(s.erle_db, 2) << ' ' << formatValue(s.residual_dbfs, 2) << ' '
+            << formatValue(s.preservation, 4) << ' ' << formatValue(s.mean_us, 1) << ' '
+            << formatValue(s.p99_us, 1) << '\n';
+    }
+    if (!out) {
+        throw std::runtime_error("Write error on " + path);
+    }
+}
+
+ResultMap readBaseline(const std::string& path) {
+    std::ifstream in(path.c_str());
+    if (!in) {
+        throw std::runtime_error("Cannot open baseline " + path);
+    }
+    ResultMap results;
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        std::string name, config, erle, residual, preservation, mean, p99;
+        if (!(fields >> name) || name[0] == '#') {
+            continue;
+        }
+        if (!(fields >> config >> erle >> residual >> preservation >> mean >> p99)) {
+            throw std::runtime_error("Malformed line in " + path + ": " + line);
+        }
+        Scores s;
+        s.erle_db = parseValue(erle);
+        s.residual_dbfs = parseValue(residual);
+        s.preservation = parseValue(preservation);
+        s.mean_us = parseValue(mean);
+        s.p99_us = parseValue(p99);
+        results[std::make_pair(name, config)] = s;
+    }
+    return results;
+}
+
+// Appends one line per gate |now| fails against |base|
+void compare(const Scores& now, const Scores& base, const Options& opts,
+             std::vector<std::string>* failures) {
+    char buf[128];
+    if (!std::isnan(base.erle_db) && !std::isnan(now.erle_db)
+        && now.erle_db < base.erle_db - opts.erle_tolerance_db) {
+        snprintf(buf, sizeof(buf), "ERLE %.2f dB, baseline %.2f dB", now.erle_db, base.erle_db);
+        failures->push_back(buf);
+    }
+    if (!std::isnan(base.residual_dbfs) && !std::isnan(now.residual_dbfs)
+        && now.residual_dbfs > base.residual_dbfs + opts.residual_tolerance_db) {
+        snprintf(buf, sizeof(buf), "residual echo %.2f dBFS, baseline %.2f dBFS",
+                 now.residual_dbfs, base.residual_dbfs);
+        failures->push_back(buf);
+    }
+    if (!std::isnan(base.preservation) && !std::isnan(now.preservation)
+        && now.preservation < base.preservation - opts.preservation_tolerance) {
+        snprintf(buf, sizeof(buf), "near-end preservation %.4f, baseline %.4f",
+                 now.preservation, base.preservation);
+        failures->push_back(buf);
+    }
+    if (opts.cpu_tolerance >= 0.0 && !std::isnan(base.mean_us) && base.mean_us > 0.0
+        && now.mean_us > base.mean_us * (1.0 + opts.cpu_tolerance)) {
+        snprintf(buf, sizeof(buf), "CPU %.1f us/frame, baseline %.1f us/frame", now.mean_us, base.mean_us);
+        failures->push_back(buf);
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options opts;
+    try {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            auto value = [&]() -> std::string {
+                if (i + 1 >= argc) {
+                    throw std::invalid_argument("Missing value for " + arg);
+                }
+                return argv[++i];
+            };
+            if (arg == "--help" || arg == "-h") {
+                printUsage(argv[0]);
+                return 0;
+            } else if (arg == "--corpus") {
+                opts.corpus_path = value();
+            } else if (arg == "--synthetic") {
+                opts.synthetic = true;
+            } else if (arg == "--matrix") {
+                opts.matrix_path = value();
+            } else if (arg == "--baseline") {
+                opts.baseline_path = value();
+            } else if (arg == "--write-baseline") {
+                opts.write_baseline_path = value();
+            } else if (arg == "--raw-rate") {
+                opts.raw_rate = parseInt(arg, value());
+            } else if (arg == "--delay") {
+                opts.delay_ms = parseInt(arg, value());
+            } else if (arg == "--settle-ms") {
+                opts.settle_ms = parseInt(arg, value());
+            } else if (arg == "--erle-tol") {
+                opts.erle_tolerance_db = parseDouble(arg, value());
+            } else if (arg == "--residual-tol") {
+                opts.residual_tolerance_db = parseDouble(arg, value());
+            } else if (arg == "--preservation-tol") {
+                opts.preservation_tolerance = parseDouble(arg, value());
+            } else if (arg == "--cpu-tol") {
+                opts.cpu_tolerance = parseDouble(arg, value());
+            } else {
+                throw std::invalid_argument("Unknown option " + arg);
+            }
+        }
+        if (opts.corpus_path.empty() && !opts.synthetic) {
+            throw std::invalid_argument("Need --corpus or --synthetic");
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        printUsage(argv[0]);
+        return 2;
+    }
+
+    std::vector<Case> cases;
+    std::vector<MatrixEntry> matrix;
+    ResultMap baseline;
+    try {
+        if (!opts.corpus_path.empty()) {
+            cases = readCorpus(opts.corpus_path, opts.raw_rate);
+        }
+        if (opts.synthetic) {
+            cases.push_back(synthesizeCase());
+        }
+        matrix = opts.matrix_path.empty() ? defaultMatrix() : readMatrix(opts.matrix_path);
+        if (!opts.baseline_path.empty()) {
+            baseline = readBaseline(opts.baseline_path);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 2;
+    }
+
+    printf("%-20s %-18s %9s %9s %8s %9s %9s  %s\n", "case", "config", "erle_db",
+           "resid_dB", "preserve", "mean_us", "p99_us", "status");
+
+    ResultMap results;
+    size_t regressions = 0;
+    size_t unmatched = 0;
+    for (size_t ci = 0; ci < cases.size(); ++ci) {
+        for (size_t mi = 0; mi < matrix.size(); ++mi) {
+            const Case& c = cases[ci];
+            const MatrixEntry& config = matrix[mi];
+            Scores s;
+            try {
+                s = runCase(c, config, opts);
+            } catch (const std::exception& e) {
+                std::cerr << "Error: " << c.name << " / " << config.name << ": " << e.what() << std::endl;
+                return 2;
+            }
+            const std::pair<std::string, std::string> key(c.name, config.name);
+            results[key] = s;
+
+            std::vector<std::string> failures;
+            std::string status = "ok";
+            if (!opts.baseline_path.empty()) {
+                ResultMap::const_iterator base = baseline.find(key);
+                if (base == baseline.end()) {
+                    status = "new";
+                    ++unmatched;
+                } else {
+                    compare(s, base->second, opts, &failures);
+                    if (!failures.empty()) {
+                        status = "REGRESSED";
+                        ++regressions;
+                    }
+                }
+            }
+            printf("%-20s %-18s %9s %9s %8s %9s %9s  %s\n", c.name.c_str(), config.name.c_str(),
+                   formatValue(s.erle_db, 2).c_str(), formatValue(s.residual_dbfs, 2).c_str(),
+                   formatValue(s.preservation, 4).c_str(), formatValue(s.mean_us, 1).c_str(),
+                   formatValue(s.p99_us, 1).c_str(), status.c_str());
+            for (size_t i = 0; i < failures.size(); ++i) {
+                printf("    %s\n", failures[i].c_str());
+            }
+            fflush(stdout);
+        }
+    }
+
+    if (!opts.write_baseline_path.empty()) {
+        try {
+            writeBaseline(opts.write_baseline_path, results);
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 2;
+        }
+        printf("baseline written to %s\n", opts.write_baseline_path.c_str());
+    }
+
+    printf("%zu runs, %zu regressed, %zu without baseline\n", results.size(), regressions, unmatched);
+    return regressions > 0 ? 1 : 0;
+}
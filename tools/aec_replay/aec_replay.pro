@@ -0,0 +1,7 @@
+TARGET = aec_replay
+TEMPLATE = app
+
+include(../common/common.pri)
+
+SOURCES += \
+        main.cpp
@@ -0,0 +1,288 @@
+// Replays an AecRecorder session through WebrtcAEC3.
+//
+// The recording is memory-mapped and fed frame by frame, with the recorded
+// stream delay and every configuration change applied at the frame it was
+// applied live, as fast as the CPU allows. The replayed output is compared
+// sample for sample with the recorded one: a recording taken from the first
+// frame after start() reproduces bit-exactly on the same libwebrtc_aec.a, so
+// an echo leak reported from the field can be stepped through on a dev
+// machine. With --set the initial configuration can be overridden to try a
+// fix against the same audio; the comparison then reports how far the output
+// moved instead.
+//
+// Exit status: 0 when the replay matched (or --no-compare), 1 when it did
+// not, 2 on usage or file errors.
+
+#include "WebrtcAEC3.h"
+#include "recordingreader.h"
+#include "wavfile.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+struct Options {
+    std::string recording;
+    bool compare;
+    std::string near_path;
+    std::string far_path;
+    std::string recorded_path;
+    std::string replayed_path;
+    std::vector<std::pair<int, ConfigValue> > overrides;
+
+    Options() : compare(true) {}
+};
+
+void printUsage(const char* argv0) {
+    std::cerr
+        << "Usage: " << argv0 << " [options] RECORDING\n"
+        << "\n"
+        << "Options:\n"
+        << "  --no-compare          only replay, do not compare with the recorded output\n"
+        << "  --set ID=VALUE        override a WebrtcAEC3 ConfigId before start; VALUE is\n"
+        << "                        an integer, true/false or a float with a '.'\n"
+        << "  --write-near FILE     export the recorded near-end input\n"
+        << "  --write-far FILE      export the recorded far-end reference\n"
+        << "  --write-recorded FILE export the output as recorded\n"
+        << "  --write-replayed FILE export the output of this replay\n"
+        << "\n"
+        << "Exported files ending in .wav are written as WAV, anything else as raw\n"
+        << "little-endian 16-bit PCM.\n";
+}
+
+int parseInt(const std::string& flag, const std::string& value) {
+    char* end = nullptr;
+    long v = strtol(value.c_str(), &end, 10);
+    if (value.empty() || *end) {
+        throw std::invalid_argument("Invalid value for " + flag + ": " + value);
+    }
+    return static_cast<int>(v);
+}
+
+std::pair<int, ConfigValue> parseOverride(const std::string& arg) {
+    const size_t eq = arg.find('=');
+    if (eq == std::string::npos) {
+        throw std::invalid_argument("--set expects ID=VALUE, got " + arg);
+    }
+    const int id = parseInt("--set", arg.substr(0, eq));
+    const std::string value = arg.substr(eq + 1);
+    if (value == "true" || value == "false") {
+        return std::make_pair(id, ConfigValue(value == "true"));
+    }
+    if (value.find('.') != std::string::npos) {
+        char* end = nullptr;
+        float f = strtof(value.c_str(), &end);
+        if (*end) {
+            throw std::invalid_argument("Invalid value for --set: " + value);
+        }
+        return std::make_pair(id, ConfigValue(f));
+    }
+    return std::make_pair(id, ConfigValue(parseInt("--set", value)));
+}
+
+bool isRebuildSetting(int id) {
+    return id == WebrtcAEC3::ENABLE_TRANSIENT_SUPPRESSION || id == WebrtcAEC3::AEC_DELAY_AGNOSTIC
+           || id == WebrtcAEC3::AEC_EXTENDED_FILTER;
+}
+
+void appendSamples(std::vector<int16_t>* dst, const int16_t* src, size_t n) {
+    dst->insert(dst->end(), src, src + n);
+}
+
+void exportStream(const std::string& path, int sample_rate, size_t channels,
+                  std::vector<int16_t>* samples) {
+    if (path.empty()) {
+        return;
+    }
+    PcmAudio audio;
+    audio.sample_rate = sample_rate;
+    audio.channels = static_cast<int>(channels);
+    audio.samples.swap(*samples);
+    writePcmFile(path, audio);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options opts;
+    try {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            auto value = [&]() -> std::string {
+                if (i + 1 >= argc) {
+                    throw std::invalid_argument("Missing value for " + arg);
+                }
+                return argv[++i];
+            };
+            if (arg == "--help" || arg == "-h") {
+                printUsage(argv[0]);
+                return 0;
+            } else if (arg == "--no-compare") {
+                opts.compare = false;
+            } else if (arg == "--set") {
+                opts.overrides.push_back(parseOverride(value()));
+            } else if (arg == "--write-near") {
+                opts.near_path = value();
+            } else if (arg == "--write-far") {
+                opts.far_path = value();
+            } else if (arg == "--write-recorded") {
+                opts.recorded_path = value();
+            } else if (arg == "--write-replayed") {
+                opts.replayed_path = value();
+            } else if (!arg.empty() && arg[0] == '-') {
+                throw std::invalid_argument("Unknown option " + arg);
+            } else if (opts.recording.empty()) {
+                opts.recording = arg;
+            } else {
+                throw std::invalid_argument("Only one recording can be replayed at a time");
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        printUsage(argv[0]);
+        return 2;
+    }
+    if (opts.recording.empty()) {
+        printUsage(argv[0]);
+        return 2;
+    }
+
+    try {
+        RecordingReader reader(opts.recording);
+        const size_t chunk = reader.frameSamples();
+        const size_t near_len = chunk * reader.captureChannels();
+        const size_t far_len = chunk * reader.renderChannels();
+
+        printf("%s: %d Hz, %zu capture / %zu render channels, %zu settings\n",
+               opts.recording.c_str(), reader.sampleRate(), reader.captureChannels(),
+               reader.renderChannels(), reader.initialConfig().size());
+
+        WebrtcAEC3 processor;
+        for (size_t i = 0; i < reader.initialConfig().size(); ++i) {
+            processor.setConfig(reader.initialConfig()[i].first, reader.initialConfig()[i].second);
+        }
+        for (size_t i = 0; i < opts.overrides.size(); ++i) {
+            processor.setConfig(opts.overrides[i].first, opts.overrides[i].second);
+        }
+        processor.start();
+
+        std::vector<int16_t> out(near_len);
+        std::vector<int16_t> near_all, far_all, recorded_all, replayed_all;
+
+        uint64_t frames = 0;
+        uint64_t expected_index = 0;
+        uint64_t gaps = 0;
+        uint64_t resets = 0;
+        uint64_t config_changes = 0;
+        uint64_t mismatched_frames = 0;
+        uint64_t first_mismatch = 0;
+        int max_diff = 0;
+        bool rebuild_changed = false;
+        bool started_mid_session = false;
+        double replay_seconds = 0.0;
+
+        RecordingReader::Record record;
+        while (reader.next(&record)) {
+            if (record.type == RecordingReader::Record::kConfig) {
+                // Queued exactly as the live setConfig() was; applied at the
+                // start of the next process() like it was then
+                try {
+                    processor.setConfig(record.config_id, record.config_value);
+                } catch (const std::exception& e) {
+                    std::cerr << "Warning: recorded setting " << record.config_id
+                              << " rejected: " << e.what() << std::endl;
+                }
+                rebuild_changed = rebuild_changed || isRebuildSetting(record.config_id);
+                ++config_changes;
+                continue;
+            }
+
+            const RecordingReader::Frame& f = record.frame;
+            if (frames == 0 && f.index != 0) {
+                started_mid_session = true;
+            } else if (frames > 0 && f.index < expected_index) {
+                processor.reset();
+                ++resets;
+            } else if (f.index > expected_index) {
+                gaps += f.index - expected_index;
+            }
+            expected_index = f.index + 1;
+
+            // The delay process() used live; may come from setStreamDelayMs()
+            // or SYSTEM_DELAY_MS, so it is set directly rather than validated
+            processor.system_delay_ms_ = f.delay_ms;
+
+            std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+            processor.process(f.near_in, f.far_in, out.data(), chunk);
+            replay_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+            if (opts.compare && std::memcmp(out.data(), f.out, near_len * sizeof(int16_t)) != 0) {
+                if (mismatched_frames == 0) {
+                    first_mismatch = frames;
+                }
+                ++mismatched_frames;
+                for (size_t i = 0; i < near_len; ++i) {
+                    max_diff = std::max(max_diff, std::abs(out[i] - f.out[i]));
+                }
+            }
+
+            if (!opts.near_path.empty()) appendSamples(&near_all, f.near_in, near_len);
+            if (!opts.far_path.empty()) appendSamples(&far_all, f.far_in, far_len);
+            if (!opts.recorded_path.empty()) appendSamples(&recorded_all, f.out, near_len);
+            if (!opts.replayed_path.empty()) appendSamples(&replayed_all, out.data(), near_len);
+            ++frames;
+        }
+
+        exportStream(opts.near_path, reader.sampleRate(), reader.captureChannels(), &near_all);
+        exportStream(opts.far_path, reader.sampleRate(), reader.renderChannels(), &far_all);
+        exportStream(opts.recorded_path, reader.sampleRate(), reader.captureChannels(), &recorded_all);
+        exportStream(opts.replayed_path, reader.sampleRate(), reader.captureChannels(), &replayed_all);
+
+        const double audio_seconds = frames / 100.0;
+        printf("frames %llu (%.2f s), config changes %llu, resets %llu\n",
+               static_cast<unsigned long long>(frames), audio_seconds,
+               static_cast<unsigned long long>(config_changes),
+               static_cast<unsigned long long>(resets));
+        printf("replay %.3f s, %.1fx real time\n", replay_seconds,
+               replay_seconds > 0.0 ? audio_seconds / replay_seconds : 0.0);
+        if (reader.truncated()) {
+            printf("note: recording is truncated (writer did not close it)\n");
+        }
+        if (gaps > 0 || reader.framesDropped() > 0) {
+            printf("note: %llu frames missing from the recording; state diverges after the first gap\n",
+                   static_cast<unsigned long long>(std::max<uint64_t>(gaps, reader.framesDropped())));
+        }
+        if (started_mid_session) {
+            printf("note: recording started mid-session; echo canceller state before it was not captured\n");
+        }
+        if (rebuild_changed) {
+            printf("note: transient suppression / delay agnostic / extended filter changed during the "
+                   "session; the live swap timing is not reproduced\n");
+        }
+
+        if (!opts.compare) {
+            return 0;
+        }
+        if (mismatched_frames == 0) {
+            printf("bit-exact: yes\n");
+            return 0;
+        }
+        printf("bit-exact: no, %llu of %llu frames differ, first at frame %llu (%.2f s), max |diff| %d\n",
+               static_cast<unsigned long long>(mismatched_frames),
+               static_cast<unsigned long long>(frames),
+               static_cast<unsigned long long>(first_mismatch), first_mismatch / 100.0, max_diff);
+        return 1;
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 2;
+    }
+}
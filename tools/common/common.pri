@@ -0,0 +1,32 @@
+# Shared settings for the headless command-line tools. These link the same
+# WebrtcAEC3 wrapper and bundled libwebrtc_aec.a as the Qt application but
+# pull in no Qt modules.
+
+QT -= core gui
+CONFIG += console c++11
+CONFIG -= app_bundle qt
+
+DEFINES += WEBRTC_POSIX WEBRTC_LINUX
+
+AEC_ROOT = $$PWD/../..
+
+INCLUDEPATH += $$AEC_ROOT $$PWD
+
+SOURCES += \
+        $$AEC_ROOT/webrtc-audioproc.cpp \
+        $$AEC_ROOT/aecrecorder.cpp \
+        $$AEC_ROOT/audiosimd.cpp \
+        $$AEC_ROOT/resampler.cpp \
+        $$PWD/wavfile.cpp \
+        $$PWD/recordingreader.cpp
+
+HEADERS += \
+        $$AEC_ROOT/WebrtcAEC3.h \
+        $$AEC_ROOT/aecrecorder.h \
+        $$AEC_ROOT/audiosimd.h \
+        $$AEC_ROOT/resampler.h \
+        $$PWD/wavfile.h \
+        $$PWD/recordingreader.h
+
+LIBS += $$AEC_ROOT/libwebrtc_aec.a
+LIBS += -lpthread
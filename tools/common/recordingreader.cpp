@@ -0,0 +1,180 @@
+#include "recordingreader.h"
+#include "aecrecorder.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+size_t padded(size_t bytes) {
+    return (bytes + 3) & ~static_cast<size_t>(3);
+}
+
+template<typename T>
+T readAt(const char* p) {
+    T v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+ConfigValue decodeConfigValue(const char* p) {
+    const int32_t type = readAt<int32_t>(p);
+    switch (type) {
+    case ConfigValue::INT:
+        return ConfigValue(static_cast<int>(readAt<int32_t>(p + 4)));
+    case ConfigValue::BOOL:
+        return ConfigValue(readAt<int32_t>(p + 4) != 0);
+    case ConfigValue::FLOAT:
+        return ConfigValue(readAt<float>(p + 4));
+    default:
+        throw std::runtime_error("Recording has a config value of unknown type " + std::to_string(type));
+    }
+}
+
+} // namespace
+
+RecordingReader::RecordingReader(const std::string& path)
+    : data_(nullptr)
+    , size_(0)
+    , pos_(0)
+    , first_record_(0)
+    , sample_rate_(0)
+    , capture_channels_(0)
+    , render_channels_(0)
+    , frame_samples_(0)
+    , truncated_(false)
+    , has_end_(false)
+    , frames_dropped_(0) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open " + path + ": " + std::strerror(errno));
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(AecRecorder::kFileHeaderBytes)) {
+        ::close(fd);
+        throw std::runtime_error(path + " is too short to be a recording");
+    }
+    size_ = static_cast<size_t>(st.st_size);
+    void* map = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        throw std::runtime_error("Cannot map " + path + ": " + std::strerror(errno));
+    }
+    data_ = static_cast<const char*>(map);
+    // Replay walks the file front to back exactly once
+    madvise(map, size_, MADV_SEQUENTIAL);
+
+    try {
+        if (std::memcmp(data_, AecRecorder::kMagic, sizeof(AecRecorder::kMagic)) != 0) {
+            throw std::runtime_error(path + " is not an AEC recording");
+        }
+        const uint32_t version = readAt<uint32_t>(data_ + 8);
+        if (version != AecRecorder::kVersion) {
+            throw std::runtime_error(path + " has unsupported recording version " + std::to_string(version));
+        }
+        pos_ = AecRecorder::kFileHeaderBytes;
+
+        uint32_t tag = 0;
+        uint32_t size = 0;
+        if (!peekChunk(&tag, &size) || tag != AecRecorder::kTagFormat || size < 16) {
+            throw std::runtime_error(path + " has no format chunk; was anything recorded?");
+        }
+        const char* p = data_ + pos_ + AecRecorder::kChunkHeaderBytes;
+        sample_rate_ = readAt<int32_t>(p);
+        capture_channels_ = readAt<uint32_t>(p + 4);
+        render_channels_ = readAt<uint32_t>(p + 8);
+        frame_samples_ = readAt<uint32_t>(p + 12);
+        if (capture_channels_ < 1 || capture_channels_ > WEBRTC_AEC3_MAX_CHANNELS
+            || render_channels_ < 1 || render_channels_ > WEBRTC_AEC3_MAX_CHANNELS
+            || frame_samples_ == 0 || frame_samples_ * 100 != static_cast<size_t>(sample_rate_)) {
+            throw std::runtime_error(path + " has an invalid format chunk");
+        }
+        pos_ += AecRecorder::kChunkHeaderBytes + padded(size);
+
+        // The snapshot is the run of CONF chunks before the first frame
+        while (peekChunk(&tag, &size) && tag == AecRecorder::kTagConfig && size >= 12) {
+            p = data_ + pos_ + AecRecorder::kChunkHeaderBytes;
+            initial_config_.push_back(std::make_pair(static_cast<int>(readAt<int32_t>(p)),
+                                                     decodeConfigValue(p + 4)));
+            pos_ += AecRecorder::kChunkHeaderBytes + padded(size);
+        }
+        first_record_ = pos_;
+    } catch (...) {
+        munmap(const_cast<char*>(data_), size_);
+        throw;
+    }
+}
+
+RecordingReader::~RecordingReader() {
+    munmap(const_cast<char*>(data_), size_);
+}
+
+bool RecordingReader::peekChunk(uint32_t* tag, uint32_t* size) const {
+    if (size_ - pos_ < AecRecorder::kChunkHeaderBytes) {
+        return false;
+    }
+    *tag = readAt<uint32_t>(data_ + pos_);
+    *size = readAt<uint32_t>(data_ + pos_ + 4);
+    return size_ - pos_ - AecRecorder::kChunkHeaderBytes >= padded(*size);
+}
+
+bool RecordingReader::next(Record* record) {
+    const size_t near_bytes = frame_samples_ * capture_channels_ * sizeof(int16_t);
+    const size_t far_bytes = frame_samples_ * render_channels_ * sizeof(int16_t);
+
+    uint32_t tag = 0;
+    uint32_t size = 0;
+    while (pos_ < size_) {
+        if (!peekChunk(&tag, &size)) {
+            truncated_ = true;
+            pos_ = size_;
+            return false;
+        }
+        const char* p = data_ + pos_ + AecRecorder::kChunkHeaderBytes;
+        pos_ += AecRecorder::kChunkHeaderBytes + padded(size);
+
+        switch (tag) {
+        case AecRecorder::kTagConfig:
+            if (size < 12) {
+                throw std::runtime_error("Malformed config chunk in recording");
+            }
+            record->type = Record::kConfig;
+            record->config_id = readAt<int32_t>(p);
+            record->config_value = decodeConfigValue(p + 4);
+            return true;
+
+        case AecRecorder::kTagFrame:
+            if (size != AecRecorder::kFrameHeaderBytes + 2 * near_bytes + far_bytes) {
+                throw std::runtime_error("Frame chunk size does not match the recording's format");
+            }
+            // Chunks are 4-byte aligned in a page-aligned mapping, so the
+            // int16 arrays can be used in place
+            record->type = Record::kFrame;
+            record->frame.index = readAt<uint64_t>(p);
+            record->frame.delay_ms = readAt<int32_t>(p + 8);
+            p += AecRecorder::kFrameHeaderBytes;
+            record->frame.near_in = reinterpret_cast<const int16_t*>(p);
+            record->frame.far_in = reinterpret_cast<const int16_t*>(p + near_bytes);
+            record->frame.out = reinterpret_cast<const int16_t*>(p + near_bytes + far_bytes);
+            return true;
+
+        case AecRecorder::kTagEnd:
+            if (size >= 16) {
+                has_end_ = true;
+                frames_dropped_ = readAt<uint64_t>(p + 8);
+            }
+            break;
+
+        default:
+            // Unknown chunks are skipped so newer writers stay readable
+            break;
+        }
+    }
+    return false;
+}
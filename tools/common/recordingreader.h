@@ -0,0 +1,82 @@
+#ifndef RECORDINGREADER_H
+#define RECORDINGREADER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "WebrtcAEC3.h"
+
+// Read side of the AecRecorder file format (aecrecorder.h).
+//
+// The file is memory-mapped read-only and walked in place: frames point
+// straight into the mapping, so replaying a recording costs no copies and
+// only the pages being read are resident. Throws std::runtime_error when the
+// file cannot be mapped or does not start with a valid header and FMT chunk.
+class RecordingReader {
+public:
+    struct Frame {
+        uint64_t index;          // frames since start()/reset() when recorded
+        int delay_ms;            // stream delay process() used
+        const int16_t* near_in;  // interleaved, captureChannels() per frame
+        const int16_t* far_in;   // interleaved, renderChannels() per frame
+        const int16_t* out;      // what process() produced
+    };
+
+    struct Record {
+        enum Type { kConfig, kFrame };
+        Type type;
+        int config_id;           // kConfig
+        ConfigValue config_value;
+        Frame frame;             // kFrame
+
+        Record() : type(kFrame), config_id(0), config_value(0) {}
+    };
+
+    explicit RecordingReader(const std::string& path);
+    ~RecordingReader();
+
+    int sampleRate() const { return sample_rate_; }
+    size_t captureChannels() const { return capture_channels_; }
+    size_t renderChannels() const { return render_channels_; }
+    size_t frameSamples() const { return frame_samples_; }
+
+    // Configuration snapshot taken when recording started, in ConfigId order
+    const std::vector<std::pair<int, ConfigValue> >& initialConfig() const { return initial_config_; }
+
+    // Next runtime config change or frame; false at the end of the file. A
+    // file cut short mid-chunk ends at the last complete one (truncated()).
+    bool next(Record* record);
+    void rewind() { pos_ = first_record_; }
+
+    bool truncated() const { return truncated_; }
+    // From the END chunk, once next() has reached it
+    bool hasEnd() const { return has_end_; }
+    uint64_t framesDropped() const { return frames_dropped_; }
+
+private:
+    // Header of the chunk at pos_; false when none fits in the file
+    bool peekChunk(uint32_t* tag, uint32_t* size) const;
+
+    const char* data_;
+    size_t size_;
+    size_t pos_;
+    size_t first_record_;
+
+    int sample_rate_;
+    size_t capture_channels_;
+    size_t render_channels_;
+    size_t frame_samples_;
+    std::vector<std::pair<int, ConfigValue> > initial_config_;
+
+    bool truncated_;
+    bool has_end_;
+    uint64_t frames_dropped_;
+
+    RecordingReader(const RecordingReader&);
+    RecordingReader& operator=(const RecordingReader&);
+};
+
+#endif // RECORDINGREADER_H
@@ -0,0 +1,196 @@
+#include "wavfile.h"
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+#include <memory>
+
+namespace {
+
+struct FileCloser {
+    void operator()(FILE* f) const { if (f) fclose(f); }
+};
+
+std::vector<uint8_t> readWholeFile(const std::string& path) {
+    std::unique_ptr<FILE, FileCloser> f(fopen(path.c_str(), "rb"));
+    if (!f) {
+        throw std::runtime_error("Cannot open " + path);
+    }
+    std::vector<uint8_t> data;
+    uint8_t chunk[65536];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f.get())) > 0) {
+        data.insert(data.end(), chunk, chunk + n);
+    }
+    if (ferror(f.get())) {
+        throw std::runtime_error("Read error on " + path);
+    }
+    return data;
+}
+
+void writeWholeFile(const std::string& path, const uint8_t* header, size_t header_size,
+                    const std::vector<int16_t>& samples) {
+    std::unique_ptr<FILE, FileCloser> f(fopen(path.c_str(), "wb"));
+    if (!f) {
+        throw std::runtime_error("Cannot create " + path);
+    }
+    if (header_size > 0 && fwrite(header, 1, header_size, f.get()) != header_size) {
+        throw std::runtime_error("Write error on " + path);
+    }
+
+    // Samples are stored little-endian regardless of host byte order
+    std::vector<uint8_t> bytes(samples.size() * 2);
+    for (size_t i = 0; i < samples.size(); ++i) {
+        uint16_t v = static_cast<uint16_t>(samples[i]);
+        bytes[2 * i] = static_cast<uint8_t>(v & 0xff);
+        bytes[2 * i + 1] = static_cast<uint8_t>(v >> 8);
+    }
+    if (!bytes.empty() && fwrite(bytes.data(), 1, bytes.size(), f.get()) != bytes.size()) {
+        throw std::runtime_error("Write error on " + path);
+    }
+}
+
+uint16_t readLe16(const uint8_t* p) {
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+uint32_t readLe32(const uint8_t* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+void writeLe16(uint8_t* p, uint16_t v) {
+    p[0] = static_cast<uint8_t>(v & 0xff);
+    p[1] = static_cast<uint8_t>(v >> 8);
+}
+
+void writeLe32(uint8_t* p, uint32_t v) {
+    p[0] = static_cast<uint8_t>(v & 0xff);
+    p[1] = static_cast<uint8_t>((v >> 8) & 0xff);
+    p[2] = static_cast<uint8_t>((v >> 16) & 0xff);
+    p[3] = static_cast<uint8_t>(v >> 24);
+}
+
+void decodeSamples(const uint8_t* data, size_t num_bytes, std::vector<int16_t>* out) {
+    out->resize(num_bytes / 2);
+    for (size_t i = 0; i < out->size(); ++i) {
+        (*out)[i] = static_cast<int16_t>(readLe16(data + 2 * i));
+    }
+}
+
+bool hasSuffix(const std::string& s, const char* suffix) {
+    size_t n = strlen(suffix);
+    if (s.size() < n) {
+        return false;
+    }
+    std::string tail = s.substr(s.size() - n);
+    std::transform(tail.begin(), tail.end(), tail.begin(), ::tolower);
+    return tail == suffix;
+}
+
+} // namespace
+
+PcmAudio readWavFile(const std::string& path) {
+    std::vector<uint8_t> data = readWholeFile(path);
+    if (data.size() < 12 || memcmp(data.data(), "RIFF", 4) != 0 ||
+        memcmp(data.data() + 8, "WAVE", 4) != 0) {
+        throw std::runtime_error(path + " is not a RIFF/WAVE file");
+    }
+
+    PcmAudio audio;
+    bool have_format = false;
+    size_t pos = 12;
+    while (pos + 8 <= data.size()) {
+        const uint8_t* chunk = data.data() + pos;
+        uint32_t chunk_size = readLe32(chunk + 4);
+        size_t body = pos + 8;
+        // Truncated files are common in field recordings; clamp the last chunk
+        size_t available = std::min<size_t>(chunk_size, data.size() - body);
+
+        if (memcmp(chunk, "fmt ", 4) == 0) {
+            if (available < 16) {
+                throw std::runtime_error(path + ": fmt chunk too small");
+            }
+            uint16_t format_tag = readLe16(data.data() + body);
+            if (format_tag == 0xFFFE && available >= 26) {
+                // WAVE_FORMAT_EXTENSIBLE: first two bytes of the sub-format GUID
+                format_tag = readLe16(data.data() + body + 24);
+            }
+            uint16_t bits = readLe16(data.data() + body + 14);
+            if (format_tag != 1 || bits != 16) {
+                throw std::runtime_error(path + ": only 16-bit PCM is supported");
+            }
+            audio.channels = readLe16(data.data() + body + 2);
+            audio.sample_rate = static_cast<int>(readLe32(data.data() + body + 4));
+            have_format = true;
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            if (!have_format) {
+                throw std::runtime_error(path + ": data chunk before fmt chunk");
+            }
+            decodeSamples(data.data() + body, available, &audio.samples);
+            if (audio.channels <= 0) {
+                throw std::runtime_error(path + ": invalid channel count");
+            }
+            audio.samples.resize(audio.numFrames() * audio.channels);
+            return audio;
+        }
+
+        // Chunks are word aligned
+        pos = body + chunk_size + (chunk_size & 1);
+    }
+
+    throw std::runtime_error(path + ": no data chunk found");
+}
+
+PcmAudio readRawPcmFile(const std::string& path, int sample_rate, int channels) {
+    if (sample_rate <= 0 || channels <= 0) {
+        throw std::invalid_argument("Raw PCM needs a positive sample rate and channel count");
+    }
+    std::vector<uint8_t> data = readWholeFile(path);
+
+    PcmAudio audio;
+    audio.sample_rate = sample_rate;
+    audio.channels = channels;
+    decodeSamples(data.data(), data.size(), &audio.samples);
+    audio.samples.resize(audio.numFrames() * audio.channels);
+    return audio;
+}
+
+void writeWavFile(const std::string& path, const PcmAudio& audio) {
+    const uint32_t data_bytes = static_cast<uint32_t>(audio.samples.size() * 2);
+    uint8_t header[44];
+    memcpy(header, "RIFF", 4);
+    writeLe32(header + 4, 36 + data_bytes);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    writeLe32(header + 16, 16);
+    writeLe16(header + 20, 1);
+    writeLe16(header + 22, static_cast<uint16_t>(audio.channels));
+    writeLe32(header + 24, static_cast<uint32_t>(audio.sample_rate));
+    writeLe32(header + 28, static_cast<uint32_t>(audio.sample_rate * audio.channels * 2));
+    writeLe16(header + 32, static_cast<uint16_t>(audio.channels * 2));
+    writeLe16(header + 34, 16);
+    memcpy(header + 36, "data", 4);
+    writeLe32(header + 40, data_bytes);
+
+    writeWholeFile(path, header, sizeof(header), audio.samples);
+}
+
+void writeRawPcmFile(const std::string& path, const PcmAudio& audio) {
+    writeWholeFile(path, nullptr, 0, audio.samples);
+}
+
+PcmAudio readPcmFile(const std::string& path, int raw_sample_rate, int raw_channels) {
+    if (hasSuffix(path, ".wav")) {
+        return readWavFile(path);
+    }
+    return readRawPcmFile(path, raw_sample_rate, raw_channels);
+}
+
+void writePcmFile(const std::string& path, const PcmAudio& audio) {
+    if (hasSuffix(path, ".wav")) {
+        writeWavFile(path, audio);
+    } else {
+        writeRawPcmFile(path, audio);
+    }
+}
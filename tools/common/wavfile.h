@@ -0,0 +1,39 @@
+#ifndef WAVFILE_H
+#define WAVFILE_H
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+// Interleaved 16-bit PCM audio loaded from / written to disk
+struct PcmAudio {
+    int sample_rate;
+    int channels;
+    std::vector<int16_t> samples;
+
+    PcmAudio() : sample_rate(0), channels(0) {}
+
+    size_t numFrames() const {
+        return channels > 0 ? samples.size() / channels : 0;
+    }
+    double durationSeconds() const {
+        return sample_rate > 0 ? static_cast<double>(numFrames()) / sample_rate : 0.0;
+    }
+};
+
+// All functions throw std::runtime_error on I/O or format errors.
+
+// Reads a RIFF/WAVE file holding 16-bit PCM (plain or WAVE_FORMAT_EXTENSIBLE).
+PcmAudio readWavFile(const std::string& path);
+
+// Reads headerless little-endian 16-bit PCM.
+PcmAudio readRawPcmFile(const std::string& path, int sample_rate, int channels);
+
+void writeWavFile(const std::string& path, const PcmAudio& audio);
+void writeRawPcmFile(const std::string& path, const PcmAudio& audio);
+
+// Picks the reader from the extension: ".wav" is parsed, anything else is raw PCM.
+PcmAudio readPcmFile(const std::string& path, int raw_sample_rate, int raw_channels);
+void writePcmFile(const std::string& path, const PcmAudio& audio);
+
+#endif // WAVFILE_H
@@ -0,0 +1,10 @@
+# Command-line tools built alongside the Qt application (Webrtc_AEC5.pro).
+# Build with: qmake tools/tools.pro && make
+
+TEMPLATE = subdirs
+
+SUBDIRS += \
+        aec_batch \
+        aec_bench \
+        aec_replay \
+        aec_regress
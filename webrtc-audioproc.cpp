@@ -1,13 +1,35 @@
 #include "WebrtcAEC3.h"
+#include "aecrecorder.h"
+#include "audiosimd.h"
 
 #include "webrtc/modules/audio_processing/include/audio_processing.h"
 #include "webrtc/modules/audio_processing/audio_buffer.h"
 #include "webrtc/modules/audio_processing/echo_cancellation_impl.h"
 #include "webrtc/modules/audio_processing/aec/aec_core_internal.h"
 
+#include <algorithm>
 #include <iostream>
 #include <stdexcept>
 
+#ifdef WEBRTC_AEC3_STAGE_TIMING
+#include <chrono>
+
+// Charges the time since the previous mark to |stage|. Compiled out entirely
+// unless the build defines WEBRTC_AEC3_STAGE_TIMING (see tools/aec_bench).
+#define AEC3_STAGE_START() \
+    stage_mark_ = std::chrono::steady_clock::now(); \
+    std::fill(stage_ns_, stage_ns_ + NUM_STAGES, 0)
+#define AEC3_STAGE_MARK(stage) \
+    do { \
+        std::chrono::steady_clock::time_point now_ = std::chrono::steady_clock::now(); \
+        stage_ns_[stage] += std::chrono::duration_cast<std::chrono::nanoseconds>(now_ - stage_mark_).count(); \
+        stage_mark_ = now_; \
+    } while (0)
+#else
+#define AEC3_STAGE_START() do {} while (0)
+#define AEC3_STAGE_MARK(stage) do {} while (0)
+#endif
+
 
 // Helper function for make_unique (C++11 compatibility)
 template<typename T, typename... Args>
@@ -17,6 +39,8 @@ std::unique_ptr<T> make_unique_helper(Args&&... args) {
 
 using namespace webrtc;
 
+const size_t WebrtcAEC3::kWarmupFrames;
+
 WebrtcAEC3::WebrtcAEC3()
     : sample_rate_(48000)
     , system_delay_ms_(8)
@@ -30,30 +54,85 @@ WebrtcAEC3::WebrtcAEC3()
     , aec_delay_agnostic_(false)
     , aec_extended_filter_(false)
     , enable_voice_detection_(true)
+    , agc_mode_(AGC_MODE_ADAPTIVE_DIGITAL)
+    , capture_channels_(WEBRTC_AEC3_NUM_CHANNELS)
+    , render_channels_(WEBRTC_AEC3_NUM_CHANNELS)
     , num_chunk_samples_(0)
-    , is_started_(false) {
+    , is_started_(false)
+    , config_dirty_(false)
+    , rebuild_state_(kRebuildIdle)
+    , reset_generation_(0)
+    , rebuild_generation_(0)
+    , builder_stop_(false)
+    , history_pos_(0)
+    , history_frames_(0)
+    , warmup_frames_(0)
+    , warmup_delay_ms_(0)
+    , reconfigurations_(0)
+    , stream_fill_(0)
+    , recorder_(nullptr)
+    , frame_index_(0) {
+    publishConfig();
+#ifdef WEBRTC_AEC3_STAGE_TIMING
+    std::fill(stage_ns_, stage_ns_ + NUM_STAGES, 0);
+#endif
 }
 
 WebrtcAEC3::~WebrtcAEC3() {
+    if (builder_thread_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(config_mutex_);
+            builder_stop_ = true;
+        }
+        rebuild_cv_.notify_one();
+        builder_thread_.join();
+    }
 }
 
 void WebrtcAEC3::setConfig(int configId, ConfigValue value) {
-    if (is_started_) {
-        throw std::runtime_error("Cannot change configuration after start() has been called");
+    if (!is_started_) {
+        applyConfigValue(configId, value, true);
+        return;
     }
 
+    // Validate now so the caller gets the exception, apply at the next frame
+    if (configId == SAMPLE_RATE || configId == CAPTURE_CHANNELS || configId == RENDER_CHANNELS) {
+        throw std::runtime_error("Sample rate and channel counts cannot change after start()");
+    }
+    applyConfigValue(configId, value, false);
+
+    std::lock_guard<std::mutex> lock(config_mutex_);
+    pending_changes_.push_back(std::make_pair(configId, value));
+    if (needsRebuild(configId) && !builder_thread_.joinable()) {
+        builder_thread_ = std::thread(&WebrtcAEC3::builderLoop, this);
+    }
+    config_dirty_.store(true, std::memory_order_release);
+}
+
+bool WebrtcAEC3::needsRebuild(int configId) {
+    // Fixed when AudioProcessing is created; everything else has a setter
+    return configId == ENABLE_TRANSIENT_SUPPRESSION
+           || configId == AEC_DELAY_AGNOSTIC
+           || configId == AEC_EXTENDED_FILTER;
+}
+
+void WebrtcAEC3::applyConfigValue(int configId, const ConfigValue& value, bool apply) {
     switch (configId) {
     case SAMPLE_RATE:
         if (value.type != ConfigValue::INT) {
             throw std::invalid_argument("SAMPLE_RATE expects int value");
         }
-        sample_rate_ = value.int_val;
+        if (apply) {
+            sample_rate_ = value.int_val;
+        }
         break;
     case SYSTEM_DELAY_MS:
         if (value.type != ConfigValue::INT) {
             throw std::invalid_argument("SYSTEM_DELAY_MS expects int value");
         }
-        system_delay_ms_ = value.int_val;
+        if (apply) {
+            system_delay_ms_ = value.int_val;
+        }
         break;
         //        case NOISE_SUPPRESSION_LEVEL:
         //            if (value.type != ConfigValue::INT) {
@@ -68,64 +147,89 @@ void WebrtcAEC3::setConfig(int configId, ConfigValue value) {
         if (value.int_val < 0 || value.int_val > 3) {
             throw std::invalid_argument("NOISE_SUPPRESSION_LEVEL must be between 0 and 3");
         }
-        noise_suppression_level_ = value.int_val;
+        if (apply) {
+            noise_suppression_level_ = value.int_val;
+        }
         break;
 
     case AEC_LEVEL:
         if (value.type != ConfigValue::INT) {
             throw std::invalid_argument("AEC_LEVEL expects int value");
         }
-        aec_level_ = value.int_val;
+        // -1 keeps kHighSuppression; anything else reaching AudioProcessing
+        // unchecked would fail an RTC_CHECK on the audio thread
+        if (value.int_val < -1 || value.int_val > 2) {
+            throw std::invalid_argument("AEC_LEVEL must be between -1 and 2");
+        }
+        if (apply) {
+            aec_level_ = value.int_val;
+        }
         break;
     case ENABLE_AEC:
         if (value.type != ConfigValue::BOOL) {
             throw std::invalid_argument("ENABLE_AEC expects bool value");
         }
-        enable_aec_ = value.bool_val;
+        if (apply) {
+            enable_aec_ = value.bool_val;
+        }
         break;
     case ENABLE_AGC:
         if (value.type != ConfigValue::BOOL) {
             throw std::invalid_argument("ENABLE_AGC expects bool value");
         }
-        enable_agc_ = value.bool_val;
+        if (apply) {
+            enable_agc_ = value.bool_val;
+        }
         break;
     case ENABLE_HP_FILTER:
         if (value.type != ConfigValue::BOOL) {
             throw std::invalid_argument("ENABLE_HP_FILTER expects bool value");
         }
-        enable_hp_filter_ = value.bool_val;
+        if (apply) {
+            enable_hp_filter_ = value.bool_val;
+        }
         break;
     case ENABLE_NOISE_SUPPRESSION:
         if (value.type != ConfigValue::BOOL) {
             throw std::invalid_argument("ENABLE_NOISE_SUPPRESSION expects bool value");
         }
-        enable_noise_suppression_ = value.bool_val;
+        if (apply) {
+            enable_noise_suppression_ = value.bool_val;
+        }
         break;
 
     case ENABLE_TRANSIENT_SUPPRESSION:
         if (value.type != ConfigValue::BOOL) {
             throw std::invalid_argument("ENABLE_TRANSIENT_SUPPRESSION expects bool value");
         }
-        enable_transient_suppression_ = value.bool_val;
+        if (apply) {
+            enable_transient_suppression_ = value.bool_val;
+        }
         break;
 
     case AEC_DELAY_AGNOSTIC:
         if (value.type != ConfigValue::BOOL) {
             throw std::invalid_argument("AEC_DELAY_AGNOSTIC expects bool value");
         }
-        aec_delay_agnostic_ = value.bool_val;
+        if (apply) {
+            aec_delay_agnostic_ = value.bool_val;
+        }
         break;
     case AEC_EXTENDED_FILTER:
         if (value.type != ConfigValue::BOOL) {
             throw std::invalid_argument("AEC_EXTENDED_FILTER expects bool value");
         }
-        aec_extended_filter_ = value.bool_val;
+        if (apply) {
+            aec_extended_filter_ = value.bool_val;
+        }
         break;
     case ENABLE_VOICE_DETECTION:
         if (value.type != ConfigValue::BOOL) {
             throw std::invalid_argument("ENABLE_VOICE_DETECTION expects bool value");
         }
-        enable_voice_detection_ = value.bool_val;
+        if (apply) {
+            enable_voice_detection_ = value.bool_val;
+        }
         break;
 
     case AGC_MODE:
@@ -135,12 +239,82 @@ void WebrtcAEC3::setConfig(int configId, ConfigValue value) {
         if (value.int_val < AGC_MODE_ADAPTIVE_ANALOG || value.int_val > AGC_MODE_FIXED_DIGITAL) {
             throw std::invalid_argument("AGC_MODE must be between 0 and 2");
         }
-        agc_mode_ = value.int_val;
+        if (apply) {
+            agc_mode_ = value.int_val;
+        }
+        break;
+
+    case CAPTURE_CHANNELS:
+        if (value.type != ConfigValue::INT) {
+            throw std::invalid_argument("CAPTURE_CHANNELS expects int value");
+        }
+        if (value.int_val < 1 || value.int_val > WEBRTC_AEC3_MAX_CHANNELS) {
+            throw std::invalid_argument("CAPTURE_CHANNELS must be between 1 and " +
+                                        std::to_string(WEBRTC_AEC3_MAX_CHANNELS));
+        }
+        if (apply) {
+            capture_channels_ = value.int_val;
+        }
+        break;
+    case RENDER_CHANNELS:
+        if (value.type != ConfigValue::INT) {
+            throw std::invalid_argument("RENDER_CHANNELS expects int value");
+        }
+        if (value.int_val < 1 || value.int_val > WEBRTC_AEC3_MAX_CHANNELS) {
+            throw std::invalid_argument("RENDER_CHANNELS must be between 1 and " +
+                                        std::to_string(WEBRTC_AEC3_MAX_CHANNELS));
+        }
+        if (apply) {
+            render_channels_ = value.int_val;
+        }
         break;
 
     default:
         throw std::invalid_argument("Invalid configuration ID: " + std::to_string(configId));
     }
+
+    if (apply) {
+        published_config_[configId].store(value.type == ConfigValue::BOOL ? value.bool_val : value.int_val,
+                                          std::memory_order_relaxed);
+    }
+}
+
+void WebrtcAEC3::publishConfig() {
+    published_config_[SAMPLE_RATE].store(sample_rate_, std::memory_order_relaxed);
+    published_config_[SYSTEM_DELAY_MS].store(system_delay_ms_, std::memory_order_relaxed);
+    published_config_[NOISE_SUPPRESSION_LEVEL].store(noise_suppression_level_, std::memory_order_relaxed);
+    published_config_[AEC_LEVEL].store(aec_level_, std::memory_order_relaxed);
+    published_config_[ENABLE_AEC].store(enable_aec_, std::memory_order_relaxed);
+    published_config_[ENABLE_AGC].store(enable_agc_, std::memory_order_relaxed);
+    published_config_[ENABLE_HP_FILTER].store(enable_hp_filter_, std::memory_order_relaxed);
+    published_config_[ENABLE_NOISE_SUPPRESSION].store(enable_noise_suppression_, std::memory_order_relaxed);
+    published_config_[ENABLE_TRANSIENT_SUPPRESSION].store(enable_transient_suppression_, std::memory_order_relaxed);
+    published_config_[AEC_DELAY_AGNOSTIC].store(aec_delay_agnostic_, std::memory_order_relaxed);
+    published_config_[AEC_EXTENDED_FILTER].store(aec_extended_filter_, std::memory_order_relaxed);
+    published_config_[ENABLE_VOICE_DETECTION].store(enable_voice_detection_, std::memory_order_relaxed);
+    published_config_[AGC_MODE].store(agc_mode_, std::memory_order_relaxed);
+    published_config_[CAPTURE_CHANNELS].store(static_cast<int>(capture_channels_), std::memory_order_relaxed);
+    published_config_[RENDER_CHANNELS].store(static_cast<int>(render_channels_), std::memory_order_relaxed);
+}
+
+ConfigValue WebrtcAEC3::getConfig(int configId) const {
+    if (configId < 0 || configId >= NUM_CONFIG_IDS) {
+        throw std::invalid_argument("Invalid configuration ID: " + std::to_string(configId));
+    }
+    const int value = published_config_[configId].load(std::memory_order_relaxed);
+    switch (configId) {
+    case ENABLE_AEC:
+    case ENABLE_AGC:
+    case ENABLE_HP_FILTER:
+    case ENABLE_NOISE_SUPPRESSION:
+    case ENABLE_TRANSIENT_SUPPRESSION:
+    case AEC_DELAY_AGNOSTIC:
+    case AEC_EXTENDED_FILTER:
+    case ENABLE_VOICE_DETECTION:
+        return ConfigValue(value != 0);
+    default:
+        return ConfigValue(value);
+    }
 }
 
 void WebrtcAEC3::start() {
@@ -153,120 +327,311 @@ void WebrtcAEC3::start() {
     // Calculate chunk size (10ms worth of samples)
     num_chunk_samples_ = sample_rate_ / 100;
 
-    // Initialize buffers
-    near_float_data_.resize(num_chunk_samples_ * WEBRTC_AEC3_NUM_CHANNELS);
-    far_float_data_.resize(num_chunk_samples_ * WEBRTC_AEC3_NUM_CHANNELS);
-    out_float_data_.resize(num_chunk_samples_ * WEBRTC_AEC3_NUM_CHANNELS);
-
     // Initialize channel buffers
-    near_chan_buf_ = make_unique_helper<ChannelBuffer<float>>(num_chunk_samples_, WEBRTC_AEC3_NUM_CHANNELS);
-    far_chan_buf_ = make_unique_helper<ChannelBuffer<float>>(num_chunk_samples_, WEBRTC_AEC3_NUM_CHANNELS);
-    out_chan_buf_ = make_unique_helper<ChannelBuffer<float>>(num_chunk_samples_, WEBRTC_AEC3_NUM_CHANNELS);
+    near_chan_buf_ = make_unique_helper<ChannelBuffer<float>>(num_chunk_samples_, capture_channels_);
+    far_chan_buf_ = make_unique_helper<ChannelBuffer<float>>(num_chunk_samples_, render_channels_);
+    out_chan_buf_ = make_unique_helper<ChannelBuffer<float>>(num_chunk_samples_, capture_channels_);
 
     // Initialize stream configs
-    stream_config_in_ = make_unique_helper<StreamConfig>(sample_rate_, WEBRTC_AEC3_NUM_CHANNELS);
-    stream_config_out_ = make_unique_helper<StreamConfig>(sample_rate_, WEBRTC_AEC3_NUM_CHANNELS);
+    capture_config_ = make_unique_helper<StreamConfig>(sample_rate_, capture_channels_);
+    render_config_ = make_unique_helper<StreamConfig>(sample_rate_, render_channels_);
+
+    // Recent input, replayed into a rebuilt AudioProcessing before the swap
+    history_near_.assign(kWarmupFrames * num_chunk_samples_ * capture_channels_, 0.0f);
+    history_far_.assign(kWarmupFrames * num_chunk_samples_ * render_channels_, 0.0f);
+    warmup_near_.assign(history_near_.size(), 0.0f);
+    warmup_far_.assign(history_far_.size(), 0.0f);
+    record_near_.assign(num_chunk_samples_ * capture_channels_, 0);
+    record_far_.assign(num_chunk_samples_ * render_channels_, 0);
+    record_out_.assign(num_chunk_samples_ * capture_channels_, 0);
+    history_pos_ = 0;
+    history_frames_ = 0;
+    pending_changes_.reserve(16);
+    stream_near_.assign(num_chunk_samples_ * capture_channels_, 0);
+    stream_far_.assign(num_chunk_samples_ * render_channels_, 0);
+    stream_fill_ = 0;
+    frame_index_ = 0;
 
     // Configure audio processing
     configureProcessing();
+    // Picks up members written directly and configureProcessing()'s fallbacks
+    publishConfig();
 
     is_started_ = true;
 }
 
+void WebrtcAEC3::reset() {
+    if (!is_started_) {
+        return;
+    }
+
+    RTC_CHECK_EQ(AudioProcessing::kNoError, audio_processor_->Initialize());
+    stream_fill_ = 0;
+    frame_index_ = 0;
+    history_pos_ = 0;
+    history_frames_ = 0;
+
+    std::lock_guard<std::mutex> lock(config_mutex_);
+    ++reset_generation_;
+    if (rebuild_state_ != kRebuildIdle) {
+        // Have applyPendingConfig() look at the outdated rebuild
+        config_dirty_.store(true, std::memory_order_release);
+    }
+}
+
+bool WebrtcAEC3::configSettled() {
+    std::lock_guard<std::mutex> lock(config_mutex_);
+    return !config_dirty_.load(std::memory_order_relaxed) && rebuild_state_ == kRebuildIdle;
+}
+
+void WebrtcAEC3::setStreamDelayMs(int delay_ms) {
+    // Same range AudioProcessing accepts without a warning
+    if (delay_ms < 0 || delay_ms > 500) {
+        throw std::invalid_argument("Stream delay must be between 0 and 500 ms");
+    }
+    system_delay_ms_ = delay_ms;
+    published_config_[SYSTEM_DELAY_MS].store(delay_ms, std::memory_order_relaxed);
+}
+
 void WebrtcAEC3::configureProcessing() {
+    // Out-of-range values set directly on the public members fall back here
+    if (noise_suppression_level_ < NS_LEVEL_LOW || noise_suppression_level_ > NS_LEVEL_VERY_HIGH) {
+        noise_suppression_level_ = NS_LEVEL_MODERATE;
+        std::cerr << "[NS] Invalid level provided. Falling back to MODERATE." << std::endl;
+    }
+    if (agc_mode_ < AGC_MODE_ADAPTIVE_ANALOG || agc_mode_ > AGC_MODE_FIXED_DIGITAL) {
+        agc_mode_ = AGC_MODE_ADAPTIVE_DIGITAL;
+        std::cerr << "[AGC] Invalid mode provided. Falling back to ADAPTIVE_DIGITAL." << std::endl;
+    }
+
+    audio_processor_ = createProcessing();
+
+    if (enable_noise_suppression_) {
+        std::cout << "[NS] Noise Suppression enabled. Level: " << noise_suppression_level_ << std::endl;
+    } else {
+        std::cout << "[NS] Noise Suppression disabled." << std::endl;
+    }
+    if (enable_agc_) {
+        std::cout << "[AGC] Enabled. Mode: " << agc_mode_ << std::endl;
+    } else {
+        std::cout << "[AGC] Disabled." << std::endl;
+    }
+}
+
+std::shared_ptr<AudioProcessing> WebrtcAEC3::createProcessing() const {
     // Create base configuration
     Config config;
     config.Set<ExperimentalNs>(new ExperimentalNs(enable_transient_suppression_));
 
-
     // Create AudioProcessing instance
-    audio_processor_ = std::shared_ptr<AudioProcessing>(AudioProcessing::Create(config));
+    std::shared_ptr<AudioProcessing> processor(AudioProcessing::Create(config));
 
     // Set extra configuration options
     Config extraconfig;
     extraconfig.Set<DelayAgnostic>(new DelayAgnostic(aec_delay_agnostic_));
     extraconfig.Set<ExtendedFilter>(new ExtendedFilter(aec_extended_filter_));
     extraconfig.Set<EchoCanceller3>(new EchoCanceller3(true));
-    audio_processor_->SetExtraOptions(extraconfig);
+    processor->SetExtraOptions(extraconfig);
 
+    applyComponentSettings(processor.get());
+    return processor;
+}
+
+void WebrtcAEC3::applyComponentSettings(AudioProcessing* processor) const {
     // Configure Echo Cancellation
     RTC_CHECK_EQ(AudioProcessing::kNoError,
-                 audio_processor_->echo_cancellation()->Enable(enable_aec_));
+                 processor->echo_cancellation()->Enable(enable_aec_));
     if (enable_aec_) {
-        audio_processor_->echo_cancellation()->set_suppression_level(EchoCancellation::kHighSuppression);
+        processor->echo_cancellation()->set_suppression_level(EchoCancellation::kHighSuppression);
         if (aec_level_ != -1) {
             RTC_CHECK_EQ(AudioProcessing::kNoError,
-                         audio_processor_->echo_cancellation()->set_suppression_level(
+                         processor->echo_cancellation()->set_suppression_level(
                              static_cast<EchoCancellation::SuppressionLevel>(aec_level_)));
         }
-        audio_processor_->echo_cancellation()->enable_metrics(true);
-        audio_processor_->echo_cancellation()->enable_delay_logging(true);
+        processor->echo_cancellation()->enable_metrics(true);
+        processor->echo_cancellation()->enable_delay_logging(true);
     }
 
     // Configure Noise Suppression
     RTC_CHECK_EQ(AudioProcessing::kNoError,
-                 audio_processor_->noise_suppression()->Enable(enable_noise_suppression_));
-
+                 processor->noise_suppression()->Enable(enable_noise_suppression_));
     if (enable_noise_suppression_) {
-        if (noise_suppression_level_ < NS_LEVEL_LOW || noise_suppression_level_ > NS_LEVEL_VERY_HIGH) {
-            noise_suppression_level_ = NS_LEVEL_MODERATE;
-            std::cerr << "[NS] Invalid level provided. Falling back to MODERATE." << std::endl;
-        }
-
         RTC_CHECK_EQ(AudioProcessing::kNoError,
-                     audio_processor_->noise_suppression()->set_level(
+                     processor->noise_suppression()->set_level(
                          static_cast<NoiseSuppression::Level>(noise_suppression_level_)));
-
-        std::cout << "[NS] Noise Suppression enabled. Level: " << noise_suppression_level_ << std::endl;
-    } else {
-        std::cout << "[NS] Noise Suppression disabled." << std::endl;
     }
 
-
     // Configure High Pass Filter
     RTC_CHECK_EQ(AudioProcessing::kNoError,
-                 audio_processor_->high_pass_filter()->Enable(enable_hp_filter_));
+                 processor->high_pass_filter()->Enable(enable_hp_filter_));
 
     // Configure Automatic Gain Control
     RTC_CHECK_EQ(AudioProcessing::kNoError,
-                 audio_processor_->gain_control()->Enable(enable_agc_));
-
+                 processor->gain_control()->Enable(enable_agc_));
     if (enable_agc_) {
-        if (agc_mode_ < AGC_MODE_ADAPTIVE_ANALOG || agc_mode_ > AGC_MODE_FIXED_DIGITAL) {
-            agc_mode_ = AGC_MODE_ADAPTIVE_DIGITAL;
-            std::cerr << "[AGC] Invalid mode provided. Falling back to ADAPTIVE_DIGITAL." << std::endl;
-        }
-
         RTC_CHECK_EQ(AudioProcessing::kNoError,
-                     audio_processor_->gain_control()->set_mode(
+                     processor->gain_control()->set_mode(
                          static_cast<GainControl::Mode>(agc_mode_)));
 
         // AGC setting
-        audio_processor_->gain_control()->set_target_level_dbfs(3);
-        audio_processor_->gain_control()->set_compression_gain_db(9);
-        audio_processor_->gain_control()->enable_limiter(true);
-
-        std::cout << "[AGC] Enabled. Mode: " << agc_mode_ << std::endl;
-    } else {
-        std::cout << "[AGC] Disabled." << std::endl;
+        processor->gain_control()->set_target_level_dbfs(3);
+        processor->gain_control()->set_compression_gain_db(9);
+        processor->gain_control()->enable_limiter(true);
     }
 
     // Configure Voice Detection
+    processor->voice_detection()->Enable(enable_voice_detection_);
     if (enable_voice_detection_) {
-        audio_processor_->voice_detection()->Enable(enable_voice_detection_);
-        audio_processor_->voice_detection()->set_likelihood(VoiceDetection::kModerateLikelihood);
-        audio_processor_->voice_detection()->set_frame_size_ms(10);
+        processor->voice_detection()->set_likelihood(VoiceDetection::kModerateLikelihood);
+        processor->voice_detection()->set_frame_size_ms(10);
+    }
+}
+
+void WebrtcAEC3::applyPendingConfig() {
+    // Only ever try the lock: a frame never waits for the control thread
+    if (!config_dirty_.load(std::memory_order_acquire)) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(config_mutex_, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        return;
+    }
+
+    bool rebuild = false;
+    if (rebuild_state_ == kRebuildReady) {
+        if (rebuild_generation_ != reset_generation_) {
+            // Warmed with audio from before a reset(); build it again from
+            // what has been processed since
+            retired_processor_ = rebuilt_processor_;
+            rebuild = true;
+        } else {
+            // Swap at this frame boundary. The replacement was built from
+            // the settings at request time; reapply in case in-place ones
+            // changed since. The old instance is freed by the builder thread.
+            retired_processor_ = audio_processor_;
+            audio_processor_ = rebuilt_processor_;
+            applyComponentSettings(audio_processor_.get());
+            reconfigurations_.fetch_add(1, std::memory_order_relaxed);
+        }
+        rebuilt_processor_.reset();
+        rebuild_state_ = kRebuildIdle;
+        rebuild_cv_.notify_one();
+    }
+    if (rebuild_state_ != kRebuildIdle) {
+        // Members must stay put while the builder reads them
+        return;
+    }
+
+    bool in_place = false;
+    AecRecorder* recorder = recorder_.load(std::memory_order_acquire);
+    for (size_t i = 0; i < pending_changes_.size(); ++i) {
+        applyConfigValue(pending_changes_[i].first, pending_changes_[i].second, true);
+        if (recorder) {
+            recorder->recordConfig(pending_changes_[i].first, pending_changes_[i].second);
+        }
+        if (needsRebuild(pending_changes_[i].first)) {
+            rebuild = true;
+        } else if (pending_changes_[i].first != SYSTEM_DELAY_MS) {
+            in_place = true;
+        }
+    }
+    pending_changes_.clear();
+
+    if (in_place) {
+        applyComponentSettings(audio_processor_.get());
+    }
+    if (rebuild) {
+        // Hand the builder the most recent audio, oldest frame first, so the
+        // new echo canceller has converged by the time it is swapped in
+        const size_t near_len = num_chunk_samples_ * capture_channels_;
+        const size_t far_len = num_chunk_samples_ * render_channels_;
+        warmup_frames_ = history_frames_;
+        for (size_t i = 0; i < warmup_frames_; ++i) {
+            size_t slot = (history_pos_ + kWarmupFrames - warmup_frames_ + i) % kWarmupFrames;
+            std::copy(history_near_.begin() + slot * near_len, history_near_.begin() + (slot + 1) * near_len,
+                      warmup_near_.begin() + i * near_len);
+            std::copy(history_far_.begin() + slot * far_len, history_far_.begin() + (slot + 1) * far_len,
+                      warmup_far_.begin() + i * far_len);
+        }
+        warmup_delay_ms_ = system_delay_ms_;
+        rebuild_generation_ = reset_generation_;
+        rebuild_state_ = kRebuildRequested;
+        rebuild_cv_.notify_one();
+    }
+    config_dirty_.store(false, std::memory_order_release);
+}
+
+void WebrtcAEC3::builderLoop() {
+    std::unique_lock<std::mutex> lock(config_mutex_);
+    for (;;) {
+        rebuild_cv_.wait(lock, [this]() {
+            return builder_stop_ || rebuild_state_ == kRebuildRequested || retired_processor_;
+        });
+        if (builder_stop_) {
+            return;
+        }
+
+        // Destroy the swapped-out instance here rather than on the audio thread
+        std::shared_ptr<AudioProcessing> retired;
+        retired.swap(retired_processor_);
+        if (rebuild_state_ != kRebuildRequested) {
+            lock.unlock();
+            retired.reset();
+            lock.lock();
+            continue;
+        }
+
+        // The audio thread leaves the settings and warm-up audio alone until
+        // the state moves on, so they can be read without the lock
+        lock.unlock();
+        retired.reset();
+        std::shared_ptr<AudioProcessing> processor = createProcessing();
+
+        ChannelBuffer<float> near_buf(num_chunk_samples_, capture_channels_);
+        ChannelBuffer<float> far_buf(num_chunk_samples_, render_channels_);
+        ChannelBuffer<float> out_buf(num_chunk_samples_, capture_channels_);
+        const size_t near_len = num_chunk_samples_ * capture_channels_;
+        const size_t far_len = num_chunk_samples_ * render_channels_;
+        for (size_t i = 0; i < warmup_frames_; ++i) {
+            for (size_t c = 0; c < render_channels_; ++c) {
+                const float* plane = &warmup_far_[i * far_len + c * num_chunk_samples_];
+                std::copy(plane, plane + num_chunk_samples_, far_buf.channels()[c]);
+            }
+            for (size_t c = 0; c < capture_channels_; ++c) {
+                const float* plane = &warmup_near_[i * near_len + c * num_chunk_samples_];
+                std::copy(plane, plane + num_chunk_samples_, near_buf.channels()[c]);
+            }
+            processor->set_stream_delay_ms(warmup_delay_ms_);
+            processor->ProcessReverseStream(far_buf.channels(), *render_config_, *render_config_,
+                                            far_buf.channels());
+            processor->ProcessStream(near_buf.channels(), *capture_config_, *capture_config_,
+                                     out_buf.channels());
+        }
+
+        lock.lock();
+        rebuilt_processor_ = processor;
+        rebuild_state_ = kRebuildReady;
+        config_dirty_.store(true, std::memory_order_release);
     }
 }
 
 void WebrtcAEC3::validateInputSizes(const std::vector<int16_t>& near_in,
                                     const std::vector<int16_t>& far_in) const {
-    if (near_in.size() != num_chunk_samples_) {
+    const size_t near_size = num_chunk_samples_ * capture_channels_;
+    const size_t far_size = num_chunk_samples_ * render_channels_;
+    if (near_in.size() != near_size) {
         throw std::invalid_argument("near_in size (" + std::to_string(near_in.size()) +
-                                    ") does not match expected size (" + std::to_string(num_chunk_samples_) + ")");
+                                    ") does not match expected size (" + std::to_string(near_size) + ")");
     }
-    if (far_in.size() != num_chunk_samples_) {
+    if (far_in.size() != far_size) {
         throw std::invalid_argument("far_in size (" + std::to_string(far_in.size()) +
+                                    ") does not match expected size (" + std::to_string(far_size) + ")");
+    }
+}
+
+void WebrtcAEC3::validateFrameCount(size_t num_frames) const {
+    if (num_frames != num_chunk_samples_) {
+        throw std::invalid_argument("num_frames (" + std::to_string(num_frames) +
                                     ") does not match expected size (" + std::to_string(num_chunk_samples_) + ")");
     }
 }
@@ -281,47 +646,232 @@ void WebrtcAEC3::process(const std::vector<int16_t>& near_in,
     validateInputSizes(near_in, far_in);
 
     // Resize output vector
-    out.resize(num_chunk_samples_);
+    out.resize(num_chunk_samples_ * capture_channels_);
 
-    // Convert far-end input from int16 to float
-    S16ToFloat(far_in.data(), far_in.size(), far_float_data_.data());
-    // Since we're mono, no deinterleaving needed - just copy to channel buffer
-    std::copy(far_float_data_.begin(), far_float_data_.end(), far_chan_buf_->channels()[0]);
+    process(near_in.data(), far_in.data(), out.data(), num_chunk_samples_);
+}
 
-    // Convert near-end input from int16 to float
-    S16ToFloat(near_in.data(), near_in.size(), near_float_data_.data());
-    // Since we're mono, no deinterleaving needed - just copy to channel buffer
-    std::copy(near_float_data_.begin(), near_float_data_.end(), near_chan_buf_->channels()[0]);
+void WebrtcAEC3::process(const int16_t* near_in,
+                         const int16_t* far_in,
+                         int16_t* out,
+                         size_t num_frames) {
+    if (!is_started_) {
+        throw std::runtime_error("WebrtcAEC3 must be started before processing");
+    }
+
+    validateFrameCount(num_frames);
+
+    applyPendingConfig();
+    AecRecorder* recorder = recorder_.load(std::memory_order_acquire);
+    if (recorder && recorder->needsFormat()) {
+        recordSession(recorder);
+    }
 
+    AEC3_STAGE_START();
+
+    // Convert far-end and near-end input from int16 straight into the
+    // channel buffers
+    deinterleaveS16ToFloat(far_in, num_frames, render_channels_, far_chan_buf_->channels());
+    deinterleaveS16ToFloat(near_in, num_frames, capture_channels_, near_chan_buf_->channels());
+    pushHistory(near_chan_buf_->channels(), far_chan_buf_->channels());
+    AEC3_STAGE_MARK(STAGE_S16_TO_FLOAT);
+
+    runProcessing(near_chan_buf_->channels(), far_chan_buf_->channels(), out_chan_buf_->channels());
+
+    // Convert output from the channel buffer straight to int16. Silence is
+    // not gated here: hasVoice() is a hint for DTX (see dtx.h), which
+    // replaces it with comfort noise at the receiver.
+    interleaveFloatToS16(out_chan_buf_->channels(), num_frames, capture_channels_, out);
+    AEC3_STAGE_MARK(STAGE_FLOAT_TO_S16);
+
+    // |out| may have overwritten |near_in|; the history ring still has it
+    if (recorder) {
+        interleaveFloatToS16(historyPlanes(history_near_, capture_channels_, newestHistorySlot()),
+                             num_chunk_samples_, capture_channels_, record_near_.data());
+        recorder->recordFrame(frame_index_, system_delay_ms_, record_near_.data(), far_in, out);
+    }
+    ++frame_index_;
+}
+
+void WebrtcAEC3::processFloat(const float* const* near_in,
+                              const float* const* far_in,
+                              float* const* out,
+                              size_t num_frames) {
+    if (!is_started_) {
+        throw std::runtime_error("WebrtcAEC3 must be started before processing");
+    }
+
+    validateFrameCount(num_frames);
+
+    applyPendingConfig();
+    AecRecorder* recorder = recorder_.load(std::memory_order_acquire);
+    if (recorder && recorder->needsFormat()) {
+        recordSession(recorder);
+    }
+
+    AEC3_STAGE_START();
+
+    // No conversion; only the copy for a rebuilt instance's warm-up, taken
+    // before |out| can overwrite |near_in|
+    pushHistory(near_in, far_in);
+    AEC3_STAGE_MARK(STAGE_S16_TO_FLOAT);
+
+    // AudioProcessing reads the caller's planes and writes |out| directly
+    runProcessing(near_in, far_in, out);
+    AEC3_STAGE_MARK(STAGE_FLOAT_TO_S16);
+
+    // Recordings stay int16; the conversion is paid only while recording
+    if (recorder) {
+        const size_t slot = newestHistorySlot();
+        interleaveFloatToS16(historyPlanes(history_near_, capture_channels_, slot),
+                             num_chunk_samples_, capture_channels_, record_near_.data());
+        interleaveFloatToS16(historyPlanes(history_far_, render_channels_, slot),
+                             num_chunk_samples_, render_channels_, record_far_.data());
+        interleaveFloatToS16(out, num_chunk_samples_, capture_channels_, record_out_.data());
+        recorder->recordFrame(frame_index_, system_delay_ms_, record_near_.data(),
+                              record_far_.data(), record_out_.data());
+    }
+    ++frame_index_;
+}
+
+void WebrtcAEC3::runProcessing(const float* const* near_in, const float* const* far_in,
+                               float* const* out) {
     // Set system delay
     RTC_CHECK_EQ(AudioProcessing::kNoError,
                  audio_processor_->set_stream_delay_ms(system_delay_ms_));
+    AEC3_STAGE_MARK(STAGE_SET_DELAY);
 
-    // Process reverse stream (far-end/reference signal)
+    // Process reverse stream (far-end/reference signal). Its output is not
+    // used, so it goes to our own buffer rather than the caller's.
     RTC_CHECK_EQ(AudioProcessing::kNoError,
-                 audio_processor_->ProcessReverseStream(far_chan_buf_->channels(),
-                                                        *stream_config_in_,
-                                                        *stream_config_out_,
+                 audio_processor_->ProcessReverseStream(far_in,
+                                                        *render_config_,
+                                                        *render_config_,
                                                         far_chan_buf_->channels()));
+    AEC3_STAGE_MARK(STAGE_REVERSE_STREAM);
 
-    // Process forward stream (near-end/microphone signal)
+    // Process forward stream (near-end/microphone signal); |out| may be
+    // |near_in|
     RTC_CHECK_EQ(AudioProcessing::kNoError,
-                 audio_processor_->ProcessStream(near_chan_buf_->channels(),
-                                                 *stream_config_in_,
-                                                 *stream_config_out_,
-                                                 out_chan_buf_->channels()));
+                 audio_processor_->ProcessStream(near_in,
+                                                 *capture_config_,
+                                                 *capture_config_,
+                                                 out));
+    AEC3_STAGE_MARK(STAGE_FORWARD_STREAM);
+}
 
-    // Since we're mono, no interleaving needed - just copy from channel buffer
-    std::copy(out_chan_buf_->channels()[0],
-            out_chan_buf_->channels()[0] + num_chunk_samples_,
-            out_float_data_.begin());
+void WebrtcAEC3::pushHistory(const float* const* near_in, const float* const* far_in) {
+    const size_t near_len = num_chunk_samples_ * capture_channels_;
+    const size_t far_len = num_chunk_samples_ * render_channels_;
+    float* near_slot = &history_near_[history_pos_ * near_len];
+    float* far_slot = &history_far_[history_pos_ * far_len];
+    for (size_t c = 0; c < capture_channels_; ++c) {
+        std::copy(near_in[c], near_in[c] + num_chunk_samples_, near_slot + c * num_chunk_samples_);
+    }
+    for (size_t c = 0; c < render_channels_; ++c) {
+        std::copy(far_in[c], far_in[c] + num_chunk_samples_, far_slot + c * num_chunk_samples_);
+    }
+    history_pos_ = (history_pos_ + 1) % kWarmupFrames;
+    history_frames_ = std::min(history_frames_ + 1, kWarmupFrames);
+}
+
+size_t WebrtcAEC3::newestHistorySlot() const {
+    return (history_pos_ + kWarmupFrames - 1) % kWarmupFrames;
+}
+
+const float* const* WebrtcAEC3::historyPlanes(const std::vector<float>& ring, size_t channels,
+                                              size_t slot) {
+    const float* base = &ring[slot * num_chunk_samples_ * channels];
+    for (size_t c = 0; c < channels; ++c) {
+        history_planes_[c] = base + c * num_chunk_samples_;
+    }
+    return history_planes_;
+}
+
+size_t WebrtcAEC3::processStream(const int16_t* near_in,
+                                 const int16_t* far_in,
+                                 size_t num_frames,
+                                 int16_t* out) {
+    if (!is_started_) {
+        throw std::runtime_error("WebrtcAEC3 must be started before processing");
+    }
 
-    if (!hasVoice()) {
-        std::fill(out_float_data_.begin(), out_float_data_.end(), 0.0f);
+    const size_t chunk = num_chunk_samples_;
+    size_t consumed = 0;
+    size_t written = 0;
+
+    // Complete the chunk left over from the previous call
+    if (stream_fill_ > 0) {
+        const size_t take = std::min(chunk - stream_fill_, num_frames);
+        std::copy(near_in, near_in + take * capture_channels_,
+                  stream_near_.begin() + stream_fill_ * capture_channels_);
+        std::copy(far_in, far_in + take * render_channels_,
+                  stream_far_.begin() + stream_fill_ * render_channels_);
+        stream_fill_ += take;
+        consumed = take;
+        if (stream_fill_ < chunk) {
+            return 0;
+        }
+        process(stream_near_.data(), stream_far_.data(), out, chunk);
+        stream_fill_ = 0;
+        written = chunk;
     }
 
-    // Convert output from float to int16
-    FloatToS16(out_float_data_.data(), out.size(), out.data());
+    // Whole chunks straight from the caller's buffers
+    while (num_frames - consumed >= chunk) {
+        process(near_in + consumed * capture_channels_, far_in + consumed * render_channels_,
+                out + written * capture_channels_, chunk);
+        consumed += chunk;
+        written += chunk;
+    }
+
+    // Keep the tail for next time
+    const size_t rest = num_frames - consumed;
+    std::copy(near_in + consumed * capture_channels_, near_in + num_frames * capture_channels_,
+              stream_near_.begin());
+    std::copy(far_in + consumed * render_channels_, far_in + num_frames * render_channels_,
+              stream_far_.begin());
+    stream_fill_ = rest;
+    return written;
+}
+
+void WebrtcAEC3::processStream(const std::vector<int16_t>& near_in,
+                               const std::vector<int16_t>& far_in,
+                               std::vector<int16_t>& out) {
+    if (!is_started_) {
+        throw std::runtime_error("WebrtcAEC3 must be started before processing");
+    }
+    const size_t num_frames = near_in.size() / capture_channels_;
+    if (near_in.size() != num_frames * capture_channels_ || far_in.size() != num_frames * render_channels_) {
+        throw std::invalid_argument("near_in (" + std::to_string(near_in.size()) + ") and far_in (" +
+                                    std::to_string(far_in.size()) +
+                                    ") sizes do not hold the same number of whole frames");
+    }
+
+    out.resize((num_frames + num_chunk_samples_ - 1) * capture_channels_);
+    const size_t written = processStream(near_in.data(), far_in.data(), num_frames, out.data());
+    out.resize(written * capture_channels_);
+}
+
+size_t WebrtcAEC3::flushStream(int16_t* out) {
+    if (!is_started_ || stream_fill_ == 0) {
+        return 0;
+    }
+
+    const size_t pending = stream_fill_;
+    std::fill(stream_near_.begin() + pending * capture_channels_, stream_near_.end(), 0);
+    std::fill(stream_far_.begin() + pending * render_channels_, stream_far_.end(), 0);
+    process(stream_near_.data(), stream_far_.data(), stream_near_.data(), num_chunk_samples_);
+    std::copy(stream_near_.begin(), stream_near_.begin() + pending * capture_channels_, out);
+    stream_fill_ = 0;
+    return pending;
+}
+
+void WebrtcAEC3::recordSession(AecRecorder* recorder) {
+    recorder->recordFormat(sample_rate_, capture_channels_, render_channels_, num_chunk_samples_);
+    for (int id = 0; id < NUM_CONFIG_IDS; ++id) {
+        recorder->recordConfig(id, getConfig(id));
+    }
 }
 
 bool WebrtcAEC3::hasVoice() const {
@@ -345,4 +895,33 @@ float WebrtcAEC3::getSpeechProbability() const {
     return audio_processor_->noise_suppression()->speech_probability();
 }
 
+bool WebrtcAEC3::getEchoMetrics(EchoMetrics* metrics) const {
+    if (!is_started_ || !enable_aec_) {
+        return false;
+    }
+    EchoCancellation* ec = audio_processor_->echo_cancellation();
+    EchoCancellation::Metrics m;
+    if (ec->GetMetrics(&m) != AudioProcessing::kNoError) {
+        return false;
+    }
+    int median = 0;
+    int std_dev = 0;
+    float fraction_poor = 0.0f;
+    // Delay logging may still be collecting its first window; keep the loss
+    // figures and report the delay as unknown
+    if (ec->GetDelayMetrics(&median, &std_dev, &fraction_poor) != AudioProcessing::kNoError) {
+        median = -1;
+        std_dev = -1;
+        fraction_poor = 0.0f;
+    }
+    metrics->erl_db = m.echo_return_loss.average;
+    metrics->erle_db = m.echo_return_loss_enhancement.average;
+    metrics->a_nlp_db = m.a_nlp.average;
+    metrics->divergent_filter_fraction = m.divergent_filter_fraction;
+    metrics->delay_median_ms = median;
+    metrics->delay_std_ms = std_dev;
+    metrics->fraction_poor_delays = fraction_poor;
+    return true;
+}
+
 
@@ -0,0 +1,128 @@
+#include "workstealingpool.h"
+
+namespace {
+
+// Identifies the pool and slot of the current thread so submit() can push to
+// the local deque without any lookup.
+thread_local const WorkStealingPool* tls_pool = nullptr;
+thread_local int tls_worker_index = -1;
+
+} // namespace
+
+WorkStealingPool::WorkStealingPool(size_t num_threads)
+    : pending_(0)
+    , sleeping_(0)
+    , next_queue_(0)
+    , stopping_(false)
+    , tasks_executed_(0)
+    , tasks_stolen_(0) {
+    if (num_threads == 0) {
+        num_threads = std::thread::hardware_concurrency();
+    }
+    if (num_threads == 0) {
+        num_threads = 1;
+    }
+
+    for (size_t i = 0; i < num_threads; ++i) {
+        queues_.push_back(std::unique_ptr<WorkerQueue>(new WorkerQueue()));
+    }
+    for (size_t i = 0; i < num_threads; ++i) {
+        workers_.push_back(std::thread(&WorkStealingPool::workerLoop, this, i));
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    {
+        std::lock_guard<std::mutex> lock(idle_mutex_);
+        stopping_.store(true);
+    }
+    idle_cv_.notify_all();
+
+    for (size_t i = 0; i < workers_.size(); ++i) {
+        workers_[i].join();
+    }
+}
+
+int WorkStealingPool::currentWorkerIndex() const {
+    return tls_pool == this ? tls_worker_index : -1;
+}
+
+void WorkStealingPool::submit(Task task) {
+    int local = currentWorkerIndex();
+    size_t index = local >= 0 ? static_cast<size_t>(local)
+                              : next_queue_.fetch_add(1, std::memory_order_relaxed) % queues_.size();
+
+    // Count the task before it becomes visible so a fast thief can never
+    // drive pending_ below zero.
+    pending_.fetch_add(1);
+    {
+        std::lock_guard<std::mutex> lock(queues_[index]->mutex);
+        queues_[index]->tasks.push_back(std::move(task));
+    }
+
+    // Only touch idle_mutex_ when someone may be asleep. Both counters are
+    // seq_cst, so either this load sees the sleeper or the sleeper's check
+    // sees the new pending_. A sleeper registers under idle_mutex_ and holds
+    // it until it waits, so locking here orders the notify after its wait.
+    if (sleeping_.load() > 0) {
+        {
+            std::lock_guard<std::mutex> lock(idle_mutex_);
+        }
+        idle_cv_.notify_one();
+    }
+}
+
+bool WorkStealingPool::popLocal(size_t index, Task* task) {
+    WorkerQueue& queue = *queues_[index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) {
+        return false;
+    }
+    *task = std::move(queue.tasks.back());
+    queue.tasks.pop_back();
+    return true;
+}
+
+bool WorkStealingPool::steal(size_t thief, Task* task) {
+    const size_t n = queues_.size();
+    for (size_t i = 1; i < n; ++i) {
+        WorkerQueue& victim = *queues_[(thief + i) % n];
+        std::unique_lock<std::mutex> lock(victim.mutex, std::try_to_lock);
+        if (!lock.owns_lock() || victim.tasks.empty()) {
+            continue;
+        }
+        *task = std::move(victim.tasks.front());
+        victim.tasks.pop_front();
+        tasks_stolen_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
+
+void WorkStealingPool::workerLoop(size_t index) {
+    tls_pool = this;
+    tls_worker_index = static_cast<int>(index);
+
+    Task task;
+    for (;;) {
+        if (popLocal(index, &task) || steal(index, &task)) {
+            pending_.fetch_sub(1);
+            task();
+            task = Task();
+            tasks_executed_.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+
+        // A failed try_lock in steal() can miss a queued task, so only sleep
+        // (or exit) once pending_ says every queue is really empty.
+        std::unique_lock<std::mutex> lock(idle_mutex_);
+        sleeping_.fetch_add(1);
+        idle_cv_.wait(lock, [this]() {
+            return stopping_.load() || pending_.load() > 0;
+        });
+        sleeping_.fetch_sub(1);
+        if (stopping_.load() && pending_.load() == 0) {
+            break;
+        }
+    }
+}
@@ -0,0 +1,64 @@
+#ifndef WORKSTEALINGPOOL_H
+#define WORKSTEALINGPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size thread pool where every worker owns a task deque. Workers pop
+// their own deque LIFO (cache-warm) and steal FIFO from the others when idle.
+// Tasks submitted from inside a worker land on that worker's deque; tasks
+// from outside are spread round-robin.
+class WorkStealingPool {
+public:
+    typedef std::function<void()> Task;
+
+    // |num_threads| == 0 uses std::thread::hardware_concurrency()
+    explicit WorkStealingPool(size_t num_threads = 0);
+    ~WorkStealingPool();
+
+    void submit(Task task);
+
+    size_t numThreads() const { return workers_.size(); }
+
+    // Index of the calling worker, or -1 when called from outside the pool
+    int currentWorkerIndex() const;
+
+    uint64_t tasksExecuted() const { return tasks_executed_.load(std::memory_order_relaxed); }
+    uint64_t tasksStolen() const { return tasks_stolen_.load(std::memory_order_relaxed); }
+
+private:
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void workerLoop(size_t index);
+    bool popLocal(size_t index, Task* task);
+    bool steal(size_t thief, Task* task);
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues_;
+    std::vector<std::thread> workers_;
+
+    std::mutex idle_mutex_;
+    std::condition_variable idle_cv_;
+    std::atomic<size_t> pending_;
+    std::atomic<size_t> sleeping_;   // workers registered on idle_cv_
+    std::atomic<size_t> next_queue_;
+    std::atomic<bool> stopping_;
+
+    std::atomic<uint64_t> tasks_executed_;
+    std::atomic<uint64_t> tasks_stolen_;
+
+    WorkStealingPool(const WorkStealingPool&);
+    WorkStealingPool& operator=(const WorkStealingPool&);
+};
+
+#endif // WORKSTEALINGPOOL_H